@@ -0,0 +1,194 @@
+/**
+ * Host Core
+ * Builds the phase-control core (device_impl.h, output_impl.h,
+ * metrics_impl.h, isr_impl.h) with -DHOST_SIMULATION against a virtual
+ * clock and a model of the ESP32 hardware timer.
+ * Include once per host program, like main.ino includes the _impl
+ * headers; programs that need more modules include their _impl headers
+ * after this one.
+ */
+
+#ifndef HOST_CORE_H
+#define HOST_CORE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "device.h"
+#include "isr.h"
+
+// ================================================================
+// DATA STRUCTURES (mirror main.ino)
+// ================================================================
+struct Device {
+    String name;
+    volatile DeviceType type;
+    volatile bool state;
+    volatile int brightness;
+    volatile int fireTick;
+    bool childLock;
+    bool autoOffEnabled;
+    PowerOnState powerOnBehavior;
+    unsigned long lastOnTime;
+    unsigned long totalRuntime;  // seconds
+    int defaultBrightness;
+};
+
+struct FadeState {
+    bool active;
+    uint8_t curve;            // FadeCurve
+    int32_t startLevel;
+    int32_t targetLevel;
+    int32_t segmentEndLevel;
+    unsigned long startTime;
+    uint32_t durationMs;
+    uint32_t segmentEndMs;
+};
+
+// ================================================================
+// GLOBAL VARIABLES (mirror main.ino)
+// ================================================================
+Device devices[CHANNEL_COUNT];
+FadeState fadeStates[CHANNEL_COUNT];
+SemaphoreHandle_t deviceMutex = NULL;
+volatile bool zeroCrossDetected = true;
+volatile unsigned long lastZeroCrossTime = 0;
+int currentError = ERR_NONE;
+
+void logMessage(LogLevel level, const char* format, ...);
+void broadcastDeviceState(int deviceId) {}
+
+// ================================================================
+// VIRTUAL CLOCK
+// ================================================================
+
+// Virtual time in microseconds; only the host program advances it
+static uint64_t hostNowUs = 0;
+
+unsigned long micros() { return hostNowUs; }
+unsigned long millis() { return hostNowUs / 1000; }
+
+// Move the clock forward (never backwards)
+static inline void hostAdvanceTo(uint64_t us) {
+    if (us > hostNowUs) hostNowUs = us;
+}
+
+// ISRs take no virtual time, so the cycle counter follows the clock
+uint32_t hostCycleCount() {
+    return (uint32_t)(hostNowUs * getCpuFrequencyMhz());
+}
+
+// ================================================================
+// HARDWARE TIMER MODEL
+// ================================================================
+
+// 1 MHz up-counter with one alarm; the counter reads hostNowUs - baseUs
+struct hw_timer_t {
+    uint64_t baseUs;
+    uint64_t alarmValue;
+    bool armed;
+    bool autoreload;
+};
+
+static hw_timer_t hostTimer = {};
+hw_timer_t *timer = &hostTimer;
+
+void timerAlarm(hw_timer_t *t, uint64_t alarmValue, bool autoreload, uint64_t reloadCount) {
+    t->alarmValue = alarmValue;
+    t->autoreload = autoreload;
+    t->armed = true;
+}
+
+void timerWrite(hw_timer_t *t, uint64_t value) {
+    t->baseUs = hostNowUs - value;
+}
+
+uint64_t timerRead(hw_timer_t *t) {
+    return hostNowUs - t->baseUs;
+}
+
+// Virtual time the armed alarm fires (an alarm already passed fires now)
+static inline uint64_t hostTimerDueUs() {
+    if (!hostTimer.armed) return UINT64_MAX;
+    uint64_t counter = timerRead(&hostTimer);
+    if (hostTimer.alarmValue <= counter) return hostNowUs;
+    return hostNowUs + (hostTimer.alarmValue - counter);
+}
+
+// Raise the timer interrupt (clock already at hostTimerDueUs())
+static inline void hostFireTimer() {
+    if (hostTimer.autoreload) {
+        hostTimer.baseUs = hostNowUs;
+    } else {
+        hostTimer.armed = false;
+    }
+    onTimerFire();
+}
+
+// ================================================================
+// TRIAC OUTPUT RECORDER
+// ================================================================
+
+// GPIO levels as last written by the ISRs (bank 0, bit n = GPIO n)
+static uint32_t hostPinLevels = 0;
+
+// Optional observer, called after every output write
+static void (*hostOutputObserver)(uint32_t setMask, uint32_t clearMask) = NULL;
+
+void hostRecordTriacOutput(uint32_t setMask, uint32_t clearMask) {
+    hostPinLevels = (hostPinLevels | setMask) & ~clearMask;
+    if (hostOutputObserver) hostOutputObserver(setMask, clearMask);
+}
+
+// ================================================================
+// LOGGING
+// ================================================================
+
+// Messages above this level are dropped (host programs may raise it)
+static LogLevel hostLogLevel = LOG_WARN;
+
+void logMessage(LogLevel level, const char* format, ...) {
+    if (level > hostLogLevel) return;
+    
+    const char* levelStr[] = {"", "[ERROR]", "[WARN]", "[INFO]", "[DEBUG]", "[VERBOSE]"};
+    fprintf(stderr, "[%10.3f] %s ", hostNowUs / 1e6, levelStr[level]);
+    
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+}
+
+// ================================================================
+// IMPLEMENTATION INCLUDES (same order as main.ino)
+// ================================================================
+#include "device_impl.h"
+#include "output_impl.h"
+#include "metrics_impl.h"
+#include "isr_impl.h"
+
+// ================================================================
+// SETUP
+// ================================================================
+
+// Boot the core the way setup() does: outputs off, every channel an
+// idle dimmer at the default brightness
+static void hostInitCore() {
+    deviceMutex = xSemaphoreCreateMutex();
+    initTriacOutputs();
+    initIsrMetrics();
+    
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        devices[i].name = "Device " + String(i + 1);
+        devices[i].type = TYPE_DIMMER;
+        devices[i].state = false;
+        devices[i].brightness = 100;
+        devices[i].fireTick = calculateFireTick(TYPE_DIMMER, 100);
+        devices[i].powerOnBehavior = POWER_ON_LAST;
+        devices[i].defaultBrightness = 100;
+        fadeStates[i] = {};
+    }
+    publishOutputSnapshot();
+}
+
+#endif // HOST_CORE_H
@@ -0,0 +1,141 @@
+/**
+ * Host Arduino/FreeRTOS Shim
+ * Just enough of the ESP32 Arduino core for the firmware modules that
+ * build with -DHOST_SIMULATION. Time comes from the virtual clock in
+ * host_core.h; nothing here touches real hardware.
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+
+// ================================================================
+// ATTRIBUTES AND HELPERS
+// ================================================================
+#define IRAM_ATTR
+#define DRAM_ATTR
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define LOW 0x0
+#define HIGH 0x1
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+inline void pinMode(int, int) {}
+inline uint32_t getCpuFrequencyMhz() { return 240; }
+
+// newlib has strlcpy(); glibc only from 2.38
+#if defined(__GLIBC__) && !__GLIBC_PREREQ(2, 38)
+inline size_t strlcpy(char *dst, const char *src, size_t size) {
+    size_t length = strlen(src);
+    if (size) {
+        size_t copy = length < size - 1 ? length : size - 1;
+        memcpy(dst, src, copy);
+        dst[copy] = '\0';
+    }
+    return length;
+}
+#endif
+
+// ================================================================
+// VIRTUAL CLOCK (provided by host_core.h)
+// ================================================================
+
+/**
+ * Virtual microseconds since boot
+ * 64-bit on the host, so elapsed-time arithmetic never wraps
+ */
+unsigned long micros();
+unsigned long millis();
+
+// ================================================================
+// HARDWARE TIMER (1 MHz counter, provided by host_core.h)
+// ================================================================
+struct hw_timer_t;
+
+void timerAlarm(hw_timer_t *timer, uint64_t alarmValue, bool autoreload, uint64_t reloadCount);
+void timerWrite(hw_timer_t *timer, uint64_t value);
+uint64_t timerRead(hw_timer_t *timer);
+
+// ================================================================
+// WALL CLOCK (provided by the host program)
+// ================================================================
+
+/**
+ * Local time from the host program's virtual wall clock
+ * False while that clock is unset, like the ESP32 core before SNTP
+ */
+bool getLocalTime(struct tm *info, uint32_t ms = 5000);
+
+// ================================================================
+// FREERTOS
+// ================================================================
+#define portNUM_PROCESSORS 2
+#define portMAX_DELAY 0xffffffffUL
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef std::timed_mutex *SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return new std::timed_mutex(); }
+
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks) {
+    if (ticks == portMAX_DELAY) {
+        mutex->lock();
+        return pdTRUE;
+    }
+    return mutex->try_lock_for(std::chrono::milliseconds(ticks)) ? pdTRUE : pdFALSE;
+}
+
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {
+    mutex->unlock();
+    return pdTRUE;
+}
+
+// The ISRs run on Core 1
+inline BaseType_t xPortGetCoreID() { return 1; }
+
+// ================================================================
+// STRING
+// ================================================================
+
+/**
+ * Arduino String over std::string, covering the operations the
+ * firmware modules use (concatenation, c_str, numeric construction)
+ */
+class String : public std::string {
+public:
+    String() {}
+    String(const char *text) : std::string(text ? text : "") {}
+    String(const std::string &text) : std::string(text) {}
+    String(int value) : std::string(std::to_string(value)) {}
+    String(unsigned int value) : std::string(std::to_string(value)) {}
+    String(long value) : std::string(std::to_string(value)) {}
+    String(unsigned long value) : std::string(std::to_string(value)) {}
+    
+    bool isEmpty() const { return empty(); }
+};
+
+inline String operator+(const String &a, const String &b) { return String((const std::string &)a + (const std::string &)b); }
+inline String operator+(const String &a, const char *b) { return String((const std::string &)a + b); }
+inline String operator+(const char *a, const String &b) { return String(a + (const std::string &)b); }
+
+#endif // HOST_ARDUINO_H
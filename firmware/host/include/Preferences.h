@@ -0,0 +1,141 @@
+/**
+ * Host Preferences Shim
+ * The Arduino-ESP32 Preferences class over the NVS flash model in
+ * nvs_sim.h, so storage_impl.h builds and runs unchanged on the host.
+ * Call nvsSimInit() or nvsSimLoad() before the first begin().
+ *
+ * Return values follow the ESP32 core: puts return the bytes stored (0
+ * on failure), gets return the default when the key is missing or holds
+ * another type, getBytes() returns 0 when the buffer is too small.
+ * Every call is timed on the virtual clock into nvsSim.ops.
+ */
+
+#ifndef HOST_PREFERENCES_H
+#define HOST_PREFERENCES_H
+
+#include "nvs_sim.h"
+
+class Preferences {
+public:
+    bool begin(const char *name, bool readOnly = false, const char *partitionLabel = NULL) {
+        if (started) return false;
+        OpTimer timer(NVS_OP_OPEN);
+        started = nvsOpenNamespace(name, !readOnly, ns);
+        this->readOnly = readOnly;
+        return started;
+    }
+    
+    void end() { started = false; }
+    
+    bool clear() {
+        if (!writable()) return false;
+        OpTimer timer(NVS_OP_CLEAR);
+        nvsEraseAll(ns);
+        return true;
+    }
+    
+    bool remove(const char *key) {
+        if (!writable()) return false;
+        OpTimer timer(NVS_OP_REMOVE);
+        return nvsEraseKey(ns, key);
+    }
+    
+    size_t putChar(const char *key, int8_t value) { return putPrimitive(key, NVS_TYPE_I8, (uint8_t)value, 1); }
+    size_t putUChar(const char *key, uint8_t value) { return putPrimitive(key, NVS_TYPE_U8, value, 1); }
+    size_t putShort(const char *key, int16_t value) { return putPrimitive(key, NVS_TYPE_I16, (uint16_t)value, 2); }
+    size_t putUShort(const char *key, uint16_t value) { return putPrimitive(key, NVS_TYPE_U16, value, 2); }
+    size_t putInt(const char *key, int32_t value) { return putPrimitive(key, NVS_TYPE_I32, (uint32_t)value, 4); }
+    size_t putUInt(const char *key, uint32_t value) { return putPrimitive(key, NVS_TYPE_U32, value, 4); }
+    size_t putLong(const char *key, int32_t value) { return putInt(key, value); }
+    size_t putULong(const char *key, uint32_t value) { return putUInt(key, value); }
+    size_t putBool(const char *key, bool value) { return putUChar(key, value ? 1 : 0); }
+    
+    size_t putString(const char *key, const char *value) {
+        if (!writable() || !value) return 0;
+        OpTimer timer(NVS_OP_PUT);
+        return nvsSetString(ns, key, value) ? strlen(value) : 0;
+    }
+    
+    size_t putString(const char *key, const String &value) { return putString(key, value.c_str()); }
+    
+    size_t putBytes(const char *key, const void *value, size_t length) {
+        if (!writable() || !value || !length) return 0;
+        OpTimer timer(NVS_OP_PUT);
+        return nvsSetBlob(ns, key, value, length) ? length : 0;
+    }
+    
+    int8_t getChar(const char *key, int8_t defaultValue = 0) { return getPrimitive(key, NVS_TYPE_I8, defaultValue); }
+    uint8_t getUChar(const char *key, uint8_t defaultValue = 0) { return getPrimitive(key, NVS_TYPE_U8, defaultValue); }
+    int16_t getShort(const char *key, int16_t defaultValue = 0) { return getPrimitive(key, NVS_TYPE_I16, defaultValue); }
+    uint16_t getUShort(const char *key, uint16_t defaultValue = 0) { return getPrimitive(key, NVS_TYPE_U16, defaultValue); }
+    int32_t getInt(const char *key, int32_t defaultValue = 0) { return getPrimitive(key, NVS_TYPE_I32, defaultValue); }
+    uint32_t getUInt(const char *key, uint32_t defaultValue = 0) { return getPrimitive(key, NVS_TYPE_U32, defaultValue); }
+    int32_t getLong(const char *key, int32_t defaultValue = 0) { return getInt(key, defaultValue); }
+    uint32_t getULong(const char *key, uint32_t defaultValue = 0) { return getUInt(key, defaultValue); }
+    bool getBool(const char *key, bool defaultValue = false) { return getUChar(key, defaultValue ? 1 : 0) != 0; }
+    
+    String getString(const char *key, String defaultValue = String()) {
+        if (!started) return defaultValue;
+        OpTimer timer(NVS_OP_GET);
+        std::string value;
+        return nvsGetString(ns, key, value) ? String(value) : defaultValue;
+    }
+    
+    size_t getBytesLength(const char *key) {
+        if (!started) return 0;
+        OpTimer timer(NVS_OP_GET);
+        size_t length = 0;
+        return nvsGetBlobLength(ns, key, length) ? length : 0;
+    }
+    
+    size_t getBytes(const char *key, void *buffer, size_t maxLength) {
+        if (!started || !buffer) return 0;
+        OpTimer timer(NVS_OP_GET);
+        size_t length = 0;
+        if (!nvsGetBlobLength(ns, key, length) || length > maxLength) return 0;
+        return nvsGetBlob(ns, key, buffer, maxLength) ? length : 0;
+    }
+    
+    bool isKey(const char *key) {
+        if (!started) return false;
+        OpTimer timer(NVS_OP_GET);
+        return nvsFindKey(ns, key);
+    }
+
+private:
+    // Virtual time spent in one call, booked on scope exit
+    struct OpTimer {
+        int op;
+        uint64_t start;
+        explicit OpTimer(int op) : op(op), start(micros()) {}
+        ~OpTimer() {
+            uint32_t us = micros() - start;
+            NvsOpStats &stats = nvsSim.ops[op];
+            stats.calls++;
+            stats.totalUs += us;
+            if (us > stats.maxUs) stats.maxUs = us;
+        }
+    };
+    
+    bool started = false;
+    bool readOnly = false;
+    uint8_t ns = 0;
+    
+    bool writable() const { return started && !readOnly; }
+    
+    size_t putPrimitive(const char *key, uint8_t type, uint64_t value, size_t size) {
+        if (!writable()) return 0;
+        OpTimer timer(NVS_OP_PUT);
+        return nvsSetPrimitive(ns, key, type, value) ? size : 0;
+    }
+    
+    template <typename T>
+    T getPrimitive(const char *key, uint8_t type, T defaultValue) {
+        if (!started) return defaultValue;
+        OpTimer timer(NVS_OP_GET);
+        uint64_t value;
+        return nvsGetPrimitive(ns, key, type, value) ? (T)value : defaultValue;
+    }
+};
+
+#endif // HOST_PREFERENCES_H
@@ -0,0 +1,102 @@
+/**
+ * Host Partition Shim
+ * The esp_partition calls the state journal uses, over one data
+ * partition held in RAM with the NOR flash model of nvs_sim.h (same
+ * program, read and erase latency, programs that set a bit counted as
+ * violations, erase counts per sector). Call nvsSimInit() first for the
+ * flash timing, then partitionSimInit() to create the partition; until
+ * then esp_partition_find_first() finds nothing, as on a device without
+ * the partition in its table.
+ *
+ * Offsets and lengths are checked as in ESP-IDF: reads and writes must
+ * stay inside the partition, erases must be whole sectors.
+ */
+
+#ifndef HOST_ESP_PARTITION_H
+#define HOST_ESP_PARTITION_H
+
+#include "nvs_sim.h"
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_SIZE 0x104
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01
+} esp_partition_type_t;
+
+typedef int esp_partition_subtype_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    uint32_t erase_size;
+    char label[17];
+} esp_partition_t;
+
+struct PartitionSim {
+    esp_partition_t partition;
+    bool present;
+    std::vector<uint8_t> flash;
+    std::vector<uint64_t> eraseCounts;
+    NvsFlashStats stats;
+};
+
+static PartitionSim partitionSim;
+
+/**
+ * Create a blank (erased) data partition of the given number of sectors
+ * Erase counts and statistics start from zero
+ */
+[[maybe_unused]] static void partitionSimInit(const char *label, int subtype, int sectors) {
+    partitionSim = PartitionSim();
+    partitionSim.partition.type = ESP_PARTITION_TYPE_DATA;
+    partitionSim.partition.subtype = subtype;
+    partitionSim.partition.size = sectors * NVS_PAGE_SIZE;
+    partitionSim.partition.erase_size = NVS_PAGE_SIZE;
+    strlcpy(partitionSim.partition.label, label, sizeof(partitionSim.partition.label));
+    partitionSim.present = sectors > 0;
+    partitionSim.flash.assign(partitionSim.partition.size, 0xFF);
+    partitionSim.eraseCounts.assign(sectors, 0);
+}
+
+inline const esp_partition_t *esp_partition_find_first(esp_partition_type_t type,
+                                                       esp_partition_subtype_t subtype,
+                                                       const char *label) {
+    const esp_partition_t &partition = partitionSim.partition;
+    if (!partitionSim.present || type != partition.type || subtype != partition.subtype) return NULL;
+    if (label && strcmp(label, partition.label)) return NULL;
+    return &partition;
+}
+
+inline esp_err_t esp_partition_read(const esp_partition_t *partition, size_t offset,
+                                    void *data, size_t length) {
+    if (!partition || !data) return ESP_ERR_INVALID_ARG;
+    if (offset > partition->size || length > partition->size - offset) return ESP_ERR_INVALID_SIZE;
+    flashRead(partitionSim.flash, partitionSim.stats, offset, data, length);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_partition_write(const esp_partition_t *partition, size_t offset,
+                                     const void *data, size_t length) {
+    if (!partition || !data) return ESP_ERR_INVALID_ARG;
+    if (offset > partition->size || length > partition->size - offset) return ESP_ERR_INVALID_SIZE;
+    flashProgram(partitionSim.flash, partitionSim.stats, offset, data, length);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t length) {
+    if (!partition) return ESP_ERR_INVALID_ARG;
+    if (offset > partition->size || length > partition->size - offset) return ESP_ERR_INVALID_SIZE;
+    if (offset % partition->erase_size || length % partition->erase_size) return ESP_ERR_INVALID_SIZE;
+    for (size_t sector = offset / NVS_PAGE_SIZE; sector < (offset + length) / NVS_PAGE_SIZE; sector++) {
+        flashEraseSector(partitionSim.flash, partitionSim.eraseCounts, partitionSim.stats, sector);
+    }
+    return ESP_OK;
+}
+
+#endif // HOST_ESP_PARTITION_H
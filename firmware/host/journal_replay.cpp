@@ -0,0 +1,267 @@
+/**
+ * Journal Replay Test
+ * Runs the state journal (journal_impl.h) unchanged on a journal
+ * partition over the NOR flash model (include/esp_partition.h), with
+ * restarts, and checks what initJournal() recovers
+ *
+ * Usage: journal_replay <scenario>
+ *
+ * wrap: random state changes across several laps of the 16 KB ring with
+ * a restart every few hundred; every restart recovers each device's
+ * newest state and runtime, sectors wear evenly, no program sets a bit
+ * and no append erases (the erase happens ahead, on an idle pass).
+ * carry: on a 2-sector ring, devices changed once and never again
+ * survive many laps of another device's changes (sector carry-over).
+ * crc: a torn newest record fails its CRC and the one before it is
+ * recovered; the journal appends after the torn slot, never onto it.
+ * power_cut: a power cut partway through the carry into a new sector,
+ * then before the erase ahead, still recovers every newest record.
+ * fade_off: a record written during a fade off holds the target (off),
+ * not the transient on-at-0.
+ */
+
+#include "host_core.h"
+#include "journal.h"
+#include "schedule_store_impl.h"
+#include "scene_store_impl.h"
+#include "storage_impl.h"
+#include "journal_impl.h"
+
+String systemName = "Smart_Home_Hub";
+Preferences preferences;
+
+static int failures = 0;
+
+#define EXPECT(cond) do { \
+    if (!(cond)) { \
+        printf("  FAIL line %d: %s\n", __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+#define JOURNAL_SIM_SECTORS 4   // 0x4000 in partitions.csv
+#define APPEND_LIMIT_US 1000    // Far below one 45 ms sector erase
+
+static uint64_t replayRandomState = 1;
+
+// splitmix64, so every run replays the same changes
+static uint32_t replayRandom(uint32_t range) {
+    uint64_t z = (replayRandomState += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (uint32_t)((z ^ (z >> 31)) % range);
+}
+
+// What the journal must give back for each device
+struct Expected {
+    bool state;
+    int brightness;
+    uint32_t totalRuntime;
+};
+
+static Expected expected[CHANNEL_COUNT];
+
+static void boot(int sectors) {
+    nvsSimInit(5);
+    partitionSimInit(JOURNAL_PARTITION_LABEL, JOURNAL_PARTITION_SUBTYPE, sectors);
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        setDeviceState(i, false, 0, false);
+        devices[i].totalRuntime = 0;
+        expected[i] = {false, 0, 0};
+    }
+    EXPECT(initJournal());
+}
+
+// A change with its runtime, journaled (flushJournal() so that a change
+// to the same level still records the runtime), then a pass with nothing
+// to append
+static void change(int deviceId, bool state, int brightness) {
+    hostAdvanceTo(micros() + 50000);
+    setDeviceState(deviceId, state, brightness, false);
+    devices[deviceId].totalRuntime += 1 + replayRandom(60);
+    flushJournal();
+    processJournal();
+    expected[deviceId] = {state, state ? brightness : 0, (uint32_t)devices[deviceId].totalRuntime};
+}
+
+static void randomChange(int deviceId) {
+    change(deviceId, replayRandom(2), 1 + replayRandom(100));
+}
+
+// Restart and compare every device with what was last written
+static void restartAndCompare() {
+    EXPECT(initJournal());
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        JournalRecord record;
+        bool found = getJournaledState(i, record);
+        EXPECT(found);
+        if (!found) continue;
+        EXPECT(record.state == expected[i].state);
+        EXPECT(record.brightness == expected[i].brightness);
+        EXPECT(record.totalRuntime == expected[i].totalRuntime);
+    }
+}
+
+static void checkFlash(const char *label, bool evenWear = true) {
+    const JournalStats &stats = getJournalStats();
+    uint64_t minErases = UINT64_MAX, maxErases = 0;
+    for (uint64_t count : partitionSim.eraseCounts) {
+        minErases = std::min(minErases, count);
+        maxErases = std::max(maxErases, count);
+    }
+    printf("  %s: %lu records, %llu erases (per sector %llu-%llu), append max %lu us, mean %.0f us\n",
+           label, (unsigned long)stats.records, (unsigned long long)partitionSim.stats.erases,
+           (unsigned long long)minErases, (unsigned long long)maxErases, (unsigned long)stats.maxAppendUs,
+           stats.records ? stats.totalAppendUs / (double)stats.records : 0.0);
+    EXPECT(partitionSim.stats.violations == 0);
+    EXPECT(!evenWear || maxErases - minErases <= 1);
+    EXPECT(stats.maxAppendUs < APPEND_LIMIT_US);
+}
+
+// ================================================================
+// SCENARIOS
+// ================================================================
+
+static void scenarioWrap() {
+    boot(JOURNAL_SIM_SECTORS);
+    int laps = 5;
+    int total = laps * JOURNAL_SIM_SECTORS * JOURNAL_RECORDS_PER_SECTOR;
+    for (int n = 0; n < total; n++) {
+        randomChange(replayRandom(CHANNEL_COUNT));
+        if (n % 333 == 332) restartAndCompare();
+    }
+    restartAndCompare();
+    EXPECT(getJournalStats().sequence > (uint32_t)total);
+    checkFlash("wrap");
+}
+
+static void scenarioCarry() {
+    boot(2);
+    for (int i = 0; i < CHANNEL_COUNT; i++) change(i, true, 10 + i);
+    for (int n = 0; n < 6 * (int)JOURNAL_RECORDS_PER_SECTOR; n++) {
+        randomChange(0);
+        if (n % 100 == 99) restartAndCompare();
+    }
+    restartAndCompare();
+    checkFlash("carry");
+}
+
+static void scenarioCrc() {
+    boot(JOURNAL_SIM_SECTORS);
+    for (int n = 0; n < 40; n++) randomChange(n % CHANNEL_COUNT);
+    
+    // Tear the newest record: one bit of its brightness (50 or 60, both
+    // under 0x80) was never programmed
+    Expected before = expected[1];
+    change(1, true, before.brightness == 50 ? 60 : 50);
+    size_t tornSlot = journalSlot - 1;
+    partitionSim.flash[journalOffset(journalSector, tornSlot) + offsetof(JournalRecord, brightness)] |= 0x80;
+    
+    expected[1] = before;
+    restartAndCompare();
+    EXPECT(journalSlot == tornSlot + 1);
+    
+    // Appends go after the torn slot and never program onto it
+    uint64_t violations = partitionSim.stats.violations;
+    for (int n = 0; n < 3 * (int)JOURNAL_RECORDS_PER_SECTOR; n++) randomChange(replayRandom(CHANNEL_COUNT));
+    restartAndCompare();
+    EXPECT(partitionSim.stats.violations == violations);
+    checkFlash("crc");
+}
+
+static void scenarioPowerCut() {
+    boot(JOURNAL_SIM_SECTORS);
+    for (int i = 0; i < CHANNEL_COUNT; i++) change(i, true, 20 + i);
+    
+    // A lap of the ring so every sector holds records, then fill the
+    // current sector with changes to the other devices and keep the
+    // partition from just before the change that moves on
+    for (int n = 0; n < JOURNAL_SIM_SECTORS * (int)JOURNAL_RECORDS_PER_SECTOR; n++) {
+        randomChange(1 + replayRandom(CHANNEL_COUNT - 1));
+    }
+    while (journalSlot < JOURNAL_RECORDS_PER_SECTOR) randomChange(1 + replayRandom(CHANNEL_COUNT - 1));
+    EXPECT(journalNextErased);
+    PartitionSim full = partitionSim;
+    Expected settled[CHANNEL_COUNT];
+    memcpy(settled, expected, sizeof(expected));
+    size_t next = (journalSector + 1) % JOURNAL_SIM_SECTORS;
+    size_t afterNext = (next + 1) % JOURNAL_SIM_SECTORS;
+    
+    // Moving on carries one record per device, in order, then appends the
+    // change; the pass after it erases the sector after the new one
+    randomChange(0);
+    PartitionSim moved = partitionSim;
+    Expected changed[CHANNEL_COUNT];
+    memcpy(changed, expected, sizeof(expected));
+    
+    // Cut after each carried record in turn: the change is lost, nothing else
+    for (int carried = 0; carried <= CHANNEL_COUNT; carried++) {
+        partitionSim = full;
+        size_t start = journalOffset(next, 0);
+        memcpy(&partitionSim.flash[start], &moved.flash[start], carried * sizeof(JournalRecord));
+        memcpy(expected, settled, sizeof(expected));
+        restartAndCompare();
+        
+        for (int n = 0; n < 2 * (int)JOURNAL_RECORDS_PER_SECTOR; n++) randomChange(replayRandom(CHANNEL_COUNT));
+        restartAndCompare();
+    }
+    
+    // Cut before the erase ahead: that sector still holds a lap-old sector's
+    // records and is erased on the next pass with nothing to append
+    partitionSim = moved;
+    size_t start = journalOffset(afterNext, 0);
+    memcpy(&partitionSim.flash[start], &full.flash[start], JOURNAL_SECTOR_SIZE);
+    memcpy(expected, changed, sizeof(expected));
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        setDeviceState(i, expected[i].state, expected[i].brightness, false);
+        devices[i].totalRuntime = expected[i].totalRuntime;
+    }
+    restartAndCompare();
+    EXPECT(!journalNextErased);
+    processJournal();
+    EXPECT(journalNextErased);
+    
+    for (int n = 0; n < 2 * (int)JOURNAL_RECORDS_PER_SECTOR; n++) randomChange(replayRandom(CHANNEL_COUNT));
+    restartAndCompare();
+    checkFlash("power_cut", false);
+}
+
+static void scenarioFadeOff() {
+    boot(JOURNAL_SIM_SECTORS);
+    change(0, true, 80);
+    
+    // Mid-fade the device reports on at its target of 0
+    setDeviceState(0, false, 0, true, 2000);
+    hostAdvanceTo(micros() + 500000);
+    bool state;
+    int brightness;
+    getDeviceState(0, state, brightness);
+    EXPECT(state && brightness == 0 && fadeStates[0].active);
+    processJournal();
+    
+    expected[0] = {false, 0, (uint32_t)devices[0].totalRuntime};
+    restartAndCompare();
+}
+
+// ================================================================
+// MAIN
+// ================================================================
+
+int main(int argc, char **argv) {
+    const char *scenario = argc > 1 ? argv[1] : "";
+    hostLogLevel = LOG_NONE;
+    hostInitCore();
+    
+    if (!strcmp(scenario, "wrap")) scenarioWrap();
+    else if (!strcmp(scenario, "carry")) scenarioCarry();
+    else if (!strcmp(scenario, "crc")) scenarioCrc();
+    else if (!strcmp(scenario, "power_cut")) scenarioPowerCut();
+    else if (!strcmp(scenario, "fade_off")) scenarioFadeOff();
+    else {
+        fprintf(stderr, "Usage: journal_replay wrap|carry|crc|power_cut|fade_off\n");
+        return 2;
+    }
+    
+    printf("%s: %s\n", scenario, failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
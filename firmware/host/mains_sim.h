@@ -0,0 +1,341 @@
+/**
+ * Mains Simulation
+ * Deterministic zero-cross source, event loop and TRIAC load meter for
+ * the host core (include after host_core.h)
+ *
+ * The source produces true mains zero crossings at the profile frequency
+ * and, for each one, a detector edge offset by uniform jitter unless it
+ * is dropped; noise spikes arrive as a Poisson process. The event loop
+ * delivers edges to onZeroCross(), the armed alarm to onTimerFire() and
+ * runs the Core 0 task every taskPeriodUs. The load meter turns every
+ * channel's gate signal into conducted half-cycles of a resistive load.
+ */
+
+#ifndef MAINS_SIM_H
+#define MAINS_SIM_H
+
+#include <queue>
+#include <vector>
+
+// ================================================================
+// CONFIGURATION
+// ================================================================
+
+struct MainsProfile {
+    double frequencyHz;     // Mains frequency (may change between runs)
+    uint32_t jitterUs;      // Detector edge jitter, uniform +/- this
+    double dropoutRate;     // Probability a detector edge is missing
+    double noiseRate;       // Spurious detector edges per second
+    uint32_t latchUs;       // Gate must be HIGH this long after zero to latch
+    uint32_t taskPeriodUs;  // Core 0 task interval
+};
+
+static const MainsProfile MAINS_PROFILE_DEFAULT = {50.0, 0, 0.0, 0.0, 150, 10000};
+
+// ================================================================
+// STATE
+// ================================================================
+
+enum MainsEventKind {
+    MAINS_TRUE_ZERO = 0,  // Actual zero crossing (load meter half-cycle boundary)
+    MAINS_EDGE = 1,       // Detector edge for a crossing
+    MAINS_NOISE = 2,      // Spurious detector edge
+    MAINS_TASK = 3        // Core 0 task tick
+};
+
+struct MainsEvent {
+    uint64_t us;
+    uint8_t kind;
+    bool operator>(const MainsEvent &other) const {
+        return us != other.us ? us > other.us : kind > other.kind;
+    }
+};
+
+// One channel's load, measured per true half-cycle
+struct ChannelMeter {
+    uint32_t gpioMask;
+    bool gateHigh;
+    uint64_t riseUs;          // Gate went HIGH (or half-cycle start if held)
+    uint64_t conductUs;       // Conduction start this half-cycle, UINT64_MAX = none
+    uint16_t commandTick;     // Fire tick in force when the gate rose (0 = not phase fired)
+    bool halfCycleGate;       // Phase or burst channel: its gate must not span a zero
+    bool heldOver;            // Gate HIGH since well before this half-cycle began
+    bool conductHeld;         // Conduction this half-cycle came from a held-over gate
+    uint64_t halfCycles;
+    uint64_t conducting;
+    double powerSum;          // Sum of delivered power fraction per half-cycle
+    uint64_t phaseSamples;    // Phase-fired half-cycles with a commanded angle
+    double angleErrorSum;     // Sum of |conduction start - commanded| in us
+    double angleErrorMax;
+    uint64_t gateRises;
+    uint64_t retriggers;      // Phase or burst gate held across a zero re-latched the TRIAC
+};
+
+struct MainsSim {
+    MainsProfile profile;
+    uint64_t rng;
+    double nextZeroUs;        // Exact time of the next true zero crossing
+    double halfCycleUs;       // Current true half-cycle length
+    uint64_t halfStartUs;     // Start of the current true half-cycle
+    uint64_t nextNoiseUs;
+    uint32_t forcedDrops;     // Next detector edges to drop unconditionally
+    void (*task)();
+    FILE *timeline;           // Pin transition CSV, or NULL
+    std::priority_queue<MainsEvent, std::vector<MainsEvent>, std::greater<MainsEvent>> events;
+    ChannelMeter meters[CHANNEL_COUNT];
+    uint64_t trueZeros;
+    uint64_t edgesDelivered;
+    uint64_t edgesDropped;
+    uint64_t noiseDelivered;
+    uint64_t timerFires;
+};
+
+static MainsSim mainsSim;
+
+// ================================================================
+// RANDOM SOURCE (splitmix64, deterministic per seed)
+// ================================================================
+
+static inline uint64_t mainsRandom() {
+    uint64_t z = (mainsSim.rng += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Uniform in [0, 1)
+static inline double mainsUniform() {
+    return (mainsRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// ================================================================
+// LOAD METER
+// ================================================================
+
+// Fraction of full power a resistive load receives when conduction
+// starts at phase x (0-1) of the half-cycle
+static inline double conductedPower(double x) {
+    if (x <= 0) return 1.0;
+    if (x >= 1) return 0.0;
+    return 1.0 - x + sin(2 * M_PI * x) / (2 * M_PI);
+}
+
+// A TRIAC latches once its gate is HIGH with enough voltage across it,
+// i.e. no closer than latchUs to either zero of the half-cycle
+static inline void meterTryLatch(ChannelMeter &m, uint64_t nowUs) {
+    if (!m.gateHigh || m.conductUs != UINT64_MAX) return;
+    uint64_t latchFrom = mainsSim.halfStartUs + mainsSim.profile.latchUs;
+    double latchUntil = mainsSim.nextZeroUs - mainsSim.profile.latchUs;
+    if (nowUs < latchFrom) return;
+    
+    uint64_t startUs = m.riseUs > latchFrom ? m.riseUs : latchFrom;
+    if (startUs < latchUntil) {
+        m.conductUs = startUs;
+        m.conductHeld = m.heldOver;
+    }
+}
+
+static void meterOnOutput(uint32_t setMask, uint32_t clearMask) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        ChannelMeter &m = mainsSim.meters[i];
+        bool high = (hostPinLevels & m.gpioMask) != 0;
+        if (high == m.gateHigh) continue;
+        
+        if (mainsSim.timeline) {
+            fprintf(mainsSim.timeline, "%llu,%d,%d\n", (unsigned long long)hostNowUs, TRIAC_PINS[i], high ? 1 : 0);
+        }
+        
+        if (high) {
+            m.gateHigh = true;
+            m.riseUs = hostNowUs;
+            uint8_t type = isrSnapshot.channels[i].type;
+            m.commandTick = isPhaseControlled(type) ? isrSnapshot.channels[i].fireTick : 0;
+            m.halfCycleGate = isPhaseControlled(type) || type == TYPE_BURST;
+            m.heldOver = false;
+            m.gateRises++;
+        } else {
+            // Latches on the way out if it was held long enough
+            meterTryLatch(m, hostNowUs);
+            m.gateHigh = false;
+            m.heldOver = false;
+        }
+    }
+}
+
+// Close the half-cycle ending now and open the next
+static void meterOnTrueZero(uint64_t nowUs) {
+    double halfUs = (double)(nowUs - mainsSim.halfStartUs);
+    
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        ChannelMeter &m = mainsSim.meters[i];
+        meterTryLatch(m, nowUs);
+        m.halfCycles++;
+        
+        if (m.conductUs != UINT64_MAX) {
+            double startUs = (double)(m.conductUs - mainsSim.halfStartUs);
+            m.conducting++;
+            m.powerSum += conductedPower(startUs / halfUs);
+            
+            // A phase or burst gate left HIGH from the last half-cycle fired
+            // it early; otherwise compare against the angle the ISR was told to use
+            if (m.conductHeld && m.halfCycleGate) {
+                m.retriggers++;
+            } else if (m.commandTick > 0 && m.commandTick < PHASE_STEPS) {
+                double error = fabs(startUs - m.commandTick * halfUs / PHASE_STEPS);
+                m.phaseSamples++;
+                m.angleErrorSum += error;
+                if (error > m.angleErrorMax) m.angleErrorMax = error;
+            }
+        }
+        
+        // A gate held across the zero keeps driving the new half-cycle; one
+        // raised by an early edge (inside the PLL window) belongs to it
+        m.conductUs = UINT64_MAX;
+        m.heldOver = m.gateHigh && nowUs - m.riseUs > PLL_WINDOW_US;
+        if (m.gateHigh) m.riseUs = nowUs;
+    }
+    
+    mainsSim.halfStartUs = nowUs;
+}
+
+// ================================================================
+// SOURCE
+// ================================================================
+
+static inline double mainsHalfCycleUs() {
+    return 500000.0 / mainsSim.profile.frequencyHz;
+}
+
+// Queue the detector edge for the crossing at zeroUs (or drop it)
+static void scheduleDetectorEdge(double zeroUs) {
+    if (mainsSim.forcedDrops > 0) {
+        mainsSim.forcedDrops--;
+        mainsSim.edgesDropped++;
+        return;
+    }
+    if (mainsSim.profile.dropoutRate > 0 && mainsUniform() < mainsSim.profile.dropoutRate) {
+        mainsSim.edgesDropped++;
+        return;
+    }
+    
+    double jitter = 0;
+    if (mainsSim.profile.jitterUs) jitter = (mainsUniform() * 2 - 1) * mainsSim.profile.jitterUs;
+    double edgeUs = zeroUs + jitter;
+    if (edgeUs < (double)hostNowUs) edgeUs = (double)hostNowUs;
+    mainsSim.events.push({(uint64_t)llround(edgeUs), MAINS_EDGE});
+}
+
+static void scheduleNoise() {
+    if (mainsSim.profile.noiseRate <= 0) {
+        mainsSim.nextNoiseUs = UINT64_MAX;
+        return;
+    }
+    double gapUs = -log(1.0 - mainsUniform()) * 1e6 / mainsSim.profile.noiseRate;
+    mainsSim.nextNoiseUs = hostNowUs + (uint64_t)gapUs + 1;
+    mainsSim.events.push({mainsSim.nextNoiseUs, MAINS_NOISE});
+}
+
+// Default Core 0 work: signal watchdog and fade segment hand-over
+static void mainsDefaultTask() {
+    checkZeroCrossHealth();
+    processFadeTransitions();
+}
+
+/**
+ * Reset the simulation: clock to zero, core booted, first crossing at
+ * one half-cycle
+ */
+static void mainsSimInit(const MainsProfile &profile, uint64_t seed) {
+    mainsSim.profile = profile;
+    mainsSim.rng = seed;
+    mainsSim.events = {};
+    mainsSim.forcedDrops = 0;
+    mainsSim.task = mainsDefaultTask;
+    mainsSim.timeline = NULL;
+    mainsSim.trueZeros = mainsSim.edgesDelivered = mainsSim.edgesDropped = 0;
+    mainsSim.noiseDelivered = mainsSim.timerFires = 0;
+    
+    hostNowUs = 0;
+    hostInitCore();
+    
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        mainsSim.meters[i] = {};
+        mainsSim.meters[i].gpioMask = channelsToGpioMask(1 << i);
+        mainsSim.meters[i].conductUs = UINT64_MAX;
+    }
+    hostOutputObserver = meterOnOutput;
+    
+    mainsSim.halfStartUs = 0;
+    mainsSim.nextZeroUs = mainsHalfCycleUs();
+    mainsSim.events.push({(uint64_t)llround(mainsSim.nextZeroUs), MAINS_TRUE_ZERO});
+    scheduleDetectorEdge(mainsSim.nextZeroUs);
+    scheduleNoise();
+    mainsSim.events.push({mainsSim.profile.taskPeriodUs, MAINS_TASK});
+}
+
+/**
+ * Drop the detector edges of the next count crossings, whatever the
+ * profile (the edge of the upcoming crossing is already queued)
+ */
+[[maybe_unused]] static void mainsDropEdges(uint32_t count) {
+    mainsSim.forcedDrops += count;
+}
+
+/**
+ * Deliver one extra detector edge at an absolute virtual time
+ */
+[[maybe_unused]] static void mainsInjectEdge(uint64_t us) {
+    mainsSim.events.push({us, MAINS_NOISE});
+}
+
+/**
+ * Run the simulation until virtual time untilUs
+ */
+static void mainsSimRun(uint64_t untilUs) {
+    while (true) {
+        uint64_t timerUs = hostTimerDueUs();
+        const MainsEvent next = mainsSim.events.top();
+        
+        // Alarms win ties: a fire point due at an edge belongs to the old half-cycle
+        if (timerUs <= next.us) {
+            if (timerUs > untilUs) break;
+            hostAdvanceTo(timerUs);
+            mainsSim.timerFires++;
+            hostFireTimer();
+            continue;
+        }
+        if (next.us > untilUs) break;
+        
+        mainsSim.events.pop();
+        hostAdvanceTo(next.us);
+        
+        switch (next.kind) {
+            case MAINS_TRUE_ZERO: {
+                // The crossing after this one, at the frequency now in force
+                mainsSim.trueZeros++;
+                mainsSim.halfCycleUs = mainsHalfCycleUs();
+                meterOnTrueZero(next.us);
+                mainsSim.nextZeroUs += mainsSim.halfCycleUs;
+                mainsSim.events.push({(uint64_t)llround(mainsSim.nextZeroUs), MAINS_TRUE_ZERO});
+                scheduleDetectorEdge(mainsSim.nextZeroUs);
+                break;
+            }
+            case MAINS_EDGE:
+                mainsSim.edgesDelivered++;
+                onZeroCross();
+                break;
+            case MAINS_NOISE:
+                mainsSim.noiseDelivered++;
+                onZeroCross();
+                if (next.us == mainsSim.nextNoiseUs) scheduleNoise();
+                break;
+            case MAINS_TASK:
+                if (mainsSim.task) mainsSim.task();
+                mainsSim.events.push({next.us + mainsSim.profile.taskPeriodUs, MAINS_TASK});
+                break;
+        }
+    }
+    hostAdvanceTo(untilUs);
+}
+
+#endif // MAINS_SIM_H
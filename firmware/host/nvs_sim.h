@@ -0,0 +1,866 @@
+/**
+ * NVS Flash Model
+ * The ESP-IDF NVS page and entry layout over an emulated NOR flash
+ * partition, for the host Preferences stand-in (include/Preferences.h)
+ *
+ * Pages follow NVS format version 2: 4096 bytes with a 32-byte header,
+ * a 2-bit-per-entry state bitmap and 126 entries of 32 bytes. Items are
+ * appended to the active page and the copy they replace is then marked
+ * erased; when only the reserve page is left free, the full page with
+ * the most erased entries has its live entries copied into the reserve
+ * and is erased. Blobs are stored as chunks plus an index entry, and a
+ * write whose data matches the stored item is skipped, as in NVS.
+ *
+ * Flash keeps NOR semantics (programming only clears bits) and every
+ * read, program and sector erase advances the virtual clock by the
+ * configured latency. Per-sector erase counts and bytes programmed are
+ * kept for wear estimates. The partition lives in RAM and can be loaded
+ * from and saved to an image file (erase counts appended).
+ */
+
+#ifndef NVS_SIM_H
+#define NVS_SIM_H
+
+#include "host_core.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <vector>
+
+#define NVS_PAGE_SIZE 4096
+#define NVS_ENTRY_SIZE 32
+#define NVS_ENTRY_COUNT 126
+#define NVS_BITMAP_OFFSET 32
+#define NVS_ENTRY_OFFSET 64
+#define NVS_KEY_SIZE 16
+#define NVS_PROGRAM_PAGE 256        // Flash program page; a write is split at these
+#define NVS_CHUNK_ANY 0xFF
+#define NVS_CHUNK_MAX_SIZE 4000     // Data entries of one page
+#define NVS_CHUNK_VERSION_0 0x00    // Blob chunk indexes alternate between the halves
+#define NVS_CHUNK_VERSION_1 0x80
+#define NVS_FORMAT_VERSION 0xFE
+
+enum NvsPageState : uint32_t {
+    NVS_PAGE_EMPTY = 0xFFFFFFFF,
+    NVS_PAGE_ACTIVE = 0xFFFFFFFE,
+    NVS_PAGE_FULL = 0xFFFFFFFC,
+    NVS_PAGE_FREEING = 0xFFFFFFF8
+};
+
+enum NvsEntryState : uint8_t {
+    NVS_ENTRY_EMPTY = 3,
+    NVS_ENTRY_WRITTEN = 2,
+    NVS_ENTRY_ERASED = 0
+};
+
+enum NvsType : uint8_t {
+    NVS_TYPE_U8 = 0x01,
+    NVS_TYPE_I8 = 0x11,
+    NVS_TYPE_U16 = 0x02,
+    NVS_TYPE_I16 = 0x12,
+    NVS_TYPE_U32 = 0x04,
+    NVS_TYPE_I32 = 0x14,
+    NVS_TYPE_U64 = 0x08,
+    NVS_TYPE_I64 = 0x18,
+    NVS_TYPE_STR = 0x21,
+    NVS_TYPE_BLOB_DATA = 0x42,
+    NVS_TYPE_BLOB_IDX = 0x48
+};
+
+// One 32-byte entry; string and blob data follow in the next span-1 entries
+struct NvsEntry {
+    uint8_t ns;
+    uint8_t type;
+    uint8_t span;
+    uint8_t chunkIndex;
+    uint32_t crc;               // Over the other header bytes
+    char key[NVS_KEY_SIZE];
+    uint8_t data[8];            // Value, {size, crc} for variable data, or the blob index
+};
+
+static_assert(sizeof(NvsEntry) == NVS_ENTRY_SIZE, "NvsEntry must be one entry");
+
+struct NvsPageHeader {
+    uint32_t state;
+    uint32_t seq;
+    uint8_t version;
+    uint8_t reserved[19];
+    uint32_t crc;
+};
+
+static_assert(sizeof(NvsPageHeader) == 32, "NvsPageHeader must be 32 bytes");
+
+// ================================================================
+// MODEL STATE
+// ================================================================
+
+/**
+ * Flash timing charged to the virtual clock
+ * Defaults are typical SPI NOR figures: 45 ms sector erase, byte program
+ * 30 us for the first byte plus 2.5 us per further byte (within one
+ * 256-byte program page), reads at about 20 MB/s
+ */
+struct NvsLatency {
+    double eraseUs;
+    double programUs;
+    double programByteUs;
+    double readUs;
+    double readByteUs;
+};
+
+#define NVS_LATENCY_DEFAULT {45000, 30, 2.5, 1, 0.05}
+
+struct NvsFlashStats {
+    uint64_t bytesProgrammed;
+    uint64_t bytesRead;
+    uint64_t programs;
+    uint64_t reads;
+    uint64_t erases;
+    uint64_t collections;       // Pages garbage-collected
+    uint64_t entriesCopied;     // Live entries moved by those collections
+    uint64_t writesSkipped;     // Writes of unchanged data
+    uint64_t violations;        // Programs that tried to set a bit
+};
+
+// Preferences calls, timed on the virtual clock
+enum NvsOp {
+    NVS_OP_OPEN,
+    NVS_OP_GET,
+    NVS_OP_PUT,
+    NVS_OP_REMOVE,
+    NVS_OP_CLEAR,
+    NVS_OP_COUNT
+};
+
+struct NvsOpStats {
+    uint64_t calls;
+    uint64_t totalUs;
+    uint32_t maxUs;
+};
+
+// Where an item's header entry lives
+struct NvsItemRef {
+    int page;
+    int entry;
+    uint8_t span;
+    uint8_t type;
+};
+
+struct NvsPageInfo {
+    uint32_t seq;
+    int nextFree;       // First never-written entry
+    int used;           // Entries written and not erased
+    int erased;
+};
+
+struct NvsSim {
+    int pages;
+    std::vector<uint8_t> flash;
+    std::vector<uint64_t> eraseCounts;
+    std::vector<NvsPageInfo> info;
+    std::vector<int> usedPages;         // Oldest first; the last one is active
+    std::deque<int> freePages;
+    uint32_t nextSeq;
+    std::map<std::string, NvsItemRef> items;     // By nvsItemKey()
+    std::map<std::string, uint8_t> namespaces;
+    std::vector<NvsItemRef *> pinned;   // Refs outside items that a collection must update
+    NvsLatency latency;
+    double pendingUs;                   // Charged but below one microsecond
+    NvsFlashStats stats;
+    NvsOpStats ops[NVS_OP_COUNT];
+};
+
+static NvsSim nvsSim;
+
+[[maybe_unused]] static const char *nvsOpName(int op) {
+    static const char *names[NVS_OP_COUNT] = {"begin", "get", "put", "remove", "clear"};
+    return names[op];
+}
+
+// ================================================================
+// FLASH
+// ================================================================
+
+static void nvsCharge(double us) {
+    nvsSim.pendingUs += us;
+    uint64_t whole = (uint64_t)nvsSim.pendingUs;
+    nvsSim.pendingUs -= whole;
+    hostAdvanceTo(micros() + whole);
+}
+
+static size_t nvsPageOffset(int page) {
+    return (size_t)page * NVS_PAGE_SIZE;
+}
+
+static size_t nvsEntryOffset(int page, int entry) {
+    return nvsPageOffset(page) + NVS_ENTRY_OFFSET + (size_t)entry * NVS_ENTRY_SIZE;
+}
+
+// NOR program: bits can only be cleared; one charge per program page
+// touched. The flash* primitives also back other partitions on the same
+// chip (include/esp_partition.h); the nvs* ones work on this partition.
+static void flashProgram(std::vector<uint8_t> &flash, NvsFlashStats &stats,
+                         size_t offset, const void *data, size_t length) {
+    const uint8_t *src = (const uint8_t *)data;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t &cell = flash[offset + i];
+        if (src[i] & ~cell) stats.violations++;
+        cell &= src[i];
+    }
+    
+    size_t done = 0;
+    while (done < length) {
+        size_t room = NVS_PROGRAM_PAGE - (offset + done) % NVS_PROGRAM_PAGE;
+        size_t part = length - done < room ? length - done : room;
+        nvsCharge(nvsSim.latency.programUs + nvsSim.latency.programByteUs * (part - 1));
+        stats.programs++;
+        done += part;
+    }
+    stats.bytesProgrammed += length;
+}
+
+static void flashRead(const std::vector<uint8_t> &flash, NvsFlashStats &stats,
+                      size_t offset, void *data, size_t length) {
+    memcpy(data, &flash[offset], length);
+    nvsCharge(nvsSim.latency.readUs + nvsSim.latency.readByteUs * length);
+    stats.reads++;
+    stats.bytesRead += length;
+}
+
+static void flashEraseSector(std::vector<uint8_t> &flash, std::vector<uint64_t> &eraseCounts,
+                             NvsFlashStats &stats, int sector) {
+    memset(&flash[(size_t)sector * NVS_PAGE_SIZE], 0xFF, NVS_PAGE_SIZE);
+    eraseCounts[sector]++;
+    stats.erases++;
+    nvsCharge(nvsSim.latency.eraseUs);
+}
+
+static void nvsProgram(size_t offset, const void *data, size_t length) {
+    flashProgram(nvsSim.flash, nvsSim.stats, offset, data, length);
+}
+
+static void nvsRead(size_t offset, void *data, size_t length) {
+    flashRead(nvsSim.flash, nvsSim.stats, offset, data, length);
+}
+
+static void nvsEraseSector(int page) {
+    flashEraseSector(nvsSim.flash, nvsSim.eraseCounts, nvsSim.stats, page);
+}
+
+// CRC-32 as esp_rom_crc32_le()
+static uint32_t nvsCrc(uint32_t crc, const uint8_t *data, size_t length) {
+    crc = ~crc;
+    while (length--) {
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+// ================================================================
+// PAGES
+// ================================================================
+
+// The bitmap is cached in RAM by NVS, so reading it costs nothing
+static NvsEntryState nvsEntryState(int page, int entry) {
+    uint8_t byte = nvsSim.flash[nvsPageOffset(page) + NVS_BITMAP_OFFSET + entry / 4];
+    return (NvsEntryState)((byte >> ((entry % 4) * 2)) & 3);
+}
+
+static void nvsSetEntryStates(int page, int first, int count, NvsEntryState state) {
+    size_t bitmap = nvsPageOffset(page) + NVS_BITMAP_OFFSET;
+    int firstWord = first / 16;
+    int lastWord = (first + count - 1) / 16;
+    
+    // One program per bitmap word, as NVS does
+    for (int word = firstWord; word <= lastWord; word++) {
+        uint32_t value;
+        memcpy(&value, &nvsSim.flash[bitmap + word * 4], 4);
+        for (int entry = word * 16; entry < word * 16 + 16; entry++) {
+            if (entry < first || entry >= first + count) continue;
+            int shift = (entry % 16) * 2;
+            value = (value & ~(3u << shift)) | ((uint32_t)state << shift);
+        }
+        nvsProgram(bitmap + word * 4, &value, 4);
+    }
+}
+
+static uint32_t nvsPageState(int page) {
+    uint32_t state;
+    memcpy(&state, &nvsSim.flash[nvsPageOffset(page)], 4);
+    return state;
+}
+
+static void nvsSetPageState(int page, NvsPageState state) {
+    uint32_t value = state;
+    nvsProgram(nvsPageOffset(page), &value, 4);
+}
+
+// Start an erased page as the active one
+static void nvsInitPage(int page) {
+    NvsPageHeader header;
+    memset(&header, 0xFF, sizeof(header));
+    header.state = NVS_PAGE_ACTIVE;
+    header.seq = nvsSim.nextSeq++;
+    header.version = NVS_FORMAT_VERSION;
+    header.crc = nvsCrc(0, (const uint8_t *)&header + 4, 24);
+    nvsProgram(nvsPageOffset(page), &header, sizeof(header));
+    
+    nvsSim.info[page] = {header.seq, 0, 0, 0};
+    nvsSim.usedPages.push_back(page);
+}
+
+static int nvsActivePage() {
+    if (nvsSim.usedPages.empty()) return -1;
+    int page = nvsSim.usedPages.back();
+    return nvsPageState(page) == NVS_PAGE_ACTIVE ? page : -1;
+}
+
+static int nvsFreeEntries(int page) {
+    return page < 0 ? 0 : NVS_ENTRY_COUNT - nvsSim.info[page].nextFree;
+}
+
+static void nvsPinRef(NvsItemRef *ref) { nvsSim.pinned.push_back(ref); }
+static void nvsUnpinRefs() { nvsSim.pinned.clear(); }
+
+// Copy the live entries of a page into the (reserve) target page, erase
+// it and return it to the free list
+static void nvsCollectPage(int victim, int target) {
+    nvsSetPageState(victim, NVS_PAGE_FREEING);
+    
+    std::map<int, int> moved;   // Victim entry -> target entry
+    NvsPageInfo &to = nvsSim.info[target];
+    for (int entry = 0; entry < NVS_ENTRY_COUNT;) {
+        if (nvsEntryState(victim, entry) != NVS_ENTRY_WRITTEN) {
+            entry++;
+            continue;
+        }
+        NvsEntry header;
+        nvsRead(nvsEntryOffset(victim, entry), &header, sizeof(header));
+        uint8_t buffer[NVS_PAGE_SIZE];
+        nvsRead(nvsEntryOffset(victim, entry), buffer, header.span * NVS_ENTRY_SIZE);
+        nvsProgram(nvsEntryOffset(target, to.nextFree), buffer, header.span * NVS_ENTRY_SIZE);
+        nvsSetEntryStates(target, to.nextFree, header.span, NVS_ENTRY_WRITTEN);
+        
+        moved[entry] = to.nextFree;
+        to.nextFree += header.span;
+        to.used += header.span;
+        nvsSim.stats.entriesCopied += header.span;
+        entry += header.span;
+    }
+    
+    auto relocate = [&](NvsItemRef &ref) {
+        if (ref.page != victim) return;
+        ref.page = target;
+        ref.entry = moved[ref.entry];
+    };
+    for (auto &item : nvsSim.items) relocate(item.second);
+    for (NvsItemRef *ref : nvsSim.pinned) relocate(*ref);
+    
+    for (size_t i = 0; i < nvsSim.usedPages.size(); i++) {
+        if (nvsSim.usedPages[i] == victim) {
+            nvsSim.usedPages.erase(nvsSim.usedPages.begin() + i);
+            break;
+        }
+    }
+    nvsEraseSector(victim);
+    nvsSim.info[victim] = {};
+    nvsSim.freePages.push_back(victim);
+    nvsSim.stats.collections++;
+}
+
+// Close the active page (if any) and open another, collecting a page when
+// only the reserve is free; false if nothing can be reclaimed
+static bool nvsRequestNewPage() {
+    int active = nvsActivePage();
+    if (active >= 0) nvsSetPageState(active, NVS_PAGE_FULL);
+    
+    if (nvsSim.freePages.size() >= 2) {
+        int page = nvsSim.freePages.front();
+        nvsSim.freePages.pop_front();
+        nvsInitPage(page);
+        return true;
+    }
+    
+    // The full page with the most erased entries, oldest first on a tie
+    int victim = -1;
+    for (int page : nvsSim.usedPages) {
+        if (nvsSim.info[page].erased > 0 && (victim < 0 || nvsSim.info[page].erased > nvsSim.info[victim].erased)) {
+            victim = page;
+        }
+    }
+    if (victim < 0 || nvsSim.freePages.empty()) return false;
+    
+    int target = nvsSim.freePages.front();
+    nvsSim.freePages.pop_front();
+    nvsInitPage(target);
+    nvsCollectPage(victim, target);
+    return true;
+}
+
+// ================================================================
+// ITEMS
+// ================================================================
+
+static std::string nvsItemKey(uint8_t ns, uint8_t chunkIndex, const char *key) {
+    std::string id(2, '\0');
+    id[0] = (char)ns;
+    id[1] = (char)chunkIndex;
+    return id + key;
+}
+
+static NvsItemRef *nvsFind(uint8_t ns, uint8_t chunkIndex, const char *key) {
+    auto it = nvsSim.items.find(nvsItemKey(ns, chunkIndex, key));
+    return it == nvsSim.items.end() ? NULL : &it->second;
+}
+
+// Header entry of an item (NVS checks it against the hash list on every find)
+static NvsEntry nvsReadHeader(const NvsItemRef &ref) {
+    NvsEntry header;
+    nvsRead(nvsEntryOffset(ref.page, ref.entry), &header, sizeof(header));
+    return header;
+}
+
+// Variable data of a string or blob chunk
+static void nvsReadData(const NvsItemRef &ref, void *data, size_t length) {
+    if (length) nvsRead(nvsEntryOffset(ref.page, ref.entry + 1), data, length);
+}
+
+static void nvsEraseRef(const NvsItemRef &ref) {
+    nvsSetEntryStates(ref.page, ref.entry, ref.span, NVS_ENTRY_ERASED);
+    nvsSim.info[ref.page].used -= ref.span;
+    nvsSim.info[ref.page].erased += ref.span;
+}
+
+// Append one item to the active page, opening pages as needed
+// data is the 8-byte value for primitives; payload/size the variable data
+static bool nvsWriteItem(uint8_t ns, uint8_t type, uint8_t chunkIndex, const char *key,
+                         const uint8_t *data, const uint8_t *payload, size_t size) {
+    int span = 1 + (int)((size + NVS_ENTRY_SIZE - 1) / NVS_ENTRY_SIZE);
+    if (span > NVS_ENTRY_COUNT) return false;
+    
+    while (nvsFreeEntries(nvsActivePage()) < span) {
+        if (!nvsRequestNewPage()) return false;
+    }
+    int page = nvsActivePage();
+    NvsPageInfo &info = nvsSim.info[page];
+    
+    NvsEntry header;
+    memset(&header, 0xFF, sizeof(header));
+    header.ns = ns;
+    header.type = type;
+    header.span = span;
+    header.chunkIndex = chunkIndex;
+    memset(header.key, 0, sizeof(header.key));
+    strncpy(header.key, key, NVS_KEY_SIZE - 1);
+    if (size || type == NVS_TYPE_STR || type == NVS_TYPE_BLOB_DATA) {
+        uint16_t length = size;
+        uint32_t dataCrc = nvsCrc(0, payload, size);
+        memcpy(header.data, &length, 2);
+        memcpy(header.data + 4, &dataCrc, 4);
+    } else {
+        memcpy(header.data, data, 8);
+    }
+    header.crc = nvsCrc(0, (const uint8_t *)&header, 4);
+    header.crc = nvsCrc(header.crc, (const uint8_t *)&header + 8, 24);
+    
+    // Header entry, then the data entries and their states in one go
+    int entry = info.nextFree;
+    nvsProgram(nvsEntryOffset(page, entry), &header, sizeof(header));
+    nvsSetEntryStates(page, entry, 1, NVS_ENTRY_WRITTEN);
+    if (span > 1) {
+        std::vector<uint8_t> padded((span - 1) * NVS_ENTRY_SIZE, 0xFF);
+        memcpy(padded.data(), payload, size);
+        nvsProgram(nvsEntryOffset(page, entry + 1), padded.data(), padded.size());
+        nvsSetEntryStates(page, entry + 1, span - 1, NVS_ENTRY_WRITTEN);
+    }
+    info.nextFree += span;
+    info.used += span;
+    
+    nvsSim.items[nvsItemKey(ns, chunkIndex, key)] = {page, entry, (uint8_t)span, type};
+    return true;
+}
+
+// Erase an item of any type, with the chunks of a blob
+static void nvsEraseItem(uint8_t ns, const char *key, NvsItemRef ref) {
+    if (ref.type == NVS_TYPE_BLOB_IDX) {
+        NvsEntry index = nvsReadHeader(ref);
+        uint8_t chunkCount = index.data[4];
+        uint8_t chunkStart = index.data[5];
+        for (int c = 0; c < chunkCount; c++) {
+            NvsItemRef *chunk = nvsFind(ns, chunkStart + c, key);
+            if (!chunk) continue;
+            nvsEraseRef(*chunk);
+            nvsSim.items.erase(nvsItemKey(ns, chunkStart + c, key));
+        }
+    }
+    nvsEraseRef(ref);
+}
+
+// ================================================================
+// NAMESPACES AND VALUES (what the NVS API calls do)
+// ================================================================
+
+static bool nvsValidKey(const char *key) {
+    return key && key[0] && strlen(key) < NVS_KEY_SIZE;
+}
+
+static bool nvsOpenNamespace(const char *name, bool create, uint8_t &ns) {
+    if (!nvsValidKey(name)) return false;
+    auto it = nvsSim.namespaces.find(name);
+    if (it != nvsSim.namespaces.end()) {
+        ns = it->second;
+        return true;
+    }
+    if (!create || nvsSim.namespaces.size() >= 254) return false;
+    
+    uint8_t data[8];
+    memset(data, 0xFF, sizeof(data));
+    data[0] = (uint8_t)(nvsSim.namespaces.size() + 1);
+    if (!nvsWriteItem(0, NVS_TYPE_U8, NVS_CHUNK_ANY, name, data, NULL, 0)) return false;
+    ns = data[0];
+    nvsSim.namespaces[name] = ns;
+    return true;
+}
+
+static bool nvsSetPrimitive(uint8_t ns, const char *key, uint8_t type, uint64_t value) {
+    if (!nvsValidKey(key)) return false;
+    uint8_t data[8];
+    memset(data, 0xFF, sizeof(data));
+    memcpy(data, &value, type & 0x0F);
+    
+    NvsItemRef old = {};
+    NvsItemRef *found = nvsFind(ns, NVS_CHUNK_ANY, key);
+    if (found) {
+        old = *found;
+        NvsEntry header = nvsReadHeader(old);
+        if (old.type == type && !memcmp(header.data, data, 8)) {
+            nvsSim.stats.writesSkipped++;
+            return true;
+        }
+    }
+    
+    // New copy first, then erase the old one (wherever a collection moved it)
+    nvsPinRef(&old);
+    bool written = nvsWriteItem(ns, type, NVS_CHUNK_ANY, key, data, NULL, 0);
+    nvsUnpinRefs();
+    if (written && found) nvsEraseItem(ns, key, old);
+    return written;
+}
+
+static bool nvsGetPrimitive(uint8_t ns, const char *key, uint8_t type, uint64_t &value) {
+    NvsItemRef *ref = nvsFind(ns, NVS_CHUNK_ANY, key);
+    if (!ref || ref->type != type) return false;
+    NvsEntry header = nvsReadHeader(*ref);
+    value = 0;
+    memcpy(&value, header.data, type & 0x0F);
+    
+    // Sign-extend the signed types
+    int bits = (type & 0x0F) * 8;
+    if ((type & 0x10) && bits < 64 && (value >> (bits - 1)) & 1) value |= ~0ULL << bits;
+    return true;
+}
+
+static bool nvsSetString(uint8_t ns, const char *key, const char *value) {
+    if (!nvsValidKey(key)) return false;
+    size_t size = strlen(value) + 1;
+    if (size > NVS_CHUNK_MAX_SIZE) return false;
+    
+    NvsItemRef old = {};
+    NvsItemRef *found = nvsFind(ns, NVS_CHUNK_ANY, key);
+    if (found) {
+        old = *found;
+        NvsEntry header = nvsReadHeader(old);
+        uint16_t length;
+        memcpy(&length, header.data, 2);
+        if (old.type == NVS_TYPE_STR && length == size) {
+            std::vector<char> stored(size);
+            nvsReadData(old, stored.data(), size);
+            if (!memcmp(stored.data(), value, size)) {
+                nvsSim.stats.writesSkipped++;
+                return true;
+            }
+        }
+    }
+    
+    nvsPinRef(&old);
+    bool written = nvsWriteItem(ns, NVS_TYPE_STR, NVS_CHUNK_ANY, key, NULL, (const uint8_t *)value, size);
+    nvsUnpinRefs();
+    if (written && found) nvsEraseItem(ns, key, old);
+    return written;
+}
+
+static bool nvsGetString(uint8_t ns, const char *key, std::string &value) {
+    NvsItemRef *ref = nvsFind(ns, NVS_CHUNK_ANY, key);
+    if (!ref || ref->type != NVS_TYPE_STR) return false;
+    NvsEntry header = nvsReadHeader(*ref);
+    uint16_t length;
+    memcpy(&length, header.data, 2);
+    std::vector<char> stored(length);
+    nvsReadData(*ref, stored.data(), length);
+    value.assign(stored.data(), length ? length - 1 : 0);
+    return true;
+}
+
+// Blob index entry fields: size, chunk count, first chunk index
+static void nvsBlobIndex(const NvsEntry &index, uint32_t &size, uint8_t &chunkCount, uint8_t &chunkStart) {
+    memcpy(&size, index.data, 4);
+    chunkCount = index.data[4];
+    chunkStart = index.data[5];
+}
+
+static bool nvsGetBlobLength(uint8_t ns, const char *key, size_t &length) {
+    NvsItemRef *ref = nvsFind(ns, NVS_CHUNK_ANY, key);
+    if (!ref || ref->type != NVS_TYPE_BLOB_IDX) return false;
+    uint32_t size;
+    uint8_t chunkCount, chunkStart;
+    nvsBlobIndex(nvsReadHeader(*ref), size, chunkCount, chunkStart);
+    length = size;
+    return true;
+}
+
+static bool nvsGetBlob(uint8_t ns, const char *key, void *data, size_t length) {
+    NvsItemRef *ref = nvsFind(ns, NVS_CHUNK_ANY, key);
+    if (!ref || ref->type != NVS_TYPE_BLOB_IDX) return false;
+    uint32_t size;
+    uint8_t chunkCount, chunkStart;
+    nvsBlobIndex(nvsReadHeader(*ref), size, chunkCount, chunkStart);
+    if (length < size) return false;
+    
+    uint8_t *cursor = (uint8_t *)data;
+    for (int c = 0; c < chunkCount; c++) {
+        NvsItemRef *chunk = nvsFind(ns, chunkStart + c, key);
+        if (!chunk) return false;
+        NvsEntry header = nvsReadHeader(*chunk);
+        uint16_t chunkSize;
+        memcpy(&chunkSize, header.data, 2);
+        nvsReadData(*chunk, cursor, chunkSize);
+        cursor += chunkSize;
+    }
+    return true;
+}
+
+// Chunks of at most one page each, then the index entry, then the old
+// version's chunks and index are erased
+static bool nvsSetBlob(uint8_t ns, const char *key, const void *data, size_t length) {
+    if (!nvsValidKey(key) || length == 0) return false;
+    const uint8_t *bytes = (const uint8_t *)data;
+    
+    NvsItemRef old = {};
+    NvsItemRef *found = nvsFind(ns, NVS_CHUNK_ANY, key);
+    uint8_t chunkStart = NVS_CHUNK_VERSION_0;
+    if (found) {
+        old = *found;
+        if (old.type == NVS_TYPE_BLOB_IDX) {
+            uint32_t size;
+            uint8_t chunkCount, oldStart;
+            nvsBlobIndex(nvsReadHeader(old), size, chunkCount, oldStart);
+            if (size == length) {
+                std::vector<uint8_t> stored(size);
+                if (nvsGetBlob(ns, key, stored.data(), size) && !memcmp(stored.data(), bytes, size)) {
+                    nvsSim.stats.writesSkipped++;
+                    return true;
+                }
+            }
+            chunkStart = oldStart == NVS_CHUNK_VERSION_0 ? NVS_CHUNK_VERSION_1 : NVS_CHUNK_VERSION_0;
+        }
+    }
+    
+    nvsPinRef(&old);
+    size_t offset = 0;
+    uint8_t chunkCount = 0;
+    bool ok = true;
+    while (ok && offset < length) {
+        int page = nvsActivePage();
+        int free = nvsFreeEntries(page);
+        size_t tailroom = free >= 2 ? (size_t)(free - 1) * NVS_ENTRY_SIZE : 0;
+        size_t remaining = length - offset;
+        
+        // A first chunk that would be split off a nearly full page starts
+        // on a fresh one instead
+        if (tailroom == 0 || (chunkCount == 0 && tailroom < remaining && tailroom < NVS_CHUNK_MAX_SIZE / 10)) {
+            ok = nvsRequestNewPage();
+            continue;
+        }
+        size_t size = remaining < tailroom ? remaining : tailroom;
+        ok = chunkCount < 127 && nvsWriteItem(ns, NVS_TYPE_BLOB_DATA, chunkStart + chunkCount, key, NULL,
+                                              bytes + offset, size);
+        if (ok) {
+            chunkCount++;
+            offset += size;
+        }
+    }
+    
+    if (ok) {
+        uint8_t index[8];
+        uint32_t size = length;
+        memcpy(index, &size, 4);
+        index[4] = chunkCount;
+        index[5] = chunkStart;
+        index[6] = index[7] = 0xFF;
+        ok = nvsWriteItem(ns, NVS_TYPE_BLOB_IDX, NVS_CHUNK_ANY, key, index, NULL, 0);
+    }
+    nvsUnpinRefs();
+    
+    if (!ok) {
+        // Out of space: drop the chunks written so far, keep the old value
+        for (int c = 0; c < chunkCount; c++) {
+            NvsItemRef *chunk = nvsFind(ns, chunkStart + c, key);
+            if (!chunk) continue;
+            nvsEraseRef(*chunk);
+            nvsSim.items.erase(nvsItemKey(ns, chunkStart + c, key));
+        }
+        if (found) nvsSim.items[nvsItemKey(ns, NVS_CHUNK_ANY, key)] = old;
+        return false;
+    }
+    if (found) nvsEraseItem(ns, key, old);
+    return true;
+}
+
+static bool nvsFindKey(uint8_t ns, const char *key) {
+    NvsItemRef *ref = nvsFind(ns, NVS_CHUNK_ANY, key);
+    if (!ref) return false;
+    nvsReadHeader(*ref);
+    return true;
+}
+
+static bool nvsEraseKey(uint8_t ns, const char *key) {
+    NvsItemRef *ref = nvsFind(ns, NVS_CHUNK_ANY, key);
+    if (!ref) return false;
+    NvsItemRef old = *ref;
+    nvsSim.items.erase(nvsItemKey(ns, NVS_CHUNK_ANY, key));
+    nvsEraseItem(ns, key, old);
+    return true;
+}
+
+static void nvsEraseAll(uint8_t ns) {
+    std::vector<std::string> keys;
+    for (const auto &item : nvsSim.items) {
+        if ((uint8_t)item.first[0] == ns && (uint8_t)item.first[1] == NVS_CHUNK_ANY) {
+            keys.push_back(item.first.substr(2));
+        }
+    }
+    for (const std::string &key : keys) nvsEraseKey(ns, key.c_str());
+}
+
+// ================================================================
+// PARTITION
+// ================================================================
+
+/**
+ * Start from a blank (erased) partition of the given number of pages
+ * Erase counts and statistics start from zero
+ */
+static void nvsSimInit(int pages) {
+    NvsLatency latency = nvsSim.latency;
+    bool configured = nvsSim.pages > 0;
+    nvsSim = NvsSim();
+    nvsSim.latency = configured ? latency : (NvsLatency)NVS_LATENCY_DEFAULT;
+    nvsSim.pages = pages;
+    nvsSim.flash.assign((size_t)pages * NVS_PAGE_SIZE, 0xFF);
+    nvsSim.eraseCounts.assign(pages, 0);
+    nvsSim.info.assign(pages, NvsPageInfo());
+    for (int page = 0; page < pages; page++) nvsSim.freePages.push_back(page);
+}
+
+// Rebuild the RAM state from flash, like nvs_flash_init()
+static void nvsMount() {
+    nvsSim.items.clear();
+    nvsSim.namespaces.clear();
+    nvsSim.usedPages.clear();
+    nvsSim.freePages.clear();
+    nvsSim.nextSeq = 0;
+    
+    std::vector<std::pair<uint32_t, int>> used;
+    for (int page = 0; page < nvsSim.pages; page++) {
+        uint32_t state = nvsPageState(page);
+        if (state == NVS_PAGE_EMPTY) {
+            nvsSim.freePages.push_back(page);
+            nvsSim.info[page] = {};
+            continue;
+        }
+        NvsPageHeader header;
+        memcpy(&header, &nvsSim.flash[nvsPageOffset(page)], sizeof(header));
+        used.push_back({header.seq, page});
+    }
+    std::sort(used.begin(), used.end());
+    
+    for (const auto &entry : used) {
+        int page = entry.second;
+        NvsPageInfo &info = nvsSim.info[page];
+        info = {entry.first, 0, 0, 0};
+        if (entry.first >= nvsSim.nextSeq) nvsSim.nextSeq = entry.first + 1;
+        
+        for (int i = 0; i < NVS_ENTRY_COUNT;) {
+            NvsEntryState state = nvsEntryState(page, i);
+            if (state == NVS_ENTRY_EMPTY) {
+                i++;
+                continue;
+            }
+            info.nextFree = i + 1;
+            if (state == NVS_ENTRY_ERASED) {
+                info.erased++;
+                i++;
+                continue;
+            }
+            NvsEntry header;
+            memcpy(&header, &nvsSim.flash[nvsEntryOffset(page, i)], sizeof(header));
+            char key[NVS_KEY_SIZE + 1] = {};
+            memcpy(key, header.key, NVS_KEY_SIZE);
+            nvsSim.items[nvsItemKey(header.ns, header.chunkIndex, key)] = {page, i, header.span, header.type};
+            if (header.ns == 0) nvsSim.namespaces[key] = header.data[0];
+            info.used += header.span;
+            info.nextFree = i + header.span;
+            i += header.span;
+        }
+        if (nvsPageState(page) != NVS_PAGE_ACTIVE) info.nextFree = NVS_ENTRY_COUNT;
+        nvsSim.usedPages.push_back(page);
+    }
+}
+
+/**
+ * Load a partition image written by nvsSimSave()
+ * Returns false if the file is missing or not an image of this size
+ */
+[[maybe_unused]] static bool nvsSimLoad(const char *path, int pages) {
+    FILE *file = fopen(path, "rb");
+    if (!file) return false;
+    
+    nvsSimInit(pages);
+    bool ok = fread(nvsSim.flash.data(), 1, nvsSim.flash.size(), file) == nvsSim.flash.size() &&
+              fread(nvsSim.eraseCounts.data(), sizeof(uint64_t), pages, file) == (size_t)pages &&
+              fgetc(file) == EOF;
+    fclose(file);
+    if (!ok) {
+        nvsSimInit(pages);
+        return false;
+    }
+    nvsMount();
+    return true;
+}
+
+/**
+ * Save the partition image, erase counts appended
+ */
+[[maybe_unused]] static bool nvsSimSave(const char *path) {
+    FILE *file = fopen(path, "wb");
+    if (!file) return false;
+    bool ok = fwrite(nvsSim.flash.data(), 1, nvsSim.flash.size(), file) == nvsSim.flash.size() &&
+              fwrite(nvsSim.eraseCounts.data(), sizeof(uint64_t), nvsSim.pages, file) == (size_t)nvsSim.pages;
+    return fclose(file) == 0 && ok;
+}
+
+/**
+ * Entries in use and in total, as nvs_get_stats()
+ */
+bool hostStorageUsage(size_t &usedEntries, size_t &totalEntries) {
+    usedEntries = 0;
+    for (int page : nvsSim.usedPages) usedEntries += nvsSim.info[page].used;
+    totalEntries = (size_t)nvsSim.pages * NVS_ENTRY_COUNT;
+    return nvsSim.pages > 0;
+}
+
+#endif // NVS_SIM_H
@@ -0,0 +1,286 @@
+/**
+ * Zero-Cross PLL Replay Test
+ * Feeds synthetic edge trains through onZeroCross()/onTimerFire() and
+ * checks when the software PLL locks, coasts and gives up
+ *
+ * Usage: pll_replay <scenario>
+ *
+ * Each scenario runs in its own process (the ISR state is file-static)
+ * and ctest runs them one by one. Channel 0 is a dimmer at 50% and
+ * channel 3 a burst channel at 50% throughout, so coasting is also
+ * checked at the outputs: no half-cycle may be re-triggered by a gate
+ * held across a missed edge.
+ */
+
+#include "host_core.h"
+#include "mains_sim.h"
+
+static int failures = 0;
+
+#define EXPECT(cond) do { \
+    if (!(cond)) { \
+        printf("  FAIL line %d: %s\n", __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+// ================================================================
+// HELPERS
+// ================================================================
+
+// Boot at the given mains frequency with clean edges and the test loads
+static void boot(double frequencyHz, uint32_t jitterUs) {
+    MainsProfile profile = MAINS_PROFILE_DEFAULT;
+    profile.frequencyHz = frequencyHz;
+    profile.jitterUs = jitterUs;
+    mainsSimInit(profile, 7);
+    
+    setDeviceState(0, true, 50);
+    setDeviceType(3, TYPE_BURST);
+    setDeviceState(3, true, 50);
+}
+
+static void runHalfCycles(uint32_t count) {
+    mainsSimRun(micros() + (uint64_t)(count * mainsHalfCycleUs()));
+}
+
+// Run until the PLL locks; returns the virtual time taken, 0 if it never does
+static uint64_t runUntilLocked(uint64_t limitUs) {
+    uint64_t startUs = micros();
+    while (!isZeroCrossLocked()) {
+        if (micros() - startUs > limitUs) return 0;
+        runHalfCycles(1);
+    }
+    return micros() - startUs;
+}
+
+// Stop just ahead of the next true zero crossing
+static void runToBeforeNextZero(uint32_t leadUs) {
+    mainsSimRun((uint64_t)mainsSim.nextZeroUs - leadUs);
+}
+
+static void resetMeters() {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        ChannelMeter &meter = mainsSim.meters[i];
+        meter.halfCycles = meter.conducting = meter.phaseSamples = meter.retriggers = 0;
+        meter.powerSum = meter.angleErrorSum = meter.angleErrorMax = 0;
+    }
+}
+
+static uint32_t rejectedEdges() { return getIsrMetrics(1).rejectedEdges; }
+static uint32_t missedEdges() { return getIsrMetrics(1).missedEdges; }
+
+// ================================================================
+// SCENARIOS
+// ================================================================
+
+// Clean 50 Hz: lock after PLL_LOCK_EDGES plausible intervals
+static void scenarioLock50() {
+    boot(50, 30);
+    uint64_t lockUs = runUntilLocked(1000000);
+    printf("  locked after %.0f ms\n", lockUs / 1000.0);
+    EXPECT(lockUs > 0 && lockUs <= 300000);
+    
+    runHalfCycles(200);
+    EXPECT(isZeroCrossLocked());
+    EXPECT(fabs(getMainsFrequencyHz() - 50) < 0.1);
+    EXPECT(rejectedEdges() == 0 && missedEdges() == 0);
+    EXPECT(currentError == ERR_NONE);
+}
+
+// 60 Hz at boot: the filter starts at 50 Hz and must converge before
+// locking, or the locked loop rejects the real edges and loses them
+static void scenarioLock60() {
+    boot(60, 30);
+    uint64_t lockUs = runUntilLocked(2000000);
+    printf("  locked after %.0f ms\n", lockUs / 1000.0);
+    EXPECT(lockUs > 0 && lockUs <= 1000000);
+    
+    runHalfCycles(600);
+    EXPECT(isZeroCrossLocked());
+    EXPECT(fabs(getMainsFrequencyHz() - 60) < 0.1);
+    EXPECT(rejectedEdges() == 0 && missedEdges() == 0);
+    EXPECT(currentError == ERR_NONE);
+}
+
+// Spikes outside the window are rejected and change nothing
+static void scenarioNoiseOutsideWindow() {
+    boot(50, 0);
+    EXPECT(runUntilLocked(1000000) > 0);
+    runHalfCycles(100);
+    resetMeters();
+    
+    const int32_t offsets[] = {-(PLL_WINDOW_US + 100), PLL_WINDOW_US + 100, 2500, 5000, -4000};
+    int spikes = 0;
+    uint32_t rejectedBefore = rejectedEdges();
+    
+    for (int round = 0; round < 20; round++) {
+        for (int32_t offsetUs : offsets) {
+            runToBeforeNextZero(5000);
+            mainsInjectEdge((uint64_t)(mainsSim.nextZeroUs + offsetUs));
+            spikes++;
+            runHalfCycles(3);
+        }
+    }
+    
+    printf("  %d spikes, %u rejected, angle error max %.1f us\n",
+           spikes, (unsigned)(rejectedEdges() - rejectedBefore), mainsSim.meters[0].angleErrorMax);
+    EXPECT(rejectedEdges() - rejectedBefore == (uint32_t)spikes);
+    EXPECT(missedEdges() == 0);
+    EXPECT(isZeroCrossLocked());
+    EXPECT(currentError == ERR_NONE);
+    EXPECT(mainsSim.meters[0].angleErrorMax < 20);
+    EXPECT(mainsSim.meters[0].retriggers == 0);
+}
+
+// A spike inside the window is taken for the edge; the real edge right
+// after it is then rejected and the loop pulls back without losing lock
+static void scenarioNoiseInsideWindow() {
+    boot(50, 0);
+    EXPECT(runUntilLocked(1000000) > 0);
+    runHalfCycles(100);
+    resetMeters();
+    
+    const int spikes = 20;
+    uint32_t rejectedBefore = rejectedEdges();
+    
+    for (int i = 0; i < spikes; i++) {
+        runToBeforeNextZero(2000);
+        mainsInjectEdge((uint64_t)(mainsSim.nextZeroUs - PLL_WINDOW_US / 2));
+        runHalfCycles(50);
+    }
+    
+    printf("  %d spikes, %u rejected, angle error max %.1f us\n",
+           spikes, (unsigned)(rejectedEdges() - rejectedBefore), mainsSim.meters[0].angleErrorMax);
+    EXPECT(rejectedEdges() - rejectedBefore == (uint32_t)spikes);
+    EXPECT(missedEdges() == 0);
+    EXPECT(isZeroCrossLocked());
+    EXPECT(currentError == ERR_NONE);
+    EXPECT(mainsSim.meters[0].angleErrorMax <= PLL_WINDOW_US);
+    EXPECT(mainsSim.meters[0].retriggers == 0);
+}
+
+// 1 to PLL_MAX_COAST_EDGES missing edges are bridged by the prediction:
+// outputs keep firing every half-cycle, nothing is re-triggered
+static void scenarioCoast() {
+    boot(50, 30);
+    EXPECT(runUntilLocked(1000000) > 0);
+    runHalfCycles(100);
+    
+    for (uint32_t drops = 1; drops <= PLL_MAX_COAST_EDGES; drops++) {
+        resetMeters();
+        uint32_t missedBefore = missedEdges();
+        
+        mainsDropEdges(drops);
+        runHalfCycles(drops + 20);
+        
+        const ChannelMeter &dimmer = mainsSim.meters[0];
+        printf("  %u dropped: %u coasted, dimmer conducted %llu/%llu, %llu re-triggered\n",
+               (unsigned)drops, (unsigned)(missedEdges() - missedBefore),
+               (unsigned long long)dimmer.conducting, (unsigned long long)dimmer.halfCycles,
+               (unsigned long long)dimmer.retriggers);
+        EXPECT(missedEdges() - missedBefore == drops);
+        EXPECT(isZeroCrossLocked());
+        EXPECT(currentError == ERR_NONE);
+        EXPECT(dimmer.conducting == dimmer.halfCycles);
+        EXPECT(dimmer.retriggers == 0);
+        EXPECT(mainsSim.meters[3].retriggers == 0);
+        
+        runHalfCycles(50);
+    }
+}
+
+// PLL_MAX_COAST_EDGES + 1 missing edges: loss, all outputs off and the
+// loads switched off by Core 0; edges returning relock the loop
+static void scenarioLoss() {
+    boot(50, 30);
+    EXPECT(runUntilLocked(1000000) > 0);
+    runHalfCycles(100);
+    
+    uint32_t missedBefore = missedEdges();
+    mainsDropEdges(PLL_MAX_COAST_EDGES + 1);
+    runHalfCycles(PLL_MAX_COAST_EDGES + 3);
+    resetMeters();
+    
+    printf("  %u missed, locked %d, error %d\n",
+           (unsigned)(missedEdges() - missedBefore), isZeroCrossLocked(), currentError);
+    EXPECT(missedEdges() - missedBefore == PLL_MAX_COAST_EDGES + 1);
+    EXPECT(!isZeroCrossLocked());
+    EXPECT(currentError == ERR_ZERO_CROSS_LOST);
+    for (int i = 0; i < CHANNEL_COUNT; i++) EXPECT(!devices[i].state);
+    
+    uint64_t relockUs = runUntilLocked(1000000);
+    printf("  relocked after %.0f ms\n", relockUs / 1000.0);
+    EXPECT(relockUs > 0 && relockUs <= 300000);
+    
+    // Safety shutdown holds until something turns a load back on
+    runHalfCycles(50);
+    EXPECT(mainsSim.meters[0].conducting == 0 && mainsSim.meters[3].conducting == 0);
+}
+
+// A frequency step far outside the window (generator changeover) is a
+// loss followed by reacquisition at the new frequency
+static void scenarioStep(double fromHz, double toHz) {
+    boot(fromHz, 30);
+    EXPECT(runUntilLocked(2000000) > 0);
+    runHalfCycles(200);
+    EXPECT(currentError == ERR_NONE);
+    
+    mainsSim.profile.frequencyHz = toHz;
+    runHalfCycles(20);
+    printf("  %.0f -> %.0f Hz: error %d\n", fromHz, toHz, currentError);
+    EXPECT(currentError == ERR_ZERO_CROSS_LOST);
+    
+    uint64_t relockUs = runUntilLocked(2000000);
+    runHalfCycles(600);
+    printf("  relocked after %.0f ms, %.3f Hz measured\n", relockUs / 1000.0, getMainsFrequencyHz());
+    EXPECT(relockUs > 0 && relockUs <= 1000000);
+    EXPECT(isZeroCrossLocked());
+    EXPECT(fabs(getMainsFrequencyHz() - toHz) < 0.1);
+}
+
+// A grid-sized frequency step is tracked without dropping an edge
+static void scenarioDrift() {
+    boot(50, 30);
+    EXPECT(runUntilLocked(1000000) > 0);
+    runHalfCycles(200);
+    
+    mainsSim.profile.frequencyHz = 50.5;
+    runHalfCycles(600);
+    mainsSim.profile.frequencyHz = 49.5;
+    runHalfCycles(600);
+    
+    printf("  %.3f Hz measured, %u rejected, %u coasted\n",
+           getMainsFrequencyHz(), (unsigned)rejectedEdges(), (unsigned)missedEdges());
+    EXPECT(isZeroCrossLocked());
+    EXPECT(rejectedEdges() == 0 && missedEdges() == 0);
+    EXPECT(currentError == ERR_NONE);
+    EXPECT(fabs(getMainsFrequencyHz() - 49.5) < 0.1);
+}
+
+// ================================================================
+// MAIN
+// ================================================================
+
+int main(int argc, char **argv) {
+    const char *scenario = argc > 1 ? argv[1] : "";
+    hostLogLevel = LOG_NONE;
+    
+    if (!strcmp(scenario, "lock50")) scenarioLock50();
+    else if (!strcmp(scenario, "lock60")) scenarioLock60();
+    else if (!strcmp(scenario, "noise_outside")) scenarioNoiseOutsideWindow();
+    else if (!strcmp(scenario, "noise_inside")) scenarioNoiseInsideWindow();
+    else if (!strcmp(scenario, "coast")) scenarioCoast();
+    else if (!strcmp(scenario, "loss")) scenarioLoss();
+    else if (!strcmp(scenario, "step50to60")) scenarioStep(50, 60);
+    else if (!strcmp(scenario, "step60to50")) scenarioStep(60, 50);
+    else if (!strcmp(scenario, "drift")) scenarioDrift();
+    else {
+        fprintf(stderr, "Usage: pll_replay lock50|lock60|noise_outside|noise_inside|coast|loss|"
+                        "step50to60|step60to50|drift\n");
+        return 2;
+    }
+    
+    printf("%s: %s\n", scenario, failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
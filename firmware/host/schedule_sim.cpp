@@ -0,0 +1,688 @@
+/**
+ * Schedule Simulator
+ * Fast-forwards the schedule engine (automation_impl.h) through days of
+ * virtual wall-clock time in a chosen timezone and reports what each
+ * device was told to do and what the engine cost
+ *
+ * Usage: schedule_sim [--days N] [--start YYYY-MM-DD] [--tz POSIX-TZ]
+ *                     [--step S] [--extra N] [--seed N] [--ntp-step S]
+ *                     [--timeline FILE] [--check]
+ *
+ * The built-in set is an evening light with a weekend override, an
+ * overnight fan (off by day), a Sunday window at 02:30 (inside the hour
+ * most DST changes skip or repeat), a weekday sunrise/sunset ramp pair
+ * and a Saturday window ending at midnight; --extra adds random
+ * constant-level windows to load the queue. A scene switches two
+ * devices off at 09:00 on weekdays and NTP steps the clock by
+ * --ntp-step seconds halfway.
+ *
+ * --timeline writes every change of a device's commanded state as
+ * "utc,local,device,state,brightness,cause". --check runs the
+ * findNextWindow() cases for midnight and for each DST change in the
+ * simulated span, and compares every device once a minute with the
+ * highest-ranked open window recomputed from the schedules.
+ */
+
+#include "host_core.h"
+#include "schedule_store_impl.h"
+#include "scene_store_impl.h"
+#include "automation_impl.h"
+
+#include <chrono>
+#include <vector>
+
+static int failures = 0;
+
+#define EXPECT(cond) do { \
+    if (!(cond)) { \
+        printf("  FAIL line %d: %s\n", __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+// ================================================================
+// VIRTUAL WALL CLOCK
+// ================================================================
+
+// Wall clock at virtual time 0; an NTP step moves it
+static time_t simEpoch = 0;
+
+time_t hostWallClock() {
+    return simEpoch + (time_t)(micros() / 1000000);
+}
+
+bool getLocalTime(struct tm *info, uint32_t ms) {
+    time_t now = hostWallClock();
+    if (now < NTP_VALID_EPOCH) return false;
+    localtime_r(&now, info);
+    return true;
+}
+
+void broadcastSceneApplied(int sceneId, ChannelMask channels) {}
+
+static uint64_t simRandomState = 1;
+
+// splitmix64, so a seed gives the same schedule set everywhere
+static uint64_t simRandom() {
+    uint64_t z = (simRandomState += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static void formatLocal(time_t t, char *out, size_t size) {
+    struct tm local;
+    localtime_r(&t, &local);
+    strftime(out, size, "%Y-%m-%d %H:%M:%S %Z", &local);
+}
+
+static long utcOffsetAt(time_t t) {
+    struct tm local;
+    localtime_r(&t, &local);
+    return local.tm_gmtoff;
+}
+
+// ================================================================
+// SCHEDULE SET
+// ================================================================
+
+#define DAYS_ALL 0x7F
+#define DAYS_WEEKDAYS 0x3E
+#define DAY_BIT(wday) (1 << (wday))
+
+static int addSchedule(int deviceId, int startMins, int endMins, uint8_t days,
+                       int startBrightness, int endBrightness, uint8_t priority) {
+    int id = allocateSchedule();
+    if (id < 0) return -1;
+    Schedule *sched = getSchedule(id);
+    sched->deviceId = deviceId;
+    sched->startMins = startMins;
+    sched->endMins = endMins;
+    sched->daysOfWeek = days;
+    sched->startBrightness = startBrightness;
+    sched->endBrightness = endBrightness;
+    sched->priority = priority;
+    sched->active = 1;
+    updateScheduleIndex(id);
+    return id;
+}
+
+static void addBuiltInSchedules() {
+    addSchedule(0, 17 * 60, 23 * 60 + 30, DAYS_ALL, 60, 60, 0);             // Evening light
+    addSchedule(0, 20 * 60, 22 * 60, DAY_BIT(5) | DAY_BIT(6), 20, 20, 1);   // Fri/Sat movie dim
+    addSchedule(1, 22 * 60 + 30, 6 * 60 + 30, DAYS_ALL, 40, 40, 0);         // Overnight fan
+    addSchedule(1, 6 * 60 + 30, 22 * 60 + 30, DAYS_ALL, 0, 0, 0);           // Fan off by day
+    addSchedule(2, 2 * 60 + 30, 3 * 60 + 30, DAY_BIT(0), 100, 100, 0);      // Sunday, DST hour
+    addSchedule(3, 6 * 60, 6 * 60 + 45, DAYS_WEEKDAYS, 0, 100, 0);          // Sunrise ramp
+    addSchedule(3, 6 * 60 + 45, 8 * 60, DAYS_WEEKDAYS, 100, 0, 0);          // Fade out
+    addSchedule(2, 23 * 60, 0, DAY_BIT(6), 50, 50, 0);                      // Saturday to midnight
+}
+
+// Constant-level windows, 15 min to 4 h, on random days and devices
+static void addRandomSchedules(int count) {
+    for (int i = 0; i < count; i++) {
+        int startMins = simRandom() % 1440;
+        int endMins = (startMins + 15 + simRandom() % 226) % 1440;
+        uint8_t days = simRandom() % 127 + 1;
+        int level = simRandom() % 101;
+        if (addSchedule(simRandom() % CHANNEL_COUNT, startMins, endMins, days, level, level,
+                        simRandom() % 3) < 0) {
+            printf("Schedule store full after %d extra schedules\n", i);
+            return;
+        }
+    }
+}
+
+// Weekday scene: switch the evening light off with a short fade, and
+// the DST-hour device off at once
+static int addMorningScene() {
+    SceneEntry entries[2] = {};
+    entries[0].deviceId = 0;
+    entries[0].state = 0;
+    entries[0].fadeMs = 2000;
+    entries[0].curve = FADE_LINEAR;
+    entries[1].deviceId = 2;
+    entries[1].state = 0;
+    int id = allocateScene();
+    return setScene(id, "Morning off", entries, 2) ? id : -1;
+}
+
+// ================================================================
+// REFERENCE MODEL
+// ================================================================
+
+// Instant a local date and minute of the day start at, worked out
+// without the engine's helpers: mktime() for ordinary and repeated
+// minutes, and for a minute skipped by a DST change the first instant
+// whose local time is later (the moment the clock jumps)
+static time_t referenceLocalTime(int year, int month, int mday, int mins) {
+    struct tm t = {};
+    t.tm_year = year;
+    t.tm_mon = month;
+    t.tm_mday = mday;
+    t.tm_hour = mins / 60;
+    t.tm_min = mins % 60;
+    t.tm_isdst = -1;
+    struct tm wall = t;
+    time_t target = timegm(&wall);   // Wall time as a number, for ordering
+    time_t when = mktime(&t);
+    if (t.tm_hour * 60 + t.tm_min == mins) return when;
+    
+    // Skipped: binary search the jump in the two hours before
+    time_t low = when - 7200;
+    time_t high = when;
+    while (high - low > 1) {
+        time_t mid = low + (high - low) / 2;
+        struct tm local;
+        localtime_r(&mid, &local);
+        if (timegm(&local) < target) low = mid; else high = mid;
+    }
+    return high;
+}
+
+// Commanded level the schedules call for on a device at t: the
+// highest-ranked open window's level, -1 if no window is open, -2 if
+// the winner is a ramp (its level depends on the fade engine)
+static int referenceLevel(int deviceId, time_t t) {
+    struct tm today;
+    localtime_r(&t, &today);
+    
+    int best = -1;
+    time_t bestStart = 0;
+    for (int id = nextScheduleId(0, deviceId); id >= 0; id = nextScheduleId(id + 1, deviceId)) {
+        const Schedule &sched = *getSchedule(id);
+        if (!sched.active || !sched.daysOfWeek || sched.startMins == sched.endMins) continue;
+        int endDay = sched.endMins < sched.startMins ? 1 : 0;
+        
+        for (int day = -1; day <= 0; day++) {
+            if (!(sched.daysOfWeek & DAY_BIT((today.tm_wday + day + 7) % 7))) continue;
+            time_t start = referenceLocalTime(today.tm_year, today.tm_mon, today.tm_mday + day, sched.startMins);
+            time_t end = referenceLocalTime(today.tm_year, today.tm_mon, today.tm_mday + day + endDay, sched.endMins);
+            if (start > t || end <= t) continue;
+            
+            const Schedule *current = best >= 0 ? getSchedule(best) : NULL;
+            bool wins = !current || sched.priority > current->priority ||
+                        (sched.priority == current->priority && (start > bestStart || (start == bestStart && id > best)));
+            if (wins) {
+                best = id;
+                bestStart = start;
+            }
+        }
+    }
+    if (best < 0) return -1;
+    const Schedule &winner = *getSchedule(best);
+    return winner.startBrightness == winner.endBrightness ? winner.startBrightness : -2;
+}
+
+// ================================================================
+// WINDOW CHECKS
+// ================================================================
+
+// Schedule used by the checks; freed before the replay starts
+static int probeId = -1;
+
+static bool probeWindow(int startMins, int endMins, uint8_t days, time_t now, ScheduleEvent &event) {
+    Schedule *sched = getSchedule(probeId);
+    sched->startMins = startMins;
+    sched->endMins = endMins;
+    sched->daysOfWeek = days;
+    updateScheduleIndex(probeId);
+    return findNextWindow(probeId, now, event);
+}
+
+// Local date and minute as an instant, for dates away from DST changes
+static time_t localAt(const struct tm &date, int dayOffset, int mins) {
+    struct tm t = date;
+    t.tm_mday += dayOffset;
+    t.tm_hour = mins / 60;
+    t.tm_min = mins % 60;
+    t.tm_sec = 0;
+    t.tm_isdst = -1;
+    return mktime(&t);
+}
+
+// Overnight windows, windows ending at midnight and end-exclusive
+// windows, on the first Monday of the span with no DST change nearby
+static void checkMidnightWindows(time_t from) {
+    struct tm monday;
+    time_t t = from;
+    while (true) {
+        localtime_r(&t, &monday);
+        if (monday.tm_wday == 1 && utcOffsetAt(t - 2 * 86400) == utcOffsetAt(t + 9 * 86400)) break;
+        t += 86400;
+    }
+    const uint8_t mon = DAY_BIT(1);
+    ScheduleEvent ev;
+    
+    // Monday 22:00-02:00 is still open at 01:00 on Tuesday
+    time_t now = localAt(monday, 1, 60);
+    EXPECT(probeWindow(22 * 60, 2 * 60, mon, now, ev));
+    EXPECT(ev.windowStart == localAt(monday, 0, 22 * 60) && ev.windowEnd == localAt(monday, 1, 120));
+    EXPECT(ev.when == now);
+    
+    // ...and closed at 02:00: next Monday
+    now = localAt(monday, 1, 120);
+    EXPECT(probeWindow(22 * 60, 2 * 60, mon, now, ev));
+    EXPECT(ev.windowStart == localAt(monday, 7, 22 * 60));
+    
+    // Sunday's overnight window is found from Monday
+    now = localAt(monday, 0, 60);
+    EXPECT(probeWindow(22 * 60, 2 * 60, DAY_BIT(0), now, ev));
+    EXPECT(ev.windowStart == localAt(monday, -1, 22 * 60) && ev.when == now);
+    
+    // Daily overnight window at 23:30: tonight's, not last night's
+    now = localAt(monday, 0, 23 * 60 + 30);
+    EXPECT(probeWindow(22 * 60, 2 * 60, DAYS_ALL, now, ev));
+    EXPECT(ev.windowStart == localAt(monday, 0, 22 * 60));
+    
+    // 23:00-00:00 ends at the next midnight
+    now = localAt(monday, 0, 12 * 60);
+    EXPECT(probeWindow(23 * 60, 0, mon, now, ev));
+    EXPECT(ev.windowStart == localAt(monday, 0, 23 * 60) && ev.windowEnd == localAt(monday, 1, 0));
+    EXPECT(ev.windowEnd - ev.windowStart == 3600);
+    
+    // The end minute itself is outside the window
+    now = localAt(monday, 0, 9 * 60);
+    EXPECT(probeWindow(8 * 60, 9 * 60, mon, now, ev));
+    EXPECT(ev.windowStart == localAt(monday, 7, 8 * 60) && ev.when == ev.windowStart);
+}
+
+// Windows around one DST change at instant change, where the offset
+// moves by shift seconds
+static void checkDstWindows(time_t change, long shift) {
+    struct tm after;
+    localtime_r(&change, &after);
+    int afterMins = after.tm_hour * 60 + after.tm_min;
+    int beforeMins = afterMins - (int)(shift / 60);
+    int shiftMins = (int)(shift > 0 ? shift : -shift) / 60;
+    const uint8_t today = DAY_BIT(after.tm_wday);
+    const uint8_t yesterday = DAY_BIT((after.tm_wday + 6) % 7);
+    ScheduleEvent ev;
+    
+    char text[64];
+    formatLocal(change, text, sizeof(text));
+    printf("  DST change at %s, %+ld min\n", text, shift / 60);
+    
+    if (beforeMins < 60 || afterMins < 60 || beforeMins > 22 * 60 || afterMins > 22 * 60) {
+        printf("  (change too close to midnight for the hour checks, skipped)\n");
+        return;
+    }
+    
+    if (shift > 0) {
+        // Window starting in the skipped hour runs from the jump to its end
+        EXPECT(probeWindow(beforeMins + shiftMins / 2, afterMins + 30, today, change - 6 * 3600, ev));
+        EXPECT(ev.windowStart == change && ev.windowEnd == change + 30 * 60);
+        
+        // Window entirely inside the skipped hour does not run that day
+        EXPECT(probeWindow(beforeMins + shiftMins / 4, beforeMins + 3 * shiftMins / 4, today,
+                           change - 6 * 3600, ev));
+        EXPECT(ev.windowStart >= change + 6 * 86400 && ev.windowEnd > ev.windowStart);
+    } else {
+        // Window starting in the repeated hour runs once, an hour (or an
+        // hour plus the repeat) long
+        EXPECT(probeWindow(afterMins + shiftMins / 2, afterMins + shiftMins / 2 + 60, today,
+                           change - 6 * 3600, ev));
+        EXPECT(ev.windowStart >= change - shiftMins * 60 && ev.windowStart < change + shiftMins * 60);
+        long duration = ev.windowEnd - ev.windowStart;
+        EXPECT(duration == 3600 || duration == 3600 + shiftMins * 60);
+    }
+    
+    // 22:00-06:00 the night of the change is eight wall-clock hours
+    if (afterMins < 6 * 60 && beforeMins < 6 * 60) {
+        EXPECT(probeWindow(22 * 60, 6 * 60, yesterday, change - 12 * 3600, ev));
+        EXPECT(ev.windowStart < change && ev.windowEnd > change);
+        EXPECT(ev.windowEnd - ev.windowStart == 8 * 3600 - shift);
+    }
+}
+
+// Every DST change in [from, to): returns how many were checked
+static int checkDstChanges(time_t from, time_t to) {
+    int changes = 0;
+    for (time_t t = from; t + 3600 <= to; t += 3600) {
+        long before = utcOffsetAt(t);
+        if (utcOffsetAt(t + 3600) == before) continue;
+        
+        // First second on the new offset
+        time_t low = t;
+        time_t high = t + 3600;
+        while (high - low > 1) {
+            time_t mid = low + (high - low) / 2;
+            if (utcOffsetAt(mid) == before) low = mid; else high = mid;
+        }
+        checkDstWindows(high, utcOffsetAt(high) - before);
+        changes++;
+    }
+    return changes;
+}
+
+static void runWindowChecks(time_t from, time_t to) {
+    probeId = addSchedule(0, 0, 60, DAYS_ALL, 100, 100, 0);
+    
+    printf("Window checks:\n");
+    checkMidnightWindows(from);
+    int changes = checkDstChanges(from, to);
+    if (!changes) printf("  no DST change in the simulated span\n");
+    
+    freeSchedule(probeId);
+    probeId = -1;
+}
+
+// ================================================================
+// REPLAY
+// ================================================================
+
+enum ChangeCause { CAUSE_SCHEDULE, CAUSE_SCENE, CAUSE_FADE };
+static const char *CAUSE_NAMES[] = {"schedule", "scene", "fade"};
+
+struct DeviceTrack {
+    bool state;
+    int brightness;
+    bool sceneHeld;         // Last changed by the scene, not a window
+    uint32_t changes;
+    uint64_t onSeconds;
+};
+
+static DeviceTrack tracks[CHANNEL_COUNT];
+static FILE *timeline = NULL;
+
+static int commandedLevel(int deviceId) {
+    return devices[deviceId].state ? devices[deviceId].brightness : 0;
+}
+
+// Log every device whose commanded state changed since the last call
+static void recordChanges(time_t now, ChangeCause cause) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        DeviceTrack &track = tracks[i];
+        if (devices[i].state == track.state && devices[i].brightness == track.brightness) continue;
+        track.state = devices[i].state;
+        track.brightness = devices[i].brightness;
+        track.changes++;
+        if (cause == CAUSE_SCENE) track.sceneHeld = true;
+        if (cause == CAUSE_SCHEDULE) track.sceneHeld = false;
+        
+        if (timeline) {
+            char text[64];
+            formatLocal(now, text, sizeof(text));
+            fprintf(timeline, "%lld,%s,%d,%d,%d,%s\n", (long long)now, text, i,
+                    track.state, track.brightness, CAUSE_NAMES[cause]);
+        }
+    }
+}
+
+// Next weekday 09:00 after now
+static time_t nextSceneTime(time_t now) {
+    struct tm local;
+    localtime_r(&now, &local);
+    for (int day = 0; day <= 7; day++) {
+        time_t when = localAt(local, day, 9 * 60);
+        struct tm at;
+        localtime_r(&when, &at);
+        if (when > now && at.tm_wday >= 1 && at.tm_wday <= 5) return when;
+    }
+    return now + 86400;
+}
+
+static time_t nextMidnight(time_t now) {
+    struct tm local;
+    localtime_r(&now, &local);
+    return localAt(local, 1, 0);
+}
+
+struct ReplayResult {
+    uint64_t steps;
+    uint64_t busySteps;        // Passes that ran at least one transition
+    double idleNs;
+    double busyNs;
+    double maxNs;
+    std::vector<uint32_t> transitionsPerDay;
+    std::vector<bool> dstDay;
+    uint32_t checked;
+    uint32_t mismatches;
+    uint32_t scenes;
+};
+
+static void replay(time_t start, int days, uint32_t stepSeconds, long ntpStep, int sceneId, bool check,
+                   ReplayResult &result) {
+    simEpoch = start;
+    time_t end = start + (time_t)days * 86400;
+    time_t ntpAt = start + (end - start) / 2;
+    time_t sceneAt = nextSceneTime(start);
+    time_t dayEnd = nextMidnight(start);
+    time_t checkAt = start - start % 60 + 90;   // 30 s past each minute
+    uint32_t dayStartTransitions = 0;
+    long dayStartOffset = utcOffsetAt(start);
+    
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        tracks[i] = {};
+        tracks[i].state = devices[i].state;
+        tracks[i].brightness = devices[i].brightness;
+    }
+    
+    while (hostWallClock() < end) {
+        hostAdvanceTo(micros() + (uint64_t)stepSeconds * 1000000);
+        if (ntpStep && hostWallClock() >= ntpAt) {
+            simEpoch += ntpStep;
+            ntpStep = 0;
+            checkAt = hostWallClock() - hostWallClock() % 60 + 90;
+        }
+        time_t now = hostWallClock();
+        
+        for (int i = 0; i < CHANNEL_COUNT; i++) {
+            if (tracks[i].state) tracks[i].onSeconds += stepSeconds;
+        }
+        
+        if (sceneId >= 0 && now >= sceneAt) {
+            activateScene(sceneId);
+            recordChanges(now, CAUSE_SCENE);
+            sceneAt = nextSceneTime(now);
+            result.scenes++;
+        }
+        
+        uint32_t transitionsBefore = getScheduleStats().transitions;
+        auto t0 = std::chrono::steady_clock::now();
+        processSchedules();
+        auto t1 = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+        
+        result.steps++;
+        if (getScheduleStats().transitions != transitionsBefore) {
+            result.busySteps++;
+            result.busyNs += ns;
+        } else {
+            result.idleNs += ns;
+        }
+        if (ns > result.maxNs) result.maxNs = ns;
+        recordChanges(now, CAUSE_SCHEDULE);
+        
+        processFadeTransitions();
+        recordChanges(now, CAUSE_FADE);
+        
+        if (now >= dayEnd) {
+            uint32_t transitions = getScheduleStats().transitions;
+            result.transitionsPerDay.push_back(transitions - dayStartTransitions);
+            result.dstDay.push_back(utcOffsetAt(dayEnd) != dayStartOffset);
+            dayStartTransitions = transitions;
+            dayStartOffset = utcOffsetAt(dayEnd);
+            dayEnd = nextMidnight(now);
+        }
+        
+        if (check && now >= checkAt) {
+            checkAt += 60;
+            for (int i = 0; i < CHANNEL_COUNT; i++) {
+                int expected = referenceLevel(i, now);
+                if (expected < 0 || tracks[i].sceneHeld) continue;
+                result.checked++;
+                if (commandedLevel(i) == expected) continue;
+                if (result.mismatches++ < 10) {
+                    char text[64];
+                    formatLocal(now, text, sizeof(text));
+                    printf("  MISMATCH %s device %d: %d%%, schedules call for %d%%\n",
+                           text, i, commandedLevel(i), expected);
+                }
+            }
+        }
+    }
+}
+
+// ================================================================
+// REPORT
+// ================================================================
+
+// Mean time per findNextWindow() over random schedules and instants
+static double benchmarkFindNextWindow(time_t from, time_t to, int calls) {
+    std::vector<int> ids;
+    for (int id = nextScheduleId(0); id >= 0; id = nextScheduleId(id + 1)) ids.push_back(id);
+    if (ids.empty()) return 0;
+    
+    std::vector<time_t> instants(calls);
+    for (int i = 0; i < calls; i++) instants[i] = from + simRandom() % (uint64_t)(to - from);
+    
+    ScheduleEvent event;
+    uint32_t found = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < calls; i++) {
+        found += findNextWindow(ids[i % ids.size()], instants[i], event);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    if (found == 0) printf("(no windows found)\n");
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / calls;
+}
+
+// Mean time of a full queue rebuild (clock set or stepped)
+static double benchmarkRebuild(time_t now, int rounds) {
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) rebuildScheduleQueue(now + i * 600);
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::micro>(t1 - t0).count() / rounds;
+}
+
+static void printReport(const ReplayResult &r, int days, double wallSeconds, time_t end) {
+    const ScheduleStats &stats = getScheduleStats();
+    
+    printf("\nSimulated %d days in %.2f s wall (%.0fx real time), TZ=%s\n",
+           days, wallSeconds, wallSeconds > 0 ? days * 86400.0 / wallSeconds : 0.0, getenv("TZ"));
+    printf("Schedules: %d, scene activations: %u, queue rebuilds: %u, pending at end: %u\n",
+           scheduleCount(), r.scenes, (unsigned)stats.rebuilds, (unsigned)stats.pending);
+    
+    printf("\nprocessSchedules(): %llu passes, %llu with transitions\n",
+           (unsigned long long)r.steps, (unsigned long long)r.busySteps);
+    printf("  idle pass %.0f ns, pass with transitions %.0f ns, max %.1f us\n",
+           r.steps > r.busySteps ? r.idleNs / (r.steps - r.busySteps) : 0.0,
+           r.busySteps ? r.busyNs / r.busySteps : 0.0, r.maxNs / 1000);
+    printf("findNextWindow(): %.0f ns per call, queue rebuild %.1f us\n",
+           benchmarkFindNextWindow(end - days * 86400L, end, 200000), benchmarkRebuild(end, 100));
+    
+    uint32_t minDay = UINT32_MAX, maxDay = 0;
+    uint64_t total = 0;
+    for (size_t d = 0; d < r.transitionsPerDay.size(); d++) {
+        uint32_t count = r.transitionsPerDay[d];
+        total += count;
+        if (count < minDay) minDay = count;
+        if (count > maxDay) maxDay = count;
+    }
+    size_t fullDays = r.transitionsPerDay.size();
+    printf("\nTransitions: %u total, per day mean %.1f, min %u, max %u\n",
+           (unsigned)stats.transitions, fullDays ? (double)total / fullDays : 0.0,
+           fullDays ? minDay : 0, maxDay);
+    for (size_t d = 0; d < fullDays; d++) {
+        if (r.dstDay[d]) printf("  DST change day %zu: %u transitions\n", d + 1, r.transitionsPerDay[d]);
+    }
+    
+    printf("\ndev  changes  per day  hours on  level\n");
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        const DeviceTrack &track = tracks[i];
+        printf("%-4d %7u  %7.1f  %8.0f  %4d%%\n", i, track.changes, (double)track.changes / days,
+               track.onSeconds / 3600.0, commandedLevel(i));
+    }
+}
+
+// ================================================================
+// MAIN
+// ================================================================
+
+int main(int argc, char **argv) {
+    int days = 365;
+    const char *startDate = "2026-01-01";
+    const char *tz = "CET-1CEST,M3.5.0,M10.5.0/3";
+    uint32_t stepSeconds = 1;
+    int extra = 0;
+    long ntpStep = 90;
+    const char *timelinePath = NULL;
+    bool check = false;
+    
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        
+        if (!strcmp(arg, "--check")) { check = true; continue; }
+        if (!value) {
+            fprintf(stderr, "Missing value for %s\n", arg);
+            return 2;
+        }
+        i++;
+        
+        if (!strcmp(arg, "--days")) days = atoi(value);
+        else if (!strcmp(arg, "--start")) startDate = value;
+        else if (!strcmp(arg, "--tz")) tz = value;
+        else if (!strcmp(arg, "--step")) stepSeconds = atoi(value);
+        else if (!strcmp(arg, "--extra")) extra = atoi(value);
+        else if (!strcmp(arg, "--seed")) simRandomState = strtoull(value, NULL, 0);
+        else if (!strcmp(arg, "--ntp-step")) ntpStep = atol(value);
+        else if (!strcmp(arg, "--timeline")) timelinePath = value;
+        else {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return 2;
+        }
+    }
+    
+    struct tm startTm = {};
+    if (sscanf(startDate, "%d-%d-%d", &startTm.tm_year, &startTm.tm_mon, &startTm.tm_mday) != 3 ||
+        days < 1 || stepSeconds < 1 || stepSeconds > 60) {
+        fprintf(stderr, "Bad --start, --days or --step\n");
+        return 2;
+    }
+    setenv("TZ", tz, 1);
+    tzset();
+    startTm.tm_year -= 1900;
+    startTm.tm_mon -= 1;
+    startTm.tm_isdst = -1;
+    time_t start = mktime(&startTm);
+    time_t end = start + (time_t)days * 86400;
+    
+    hostLogLevel = LOG_NONE;
+    hostInitCore();
+    initScheduleStore();
+    
+    if (check) runWindowChecks(start, end);
+    
+    addBuiltInSchedules();
+    addRandomSchedules(extra);
+    int sceneId = addMorningScene();
+    
+    if (timelinePath) {
+        timeline = fopen(timelinePath, "w");
+        if (!timeline) {
+            perror(timelinePath);
+            return 2;
+        }
+        fprintf(timeline, "utc,local,device,state,brightness,cause\n");
+    }
+    
+    resetScheduleStats();
+    ReplayResult result = {};
+    auto wallStart = std::chrono::steady_clock::now();
+    replay(start, days, stepSeconds, ntpStep, sceneId, check, result);
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    
+    if (timeline) fclose(timeline);
+    printReport(result, days, wallSeconds, end);
+    
+    if (check) {
+        printf("\nReference check: %u device-minutes compared, %u mismatches\n", result.checked, result.mismatches);
+        EXPECT(result.mismatches == 0);
+        EXPECT(result.checked > 0);
+        printf("Check: %s\n", failures ? "FAIL" : "PASS");
+        return failures ? 1 : 0;
+    }
+    return 0;
+}
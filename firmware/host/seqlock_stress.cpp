@@ -0,0 +1,153 @@
+/**
+ * Seqlock Stress Test
+ * One thread publishes patterned device state through
+ * publishOutputSnapshot() as fast as it can while another picks it up
+ * with refreshIsrSnapshot(), the way the zero-cross ISR does, and checks
+ * every accepted snapshot is internally consistent
+ *
+ * Usage: seqlock_stress [million publishes, default 2] [--unguarded]
+ *
+ * Each publish derives every channel from one pattern number, carried in
+ * channel 0's fireTick, so a snapshot mixing two publishes does not match
+ * the snapshot rebuilt from that number. --unguarded copies the shared
+ * snapshot without the sequence check, to show the checker sees tearing.
+ */
+
+#include "host_core.h"
+
+#include <thread>
+
+#define PATTERN_COUNT PHASE_STEPS
+
+// ================================================================
+// PATTERN
+// ================================================================
+
+// Device state for one pattern number (caller holds deviceMutex)
+static void writePattern(uint32_t pattern) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        devices[i].state = (pattern + i) % 3 != 0;
+        devices[i].type = (DeviceType)((pattern + i) % 4);
+        devices[i].fireTick = (pattern + i * 1000) % PHASE_STEPS;
+        devices[i].brightness = (pattern + i) % 101;
+    }
+}
+
+// The snapshot publishOutputSnapshot() builds from that state
+static void expectedSnapshot(uint32_t pattern, OutputSnapshot &snapshot) {
+    snapshot = {};
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        ChannelSnapshot &ch = snapshot.channels[i];
+        ch.state = (pattern + i) % 3 != 0;
+        ch.type = (pattern + i) % 4;
+        ch.fireTick = (pattern + i * 1000) % PHASE_STEPS;
+        ch.burstDuty = ((pattern + i) % 101) * (BRIGHTNESS_LEVELS / 100);
+    }
+    buildOutputMasks(snapshot);
+    buildFiringTimeline(snapshot);
+}
+
+static bool snapshotsMatch(const OutputSnapshot &a, const OutputSnapshot &b) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        const ChannelSnapshot &x = a.channels[i];
+        const ChannelSnapshot &y = b.channels[i];
+        if (x.state != y.state || x.type != y.type || x.fireTick != y.fireTick || x.burstDuty != y.burstDuty) return false;
+        if (a.channelGpioMask[i] != b.channelGpioMask[i]) return false;
+    }
+    if (a.zeroCrossSetMask != b.zeroCrossSetMask || a.zeroCrossClearMask != b.zeroCrossClearMask) return false;
+    if (a.phaseChannels != b.phaseChannels || a.burstChannels != b.burstChannels) return false;
+    if (a.burstGpioMask != b.burstGpioMask || a.releaseGpioMask != b.releaseGpioMask) return false;
+    if (a.rampChannels != b.rampChannels) return false;
+    
+    if (a.timeline.count != b.timeline.count) return false;
+    for (int e = 0; e < a.timeline.count; e++) {
+        const FiringEvent &x = a.timeline.events[e];
+        const FiringEvent &y = b.timeline.events[e];
+        if (x.tick != y.tick || x.mask != y.mask || x.gpioMask != y.gpioMask) return false;
+    }
+    return true;
+}
+
+// ================================================================
+// MAIN
+// ================================================================
+
+int main(int argc, char **argv) {
+    uint64_t publishes = 2000000;
+    bool unguarded = false;
+    
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--unguarded")) {
+            unguarded = true;
+        } else {
+            publishes = (uint64_t)(atof(argv[i]) * 1000000);
+        }
+    }
+    
+    // Every snapshot the reader can see, including the first, is a pattern
+    hostInitCore();
+    xSemaphoreTake(deviceMutex, portMAX_DELAY);
+    writePattern(0);
+    xSemaphoreGive(deviceMutex);
+    publishOutputSnapshot();
+    
+    std::atomic<bool> done(false);
+    auto wallStart = std::chrono::steady_clock::now();
+    
+    // Core 0: publish pattern after pattern
+    std::thread writer([&]() {
+        for (uint64_t n = 0; n < publishes; n++) {
+            xSemaphoreTake(deviceMutex, portMAX_DELAY);
+            writePattern(n % PATTERN_COUNT);
+            xSemaphoreGive(deviceMutex);
+            publishOutputSnapshot();
+            
+            // On a single-core host this is where the reader gets to run
+            std::this_thread::yield();
+        }
+        done.store(true, std::memory_order_release);
+    });
+    
+    // Core 1: refresh like the zero-cross ISR and check what it latched,
+    // until the writer has finished
+    uint64_t reads = 0;
+    uint64_t accepted = 0;
+    uint64_t torn = 0;
+    uint64_t seqErrors = 0;
+    uint32_t lastSeq = isrSnapshotSeq;
+    OutputSnapshot expected;
+    
+    while (!done.load(std::memory_order_acquire)) {
+        reads++;
+        if (unguarded) {
+            isrSnapshot = sharedSnapshot;
+            isrSnapshotSeq++;
+        } else {
+            refreshIsrSnapshot();
+        }
+        if (isrSnapshotSeq != lastSeq) {
+            // Published sequence numbers are even and only move forward
+            if (!unguarded && ((isrSnapshotSeq & 1) || isrSnapshotSeq < lastSeq)) seqErrors++;
+            lastSeq = isrSnapshotSeq;
+            accepted++;
+            
+            expectedSnapshot(isrSnapshot.channels[0].fireTick, expected);
+            if (!snapshotsMatch(isrSnapshot, expected)) torn++;
+        }
+        
+        // Let the writer run (the only way it does on a single-core host)
+        std::this_thread::yield();
+    }
+    writer.join();
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    
+    printf("%s: %llu publishes, %llu reads, %llu snapshots checked in %.2f s\n",
+           unguarded ? "Unguarded copy" : "Seqlock", (unsigned long long)publishes, (unsigned long long)reads,
+           (unsigned long long)accepted, wallSeconds);
+    printf("Torn snapshots: %llu, sequence errors: %llu\n", (unsigned long long)torn, (unsigned long long)seqErrors);
+    
+    // A reader that never saw a new snapshot has not tested anything
+    bool ok = torn == 0 && seqErrors == 0 && accepted > 1000;
+    printf("%s\n", ok ? "PASS" : "FAIL");
+    return ok ? 0 : 1;
+}
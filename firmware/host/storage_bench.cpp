@@ -0,0 +1,662 @@
+/**
+ * Storage Benchmark
+ * Runs the configuration store (storage_impl.h) unchanged against the
+ * NVS flash model (nvs_sim.h) and reports what it costs in flash time,
+ * bytes programmed and sector wear
+ *
+ * Usage: storage_bench [--days N] [--seed N] [--pages N] [--schedules N]
+ *                      [--scenes N] [--edits-per-day X] [--reboot-days N]
+ *                      [--erase-ms X] [--program-us X] [--program-byte-us X]
+ *                      [--endurance N] [--min-years X] [--image FILE] [--check]
+ *
+ * 1. Migration: boots on the per-key layout of the oldest firmware and
+ *    checks what loadDeviceConfig(), loadSchedules() and loadScenes()
+ *    restore, that the old keys are gone, that a second boot writes
+ *    nothing and that a section failing its check is discarded.
+ * 2. Usage: a household configuration (--schedules, --scenes) edited
+ *    for --days in bursts of clicks through markConfigDirty() and
+ *    processConfigFlush(), the way the API and cloud sync do. Per day,
+ *    on average --edits-per-day bursts: half on schedules, a quarter on
+ *    scenes, a quarter on device settings. Every --reboot-days the
+ *    device restarts (flushConfig(), remount, reload, compare) and every
+ *    30 days an OTA update flushes the device section.
+ * 3. Sections: saveSection()/loadSection() at fixed sizes on an empty
+ *    partition.
+ *
+ * The default partition is the 5 pages (0x5000) of partitions.csv.
+ * Lifetime is projected from the most-erased sector during the usage
+ * phase at --endurance erase cycles (NOR flash is rated for 100,000).
+ * --image starts the usage phase from a saved partition (if the file
+ * exists) and saves it afterwards, so wear accumulates across runs.
+ * --check fails on a wrong migration, a reboot that does not restore the
+ * configuration, a failed write, a flash program that sets a bit, or a
+ * projected lifetime under --min-years.
+ */
+
+#include "host_core.h"
+#include "journal.h"
+#include "schedule_store_impl.h"
+#include "scene_store_impl.h"
+#include "storage_impl.h"
+#include "journal_impl.h"
+
+#include <vector>
+
+String systemName = "Smart_Home_Hub";
+Preferences preferences;
+
+static int failures = 0;
+
+#define EXPECT(cond) do { \
+    if (!(cond)) { \
+        printf("  FAIL line %d: %s\n", __LINE__, #cond); \
+        failures++; \
+    } \
+} while (0)
+
+static uint64_t benchRandomState = 1;
+
+// splitmix64, so a seed gives the same edits everywhere
+static uint64_t benchRandom() {
+    uint64_t z = (benchRandomState += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static double benchUniform() {
+    return (benchRandom() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Knuth's method; rates here are a few per day
+static int benchPoisson(double mean) {
+    double limit = exp(-mean);
+    double product = benchUniform();
+    int count = 0;
+    while (product > limit) {
+        product *= benchUniform();
+        count++;
+    }
+    return count;
+}
+
+// ================================================================
+// CONFIGURATION STATE
+// ================================================================
+
+// Everything the store persists, in a comparable form (live device
+// state and brightness come from the journal and power-on behavior)
+static std::string configSnapshot() {
+    char line[160];
+    std::string out = std::string("system ") + systemName.c_str() + "\n";
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        snprintf(line, sizeof(line), "device %d %s type %d lock %d pon %d def %d auto %d runtime %lu\n", i,
+                 devices[i].name.c_str(), (int)devices[i].type, devices[i].childLock,
+                 (int)devices[i].powerOnBehavior, devices[i].defaultBrightness, devices[i].autoOffEnabled,
+                 devices[i].totalRuntime);
+        out += line;
+    }
+    for (int id = nextScheduleId(0); id >= 0; id = nextScheduleId(id + 1)) {
+        const Schedule *sched = getSchedule(id);
+        snprintf(line, sizeof(line), "schedule %d dev %d %u-%u days %02x br %d-%d act %u prio %u\n", id,
+                 sched->deviceId, (unsigned)sched->startMins, (unsigned)sched->endMins,
+                 (unsigned)sched->daysOfWeek, sched->startBrightness, sched->endBrightness,
+                 (unsigned)sched->active, sched->priority);
+        out += line;
+    }
+    for (int i = 0; i < SCENE_MAX_COUNT; i++) {
+        const Scene *scene = getScene(i);
+        if (!scene) continue;
+        out += "scene " + std::to_string(i) + " " + scene->name + "\n";
+        const SceneEntry *entries = getSceneEntries(*scene);
+        for (int e = 0; e < scene->entryCount; e++) {
+            snprintf(line, sizeof(line), "  dev %d st %u br %d fade %u curve %u\n", entries[e].deviceId,
+                     (unsigned)entries[e].state, entries[e].brightness, (unsigned)entries[e].fadeMs,
+                     (unsigned)entries[e].curve);
+            out += line;
+        }
+    }
+    return out;
+}
+
+// What a cold boot starts from before the load functions run
+static void clearRamConfig() {
+    for (int id = nextScheduleId(0); id >= 0; id = nextScheduleId(id + 1)) {
+        freeSchedule(id);
+    }
+    for (int i = 0; i < SCENE_MAX_COUNT; i++) {
+        deleteScene(i);
+    }
+    systemName = "";
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        devices[i] = Device();
+    }
+}
+
+static void loadAll() {
+    loadDeviceConfig();
+    loadSchedules();
+    loadScenes();
+}
+
+static int addSchedule(int deviceId, int startMins, int endMins, uint8_t days, int startBrightness,
+                       int endBrightness) {
+    int id = allocateSchedule();
+    if (id < 0) return -1;
+    Schedule *sched = getSchedule(id);
+    sched->deviceId = deviceId;
+    sched->startMins = startMins;
+    sched->endMins = endMins;
+    sched->daysOfWeek = days;
+    sched->startBrightness = startBrightness;
+    sched->endBrightness = endBrightness;
+    sched->priority = 0;
+    sched->active = 1;
+    updateScheduleIndex(id);
+    return id;
+}
+
+static void addRandomSchedule() {
+    int startMins = benchRandom() % 1440;
+    int level = benchRandom() % 101;
+    addSchedule(benchRandom() % CHANNEL_COUNT, startMins, (startMins + 15 + benchRandom() % 226) % 1440,
+                benchRandom() % 127 + 1, level, level);
+}
+
+static bool setRandomScene(int sceneId, const char *name) {
+    SceneEntry entries[CHANNEL_COUNT] = {};
+    int count = 1 + benchRandom() % CHANNEL_COUNT;
+    for (int e = 0; e < count; e++) {
+        entries[e].deviceId = e;
+        entries[e].state = benchRandom() % 2;
+        entries[e].brightness = benchRandom() % 101;
+        entries[e].fadeMs = (benchRandom() % 5) * 500;
+        entries[e].curve = FADE_LINEAR;
+    }
+    return setScene(sceneId, name, entries, count);
+}
+
+static int schedulesInUse() {
+    int count = 0;
+    for (int id = nextScheduleId(0); id >= 0; id = nextScheduleId(id + 1)) count++;
+    return count;
+}
+
+// ================================================================
+// MIGRATION
+// ================================================================
+
+// Per-key layout: system name, device fields, 10 schedule and 10 scene slots
+static void seedLegacyKeys() {
+    preferences.begin(PREF_NAMESPACE, false);
+    preferences.putString(PREF_SYSTEM_NAME, "Cottage");
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        String prefix = PREF_DEVICE_PREFIX + String(i) + "_";
+        preferences.putInt((prefix + "type").c_str(), i % 4);
+        preferences.putString((prefix + "name").c_str(), "Old " + String(i));
+        preferences.putBool((prefix + "lock").c_str(), i == 1);
+        preferences.putInt((prefix + "pon").c_str(), i % 4);
+        preferences.putInt((prefix + "def_br").c_str(), 40 + i * 10);
+        preferences.putBool((prefix + "auto").c_str(), i != 2);
+        preferences.putULong((prefix + "runtime").c_str(), 3600UL * (i + 1));
+        preferences.putBool((prefix + "last_st").c_str(), true);
+        preferences.putInt((prefix + "last_br").c_str(), 70);
+    }
+    
+    // Slot 3 ends before it starts (kept, inactive), slot 4 names no device
+    for (int i = 0; i < 6; i++) {
+        String prefix = PREF_SCHEDULE_PREFIX + String(i) + "_";
+        preferences.putChar((prefix + "dev").c_str(), i == 4 ? 9 : i % CHANNEL_COUNT);
+        preferences.putShort((prefix + "start").c_str(), i == 3 ? 1200 : 60 * (i + 6));
+        preferences.putShort((prefix + "end").c_str(), i == 3 ? 600 : (i == 5 ? 1440 : 60 * (i + 7)));
+        preferences.putChar((prefix + "sbr").c_str(), 10 * i);
+        preferences.putChar((prefix + "ebr").c_str(), 100 - 10 * i);
+        preferences.putBool((prefix + "act").c_str(), true);
+        preferences.putUChar((prefix + "days").c_str(), 0x3E);
+    }
+    
+    // Scene 2 is inactive and is not carried over
+    const char *names[] = {"Evening", "Movie", "Away"};
+    for (int i = 0; i < 3; i++) {
+        String prefix = PREF_SCENE_PREFIX + String(i) + "_";
+        preferences.putString((prefix + "name").c_str(), names[i]);
+        preferences.putBool((prefix + "act").c_str(), i != 2);
+        for (int j = 0; j <= i + 1 && j < CHANNEL_COUNT; j++) {
+            String devPrefix = prefix + "d" + String(j) + "_";
+            preferences.putChar((devPrefix + "id").c_str(), j);
+            preferences.putBool((devPrefix + "st").c_str(), j % 2 == 0);
+            preferences.putChar((devPrefix + "br").c_str(), 25 * j);
+        }
+    }
+    preferences.end();
+}
+
+static void checkLegacyMigration() {
+    EXPECT(systemName == "Cottage");
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        EXPECT(devices[i].name == "Old " + String(i));
+        EXPECT(devices[i].type == (DeviceType)(i % 4));
+        EXPECT(devices[i].childLock == (i == 1));
+        EXPECT(devices[i].powerOnBehavior == (PowerOnState)(i % 4));
+        EXPECT(devices[i].defaultBrightness == 40 + i * 10);
+        EXPECT(devices[i].autoOffEnabled == (i != 2));
+        EXPECT(devices[i].totalRuntime == 3600UL * (i + 1));
+    }
+    
+    EXPECT(schedulesInUse() == 5);
+    for (int i = 0; i < 6; i++) {
+        const Schedule *sched = getSchedule(i);
+        if (i == 4) {
+            EXPECT(sched == NULL || sched->deviceId < 0);
+            continue;
+        }
+        EXPECT(sched && sched->deviceId == i % CHANNEL_COUNT);
+        if (!sched) continue;
+        EXPECT(sched->startMins == (unsigned)(i == 3 ? 1200 : 60 * (i + 6)));
+        EXPECT(sched->endMins == (unsigned)(i == 3 ? 600 : (i == 5 ? 0 : 60 * (i + 7))));
+        EXPECT(sched->active == (i != 3));
+        EXPECT(sched->daysOfWeek == 0x3E && sched->startBrightness == 10 * i);
+    }
+    
+    EXPECT(sceneCount() == 2 && findSceneByName("Away") < 0);
+    int movie = findSceneByName("Movie");
+    EXPECT(movie >= 0);
+    if (movie >= 0) {
+        const Scene *scene = getScene(movie);
+        const SceneEntry *entries = getSceneEntries(*scene);
+        EXPECT(scene->entryCount == 3);
+        EXPECT(entries[2].deviceId == 2 && entries[2].brightness == 50 && entries[2].fadeMs == FADE_DURATION_MS);
+    }
+    
+    // Only the namespace and the three sections are left
+    EXPECT(nvsSim.items.size() == 1 + 3 + 3);
+    preferences.begin(PREF_NAMESPACE, true);
+    EXPECT(!preferences.isKey(PREF_SYSTEM_NAME) && !preferences.isKey("dev_0_runtime"));
+    EXPECT(!preferences.isKey("sched_0_dev") && !preferences.isKey("scene_1_d2_br"));
+    preferences.end();
+}
+
+static void runMigrations(int pages) {
+    printf("Migration\n");
+    
+    nvsSimInit(pages);
+    seedLegacyKeys();
+    size_t legacyEntries, total;
+    hostStorageUsage(legacyEntries, total);
+    NvsFlashStats before = nvsSim.stats;
+    uint64_t startUs = micros();
+    
+    clearRamConfig();
+    loadAll();
+    uint64_t bootUs = micros() - startUs;
+    size_t entries;
+    hostStorageUsage(entries, total);
+    checkLegacyMigration();
+    printf("  Per-key layout:  %3u -> %3u entries, boot %7.1f ms, %6llu bytes programmed, %llu erases\n",
+           (unsigned)legacyEntries, (unsigned)entries, bootUs / 1000.0,
+           (unsigned long long)(nvsSim.stats.bytesProgrammed - before.bytesProgrammed),
+           (unsigned long long)(nvsSim.stats.erases - before.erases));
+    
+    // A second boot reads the sections and writes nothing
+    std::string migrated = configSnapshot();
+    before = nvsSim.stats;
+    startUs = micros();
+    clearRamConfig();
+    nvsMount();
+    loadAll();
+    EXPECT(configSnapshot() == migrated);
+    EXPECT(nvsSim.stats.bytesProgrammed == before.bytesProgrammed);
+    printf("  Second boot:     boot %7.1f ms, %6llu bytes programmed\n", (micros() - startUs) / 1000.0,
+           (unsigned long long)(nvsSim.stats.bytesProgrammed - before.bytesProgrammed));
+    
+    // A section that fails its check is discarded, not loaded
+    std::vector<uint8_t> garbage(24 * sizeof(Schedule));
+    for (uint8_t &byte : garbage) byte = benchRandom();
+    preferences.begin(PREF_NAMESPACE, false);
+    preferences.putBytes(PREF_SCHEDULE_TABLE, garbage.data(), garbage.size());
+    preferences.end();
+    clearRamConfig();
+    LogLevel logLevel = hostLogLevel;
+    hostLogLevel = LOG_NONE;
+    loadSchedules();
+    hostLogLevel = logLevel;
+    EXPECT(schedulesInUse() == 0);
+}
+
+// ================================================================
+// USAGE
+// ================================================================
+
+enum EditKind {
+    EDIT_DEVICE,
+    EDIT_SCHEDULE,
+    EDIT_SCENE
+};
+
+struct Edit {
+    uint64_t us;
+    int kind;
+};
+
+static const char *const ROOM_NAMES[] = {"Hall", "Kitchen", "Porch", "Desk", "Bedroom", "Lounge"};
+
+// One click in the app: change something and mark its section dirty
+static void applyEdit(int kind, int targetSchedules, int targetScenes) {
+    if (kind == EDIT_DEVICE) {
+        int i = benchRandom() % CHANNEL_COUNT;
+        switch (benchRandom() % 4) {
+            case 0: devices[i].name = ROOM_NAMES[benchRandom() % 6] + String(" ") + String(i); break;
+            case 1: devices[i].childLock = !devices[i].childLock; break;
+            case 2: devices[i].defaultBrightness = benchRandom() % 101; break;
+            default: devices[i].powerOnBehavior = (PowerOnState)(benchRandom() % 4); break;
+        }
+        markConfigDirty(CONFIG_DEVICES);
+    } else if (kind == EDIT_SCHEDULE) {
+        int count = schedulesInUse();
+        int roll = benchRandom() % 10;
+        if (count == 0 || (roll < 2 && count < targetSchedules * 3 / 2)) {
+            addRandomSchedule();
+        } else {
+            int pick = benchRandom() % count;
+            int id = nextScheduleId(0);
+            while (pick--) id = nextScheduleId(id + 1);
+            if (roll < 4 && count > targetSchedules / 2) {
+                freeSchedule(id);
+            } else {
+                Schedule *sched = getSchedule(id);
+                sched->startMins = (sched->startMins + 15) % 1440;
+                sched->startBrightness = sched->endBrightness = benchRandom() % 101;
+                updateScheduleIndex(id);
+            }
+        }
+        markConfigDirty(CONFIG_SCHEDULES);
+    } else {
+        int count = sceneCount();
+        int roll = benchRandom() % 10;
+        char name[SCENE_NAME_LEN];
+        if (count == 0 || (roll < 2 && count < targetScenes * 3 / 2)) {
+            int id = allocateScene();
+            snprintf(name, sizeof(name), "Scene %u", (unsigned)(benchRandom() % 10000));
+            if (id >= 0 && findSceneByName(name) < 0) setRandomScene(id, name);
+        } else {
+            int id = -1;
+            for (int pick = benchRandom() % count; pick >= 0; pick--) {
+                do id++; while (!getScene(id));
+            }
+            if (roll < 3 && count > targetScenes / 2) {
+                deleteScene(id);
+            } else {
+                strlcpy(name, getScene(id)->name, sizeof(name));
+                setRandomScene(id, name);
+            }
+        }
+        markConfigDirty(CONFIG_SCENES);
+    }
+}
+
+// Run the write-behind up to a point in time, polling only when a flush
+// can be due (the connectivity loop polls every pass)
+static void flushUntil(uint64_t us) {
+    while (getStorageStats().pending) {
+        uint64_t quietMs = lastDirtyMs + STORAGE_FLUSH_QUIET_MS;
+        uint64_t maxMs = firstDirtyMs + STORAGE_FLUSH_MAX_MS;
+        uint64_t dueUs = (quietMs < maxMs ? quietMs : maxMs) * 1000;
+        if (dueUs > us) break;
+        hostAdvanceTo(dueUs);
+        processConfigFlush();
+    }
+    hostAdvanceTo(us);
+}
+
+struct UsageResult {
+    int reboots;
+    int rebootMismatches;
+    std::vector<uint64_t> erases;   // Per sector, during the usage phase
+    uint64_t payloadBytes;
+};
+
+static UsageResult runUsage(int pages, int days, int targetSchedules, int targetScenes, double editsPerDay,
+                            int rebootDays, const char *image) {
+    UsageResult result = {};
+    
+    // First boot on a blank (or saved) partition, then the household set-up
+    if (!image || !nvsSimLoad(image, pages)) nvsSimInit(pages);
+    clearRamConfig();
+    loadAll();
+    if (schedulesInUse() == 0 && sceneCount() == 0) {
+        systemName = "Smart_Home_Hub";
+        for (int i = 0; i < CHANNEL_COUNT; i++) devices[i].name = ROOM_NAMES[i % 6] + String(" ") + String(i);
+        for (int i = 0; i < targetSchedules; i++) addRandomSchedule();
+        char name[SCENE_NAME_LEN];
+        for (int i = 0; i < targetScenes; i++) {
+            snprintf(name, sizeof(name), "Scene %d", i);
+            setRandomScene(allocateScene(), name);
+        }
+        markConfigDirty(CONFIG_ALL);
+        flushConfig();
+    }
+    
+    std::vector<uint64_t> startErases = nvsSim.eraseCounts;
+    NvsFlashStats flashBefore = nvsSim.stats;
+    for (NvsOpStats &op : nvsSim.ops) op = {};
+    resetStorageStats();
+    
+    // Half of the bursts go to schedules, a quarter each to scenes and devices
+    const double kindShare[] = {0.25, 0.5, 0.25};
+    uint64_t dayUs = 86400ULL * 1000000;
+    uint64_t dayStart = (micros() / dayUs + 1) * dayUs;
+    
+    for (int day = 0; day < days; day++, dayStart += dayUs) {
+        std::vector<Edit> edits;
+        for (int kind = EDIT_DEVICE; kind <= EDIT_SCENE; kind++) {
+            int bursts = benchPoisson(editsPerDay * kindShare[kind]);
+            for (int b = 0; b < bursts; b++) {
+                // Bursts between 07:00 and 23:00, 1-6 clicks 0.5-3 s apart
+                uint64_t us = dayStart + (7 * 3600 + benchRandom() % (16 * 3600)) * 1000000ULL;
+                int clicks = 1 + benchRandom() % 6;
+                for (int c = 0; c < clicks; c++) {
+                    edits.push_back({us, kind});
+                    us += 500000 + benchRandom() % 2500000;
+                }
+            }
+        }
+        std::sort(edits.begin(), edits.end(), [](const Edit &a, const Edit &b) { return a.us < b.us; });
+        
+        for (const Edit &edit : edits) {
+            flushUntil(edit.us);
+            applyEdit(edit.kind, targetSchedules, targetScenes);
+        }
+        flushUntil(dayStart + dayUs - 1);
+        
+        // OTA update: the update handler saves the device section before rebooting
+        bool ota = (day + 1) % 30 == 0;
+        if (ota) {
+            markConfigDirty(CONFIG_DEVICES);
+            flushConfig();
+        }
+        
+        // Restart: write pending changes, remount and load from flash
+        if (ota || (rebootDays > 0 && (day + 1) % rebootDays == 0)) {
+            flushConfig();
+            std::string before = configSnapshot();
+            clearRamConfig();
+            nvsMount();
+            loadAll();
+            result.reboots++;
+            if (configSnapshot() != before) result.rebootMismatches++;
+        }
+    }
+    flushConfig();
+    
+    result.erases.resize(pages);
+    for (int page = 0; page < pages; page++) result.erases[page] = nvsSim.eraseCounts[page] - startErases[page];
+    result.payloadBytes = getStorageStats().bytesWritten;
+    
+    NvsFlashStats flash = nvsSim.stats;
+    flash.bytesProgrammed -= flashBefore.bytesProgrammed;
+    flash.erases -= flashBefore.erases;
+    flash.collections -= flashBefore.collections;
+    flash.entriesCopied -= flashBefore.entriesCopied;
+    flash.writesSkipped -= flashBefore.writesSkipped;
+    
+    const StorageStats &stats = getStorageStats();
+    size_t used, total;
+    hostStorageUsage(used, total);
+    printf("\nUsage: %d days, %d schedules and %d scenes in use, %.1f edit bursts/day, %d reboots\n",
+           days, schedulesInUse(), sceneCount(), editsPerDay, result.reboots);
+    printf("  Write-behind:  %u section saves requested, %u folded, %u flushes\n",
+           stats.saveRequests, stats.writesAvoided, stats.flushes);
+    printf("  Section writes: %u (%u failed), %.1f/day, avg %.1f ms, max %.1f ms\n", stats.flashWrites,
+           stats.failedWrites, stats.flashWrites / (double)days,
+           stats.flashWrites ? stats.totalWriteUs / 1000.0 / stats.flashWrites : 0.0, stats.maxWriteUs / 1000.0);
+    printf("  Flash:         %llu payload bytes, %llu programmed (x%.2f), %llu skipped unchanged writes\n",
+           (unsigned long long)result.payloadBytes, (unsigned long long)flash.bytesProgrammed,
+           result.payloadBytes ? flash.bytesProgrammed / (double)result.payloadBytes : 0.0,
+           (unsigned long long)flash.writesSkipped);
+    printf("  Reclaim:       %llu pages collected, %llu entries copied, %llu sector erases\n",
+           (unsigned long long)flash.collections, (unsigned long long)flash.entriesCopied,
+           (unsigned long long)flash.erases);
+    printf("  NVS entries:   %u of %u in use\n", (unsigned)used, (unsigned)total);
+    
+    printf("  Calls:   %-8s %8s %10s %10s\n", "", "count", "avg us", "max us");
+    for (int op = 0; op < NVS_OP_COUNT; op++) {
+        const NvsOpStats &s = nvsSim.ops[op];
+        printf("           %-8s %8llu %10.1f %10u\n", nvsOpName(op), (unsigned long long)s.calls,
+               s.calls ? s.totalUs / (double)s.calls : 0.0, s.maxUs);
+    }
+    return result;
+}
+
+// ================================================================
+// SECTIONS
+// ================================================================
+
+// Rewrite one section of a given size and read it back, on a blank partition
+static void runSectionBench(int pages) {
+    const size_t sizes[] = {32, 256, 1024, 4000, 7700};
+    const int rounds = 40;
+    
+    printf("\nSections (%d rewrites each, blank %d-page partition)\n", rounds, pages);
+    printf("  %6s %10s %10s %12s %10s %8s\n", "bytes", "save us", "load us", "programmed", "erases", "failed");
+    for (size_t size : sizes) {
+        nvsSimInit(pages);
+        std::vector<uint8_t> data(size);
+        uint64_t saveUs = 0, loadUs = 0;
+        int failed = 0;
+        
+        preferences.begin(PREF_NAMESPACE, false);
+        NvsFlashStats before = nvsSim.stats;
+        for (int round = 0; round < rounds; round++) {
+            // A settings change touches a few bytes of the section
+            data[benchRandom() % size] = round;
+            SectionPart part = {data.data(), size};
+            uint64_t startUs = micros();
+            if (!saveSection("bench", 1, &part, 1)) failed++;
+            saveUs += micros() - startUs;
+            
+            uint16_t version;
+            uint8_t *payload;
+            size_t length;
+            startUs = micros();
+            if (loadSection("bench", version, payload, length) == SECTION_OK) free(payload);
+            loadUs += micros() - startUs;
+        }
+        preferences.end();
+        
+        printf("  %6u %10.1f %10.1f %12.0f %10.2f %8d\n", (unsigned)size, saveUs / (double)rounds,
+               loadUs / (double)rounds, (nvsSim.stats.bytesProgrammed - before.bytesProgrammed) / (double)rounds,
+               (nvsSim.stats.erases - before.erases) / (double)rounds, failed);
+    }
+}
+
+// ================================================================
+// MAIN
+// ================================================================
+
+int main(int argc, char **argv) {
+    int days = 365;
+    int pages = 5;
+    int targetSchedules = 24;
+    int targetScenes = 8;
+    double editsPerDay = 4;
+    int rebootDays = 7;
+    double endurance = 100000;
+    double minYears = 10;
+    const char *image = NULL;
+    bool check = false;
+    NvsLatency latency = NVS_LATENCY_DEFAULT;
+    
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!strcmp(arg, "--check")) {
+            check = true;
+        } else if (value && !strcmp(arg, "--days")) {
+            days = atoi(value); i++;
+        } else if (value && !strcmp(arg, "--seed")) {
+            benchRandomState = strtoull(value, NULL, 0); i++;
+        } else if (value && !strcmp(arg, "--pages")) {
+            pages = atoi(value); i++;
+        } else if (value && !strcmp(arg, "--schedules")) {
+            targetSchedules = atoi(value); i++;
+        } else if (value && !strcmp(arg, "--scenes")) {
+            targetScenes = atoi(value); i++;
+        } else if (value && !strcmp(arg, "--edits-per-day")) {
+            editsPerDay = atof(value); i++;
+        } else if (value && !strcmp(arg, "--reboot-days")) {
+            rebootDays = atoi(value); i++;
+        } else if (value && !strcmp(arg, "--erase-ms")) {
+            latency.eraseUs = atof(value) * 1000; i++;
+        } else if (value && !strcmp(arg, "--program-us")) {
+            latency.programUs = atof(value); i++;
+        } else if (value && !strcmp(arg, "--program-byte-us")) {
+            latency.programByteUs = atof(value); i++;
+        } else if (value && !strcmp(arg, "--endurance")) {
+            endurance = atof(value); i++;
+        } else if (value && !strcmp(arg, "--min-years")) {
+            minYears = atof(value); i++;
+        } else if (value && !strcmp(arg, "--image")) {
+            image = value; i++;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return 2;
+        }
+    }
+    if (days < 1 || pages < 2) {
+        fprintf(stderr, "Need at least 1 day and 2 pages\n");
+        return 2;
+    }
+    
+    hostInitCore();
+    initScheduleStore();
+    nvsSimInit(pages);
+    nvsSim.latency = latency;
+    printf("NVS model: %d pages, erase %.1f ms, program %.1f us + %.2f us/byte\n\n", pages,
+           latency.eraseUs / 1000, latency.programUs, latency.programByteUs);
+    
+    runMigrations(pages);
+    UsageResult usage = runUsage(pages, days, targetSchedules, targetScenes, editsPerDay, rebootDays, image);
+    if (image && !nvsSimSave(image)) printf("Could not save the partition image to %s\n", image);
+    
+    uint64_t maxErases = 0;
+    printf("  Erases:  ");
+    for (int page = 0; page < pages; page++) {
+        printf(" %llu", (unsigned long long)usage.erases[page]);
+        if (usage.erases[page] > maxErases) maxErases = usage.erases[page];
+    }
+    double years = maxErases ? endurance * days / maxErases / 365.0 : INFINITY;
+    printf(" (per sector)\n  Lifetime: %.0f years at %.0f cycles (most-erased sector)\n", years, endurance);
+    printf("  Reboots: %d, configuration not restored after %d\n", usage.reboots, usage.rebootMismatches);
+    
+    const StorageStats &stats = getStorageStats();
+    bool usageOk = usage.rebootMismatches == 0 && stats.failedWrites == 0;
+    runSectionBench(pages);
+    
+    if (!check) return 0;
+    printf("\nChecks\n");
+    EXPECT(usageOk);
+    EXPECT(nvsSim.stats.violations == 0);
+    EXPECT(years >= minYears);
+    printf("%s\n", failures ? "FAIL" : "PASS");
+    return failures ? 1 : 0;
+}
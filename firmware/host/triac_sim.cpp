@@ -0,0 +1,177 @@
+/**
+ * TRIAC Simulator
+ * Runs the phase-control core against a simulated mains supply and
+ * reports what each load actually received
+ *
+ * Usage: triac_sim [--seconds S] [--hz F] [--jitter-us N] [--dropout P]
+ *                  [--noise R] [--seed N] [--dimmer P] [--fan P]
+ *                  [--burst P] [--timeline FILE] [--check]
+ *
+ * Channels: 0 dimmer, 1 fan, 2 switch (on), 3 burst. --timeline writes
+ * every TRIAC pin transition as "time_us,gpio,level". --check exits
+ * non-zero if the PLL is not locked at the end or any channel's
+ * delivered power is off its commanded power by more than 2%.
+ */
+
+#include "host_core.h"
+#include "mains_sim.h"
+
+#include <chrono>
+
+// ================================================================
+// REPORT
+// ================================================================
+
+static const char* typeName(DeviceType type) {
+    switch (type) {
+        case TYPE_SWITCH: return "switch";
+        case TYPE_FAN: return "fan";
+        case TYPE_DIMMER: return "dimmer";
+        case TYPE_BURST: return "burst";
+    }
+    return "?";
+}
+
+// Power fraction the channel should receive from its device state
+static double commandedPower(int channel) {
+    const Device &device = devices[channel];
+    if (!device.state) return 0.0;
+    switch (device.type) {
+        case TYPE_SWITCH: return 1.0;
+        case TYPE_BURST: return constrain(device.brightness, 0, 100) / 100.0;
+        default: return conductedPower((double)device.fireTick / PHASE_STEPS);
+    }
+}
+
+// Print the run summary; returns the largest power error across channels
+static double printReport(double simSeconds, double wallSeconds) {
+    const MainsProfile &p = mainsSim.profile;
+    const IsrMetrics &m = getIsrMetrics(1);
+    
+    printf("Simulated %.1f s in %.3f s wall (%.0fx real time)\n",
+           simSeconds, wallSeconds, wallSeconds > 0 ? simSeconds / wallSeconds : 0.0);
+    printf("Mains: %.2f Hz, jitter +/-%u us, dropout %.3f%%, noise %.2f/s\n",
+           p.frequencyHz, (unsigned)p.jitterUs, p.dropoutRate * 100, p.noiseRate);
+    printf("Edges: %llu crossings, %llu delivered, %llu dropped, %llu noise\n",
+           (unsigned long long)mainsSim.trueZeros, (unsigned long long)mainsSim.edgesDelivered,
+           (unsigned long long)mainsSim.edgesDropped, (unsigned long long)mainsSim.noiseDelivered);
+    printf("PLL: %s, %.3f Hz measured, jitter %u us, %u rejected, %u coasted, error %d\n",
+           isZeroCrossLocked() ? "locked" : "unlocked", getMainsFrequencyHz(), (unsigned)getMainsJitterUs(),
+           (unsigned)m.rejectedEdges, (unsigned)m.missedEdges, currentError);
+    printf("Timer: %llu alarms\n\n", (unsigned long long)mainsSim.timerFires);
+    
+    printf("ch  gpio  type    level  commanded  delivered  Vrms   conducting  retrig  angle err mean/max (us)\n");
+    
+    double worst = 0;
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        const ChannelMeter &meter = mainsSim.meters[i];
+        double delivered = meter.halfCycles ? meter.powerSum / meter.halfCycles : 0.0;
+        double commanded = commandedPower(i);
+        double conducting = meter.halfCycles ? 100.0 * meter.conducting / meter.halfCycles : 0.0;
+        double error = fabs(delivered - commanded);
+        if (error > worst) worst = error;
+        
+        printf("%-3d %-5d %-7s %4d%%  %8.2f%%  %8.2f%%  %5.3f  %9.2f%%  %6llu  ",
+               i, TRIAC_PINS[i], typeName(devices[i].type), devices[i].state ? devices[i].brightness : 0,
+               commanded * 100, delivered * 100, sqrt(delivered), conducting, (unsigned long long)meter.retriggers);
+        if (meter.phaseSamples) {
+            printf("%.1f / %.1f\n", meter.angleErrorSum / meter.phaseSamples, meter.angleErrorMax);
+        } else {
+            printf("-\n");
+        }
+    }
+    return worst;
+}
+
+// ================================================================
+// MAIN
+// ================================================================
+
+int main(int argc, char **argv) {
+    MainsProfile profile = MAINS_PROFILE_DEFAULT;
+    profile.jitterUs = 50;
+    profile.dropoutRate = 0.001;
+    profile.noiseRate = 0.5;
+    
+    double seconds = 3600;
+    uint64_t seed = 1;
+    int dimmer = 50;
+    int fan = 70;
+    int burst = 30;
+    const char *timelinePath = NULL;
+    bool check = false;
+    
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+        
+        if (!strcmp(arg, "--check")) { check = true; continue; }
+        if (!value) {
+            fprintf(stderr, "Missing value for %s\n", arg);
+            return 2;
+        }
+        i++;
+        
+        if (!strcmp(arg, "--seconds")) seconds = atof(value);
+        else if (!strcmp(arg, "--hz")) profile.frequencyHz = atof(value);
+        else if (!strcmp(arg, "--jitter-us")) profile.jitterUs = atoi(value);
+        else if (!strcmp(arg, "--dropout")) profile.dropoutRate = atof(value);
+        else if (!strcmp(arg, "--noise")) profile.noiseRate = atof(value);
+        else if (!strcmp(arg, "--seed")) seed = strtoull(value, NULL, 0);
+        else if (!strcmp(arg, "--dimmer")) dimmer = atoi(value);
+        else if (!strcmp(arg, "--fan")) fan = atoi(value);
+        else if (!strcmp(arg, "--burst")) burst = atoi(value);
+        else if (!strcmp(arg, "--timeline")) timelinePath = value;
+        else {
+            fprintf(stderr, "Unknown option %s\n", arg);
+            return 2;
+        }
+    }
+    
+    mainsSimInit(profile, seed);
+    
+    if (timelinePath) {
+        mainsSim.timeline = fopen(timelinePath, "w");
+        if (!mainsSim.timeline) {
+            perror(timelinePath);
+            return 2;
+        }
+        fprintf(mainsSim.timeline, "time_us,gpio,level\n");
+    }
+    
+    // Let the PLL lock before loading the channels
+    mainsSimRun(500000);
+    
+    setDeviceType(0, TYPE_DIMMER);
+    setDeviceType(1, TYPE_FAN);
+    setDeviceType(2, TYPE_SWITCH);
+    setDeviceType(3, TYPE_BURST);
+    setDeviceState(0, dimmer > 0, dimmer);
+    setDeviceState(1, fan > 0, fan);
+    setDeviceState(2, true, 100);
+    setDeviceState(3, burst > 0, burst);
+    
+    // Measure from the first half-cycle that uses the new snapshot
+    mainsSimRun(micros() + 2 * (uint64_t)mainsHalfCycleUs());
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        ChannelMeter &meter = mainsSim.meters[i];
+        meter.halfCycles = meter.conducting = meter.phaseSamples = meter.retriggers = 0;
+        meter.powerSum = meter.angleErrorSum = meter.angleErrorMax = 0;
+    }
+    
+    uint64_t startUs = micros();
+    auto wallStart = std::chrono::steady_clock::now();
+    mainsSimRun(startUs + (uint64_t)(seconds * 1e6));
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    
+    if (mainsSim.timeline) fclose(mainsSim.timeline);
+    
+    double worst = printReport((micros() - startUs) / 1e6, wallSeconds);
+    
+    if (check) {
+        bool ok = isZeroCrossLocked() && currentError == ERR_NONE && worst <= 0.02;
+        printf("\nCheck: %s (worst power error %.2f%%)\n", ok ? "PASS" : "FAIL", worst * 100);
+        return ok ? 0 : 1;
+    }
+    return 0;
+}
@@ -6,7 +6,7 @@
 #ifndef API_H
 #define API_H
 
-#include <WebServer.h>
+#include <ESPAsyncWebServer.h>
 #include <ArduinoJson.h>
 #include <WebSocketsServer.h>
 #include "config.h"
@@ -14,7 +14,7 @@
 // ================================================================
 // GLOBAL OBJECTS
 // ================================================================
-extern WebServer localServer;
+extern AsyncWebServer localServer;
 extern WebSocketsServer webSocket;
 
 // ================================================================
@@ -24,6 +24,13 @@ void initLocalAPI();
 void handleLocalAPIRequests();
 void broadcastStateUpdate();
 
+/**
+ * Restart (or factory reset) once a /restart or /factory-reset response
+ * has gone out. Called from the connectivity loop; handlers run on the
+ * AsyncTCP task and never restart from there.
+ */
+void processPendingRestart();
+
 // ================================================================
 // REST API ENDPOINTS
 // ================================================================
@@ -31,7 +38,14 @@ void broadcastStateUpdate();
 /**
  * GET /status
  * Returns current state of all devices
+ * The body is cached per state version and carries an ETag; a request
+ * with a matching If-None-Match gets 304 Not Modified. With
+ * ?since=<version> the response is held open, without blocking anything,
+ * until the version differs or ?timeout=<ms> passes (default
+ * STATUS_LONG_POLL_MS, at most STATUS_LONG_POLL_MAX_MS); such a response
+ * is chunked and has no ETag.
  * Response: {
+ *   "version": 812,
  *   "devices": [
  *     {"id": 0, "name": "Light 1", "type": 0, "state": true, "brightness": 75, "runtime": 3600},
  *     ...
@@ -46,15 +60,45 @@ void handleGetStatus();
  * Body: {
  *   "id": 0,
  *   "state": true,
- *   "brightness": 75  // optional, for dimmers/fans
+ *   "brightness": 75,  // optional, for dimmers/fans
+ *   "fade": true,      // optional, default true
+ *   "fade_ms": 1000,   // optional, 0 or 50-14400000
+ *   "curve": "linear"  // optional: linear, ease_in_out, perceptual
  * }
  * Response: {"success": true}
  */
 void handlePostControl();
 
+/**
+ * POST /control/batch
+ * Change several devices at once ("all off", room sliders)
+ * Every entry is checked (id, child lock, brightness, fade) before any is
+ * applied; if one fails nothing changes. Accepted entries are applied in
+ * one commit, so they start on the same zero-cross, and announced with
+ * one "devices_update" WebSocket message.
+ * Body: [
+ *   {"id": 0, "state": false},
+ *   {"id": 1, "state": true, "brightness": 40, "fade_ms": 2000}
+ * ]
+ * (or {"devices": [...]}; entry fields as for POST /control)
+ * Response: {
+ *   "success": true,
+ *   "results": [{"id": 0, "success": true}, {"id": 1, "success": true}]
+ * }
+ * Rejected (400, or 403 if only locks failed): {
+ *   "success": false,
+ *   "error": "Batch rejected, nothing applied",
+ *   "results": [{"id": 0, "success": false},
+ *               {"id": 1, "success": false, "error": "Device is locked"}]
+ * }
+ */
+void handlePostControlBatch();
+
 /**
  * GET /info
  * Get system information
+ * Cached per state version and INFO_CACHE_S of uptime, with an ETag
+ * (If-None-Match answered with 304)
  * Response: {
  *   "name": "Living Room Hub",
  *   "firmware": "3.0",
@@ -63,7 +107,17 @@ void handlePostControl();
  *   "uptime": 3600,
  *   "rssi": -45,
  *   "heap": 180000,
- *   "cloud_connected": true
+ *   "heap_min": 152000,        // Lowest free heap since boot
+ *   "heap_max_block": 110580,  // Largest allocatable block (fragmentation)
+ *   "heap_request_last": 1460, // Peak heap drawn by the previous API request
+ *   "heap_request_max": 6144,  // Largest such peak since boot
+ *   "cloud_connected": true,
+ *   "mains_hz": 50.02,
+ *   "mains_half_cycle_us": 9996,
+ *   "mains_jitter_us": 12,
+ *   "mains_locked": true,
+ *   "nvs_used_entries": 42,    // NVS partition usage, all namespaces
+ *   "nvs_total_entries": 504
  * }
  */
 void handleGetInfo();
@@ -73,8 +127,8 @@ void handleGetInfo();
  * Update device configuration
  * Body: {
  *   "device_id": 0,
- *   "name": "Living Room Light",
- *   "type": 2,  // DIMMER
+ *   "name": "Living Room Light",  // Up to 31 characters
+ *   "type": 2,  // 0=SWITCH, 1=FAN, 2=DIMMER, 3=BURST
  *   "power_on_state": 2  // LAST
  * }
  * Response: {"success": true}
@@ -82,21 +136,29 @@ void handleGetInfo();
 void handlePostConfig();
 
 /**
- * GET /schedules
- * List all schedules
+ * GET /schedules?offset=0&limit=20&device=0&day=1
+ * List schedules a page at a time (limit 1-50, default 20)
+ * Optional filters: device id, start day (0=Sun)
+ * Windows with end_mins < start_mins run past midnight into the next day.
+ * Overlapping windows on a device: higher priority wins, then the later
+ * start, then the higher id.
  * Response: {
  *   "schedules": [
  *     {
  *       "id": 0,
  *       "device_id": 0,
- *       "start_time": "18:00",
- *       "end_time": "23:00",
+ *       "start_mins": 1080,      // 18:00
+ *       "end_mins": 1380,        // 23:00
  *       "start_brightness": 0,
  *       "end_brightness": 75,
  *       "active": true,
- *       "days": [1,2,3,4,5]  // Mon-Fri
+ *       "days_of_week": 62,      // Bitmask, bit 0=Sun: Mon-Fri
+ *       "priority": 0
  *     }
- *   ]
+ *   ],
+ *   "total": 1,    // Matching schedules across all pages
+ *   "offset": 0,
+ *   "limit": 20
  * }
  */
 void handleGetSchedules();
@@ -105,14 +167,15 @@ void handleGetSchedules();
  * POST /schedules
  * Create or update a schedule
  * Body: {
- *   "id": 0,  // -1 for new
+ *   "id": 0,  // -1 or absent for new (device_id then required)
  *   "device_id": 0,
- *   "start_time": "18:00",
- *   "end_time": "23:00",
- *   "start_brightness": 0,
- *   "end_brightness": 75,
+ *   "start_mins": 1080,     // 0-1439
+ *   "end_mins": 1380,       // 0-1439
+ *   "start_brightness": 0,  // 0-100
+ *   "end_brightness": 75,   // 0-100
  *   "active": true,
- *   "days": [1,2,3,4,5]
+ *   "days_of_week": 62,     // 0-127
+ *   "priority": 0           // 0-255, optional
  * }
  * Response: {"success": true, "id": 0}
  */
@@ -126,19 +189,22 @@ void handlePostSchedule();
 void handleDeleteSchedule();
 
 /**
- * GET /scenes
- * List all scenes
+ * GET /scenes?offset=0&limit=20
+ * List scenes a page at a time (limit 1-50, default 20)
  * Response: {
  *   "scenes": [
  *     {
  *       "id": 0,
  *       "name": "Movie Time",
  *       "devices": [
- *         {"id": 0, "state": false},
- *         {"id": 1, "state": true, "brightness": 20}
+ *         {"id": 0, "state": false, "brightness": 0, "fade_ms": 1000, "curve": "linear"},
+ *         {"id": 1, "state": true, "brightness": 20, "fade_ms": 3000, "curve": "perceptual"}
  *       ]
  *     }
- *   ]
+ *   ],
+ *   "total": 1,
+ *   "offset": 0,
+ *   "limit": 20
  * }
  */
 void handleGetScenes();
@@ -147,9 +213,9 @@ void handleGetScenes();
  * POST /scenes
  * Create or update a scene
  * Body: {
- *   "id": 0,  // -1 for new
- *   "name": "Movie Time",
- *   "devices": [...]
+ *   "id": 0,  // -1 or absent for new
+ *   "name": "Movie Time",  // 1-23 characters, unique ignoring case; required for new
+ *   "devices": [...]  // entries as in GET /scenes, one per device; fade_ms and curve optional
  * }
  * Response: {"success": true, "id": 0}
  */
@@ -162,6 +228,14 @@ void handlePostScene();
  */
 void handleActivateScene();
 
+/**
+ * POST /scenes/activate
+ * Activate a scene by name (case-insensitive)
+ * Body: {"name": "Movie Time"}
+ * Response: {"success": true}
+ */
+void handleActivateSceneByName();
+
 /**
  * DELETE /scenes/{id}
  * Delete a scene
@@ -169,6 +243,90 @@ void handleActivateScene();
  */
 void handleDeleteScene();
 
+/**
+ * GET /metrics/isr
+ * ISR latency and jitter histograms, per core
+ * Buckets are powers of two in microseconds: [<1, 1-2, 2-4, ..., >=16384]
+ * Response: {
+ *   "bucket_upper_us": [1, 2, 4, ...],
+ *   "cores": [
+ *     {
+ *       "core": 1,
+ *       "zero_cross_edges": 360000,
+ *       "missed_edges": 3,
+ *       "rejected_edges": 41,
+ *       "timer_interrupts": 720000,
+ *       "min_interval_us": 9950,
+ *       "max_interval_us": 10060,
+ *       "fire_error": {"counts": [...], "max_us": 14},
+ *       "zero_cross_isr": {"counts": [...], "max_us": 6},
+ *       "timer_isr": {"counts": [...], "max_us": 4},
+ *       "zero_cross_deviation": {"counts": [...], "max_us": 48}
+ *     }
+ *   ]
+ * }
+ */
+void handleGetIsrMetrics();
+
+/**
+ * POST /metrics/isr/reset
+ * Clear ISR metrics (applied by each core at its next zero-cross)
+ * Response: {"success": true}
+ */
+void handleResetIsrMetrics();
+
+/**
+ * GET /metrics/schedules
+ * Schedule engine cost and activity since the last reset
+ * Response: {
+ *   "evaluations": 8640000,
+ *   "avg_eval_us": 3.1,
+ *   "max_eval_us": 412,
+ *   "transitions": 96,
+ *   "transitions_per_day": 96.0,
+ *   "rebuilds": 2,
+ *   "pending": 12,
+ *   "schedules": 12,
+ *   "capacity": 16
+ * }
+ */
+void handleGetScheduleMetrics();
+
+/**
+ * POST /metrics/schedules/reset
+ * Clear schedule engine metrics
+ * Response: {"success": true}
+ */
+void handleResetScheduleMetrics();
+
+/**
+ * GET /metrics/storage
+ * Get write-behind counters: section saves requested, flash writes done
+ * and avoided by coalescing, and the sections still waiting; plus state
+ * journal appends, sector erases and time per append
+ * Response: {
+ *   "save_requests": 40,
+ *   "flash_writes": 6,
+ *   "writes_avoided": 34,
+ *   "failed_writes": 0,
+ *   "flushes": 5,
+ *   "bytes_written": 1470,
+ *   "avg_write_us": 5210.3,
+ *   "max_write_us": 18432,
+ *   "pending": ["devices"],
+ *   "journal": {"records": 212, "erases": 0, "avg_append_us": 61.5,
+ *               "max_append_us": 140, "sequence": 5821}
+ * }
+ */
+void handleGetStorageMetrics();
+
+/**
+ * POST /metrics/storage/reset
+ * Clear write-behind counters
+ * Response: {"success": true}
+ */
+void handleResetStorageMetrics();
+
 /**
  * POST /restart
  * Restart the device
@@ -203,6 +361,30 @@ void handleWebSocketEvent(uint8_t num, WStype_t type, uint8_t * payload, size_t
  */
 void broadcastDeviceState(int deviceId);
 
+/**
+ * Broadcast the result of a scene activation as one message
+ * Message: {
+ *   "type": "scene_applied",
+ *   "scene_id": 0,
+ *   "devices": [{"id": 0, "state": true, "brightness": 20, "name": "Light 1"}, ...]
+ * }
+ * 
+ * @param sceneId Scene that was applied
+ * @param channels Devices the scene changed
+ */
+void broadcastSceneApplied(int sceneId, ChannelMask channels);
+
+/**
+ * Broadcast several device changes as one message
+ * Message: {
+ *   "type": "devices_update",
+ *   "devices": [{"id": 0, "state": false, "brightness": 0, "name": "Light 1"}, ...]
+ * }
+ * 
+ * @param channels Devices that changed
+ */
+void broadcastDevicesUpdate(ChannelMask channels);
+
 /**
  * Broadcast system status to all connected WebSocket clients
  */
@@ -214,6 +396,8 @@ void broadcastSystemStatus();
 
 /**
  * Send JSON response
+ * Serialized into a response buffer sized by measureJson(), which
+ * AsyncTCP drains as the client takes it
  */
 void sendJsonResponse(int code, const JsonDocument& doc);
 
@@ -223,13 +407,21 @@ void sendJsonResponse(int code, const JsonDocument& doc);
 void sendErrorResponse(int code, const char* message);
 
 /**
- * Validate device ID
+ * Parse JSON body from request
  */
-bool isValidDeviceId(int id);
+bool parseJsonBody(JsonDocument& doc);
 
 /**
- * Parse JSON body from request
+ * Read the optional "fade_ms" and "curve" fields of a request object
+ * Missing fields default to FADE_DURATION_MS and "linear"
+ * 
+ * @return false if a field is present but invalid
  */
-bool parseJsonBody(JsonDocument& doc);
+bool parseFadeFields(JsonObjectConst obj, uint32_t &fadeMs, FadeCurve &curve);
+
+/**
+ * API name of a fade curve ("linear", "ease_in_out", "perceptual")
+ */
+const char* fadeCurveName(FadeCurve curve);
 
 #endif // API_H
@@ -9,13 +9,14 @@
 #include "api.h"
 #include "config.h"
 #include <ArduinoJson.h>
+#include <memory>
+#include <esp_heap_caps.h>
 
 // External references to global objects and data
-extern WebServer localServer;
+extern AsyncWebServer localServer;
 extern WebSocketsServer webSocket;
-extern Device devices[4];
-extern Schedule schedules[SCHEDULE_MAX_COUNT];
-extern Scene scenes[SCENE_MAX_COUNT];
+extern SemaphoreHandle_t controlMutex;
+extern Device devices[CHANNEL_COUNT];
 extern String systemName;
 extern bool cloudConnected;
 
@@ -23,10 +24,249 @@ extern bool cloudConnected;
 // UTILITY FUNCTIONS IMPLEMENTATION
 // ================================================================
 
+// Request being served; set by handleApiRequest() around each handler.
+// Handlers only run on the AsyncTCP task, one at a time
+static AsyncWebServerRequest *apiRequest = NULL;
+static bool apiLockHeld = false;  // handleApiRequest() holds controlMutex
+
+// Responses go out after their handler has returned, as AsyncTCP finds
+// room. Small documents are serialized into a buffer of their measured
+// size. Lists and cached bodies are read by filler callbacks a piece at
+// a time (see STREAMED RESPONSES), so no response holds a whole list
+
+// Heap drawn while a handler ran (its response, and the first piece of a
+// streamed body, included): free heap before the call minus the
+// allocator's low-water mark over it. Other tasks allocating meanwhile
+// count too, so these are upper bounds
+static uint32_t requestHeapLast = 0;
+static uint32_t requestHeapMax = 0;
+
+static void runMeasuredHandler(void (*handler)()) {
+    uint32_t freeBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    heap_caps_monitor_local_minimum_free_size_start();
+    handler();
+    uint32_t lowest = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    heap_caps_monitor_local_minimum_free_size_stop();
+    
+    requestHeapLast = freeBefore > lowest ? freeBefore - lowest : 0;
+    if (requestHeapLast > requestHeapMax) requestHeapMax = requestHeapLast;
+    logMessage(LOG_DEBUG, "API %s: %lu heap bytes at peak", apiRequest->url().c_str(),
+               (unsigned long)requestHeapLast);
+}
+
 void sendJsonResponse(int code, const JsonDocument& doc) {
-    String response;
-    serializeJson(doc, response);
-    localServer.send(code, "application/json", response);
+    AsyncResponseStream *response = apiRequest->beginResponseStream("application/json", measureJson(doc));
+    response->setCode(code);
+    serializeJson(doc, *response);
+    apiRequest->send(response);
+}
+
+// Integer query parameter, or fallback when absent
+static long queryArgInt(const char* name, long fallback) {
+    if (!apiRequest->hasArg(name)) return fallback;
+    return apiRequest->arg(name).toInt();
+}
+
+// ================================================================
+// STREAMED RESPONSES
+// ================================================================
+
+// Take controlMutex for a filler call. send() makes the first call from
+// inside the handler, which holds it already (taken stays false then)
+// @return false if the control loop holds it; try again later
+static bool takeFillerLock(bool &taken) {
+    taken = false;
+    if (apiLockHeld) return true;
+    taken = xSemaphoreTake(controlMutex, pdMS_TO_TICKS(API_LOCK_TIMEOUT_MS)) == pdTRUE;
+    return taken;
+}
+
+/**
+ * Body written a piece at a time by the response's filler calls
+ * Items is a cursor whose writeNext(Print &out) writes the next piece
+ * (the opening, one entry, the closing) and returns false after the
+ * last, and whose ITEM_MAX bounds a piece. Each piece is written under
+ * controlMutex into a buffer of that size and copied out as the
+ * connection takes it, so a list edited meanwhile reads as it is then.
+ */
+template <typename Items>
+struct ChunkedBody : public Print {
+    Items items;
+    char pending[Items::ITEM_MAX];
+    size_t length = 0;
+    size_t sent = 0;
+    bool done = false;
+    bool overflow = false;
+    
+    explicit ChunkedBody(const Items &items) : items(items) {}
+    
+    size_t write(uint8_t c) override {
+        if (length == sizeof(pending)) {
+            overflow = true;
+            return 0;
+        }
+        pending[length++] = c;
+        return 1;
+    }
+    
+    size_t fill(uint8_t *buffer, size_t maxLen) {
+        size_t copied = 0;
+        bool locked = false;
+        bool taken = false;
+        
+        while (copied < maxLen) {
+            if (sent == length) {
+                if (done || (!locked && !(locked = takeFillerLock(taken)))) break;
+                length = 0;
+                sent = 0;
+                done = !items.writeNext(*this);
+                if (overflow) logMessage(LOG_ERROR, "API: response piece over %u bytes cut short", (unsigned)sizeof(pending));
+                overflow = false;
+                continue;
+            }
+            
+            size_t count = length - sent;
+            if (count > maxLen - copied) count = maxLen - copied;
+            memcpy(buffer + copied, pending + sent, count);
+            sent += count;
+            copied += count;
+        }
+        
+        if (taken) xSemaphoreGive(controlMutex);
+        if (copied > 0) return copied;
+        return done ? 0 : RESPONSE_TRY_AGAIN;
+    }
+};
+
+// Send a streamed body (chunked transfer encoding: its length is not known
+// up front)
+template <typename Items>
+static void sendChunkedBody(const Items &items, const char *etag = NULL) {
+    std::shared_ptr<ChunkedBody<Items>> body = std::make_shared<ChunkedBody<Items>>(items);
+    AsyncWebServerResponse *response = apiRequest->beginChunkedResponse("application/json",
+        [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            return body->fill(buffer, maxLen);
+        });
+    if (etag) {
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", "no-cache");
+    }
+    apiRequest->send(response);
+}
+
+// Write a whole body from a fresh cursor (into a cache)
+template <typename Items>
+static void writeItems(Print &out) {
+    Items items;
+    while (items.writeNext(out)) {}
+}
+
+// ================================================================
+// RESPONSE CACHE
+// ================================================================
+
+// Serialized body of a GET response, valid while its ETag still matches.
+// A body that outgrows the buffer is not cached, and one still being
+// sent is not rebuilt
+struct CachedBody : public Print {
+    char *body;
+    size_t capacity;
+    size_t length = 0;
+    bool overflow = false;
+    char etag[24] = "";
+    int readers = 0;  // Responses sending straight from body
+    
+    CachedBody(char *buffer, size_t size) : body(buffer), capacity(size) {}
+    
+    size_t write(uint8_t c) override {
+        if (length == capacity) {
+            overflow = true;
+            return 0;
+        }
+        body[length++] = c;
+        return 1;
+    }
+    
+    void reset() {
+        length = 0;
+        overflow = false;
+        etag[0] = '\0';
+    }
+};
+
+// Counts the bytes a body would take
+struct MeasuredBody : public Print {
+    size_t length = 0;
+    
+    size_t write(uint8_t c) override {
+        length++;
+        return 1;
+    }
+};
+
+static char statusBody[64 + CHANNEL_COUNT * 192];
+static char infoBody[768];
+static CachedBody statusCache(statusBody, sizeof(statusBody));
+static CachedBody infoCache(infoBody, sizeof(infoBody));
+
+static void addValidators(AsyncWebServerResponse *response, const char *etag) {
+    response->addHeader("ETag", etag);
+    response->addHeader("Cache-Control", "no-cache");
+}
+
+// Held by a response reading a cache in place, until the response is gone
+struct CacheReader {
+    CachedBody &cache;
+    explicit CacheReader(CachedBody &cache) : cache(cache) { cache.readers++; }
+    ~CacheReader() { cache.readers--; }
+};
+
+// Answer 304 if the client already has this version
+static bool sendNotModified(const char *etag) {
+    const AsyncWebHeader *match = apiRequest->getHeader("If-None-Match");
+    if (!match || match->value() != etag) return false;
+    
+    AsyncWebServerResponse *response = apiRequest->beginResponse(304);
+    addValidators(response, etag);
+    apiRequest->send(response);
+    return true;
+}
+
+// Rebuild the cache if its ETag is stale
+// @return false if the body does not fit the cache, or the cache holds an
+// older body still being sent
+static bool refreshCache(CachedBody &cache, const char *etag, void (*writeBody)(Print &out)) {
+    if (strcmp(cache.etag, etag) != 0) {
+        if (cache.readers > 0) return false;
+        cache.reset();
+        writeBody(cache);
+        if (!cache.overflow) strlcpy(cache.etag, etag, sizeof(cache.etag));
+    }
+    return !cache.overflow;
+}
+
+// Send the cached body straight from the cache, which is not rebuilt
+// until the response is gone, or stream it uncached if the cache cannot
+// take it now
+template <typename Items>
+static void sendCachedBody(CachedBody &cache, const char *etag) {
+    if (!refreshCache(cache, etag, writeItems<Items>)) {
+        sendChunkedBody(Items(), etag);
+        return;
+    }
+    
+    std::shared_ptr<CacheReader> reader = std::make_shared<CacheReader>(cache);
+    AsyncWebServerResponse *response = apiRequest->beginResponse("application/json", cache.length,
+        [reader](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            const CachedBody &body = reader->cache;
+            if (index >= body.length) return 0;
+            size_t count = body.length - index;
+            if (count > maxLen) count = maxLen;
+            memcpy(buffer, body.body + index, count);
+            return count;
+        });
+    addValidators(response, etag);
+    apiRequest->send(response);
 }
 
 void sendErrorResponse(int code, const char* message) {
@@ -36,16 +276,46 @@ void sendErrorResponse(int code, const char* message) {
     sendJsonResponse(code, doc);
 }
 
-bool isValidDeviceId(int id) {
-    return (id >= 0 && id < 4);
+static const char* const FADE_CURVE_NAMES[] = {"linear", "ease_in_out", "perceptual"};
+
+const char* fadeCurveName(FadeCurve curve) {
+    if (curve < FADE_LINEAR || curve > FADE_PERCEPTUAL) return FADE_CURVE_NAMES[FADE_LINEAR];
+    return FADE_CURVE_NAMES[curve];
+}
+
+bool parseFadeFields(JsonObjectConst obj, uint32_t &fadeMs, FadeCurve &curve) {
+    fadeMs = FADE_DURATION_MS;
+    curve = FADE_LINEAR;
+    
+    if (obj.containsKey("fade_ms")) {
+        long value = obj["fade_ms"].as<long>();
+        if (value != 0 && (value < FADE_MIN_MS || value > (long)FADE_MAX_MS)) return false;
+        fadeMs = value;
+    }
+    
+    if (obj.containsKey("curve")) {
+        const char* name = obj["curve"].as<const char*>();
+        if (!name) return false;
+        
+        for (int i = FADE_LINEAR; i <= FADE_PERCEPTUAL; i++) {
+            if (strcmp(name, FADE_CURVE_NAMES[i]) == 0) {
+                curve = (FadeCurve)i;
+                return true;
+            }
+        }
+        return false;
+    }
+    
+    return true;
 }
 
 bool parseJsonBody(JsonDocument& doc) {
-    if (!localServer.hasArg("plain")) {
+    // Collected by collectRequestBody() as the body arrived
+    const char* body = (const char*)apiRequest->_tempObject;
+    if (!body) {
         return false;
     }
     
-    String body = localServer.arg("plain");
     DeserializationError error = deserializeJson(doc, body);
     
     if (error) {
@@ -59,22 +329,124 @@ bool parseJsonBody(JsonDocument& doc) {
 // REST API ENDPOINT IMPLEMENTATIONS
 // ================================================================
 
-void handleGetStatus() {
-    StaticJsonDocument<1024> doc;
-    JsonArray devicesArray = doc.createNestedArray("devices");
+// GET /status: the version, then one device per piece
+struct StatusItems {
+    static const size_t ITEM_MAX = 192;
+    int next = -1;
+    
+    bool writeNext(Print &out) {
+        if (next < 0) {
+            out.printf("{\"version\":%lu,\"devices\":[", (unsigned long)getStateVersion());
+        } else if (next < CHANNEL_COUNT) {
+            int i = next;
+            StaticJsonDocument<192> device;
+            device["id"] = i;
+            device["name"] = devices[i].name;
+            device["type"] = (int)devices[i].type;
+            device["state"] = devices[i].state;
+            device["brightness"] = devices[i].brightness;
+            device["runtime"] = devices[i].totalRuntime;
+            device["locked"] = devices[i].childLock;
+            
+            if (i > 0) out.print(',');
+            serializeJson(device, out);
+        } else {
+            out.print("]}");
+            return false;
+        }
+        next++;
+        return true;
+    }
+};
+
+static void writeStatusBody(Print &out) {
+    writeItems<StatusItems>(out);
+}
+
+// Long-poll state, owned by the response's filler callback
+struct StatusPoll {
+    uint32_t since;
+    unsigned long startMs;
+    unsigned long timeoutMs;
+    bool ready = false;
+    char *body = NULL;
+    size_t length = 0;
+    
+    ~StatusPoll() { free(body); }
+};
+
+// Copy the current status body into the poll
+// @return false if the control loop holds the lock; try again later
+static bool renderStatusPoll(StatusPoll &poll) {
+    if (xSemaphoreTake(controlMutex, pdMS_TO_TICKS(API_LOCK_TIMEOUT_MS)) != pdTRUE) return false;
+    
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"s%lu\"", (unsigned long)getStateVersion());
+    if (refreshCache(statusCache, etag, writeStatusBody)) {
+        poll.body = (char *)malloc(statusCache.length);
+        if (poll.body) {
+            memcpy(poll.body, statusCache.body, statusCache.length);
+            poll.length = statusCache.length;
+        }
+    } else {
+        MeasuredBody measured;
+        writeStatusBody(measured);
+        poll.body = (char *)malloc(measured.length);
+        if (poll.body) {
+            CachedBody out(poll.body, measured.length);
+            writeStatusBody(out);
+            poll.length = out.length;
+        }
+    }
     
-    for (int i = 0; i < 4; i++) {
-        JsonObject device = devicesArray.createNestedObject();
-        device["id"] = i;
-        device["name"] = devices[i].name;
-        device["type"] = (int)devices[i].type;
-        device["state"] = devices[i].state;
-        device["brightness"] = devices[i].brightness;
-        device["runtime"] = devices[i].totalRuntime;
-        device["locked"] = devices[i].childLock;
+    xSemaphoreGive(controlMutex);
+    poll.ready = true;  // An allocation failure ends the response empty
+    return true;
+}
+
+// Long-poll: AsyncTCP calls the filler whenever the connection can take
+// data, and it answers "try again" until the state version moves on from
+// `since` or the timeout passes. Nothing waits in between. The headers go
+// out before the body is known, so this response carries no ETag; the
+// body's "version" is the next `since`
+static void sendStatusWhenChanged(uint32_t since, unsigned long timeoutMs) {
+    std::shared_ptr<StatusPoll> poll = std::make_shared<StatusPoll>();
+    poll->since = since;
+    poll->startMs = millis();
+    poll->timeoutMs = timeoutMs;
+    
+    AsyncWebServerResponse *response = apiRequest->beginChunkedResponse("application/json",
+        [poll](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            if (!poll->ready) {
+                bool waiting = getStateVersion() == poll->since && millis() - poll->startMs < poll->timeoutMs;
+                if (waiting || !renderStatusPoll(*poll)) return RESPONSE_TRY_AGAIN;
+            }
+            
+            if (index >= poll->length) return 0;
+            size_t count = poll->length - index;
+            if (count > maxLen) count = maxLen;
+            memcpy(buffer, poll->body + index, count);
+            return count;
+        });
+    response->addHeader("Cache-Control", "no-cache");
+    apiRequest->send(response);
+}
+
+void handleGetStatus() {
+    if (apiRequest->hasArg("since")) {
+        uint32_t since = strtoul(apiRequest->arg("since").c_str(), NULL, 10);
+        long timeoutMs = constrain(queryArgInt("timeout", STATUS_LONG_POLL_MS), 0L, (long)STATUS_LONG_POLL_MAX_MS);
+        if (getStateVersion() == since && timeoutMs > 0) {
+            sendStatusWhenChanged(since, timeoutMs);
+            return;
+        }
     }
     
-    sendJsonResponse(200, doc);
+    // Read the version before the state, so a body is never older than its tag
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"s%lu\"", (unsigned long)getStateVersion());
+    if (sendNotModified(etag)) return;
+    sendCachedBody<StatusItems>(statusCache, etag);
 }
 
 void handlePostControl() {
@@ -106,6 +478,13 @@ void handlePostControl() {
     int brightness = doc.containsKey("brightness") ? doc["brightness"].as<int>() : devices[deviceId].brightness;
     bool fade = doc.containsKey("fade") ? doc["fade"].as<bool>() : true;
     
+    uint32_t fadeMs;
+    FadeCurve curve;
+    if (!parseFadeFields(doc.as<JsonObjectConst>(), fadeMs, curve)) {
+        sendErrorResponse(400, "Invalid fade_ms (0 or 50-14400000) or curve");
+        return;
+    }
+    
     // Validate brightness range
     if (brightness < 0 || brightness > 100) {
         sendErrorResponse(400, "Brightness must be 0-100");
@@ -113,14 +492,95 @@ void handlePostControl() {
     }
     
     // Apply control
-    setDeviceState(deviceId, state, brightness, fade);
+    setDeviceState(deviceId, state, brightness, fade, fadeMs, curve);
     
     StaticJsonDocument<64> response;
     response["success"] = true;
     sendJsonResponse(200, response);
 }
 
-void handleGetInfo() {
+void handlePostControlBatch() {
+    StaticJsonDocument<256 + CHANNEL_COUNT * 128> doc;
+    
+    if (!parseJsonBody(doc)) {
+        sendErrorResponse(400, "Invalid JSON");
+        return;
+    }
+    
+    JsonArrayConst entries = doc.is<JsonArrayConst>() ? doc.as<JsonArrayConst>()
+                                                      : doc["devices"].as<JsonArrayConst>();
+    if (entries.isNull() || entries.size() == 0 || entries.size() > CHANNEL_COUNT) {
+        sendErrorResponse(400, "Batch must have at least one entry and at most one per device");
+        return;
+    }
+    
+    // Validate every entry before applying any; locks only change under controlMutex, held here
+    DeviceChange changes[CHANNEL_COUNT];
+    JsonVariantConst requestedIds[CHANNEL_COUNT];  // As sent; DeviceChange narrows ids
+    const char* errors[CHANNEL_COUNT] = {};
+    int count = 0;
+    bool rejected = false;
+    bool onlyLocks = true;
+    ChannelMask seen = 0;
+    
+    for (JsonObjectConst entry : entries) {
+        int index = count++;
+        int deviceId = entry["id"] | -1;
+        uint32_t fadeMs;
+        FadeCurve curve;
+        bool locked = false;
+        const char* &error = errors[index];
+        
+        DeviceChange &change = changes[index];
+        change.deviceId = deviceId;
+        requestedIds[index] = entry["id"];
+        
+        if (!isValidDeviceId(deviceId) || (seen & (1 << deviceId))) {
+            error = "Invalid or repeated device id";
+        } else if (devices[deviceId].childLock) {
+            error = "Device is locked";
+            locked = true;
+        } else if (!parseFadeFields(entry, fadeMs, curve)) {
+            error = "Invalid fade_ms (0 or 50-14400000) or curve";
+        } else {
+            bool state;
+            int brightness;
+            getDeviceState(deviceId, state, brightness);
+            if (entry.containsKey("brightness")) brightness = entry["brightness"].as<int>();
+            change.state = entry.containsKey("state") ? entry["state"].as<bool>() : state;
+            change.brightness = constrain(brightness, 0, 100);
+            change.fadeMs = (entry["fade"] | true) ? fadeMs : 0;
+            change.curve = curve;
+            if (brightness < 0 || brightness > 100) error = "Brightness must be 0-100";
+        }
+        
+        if (isValidDeviceId(deviceId)) seen |= (1 << deviceId);
+        if (error) {
+            rejected = true;
+            if (!locked) onlyLocks = false;
+        }
+    }
+    
+    // One commit: every channel starts its change on the same zero-cross
+    ChannelMask applied = rejected ? 0 : applyDeviceChanges(changes, count);
+    if (applied) broadcastDevicesUpdate(applied);
+    
+    StaticJsonDocument<128 + CHANNEL_COUNT * 96> response;
+    response["success"] = applied != 0;
+    if (!applied) response["error"] = "Batch rejected, nothing applied";
+    
+    JsonArray results = response.createNestedArray("results");
+    for (int i = 0; i < count; i++) {
+        JsonObject result = results.createNestedObject();
+        result["id"] = requestedIds[i];
+        result["success"] = applied != 0;
+        if (errors[i]) result["error"] = errors[i];
+    }
+    
+    sendJsonResponse(applied ? 200 : (rejected && onlyLocks ? 403 : 400), response);
+}
+
+static void writeInfoBody(Print &out) {
     StaticJsonDocument<512> doc;
     
     doc["name"] = systemName;
@@ -132,9 +592,43 @@ void handleGetInfo() {
     doc["rssi"] = WiFi.RSSI();
     doc["signal"] = getSignalStrength(WiFi.RSSI());
     doc["heap"] = ESP.getFreeHeap();
+    doc["heap_min"] = ESP.getMinFreeHeap();
+    doc["heap_max_block"] = ESP.getMaxAllocHeap();
+    doc["heap_request_last"] = requestHeapLast;
+    doc["heap_request_max"] = requestHeapMax;
     doc["cloud_connected"] = cloudConnected;
+    doc["mains_hz"] = getMainsFrequencyHz();
+    doc["mains_half_cycle_us"] = getMainsHalfCycleUs();
+    doc["mains_jitter_us"] = getMainsJitterUs();
+    doc["mains_locked"] = isZeroCrossLocked();
+    
+    size_t nvsUsed, nvsTotal;
+    if (getStorageUsage(nvsUsed, nvsTotal)) {
+        doc["nvs_used_entries"] = nvsUsed;
+        doc["nvs_total_entries"] = nvsTotal;
+    }
     
-    sendJsonResponse(200, doc);
+    serializeJson(doc, out);
+}
+
+// GET /info: one document, one piece
+struct InfoItems {
+    static const size_t ITEM_MAX = sizeof(infoBody);
+    
+    bool writeNext(Print &out) {
+        writeInfoBody(out);
+        return false;
+    }
+};
+
+void handleGetInfo() {
+    // Live readings (uptime, RSSI, heap) refresh every INFO_CACHE_S even
+    // when the state version stands still
+    char etag[24];
+    snprintf(etag, sizeof(etag), "\"i%lu.%lu\"", (unsigned long)getStateVersion(),
+             getUptimeSeconds() / INFO_CACHE_S);
+    if (sendNotModified(etag)) return;
+    sendCachedBody<InfoItems>(infoCache, etag);
 }
 
 void handlePostConfig() {
@@ -162,6 +656,10 @@ void handlePostConfig() {
     // Update device name
     if (doc.containsKey("name")) {
         String newName = doc["name"].as<String>();
+        if (newName.length() >= DEVICE_NAME_LEN) {
+            sendErrorResponse(400, "Name too long");
+            return;
+        }
         if (newName.length() > 0 && newName != devices[deviceId].name) {
             devices[deviceId].name = newName;
             configChanged = true;
@@ -171,8 +669,8 @@ void handlePostConfig() {
     // Update device type
     if (doc.containsKey("type")) {
         int typeInt = doc["type"].as<int>();
-        if (typeInt >= 0 && typeInt <= 2) {
-            devices[deviceId].type = (DeviceType)typeInt;
+        if (typeInt >= TYPE_SWITCH && typeInt <= TYPE_BURST) {
+            setDeviceType(deviceId, (DeviceType)typeInt);
             configChanged = true;
         }
     }
@@ -202,7 +700,7 @@ void handlePostConfig() {
     }
     
     if (configChanged) {
-        saveDeviceConfig();
+        markConfigDirty(CONFIG_DEVICES);
     }
     
     StaticJsonDocument<64> response;
@@ -210,29 +708,68 @@ void handlePostConfig() {
     sendJsonResponse(200, response);
 }
 
+// GET /schedules page: the opening, then one schedule per piece. Offset
+// and total count matching schedules, not slot ids
+struct ScheduleItems {
+    static const size_t ITEM_MAX = 256;
+    int offset, limit, deviceFilter, dayFilter;
+    int nextId = 0;
+    int total = 0;  // Matching schedules passed so far
+    bool opened = false;
+    
+    ScheduleItems(int offset, int limit, int deviceFilter, int dayFilter)
+        : offset(offset), limit(limit), deviceFilter(deviceFilter), dayFilter(dayFilter) {}
+    
+    bool writeNext(Print &out) {
+        if (!opened) {
+            out.print("{\"schedules\":[");
+            opened = true;
+            return true;
+        }
+        
+        for (int id = nextScheduleId(nextId, deviceFilter, dayFilter); id >= 0;
+             id = nextScheduleId(id + 1, deviceFilter, dayFilter)) {
+            nextId = id + 1;
+            if (total++ < offset || total > offset + limit) continue;
+            
+            const Schedule *sched = getSchedule(id);
+            StaticJsonDocument<256> schedule;
+            schedule["id"] = id;
+            schedule["device_id"] = sched->deviceId;
+            schedule["start_mins"] = sched->startMins;
+            schedule["end_mins"] = sched->endMins;
+            schedule["start_brightness"] = sched->startBrightness;
+            schedule["end_brightness"] = sched->endBrightness;
+            schedule["active"] = (bool)sched->active;
+            schedule["days_of_week"] = sched->daysOfWeek;
+            schedule["priority"] = sched->priority;
+            
+            if (total > offset + 1) out.print(',');
+            serializeJson(schedule, out);
+            return true;
+        }
+        
+        out.printf("],\"total\":%d,\"offset\":%d,\"limit\":%d}", total, offset, limit);
+        return false;
+    }
+};
+
 void handleGetSchedules() {
-    DynamicJsonDocument doc(2048);
-    JsonArray schedulesArray = doc.createNestedArray("schedules");
+    int offset = constrain(queryArgInt("offset", 0), 0L, (long)SCHEDULE_MAX_COUNT);
+    int limit = constrain(queryArgInt("limit", SCHEDULE_PAGE_DEFAULT), 1L, (long)SCHEDULE_PAGE_MAX);
+    int deviceFilter = queryArgInt("device", -1);
+    int dayFilter = queryArgInt("day", -1);
     
-    for (int i = 0; i < SCHEDULE_MAX_COUNT; i++) {
-        if (schedules[i].deviceId < 0) continue;  // Skip empty slots
-        
-        JsonObject schedule = schedulesArray.createNestedObject();
-        schedule["id"] = i;
-        schedule["device_id"] = schedules[i].deviceId;
-        schedule["start_mins"] = schedules[i].startMins;
-        schedule["end_mins"] = schedules[i].endMins;
-        schedule["start_brightness"] = schedules[i].startBrightness;
-        schedule["end_brightness"] = schedules[i].endBrightness;
-        schedule["active"] = schedules[i].active;
-        schedule["days_of_week"] = schedules[i].daysOfWeek;
+    if (deviceFilter >= CHANNEL_COUNT || deviceFilter < -1 || dayFilter >= 7 || dayFilter < -1) {
+        sendErrorResponse(400, "Invalid filter");
+        return;
     }
     
-    sendJsonResponse(200, doc);
+    sendChunkedBody(ScheduleItems(offset, limit, deviceFilter, dayFilter));
 }
 
 void handlePostSchedule() {
-    DynamicJsonDocument doc(512);
+    StaticJsonDocument<512> doc;
     
     if (!parseJsonBody(doc)) {
         sendErrorResponse(400, "Invalid JSON");
@@ -240,61 +777,96 @@ void handlePostSchedule() {
     }
     
     int scheduleId = doc.containsKey("id") ? doc["id"].as<int>() : -1;
+    bool creating = scheduleId < 0;
     
-    // Find or create schedule
-    if (scheduleId < 0) {
-        // Find empty slot
-        for (int i = 0; i < SCHEDULE_MAX_COUNT; i++) {
-            if (schedules[i].deviceId < 0) {
-                scheduleId = i;
-                break;
-            }
+    // Validate into a copy so a bad field leaves the stored schedule untouched
+    Schedule updated;
+    if (creating) {
+        if (!doc.containsKey("device_id")) {
+            sendErrorResponse(400, "device_id required");
+            return;
         }
-        
-        if (scheduleId < 0) {
-            sendErrorResponse(400, "No available schedule slots");
+        memset(&updated, 0, sizeof(updated));
+        updated.deviceId = -1;
+        updated.endBrightness = 100;
+        updated.daysOfWeek = 0x7F;
+    } else {
+        const Schedule *existing = getSchedule(scheduleId);
+        if (!existing || existing->deviceId < 0) {
+            sendErrorResponse(400, "Invalid schedule ID");
             return;
         }
-    } else if (scheduleId >= SCHEDULE_MAX_COUNT) {
-        sendErrorResponse(400, "Invalid schedule ID");
-        return;
+        updated = *existing;
     }
     
-    // Update schedule
     if (doc.containsKey("device_id")) {
         int devId = doc["device_id"].as<int>();
         if (!isValidDeviceId(devId)) {
             sendErrorResponse(400, "Invalid device ID");
             return;
         }
-        schedules[scheduleId].deviceId = devId;
+        updated.deviceId = devId;
     }
     
-    if (doc.containsKey("start_mins")) {
-        schedules[scheduleId].startMins = doc["start_mins"].as<int>();
+    // 1440 is accepted as midnight for clients written against the old API
+    const char* minuteFields[] = {"start_mins", "end_mins"};
+    for (int f = 0; f < 2; f++) {
+        if (!doc.containsKey(minuteFields[f])) continue;
+        int mins = doc[minuteFields[f]].as<int>();
+        if (mins < 0 || mins > 24 * 60) {
+            sendErrorResponse(400, "Minutes must be 0-1439");
+            return;
+        }
+        if (f == 0) updated.startMins = mins % (24 * 60);
+        else updated.endMins = mins % (24 * 60);
     }
     
-    if (doc.containsKey("end_mins")) {
-        schedules[scheduleId].endMins = doc["end_mins"].as<int>();
+    const char* brightnessFields[] = {"start_brightness", "end_brightness"};
+    for (int f = 0; f < 2; f++) {
+        if (!doc.containsKey(brightnessFields[f])) continue;
+        int level = doc[brightnessFields[f]].as<int>();
+        if (level < 0 || level > 100) {
+            sendErrorResponse(400, "Brightness must be 0-100");
+            return;
+        }
+        if (f == 0) updated.startBrightness = level;
+        else updated.endBrightness = level;
     }
     
-    if (doc.containsKey("start_brightness")) {
-        schedules[scheduleId].startBrightness = doc["start_brightness"].as<int>();
+    if (doc.containsKey("active")) {
+        updated.active = doc["active"].as<bool>();
     }
     
-    if (doc.containsKey("end_brightness")) {
-        schedules[scheduleId].endBrightness = doc["end_brightness"].as<int>();
+    if (doc.containsKey("days_of_week")) {
+        int days = doc["days_of_week"].as<int>();
+        if (days < 0 || days > 0x7F) {
+            sendErrorResponse(400, "days_of_week must be 0-127");
+            return;
+        }
+        updated.daysOfWeek = days;
     }
     
-    if (doc.containsKey("active")) {
-        schedules[scheduleId].active = doc["active"].as<bool>();
+    if (doc.containsKey("priority")) {
+        int priority = doc["priority"].as<int>();
+        if (priority < 0 || priority > 255) {
+            sendErrorResponse(400, "Priority must be 0-255");
+            return;
+        }
+        updated.priority = priority;
     }
     
-    if (doc.containsKey("days_of_week")) {
-        schedules[scheduleId].daysOfWeek = doc["days_of_week"].as<uint8_t>();
+    if (creating) {
+        scheduleId = allocateSchedule();
+        if (scheduleId < 0) {
+            sendErrorResponse(400, "No available schedule slots");
+            return;
+        }
     }
     
-    saveSchedules();
+    *getSchedule(scheduleId) = updated;
+    updateScheduleIndex(scheduleId);
+    markConfigDirty(CONFIG_SCHEDULES);
+    scheduleUpdated(scheduleId);
     
     StaticJsonDocument<128> response;
     response["success"] = true;
@@ -303,51 +875,81 @@ void handlePostSchedule() {
 }
 
 void handleDeleteSchedule() {
-    String uri = localServer.uri();
+    const String &uri = apiRequest->url();
     int scheduleId = uri.substring(uri.lastIndexOf('/') + 1).toInt();
     
-    if (scheduleId < 0 || scheduleId >= SCHEDULE_MAX_COUNT) {
+    const Schedule *sched = getSchedule(scheduleId);
+    if (!sched || sched->deviceId < 0) {
         sendErrorResponse(400, "Invalid schedule ID");
         return;
     }
     
-    // Clear schedule
-    schedules[scheduleId].deviceId = -1;
-    schedules[scheduleId].active = false;
-    saveSchedules();
+    freeSchedule(scheduleId);
+    markConfigDirty(CONFIG_SCHEDULES);
+    scheduleUpdated(scheduleId);
     
     StaticJsonDocument<64> response;
     response["success"] = true;
     sendJsonResponse(200, response);
 }
 
-void handleGetScenes() {
-    DynamicJsonDocument doc(2048);
-    JsonArray scenesArray = doc.createNestedArray("scenes");
-    
-    for (int i = 0; i < SCENE_MAX_COUNT; i++) {
-        if (!scenes[i].active || scenes[i].name.length() == 0) continue;
-        
-        JsonObject scene = scenesArray.createNestedObject();
-        scene["id"] = i;
-        scene["name"] = scenes[i].name;
+// GET /scenes page: the opening, then one scene per piece
+struct SceneItems {
+    static const size_t ITEM_MAX = 128 + CHANNEL_COUNT * 112;
+    int offset, limit;
+    int nextSlot = 0;
+    int total = 0;  // Scenes passed so far
+    bool opened = false;
+    
+    SceneItems(int offset, int limit) : offset(offset), limit(limit) {}
+    
+    bool writeNext(Print &out) {
+        if (!opened) {
+            out.print("{\"scenes\":[");
+            opened = true;
+            return true;
+        }
         
-        JsonArray devicesArray = scene.createNestedArray("devices");
-        for (int j = 0; j < 4; j++) {
-            if (scenes[i].devices[j].deviceId >= 0) {
+        for (; nextSlot < SCENE_MAX_COUNT; nextSlot++) {
+            const Scene *scene = getScene(nextSlot);
+            if (!scene) continue;
+            if (total++ < offset || total > offset + limit) continue;
+            
+            StaticJsonDocument<128 + CHANNEL_COUNT * 112> sceneObj;
+            sceneObj["id"] = nextSlot;
+            sceneObj["name"] = scene->name;
+            
+            JsonArray devicesArray = sceneObj.createNestedArray("devices");
+            const SceneEntry *entries = getSceneEntries(*scene);
+            for (int j = 0; j < scene->entryCount; j++) {
                 JsonObject device = devicesArray.createNestedObject();
-                device["id"] = scenes[i].devices[j].deviceId;
-                device["state"] = scenes[i].devices[j].state;
-                device["brightness"] = scenes[i].devices[j].brightness;
+                device["id"] = entries[j].deviceId;
+                device["state"] = (bool)entries[j].state;
+                device["brightness"] = entries[j].brightness;
+                device["fade_ms"] = entries[j].fadeMs;
+                device["curve"] = fadeCurveName((FadeCurve)entries[j].curve);
             }
+            
+            if (total > offset + 1) out.print(',');
+            serializeJson(sceneObj, out);
+            nextSlot++;
+            return true;
         }
+        
+        out.printf("],\"total\":%d,\"offset\":%d,\"limit\":%d}", total, offset, limit);
+        return false;
     }
+};
+
+void handleGetScenes() {
+    int offset = constrain(queryArgInt("offset", 0), 0L, (long)SCENE_MAX_COUNT);
+    int limit = constrain(queryArgInt("limit", SCENE_PAGE_DEFAULT), 1L, (long)SCENE_PAGE_MAX);
     
-    sendJsonResponse(200, doc);
+    sendChunkedBody(SceneItems(offset, limit));
 }
 
 void handlePostScene() {
-    DynamicJsonDocument doc(1024);
+    StaticJsonDocument<1024> doc;
     
     if (!parseJsonBody(doc)) {
         sendErrorResponse(400, "Invalid JSON");
@@ -355,46 +957,89 @@ void handlePostScene() {
     }
     
     int sceneId = doc.containsKey("id") ? doc["id"].as<int>() : -1;
+    const Scene *existing = NULL;
     
-    // Find or create scene
-    if (sceneId < 0) {
-        for (int i = 0; i < SCENE_MAX_COUNT; i++) {
-            if (!scenes[i].active) {
-                sceneId = i;
-                break;
-            }
-        }
-        
-        if (sceneId < 0) {
-            sendErrorResponse(400, "No available scene slots");
+    if (sceneId >= 0) {
+        existing = getScene(sceneId);
+        if (!existing) {
+            sendErrorResponse(400, "Invalid scene ID");
             return;
         }
-    } else if (sceneId >= SCENE_MAX_COUNT) {
-        sendErrorResponse(400, "Invalid scene ID");
-        return;
     }
     
-    // Update scene
+    // Name is required for a new scene; an update may keep the old one
+    char name[SCENE_NAME_LEN];
     if (doc.containsKey("name")) {
-        scenes[sceneId].name = doc["name"].as<String>();
+        const char* requested = doc["name"].as<const char*>();
+        if (!requested || !requested[0] || strlen(requested) >= SCENE_NAME_LEN) {
+            sendErrorResponse(400, "Name must be 1-23 characters");
+            return;
+        }
+        strlcpy(name, requested, sizeof(name));
+    } else if (existing) {
+        strlcpy(name, existing->name, sizeof(name));
+    } else {
+        sendErrorResponse(400, "name required");
+        return;
     }
     
-    scenes[sceneId].active = true;
+    int owner = findSceneByName(name);
+    if (owner >= 0 && owner != sceneId) {
+        sendErrorResponse(409, "Scene name already in use");
+        return;
+    }
     
+    // Device list replaces the old one; without it the entries are kept
+    SceneEntry entries[CHANNEL_COUNT];
+    int count = 0;
     if (doc.containsKey("devices")) {
-        JsonArray devicesArray = doc["devices"].as<JsonArray>();
-        int idx = 0;
-        for (JsonObject device : devicesArray) {
-            if (idx >= 4) break;
+        ChannelMask seen = 0;
+        for (JsonObjectConst device : doc["devices"].as<JsonArrayConst>()) {
+            int devId = device["id"] | -1;
+            int brightness = device["brightness"] | 100;
+            uint32_t fadeMs;
+            FadeCurve curve;
             
-            scenes[sceneId].devices[idx].deviceId = device["id"].as<int>();
-            scenes[sceneId].devices[idx].state = device["state"].as<bool>();
-            scenes[sceneId].devices[idx].brightness = device["brightness"].as<int>();
-            idx++;
+            if (!isValidDeviceId(devId) || (seen & (1 << devId))) {
+                sendErrorResponse(400, "Invalid or repeated device id");
+                return;
+            }
+            if (brightness < 0 || brightness > 100) {
+                sendErrorResponse(400, "Brightness must be 0-100");
+                return;
+            }
+            if (!parseFadeFields(device, fadeMs, curve)) {
+                sendErrorResponse(400, "Invalid fade_ms (0 or 50-14400000) or curve");
+                return;
+            }
+            
+            seen |= (1 << devId);
+            SceneEntry &entry = entries[count++];
+            entry.deviceId = devId;
+            entry.state = device["state"].as<bool>();
+            entry.brightness = brightness;
+            entry.fadeMs = fadeMs;
+            entry.curve = curve;
+            entry.reserved = 0;
+        }
+    } else if (existing) {
+        count = existing->entryCount;
+        memcpy(entries, getSceneEntries(*existing), count * sizeof(SceneEntry));
+    }
+    
+    if (sceneId < 0) {
+        sceneId = allocateScene();
+        if (sceneId < 0) {
+            sendErrorResponse(400, "No available scene slots");
+            return;
         }
     }
     
-    saveScenes();
+    if (!setScene(sceneId, name, entries, count)) {
+        sendErrorResponse(400, "Scene storage full");
+        return;
+    }
+    markConfigDirty(CONFIG_SCENES);
     
     StaticJsonDocument<128> response;
     response["success"] = true;
@@ -403,7 +1048,7 @@ void handlePostScene() {
 }
 
 void handleActivateScene() {
-    String uri = localServer.uri();
+    const String &uri = apiRequest->url();
     // Extract scene ID from URI like "/scenes/0/activate"
     int firstSlash = uri.indexOf('/');
     int secondSlash = uri.indexOf('/', firstSlash + 1);
@@ -412,17 +1057,30 @@ void handleActivateScene() {
     String idStr = uri.substring(secondSlash + 1, thirdSlash);
     int sceneId = idStr.toInt();
     
-    if (sceneId < 0 || sceneId >= SCENE_MAX_COUNT) {
-        sendErrorResponse(400, "Invalid scene ID");
+    if (!getScene(sceneId)) {
+        sendErrorResponse(404, "Scene not found");
         return;
     }
     
-    if (!scenes[sceneId].active) {
-        sendErrorResponse(404, "Scene not found");
+    activateScene(sceneId);
+    
+    StaticJsonDocument<64> response;
+    response["success"] = true;
+    sendJsonResponse(200, response);
+}
+
+void handleActivateSceneByName() {
+    StaticJsonDocument<128> doc;
+    
+    if (!parseJsonBody(doc) || !doc["name"].is<const char*>()) {
+        sendErrorResponse(400, "name required");
         return;
     }
     
-    activateScene(sceneId);
+    if (!activateSceneByName(doc["name"].as<const char*>())) {
+        sendErrorResponse(404, "Scene not found");
+        return;
+    }
     
     StaticJsonDocument<64> response;
     response["success"] = true;
@@ -430,31 +1088,174 @@ void handleActivateScene() {
 }
 
 void handleDeleteScene() {
-    String uri = localServer.uri();
+    const String &uri = apiRequest->url();
     int sceneId = uri.substring(uri.lastIndexOf('/') + 1).toInt();
     
-    if (sceneId < 0 || sceneId >= SCENE_MAX_COUNT) {
+    if (!getScene(sceneId)) {
         sendErrorResponse(400, "Invalid scene ID");
         return;
     }
     
-    scenes[sceneId].active = false;
-    scenes[sceneId].name = "";
-    saveScenes();
+    deleteScene(sceneId);
+    markConfigDirty(CONFIG_SCENES);
+    
+    StaticJsonDocument<64> response;
+    response["success"] = true;
+    sendJsonResponse(200, response);
+}
+
+static void addHistogram(JsonObject parent, const char* key, const IsrHistogram& hist) {
+    JsonObject obj = parent.createNestedObject(key);
+    JsonArray counts = obj.createNestedArray("counts");
+    for (int b = 0; b < ISR_HIST_BUCKETS; b++) {
+        counts.add(hist.counts[b]);
+    }
+    obj["max_us"] = hist.maxUs;
+}
+
+// GET /metrics/isr: the bucket bounds, then one core per piece
+struct IsrMetricsItems {
+    static const size_t ITEM_MAX = 1280;
+    int nextCore = -1;
+    bool first = true;
+    
+    bool writeNext(Print &out) {
+        if (nextCore < 0) {
+            out.print("{\"bucket_upper_us\":[");
+            for (int b = 0; b < ISR_HIST_BUCKETS - 1; b++) {
+                out.printf(b > 0 ? ",%lu" : "%lu", 1UL << b);
+            }
+            out.print("],\"cores\":[");
+            nextCore = 0;
+            return true;
+        }
+        
+        for (; nextCore < portNUM_PROCESSORS; nextCore++) {
+            int c = nextCore;
+            const IsrMetrics& m = getIsrMetrics(c);
+            if (m.zeroCrossEdges == 0 && m.timerInterrupts == 0) continue;
+            
+            StaticJsonDocument<2048> doc;
+            JsonObject core = doc.to<JsonObject>();
+            core["core"] = c;
+            core["zero_cross_edges"] = m.zeroCrossEdges;
+            core["missed_edges"] = m.missedEdges;
+            core["rejected_edges"] = m.rejectedEdges;
+            core["timer_interrupts"] = m.timerInterrupts;
+            core["min_interval_us"] = m.minIntervalUs;
+            core["max_interval_us"] = m.maxIntervalUs;
+            addHistogram(core, "fire_error", m.fireError);
+            addHistogram(core, "zero_cross_isr", m.zeroCrossIsr);
+            addHistogram(core, "timer_isr", m.timerIsr);
+            addHistogram(core, "zero_cross_deviation", m.zeroCrossDeviation);
+            
+            if (!first) out.print(',');
+            serializeJson(doc, out);
+            first = false;
+            nextCore++;
+            return true;
+        }
+        
+        out.print("]}");
+        return false;
+    }
+};
+
+void handleGetIsrMetrics() {
+    sendChunkedBody(IsrMetricsItems());
+}
+
+void handleResetIsrMetrics() {
+    resetIsrMetrics();
+    
+    StaticJsonDocument<64> response;
+    response["success"] = true;
+    sendJsonResponse(200, response);
+}
+
+void handleGetScheduleMetrics() {
+    const ScheduleStats& stats = getScheduleStats();
+    StaticJsonDocument<384> doc;
+    
+    doc["evaluations"] = stats.evaluations;
+    doc["avg_eval_us"] = stats.evaluations ? (float)stats.totalEvalUs / stats.evaluations : 0.0f;
+    doc["max_eval_us"] = stats.maxEvalUs;
+    doc["transitions"] = stats.transitions;
+    
+    time_t span = stats.since ? time(nullptr) - stats.since : 0;
+    doc["transitions_per_day"] = span > 0 ? stats.transitions * 86400.0f / span : 0.0f;
+    doc["rebuilds"] = stats.rebuilds;
+    doc["pending"] = stats.pending;
+    doc["schedules"] = scheduleCount();
+    doc["capacity"] = scheduleCapacity();
+    
+    sendJsonResponse(200, doc);
+}
+
+void handleResetScheduleMetrics() {
+    resetScheduleStats();
+    
+    StaticJsonDocument<64> response;
+    response["success"] = true;
+    sendJsonResponse(200, response);
+}
+
+void handleGetStorageMetrics() {
+    const StorageStats& stats = getStorageStats();
+    StaticJsonDocument<512> doc;
+    
+    doc["save_requests"] = stats.saveRequests;
+    doc["flash_writes"] = stats.flashWrites;
+    doc["writes_avoided"] = stats.writesAvoided;
+    doc["failed_writes"] = stats.failedWrites;
+    doc["flushes"] = stats.flushes;
+    doc["bytes_written"] = stats.bytesWritten;
+    uint32_t writes = stats.flashWrites + stats.failedWrites;
+    doc["avg_write_us"] = writes ? (float)stats.totalWriteUs / writes : 0.0f;
+    doc["max_write_us"] = stats.maxWriteUs;
+    
+    JsonArray pending = doc.createNestedArray("pending");
+    if (stats.pending & CONFIG_DEVICES) pending.add("devices");
+    if (stats.pending & CONFIG_SCHEDULES) pending.add("schedules");
+    if (stats.pending & CONFIG_SCENES) pending.add("scenes");
+    
+    const JournalStats& journal = getJournalStats();
+    JsonObject journalDoc = doc.createNestedObject("journal");
+    journalDoc["records"] = journal.records;
+    journalDoc["erases"] = journal.erases;
+    journalDoc["avg_append_us"] = journal.records ? (float)journal.totalAppendUs / journal.records : 0.0f;
+    journalDoc["max_append_us"] = journal.maxAppendUs;
+    journalDoc["sequence"] = journal.sequence;
+    
+    sendJsonResponse(200, doc);
+}
+
+void handleResetStorageMetrics() {
+    resetStorageStats();
     
     StaticJsonDocument<64> response;
     response["success"] = true;
     sendJsonResponse(200, response);
 }
 
+// Restart asked for by a handler. The connectivity loop carries it out
+// once the response has had API_RESTART_DELAY_MS to go out
+enum PendingRestart { RESTART_NONE, RESTART_REBOOT, RESTART_FACTORY_RESET };
+static volatile PendingRestart pendingRestart = RESTART_NONE;
+static unsigned long restartRequestedMs = 0;
+
+static void requestRestart(PendingRestart kind) {
+    restartRequestedMs = millis();
+    pendingRestart = kind;
+}
+
 void handleRestart() {
     StaticJsonDocument<64> doc;
     doc["success"] = true;
     doc["message"] = "Restarting device...";
     sendJsonResponse(200, doc);
     
-    delay(500);
-    ESP.restart();
+    requestRestart(RESTART_REBOOT);
 }
 
 void handleFactoryReset() {
@@ -475,16 +1276,27 @@ void handleFactoryReset() {
     response["message"] = "Factory reset initiated...";
     sendJsonResponse(200, response);
     
-    delay(500);
-    
-    // Clear WiFi settings
-    WiFiManager wm;
-    wm.resetSettings();
+    requestRestart(RESTART_FACTORY_RESET);
+}
+
+void processPendingRestart() {
+    if (pendingRestart == RESTART_NONE || millis() - restartRequestedMs < API_RESTART_DELAY_MS) return;
     
-    // Clear all preferences
-    preferences.begin(PREF_NAMESPACE, false);
-    preferences.clear();
-    preferences.end();
+    if (pendingRestart == RESTART_FACTORY_RESET) {
+        // Clear WiFi settings
+        WiFiManager wm;
+        wm.resetSettings();
+        
+        // Clear all preferences; pending writes would only be erased again
+        discardConfigChanges();
+        eraseJournal();
+        preferences.begin(PREF_NAMESPACE, false);
+        preferences.clear();
+        preferences.end();
+    } else {
+        flushConfig();
+        flushJournal();
+    }
     
     ESP.restart();
 }
@@ -549,15 +1361,49 @@ void initWebSocket() {
     logMessage(LOG_INFO, "WebSocket server initialized on port 81");
 }
 
+static void addDeviceStates(JsonArray devicesArray, ChannelMask channels) {
+    while (channels) {
+        int i = __builtin_ctz(channels);
+        channels &= channels - 1;
+        
+        JsonObject device = devicesArray.createNestedObject();
+        device["id"] = i;
+        device["state"] = devices[i].state;
+        device["brightness"] = devices[i].brightness;
+        device["name"] = devices[i].name;
+    }
+}
+
+void broadcastSceneApplied(int sceneId, ChannelMask channels) {
+    DynamicJsonDocument doc(128 + CHANNEL_COUNT * 128);
+    doc["type"] = "scene_applied";
+    doc["scene_id"] = sceneId;
+    addDeviceStates(doc.createNestedArray("devices"), channels);
+    
+    String message;
+    serializeJson(doc, message);
+    webSocket.broadcastTXT(message);
+}
+
+void broadcastDevicesUpdate(ChannelMask channels) {
+    DynamicJsonDocument doc(128 + CHANNEL_COUNT * 128);
+    doc["type"] = "devices_update";
+    addDeviceStates(doc.createNestedArray("devices"), channels);
+    
+    String message;
+    serializeJson(doc, message);
+    webSocket.broadcastTXT(message);
+}
+
 void broadcastSystemStatus() {
-    DynamicJsonDocument doc(1024);
+    DynamicJsonDocument doc(256 + CHANNEL_COUNT * 192);
     doc["type"] = "system_status";
     doc["uptime"] = getUptimeSeconds();
     doc["rssi"] = WiFi.RSSI();
     doc["cloud_connected"] = cloudConnected;
     
     JsonArray devicesArray = doc.createNestedArray("devices");
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
         JsonObject device = devicesArray.createNestedObject();
         device["id"] = i;
         device["state"] = devices[i].state;
@@ -574,33 +1420,87 @@ void broadcastSystemStatus() {
 // API INITIALIZATION
 // ================================================================
 
-void initLocalAPI() {
-    // REST endpoints
-    localServer.on("/status", HTTP_GET, handleGetStatus);
-    localServer.on("/control", HTTP_POST, handlePostControl);
-    localServer.on("/info", HTTP_GET, handleGetInfo);
-    localServer.on("/config", HTTP_POST, handlePostConfig);
-    localServer.on("/schedules", HTTP_GET, handleGetSchedules);
-    localServer.on("/schedules", HTTP_POST, handlePostSchedule);
-    localServer.on("/scenes", HTTP_GET, handleGetScenes);
-    localServer.on("/scenes", HTTP_POST, handlePostScene);
-    localServer.on("/restart", HTTP_POST, handleRestart);
-    localServer.on("/factory-reset", HTTP_POST, handleFactoryReset);
+struct ApiRoute {
+    const char* uri;
+    WebRequestMethod method;
+    void (*handler)();
+};
+
+// Matched exactly; AsyncWebServer's own routes would also take any
+// longer path below theirs ("/scenes" for "/scenes/3/activate")
+static const ApiRoute apiRoutes[] = {
+    {"/status", HTTP_GET, handleGetStatus},
+    {"/control", HTTP_POST, handlePostControl},
+    {"/control/batch", HTTP_POST, handlePostControlBatch},
+    {"/info", HTTP_GET, handleGetInfo},
+    {"/config", HTTP_POST, handlePostConfig},
+    {"/schedules", HTTP_GET, handleGetSchedules},
+    {"/schedules", HTTP_POST, handlePostSchedule},
+    {"/scenes", HTTP_GET, handleGetScenes},
+    {"/scenes", HTTP_POST, handlePostScene},
+    {"/scenes/activate", HTTP_POST, handleActivateSceneByName},
+    {"/metrics/isr", HTTP_GET, handleGetIsrMetrics},
+    {"/metrics/isr/reset", HTTP_POST, handleResetIsrMetrics},
+    {"/metrics/schedules", HTTP_GET, handleGetScheduleMetrics},
+    {"/metrics/schedules/reset", HTTP_POST, handleResetScheduleMetrics},
+    {"/metrics/storage", HTTP_GET, handleGetStorageMetrics},
+    {"/metrics/storage/reset", HTTP_POST, handleResetStorageMetrics},
+    {"/restart", HTTP_POST, handleRestart},
+    {"/factory-reset", HTTP_POST, handleFactoryReset},
+};
+
+static void handleNotFound() {
+    sendErrorResponse(404, "Endpoint not found");
+}
+
+static void (*findApiHandler(const String &uri, WebRequestMethodComposite method))() {
+    for (const ApiRoute &route : apiRoutes) {
+        if (route.method == method && uri == route.uri) return route.handler;
+    }
     
     // Pattern matching for DELETE and activate endpoints
-    localServer.onNotFound([]() {
-        String uri = localServer.uri();
-        
-        if (uri.startsWith("/schedules/") && localServer.method() == HTTP_DELETE) {
-            handleDeleteSchedule();
-        } else if (uri.startsWith("/scenes/") && uri.endsWith("/activate") && localServer.method() == HTTP_POST) {
-            handleActivateScene();
-        } else if (uri.startsWith("/scenes/") && localServer.method() == HTTP_DELETE) {
-            handleDeleteScene();
-        } else {
-            sendErrorResponse(404, "Endpoint not found");
-        }
-    });
+    if (uri.startsWith("/schedules/") && method == HTTP_DELETE) return handleDeleteSchedule;
+    if (uri.startsWith("/scenes/") && uri.endsWith("/activate") && method == HTTP_POST) return handleActivateScene;
+    if (uri.startsWith("/scenes/") && method == HTTP_DELETE) return handleDeleteScene;
+    return handleNotFound;
+}
+
+// Body bytes arrive in pieces as AsyncTCP receives them; the request
+// frees _tempObject when it is destroyed
+static void collectRequestBody(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+    if (total > API_MAX_BODY_SIZE) return;  // Handler then reports invalid JSON
+    if (index == 0) request->_tempObject = malloc(total + 1);
+    
+    char *body = (char *)request->_tempObject;
+    if (!body || index + len > total) return;
+    memcpy(body + index, data, len);
+    body[index + len] = '\0';
+}
+
+// Runs on the AsyncTCP task once the request is complete. Handlers hold
+// controlMutex, which the connectivity loop takes for each pass; if the
+// loop keeps it (cloud update, OTA) the client gets 503 instead of the
+// server stalling
+static void handleApiRequest(AsyncWebServerRequest *request) {
+    void (*handler)() = findApiHandler(request->url(), request->method());
+    apiRequest = request;
+    
+    if (xSemaphoreTake(controlMutex, pdMS_TO_TICKS(API_LOCK_TIMEOUT_MS)) != pdTRUE) {
+        sendErrorResponse(503, "Busy, try again");
+    } else {
+        apiLockHeld = true;
+        runMeasuredHandler(handler);
+        apiLockHeld = false;
+        xSemaphoreGive(controlMutex);
+    }
+    
+    apiRequest = NULL;
+}
+
+void initLocalAPI() {
+    // Every request goes through the catch-all handlers and our own routing
+    localServer.onRequestBody(collectRequestBody);
+    localServer.onNotFound(handleApiRequest);
     
     localServer.begin();
     logMessage(LOG_INFO, "Local API server started on port 8080");
@@ -610,7 +1510,7 @@ void initLocalAPI() {
 }
 
 void handleLocalAPIRequests() {
-    localServer.handleClient();
+    // HTTP is served by AsyncTCP; only the WebSocket server is polled
     webSocket.loop();
 }
 
@@ -37,19 +37,70 @@ int getCurrentMinutes();
  * Activate a scene
  * Applies the device states defined in the scene
  * 
- * @param sceneId Scene index (0-9)
+ * @param sceneId Scene index (0 to SCENE_MAX_COUNT-1)
  */
 void activateScene(int sceneId);
 
+/**
+ * Activate a scene by name (case-insensitive hash lookup)
+ * 
+ * @param name Scene name
+ * @return false if no scene has that name
+ */
+bool activateSceneByName(const char *name);
+
 // ================================================================
 // SCHEDULES
 // ================================================================
 
 /**
  * Process schedules
- * Check and execute active schedules based on current time
- * Call periodically (e.g., every minute)
+ * Runs every schedule transition that is due. Pending transitions are
+ * kept in a time-ordered queue, so this returns immediately when nothing
+ * is due; rebuilds the queue when the wall clock is first set or jumps.
+ * Call from the main loop on every pass
  */
 void processSchedules();
 
+/**
+ * Requeue one schedule after it was created, changed or deleted
+ * A schedule changed mid-window takes effect immediately
+ * 
+ * @param scheduleId Schedule index (0 to SCHEDULE_MAX_COUNT-1)
+ */
+void scheduleUpdated(int scheduleId);
+
+/**
+ * Schedule engine counters, for the metrics API and host benchmarks
+ */
+struct ScheduleStats {
+    uint32_t evaluations;   // processSchedules() passes with a valid clock
+    uint32_t transitions;   // Events run (start, ramp, end)
+    uint32_t rebuilds;      // Full queue rebuilds (clock set or stepped)
+    uint64_t totalEvalUs;   // Time spent in those passes
+    uint32_t maxEvalUs;
+    uint16_t pending;       // Events currently queued
+    time_t since;           // Wall clock of the first pass after a reset
+};
+
+/**
+ * Current schedule engine counters
+ */
+const ScheduleStats& getScheduleStats();
+
+/**
+ * Clear the schedule engine counters
+ */
+void resetScheduleStats();
+
+#ifdef HOST_SIMULATION
+/**
+ * Host build seam: wall clock read by the schedule engine instead of
+ * time(), so a host program can fast-forward virtual time. Local time
+ * still comes from localtime_r()/mktime() and the TZ environment.
+ * Provided by the host simulation
+ */
+extern time_t hostWallClock();
+#endif
+
 #endif // AUTOMATION_H
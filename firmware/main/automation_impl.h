@@ -9,11 +9,10 @@
 #include "automation.h"
 
 // External references
-extern Device devices[4];
-extern Schedule schedules[SCHEDULE_MAX_COUNT];
-extern Scene scenes[SCENE_MAX_COUNT];
-extern void setDeviceState(int deviceId, bool state, int brightness, bool fade);
+extern Device devices[CHANNEL_COUNT];
+extern void setDeviceState(int deviceId, bool state, int brightness, bool fade, uint32_t fadeMs, FadeCurve curve);
 extern void logMessage(LogLevel level, const char* format, ...);
+extern void broadcastSceneApplied(int sceneId, ChannelMask channels);
 
 // ================================================================
 // UTILITY FUNCTIONS
@@ -36,60 +35,422 @@ int getCurrentMinutes() {
 // ================================================================
 
 void activateScene(int sceneId) {
-    if (sceneId < 0 || sceneId >= SCENE_MAX_COUNT) return;
-    if (!scenes[sceneId].active) return;
-    
-    logMessage(LOG_INFO, "Activating scene: %s", scenes[sceneId].name.c_str());
-    
-    for (int i = 0; i < 4; i++) {
-        if (scenes[sceneId].devices[i].deviceId >= 0) {
-            int devId = scenes[sceneId].devices[i].deviceId;
-            setDeviceState(devId, 
-                          scenes[sceneId].devices[i].state,
-                          scenes[sceneId].devices[i].brightness,
-                          true);  // Use fade transition
-        }
+    const Scene *scene = getScene(sceneId);
+    if (!scene) return;
+    
+    logMessage(LOG_INFO, "Activating scene: %s", scene->name);
+    
+    const SceneEntry *entries = getSceneEntries(*scene);
+    DeviceChange changes[CHANNEL_COUNT] = {};
+    int count = scene->entryCount;
+    for (int i = 0; i < count; i++) {
+        changes[i].deviceId = entries[i].deviceId;
+        changes[i].state = entries[i].state;
+        changes[i].brightness = entries[i].brightness;
+        changes[i].fadeMs = entries[i].fadeMs;
+        changes[i].curve = entries[i].curve;
     }
+    
+    // All channels commit together and clients get a single message
+    ChannelMask applied = applyDeviceChanges(changes, count);
+    if (applied) {
+        broadcastSceneApplied(sceneId, applied);
+    } else if (count > 0) {
+        logMessage(LOG_WARN, "Scene %d not applied: invalid entries", sceneId);
+    }
+}
+
+bool activateSceneByName(const char *name) {
+    int sceneId = findSceneByName(name);
+    if (sceneId < 0) return false;
+    activateScene(sceneId);
+    return true;
 }
 
 // ================================================================
 // SCHEDULES
 // ================================================================
 
-void processSchedules() {
-    int currentMins = getCurrentMinutes();
-    if (currentMins < 0) return;  // Time not available
+// Upcoming schedule transition
+// START applies the level for the current point of the window and starts
+// its ramp; RAMP hands the fade engine the next FADE_MAX_MS of a long ramp;
+// END closes the window and hands the device to the next open window
+enum ScheduleEventKind : uint8_t {
+    SCHED_EVENT_START = 0,
+    SCHED_EVENT_RAMP = 1,
+    SCHED_EVENT_END = 2
+};
+
+struct ScheduleEvent {
+    time_t when;
+    time_t windowStart;
+    time_t windowEnd;
+    uint16_t scheduleId;
+    uint8_t kind;
+};
+
+// Min-heap of each schedule's next transition (at most one per schedule),
+// sized to follow the schedule store's capacity
+static ScheduleEvent *scheduleHeap = NULL;
+static int16_t *scheduleHeapPos = NULL;  // Per schedule id, -1 = nothing queued
+static int scheduleHeapCapacity = 0;
+static int scheduleHeapSize = 0;
+
+// Schedule whose window currently drives each device (-1 = none)
+static int16_t scheduleOwner[CHANNEL_COUNT];
+
+static ScheduleStats scheduleStats = {};
+
+// Wall clock tracking for jump detection
+static bool scheduleQueueReady = false;
+static time_t scheduleLastWall = 0;
+static unsigned long scheduleLastMillis = 0;
+
+// Grow the heap alongside the store; returns false if out of memory
+static bool ensureScheduleHeap() {
+    int capacity = scheduleCapacity();
+    if (capacity <= scheduleHeapCapacity) return true;
     
-    struct tm timeinfo;
-    if (!getLocalTime(&timeinfo)) return;
-    int currentDay = timeinfo.tm_wday;  // 0=Sunday
+    ScheduleEvent *heap = (ScheduleEvent *)realloc(scheduleHeap, capacity * sizeof(ScheduleEvent));
+    if (!heap) return false;
+    scheduleHeap = heap;
+    
+    int16_t *pos = (int16_t *)realloc(scheduleHeapPos, capacity * sizeof(int16_t));
+    if (!pos) return false;
+    scheduleHeapPos = pos;
+    
+    for (int i = scheduleHeapCapacity; i < capacity; i++) {
+        scheduleHeapPos[i] = -1;
+    }
+    scheduleHeapCapacity = capacity;
+    return true;
+}
+
+static void heapSwap(int a, int b) {
+    ScheduleEvent tmp = scheduleHeap[a];
+    scheduleHeap[a] = scheduleHeap[b];
+    scheduleHeap[b] = tmp;
+    scheduleHeapPos[scheduleHeap[a].scheduleId] = a;
+    scheduleHeapPos[scheduleHeap[b].scheduleId] = b;
+}
+
+// Heap order: by time; at the same second windows close before others
+// open, so a window ending as another starts hands over first
+static bool eventBefore(const ScheduleEvent &a, const ScheduleEvent &b) {
+    if (a.when != b.when) return a.when < b.when;
+    return a.kind > b.kind;
+}
+
+static void heapSiftUp(int pos) {
+    while (pos > 0) {
+        int parent = (pos - 1) / 2;
+        if (!eventBefore(scheduleHeap[pos], scheduleHeap[parent])) break;
+        heapSwap(pos, parent);
+        pos = parent;
+    }
+}
+
+static void heapSiftDown(int pos) {
+    while (true) {
+        int smallest = pos;
+        int left = 2 * pos + 1;
+        int right = left + 1;
+        if (left < scheduleHeapSize && eventBefore(scheduleHeap[left], scheduleHeap[smallest])) smallest = left;
+        if (right < scheduleHeapSize && eventBefore(scheduleHeap[right], scheduleHeap[smallest])) smallest = right;
+        if (smallest == pos) break;
+        heapSwap(pos, smallest);
+        pos = smallest;
+    }
+}
+
+static void heapPush(const ScheduleEvent &event) {
+    if (event.scheduleId >= scheduleHeapCapacity) return;
+    int pos = scheduleHeapSize++;
+    scheduleHeap[pos] = event;
+    scheduleHeapPos[event.scheduleId] = pos;
+    heapSiftUp(pos);
+}
+
+static void heapRemove(int scheduleId) {
+    if (scheduleId >= scheduleHeapCapacity) return;
+    int pos = scheduleHeapPos[scheduleId];
+    if (pos < 0) return;
+    
+    scheduleHeapPos[scheduleId] = -1;
+    int last = --scheduleHeapSize;
+    if (pos == last) return;
+    
+    // Move the last event into the hole, then restore heap order
+    int movedId = scheduleHeap[last].scheduleId;
+    scheduleHeap[pos] = scheduleHeap[last];
+    scheduleHeapPos[movedId] = pos;
+    heapSiftUp(pos);
+    heapSiftDown(scheduleHeapPos[movedId]);
+}
+
+// Queued event of a schedule whose window is open at now, or NULL
+static const ScheduleEvent *openWindowEvent(int scheduleId, time_t now) {
+    if (scheduleId < 0 || scheduleId >= scheduleHeapCapacity) return NULL;
+    int pos = scheduleHeapPos[scheduleId];
+    if (pos < 0) return NULL;
+    const ScheduleEvent &event = scheduleHeap[pos];
+    if (event.windowStart > now || event.windowEnd <= now) return NULL;
+    return &event;
+}
+
+// Overlap rule: higher priority, then the later start, then the higher id
+static bool scheduleOutranks(int a, time_t aStart, int b, time_t bStart) {
+    uint8_t aPriority = getSchedule(a)->priority;
+    uint8_t bPriority = getSchedule(b)->priority;
+    if (aPriority != bPriority) return aPriority > bPriority;
+    if (aStart != bStart) return aStart > bStart;
+    return a > b;
+}
+
+// Local time of a minute of the day, dayOffset days after base (DST-aware)
+// A minute skipped by a DST change maps to the moment the clock jumps
+static time_t localTimeAt(const struct tm &base, int dayOffset, int mins) {
+    struct tm t = base;
+    t.tm_mday += dayOffset;
+    t.tm_hour = mins / 60;
+    t.tm_min = mins % 60;
+    t.tm_sec = 0;
+    t.tm_isdst = -1;
+    time_t when = mktime(&t);
+    if (t.tm_hour * 60 + t.tm_min == mins) return when;
+    
+    // mktime() moved it by the size of the jump; find the jump itself
+    time_t low = when - 3 * 3600;
+    time_t high = when + 3 * 3600;
+    struct tm probe;
+    localtime_r(&low, &probe);
+    int dstBefore = probe.tm_isdst;
+    while (high - low > 1) {
+        time_t mid = low + (high - low) / 2;
+        localtime_r(&mid, &probe);
+        if (probe.tm_isdst == dstBefore) low = mid; else high = mid;
+    }
+    return high;
+}
+
+// Find the first window of a schedule that has not ended by now
+// Returns false if the schedule can never run
+static bool findNextWindow(int scheduleId, time_t now, ScheduleEvent &event) {
+    const Schedule *sched = getSchedule(scheduleId);
+    if (!sched || !sched->active || !isValidDeviceId(sched->deviceId) || !sched->daysOfWeek) return false;
+    if (sched->startMins == sched->endMins) return false;
+    
+    // Windows ending before they start run past midnight into the next day
+    int endDay = sched->endMins < sched->startMins ? 1 : 0;
+    
+    struct tm today;
+    localtime_r(&now, &today);
+    
+    // Start from yesterday: its overnight window may still be open. Look
+    // two weeks ahead: a weekly window skipped by DST waits for the next
+    for (int day = -1; day <= 14; day++) {
+        if (!(sched->daysOfWeek & (1 << ((today.tm_wday + day + 7) % 7)))) continue;
+        
+        time_t start = localTimeAt(today, day, sched->startMins);
+        time_t end = localTimeAt(today, day + endDay, sched->endMins);
+        if (end <= now || end <= start) continue;  // Ended, or skipped by DST
+        
+        event.when = start > now ? start : now;  // Already inside: apply now
+        event.windowStart = start;
+        event.windowEnd = end;
+        event.scheduleId = scheduleId;
+        event.kind = SCHED_EVENT_START;
+        return true;
+    }
+    return false;
+}
+
+// Queue a schedule's next window, if it has one
+static void queueNextWindow(int scheduleId, time_t now) {
+    ScheduleEvent event;
+    if (findNextWindow(scheduleId, now, event)) heapPush(event);
+}
+
+// Brightness on the schedule's linear ramp at time t
+static int scheduleLevelAt(const Schedule &sched, const ScheduleEvent &event, time_t t) {
+    long duration = event.windowEnd - event.windowStart;
+    long elapsed = constrain((long)(t - event.windowStart), 0L, duration);
+    return sched.startBrightness + (sched.endBrightness - sched.startBrightness) * elapsed / duration;
+}
+
+// Give a device with no driving window to the best window still open on it
+static void handOverDevice(int deviceId, time_t now) {
+    int best = -1;
+    time_t bestStart = 0;
+    for (int id = nextScheduleId(0, deviceId); id >= 0; id = nextScheduleId(id + 1, deviceId)) {
+        const ScheduleEvent *open = openWindowEvent(id, now);
+        if (!open || open->kind == SCHED_EVENT_START) continue;
+        if (best < 0 || scheduleOutranks(id, open->windowStart, best, bestStart)) {
+            best = id;
+            bestStart = open->windowStart;
+        }
+    }
+    if (best < 0) return;
+    
+    // Resume it as if its window were starting now
+    ScheduleEvent resume = *openWindowEvent(best, now);
+    heapRemove(best);
+    resume.when = now;
+    resume.kind = SCHED_EVENT_START;
+    heapPush(resume);
+}
+
+// Close a window and release its device
+static void endScheduleWindow(const ScheduleEvent &event, time_t now) {
+    int deviceId = getSchedule(event.scheduleId)->deviceId;
+    queueNextWindow(event.scheduleId, event.windowEnd);
+    
+    if (!isValidDeviceId(deviceId) || scheduleOwner[deviceId] != event.scheduleId) return;
+    scheduleOwner[deviceId] = -1;
+    handOverDevice(deviceId, now);
+}
+
+static void runScheduleEvent(const ScheduleEvent &event, time_t now) {
+    if (event.kind == SCHED_EVENT_END) {
+        endScheduleWindow(event, now);
+        return;
+    }
+    
+    const Schedule &sched = *getSchedule(event.scheduleId);
+    
+    // Yield to a higher-ranked window already driving this device
+    int owner = scheduleOwner[sched.deviceId];
+    if (owner >= 0 && owner != event.scheduleId) {
+        const ScheduleEvent *ownerEvent = openWindowEvent(owner, now);
+        if (ownerEvent && ownerEvent->kind != SCHED_EVENT_START &&
+            scheduleOutranks(owner, ownerEvent->windowStart, event.scheduleId, event.windowStart)) {
+            ScheduleEvent wait = event;
+            wait.when = event.windowEnd;
+            wait.kind = SCHED_EVENT_END;
+            heapPush(wait);
+            return;
+        }
+    }
+    scheduleOwner[sched.deviceId] = event.scheduleId;
+    
+    if (event.kind == SCHED_EVENT_START) {
+        // Jump to the level for this point of the window
+        int level = scheduleLevelAt(sched, event, now);
+        logMessage(LOG_INFO, "Schedule %d started on device %d at %d%%", event.scheduleId, sched.deviceId, level);
+        setDeviceState(sched.deviceId, level > 0, level, false, 0, FADE_LINEAR);
+    }
     
-    for (int i = 0; i < SCHEDULE_MAX_COUNT; i++) {
-        if (!schedules[i].active) continue;
-        if (schedules[i].deviceId < 0 || schedules[i].deviceId >= 4) continue;
+    ScheduleEvent next = event;
+    next.when = event.windowEnd;
+    next.kind = SCHED_EVENT_END;
+    
+    // Hand the rest of the ramp (or its next FADE_MAX_MS) to the fade engine
+    if (sched.startBrightness != sched.endBrightness && now < event.windowEnd) {
+        uint32_t remainingMs = (uint32_t)(event.windowEnd - now) * 1000;
+        uint32_t pieceMs = remainingMs > FADE_MAX_MS ? FADE_MAX_MS : remainingMs;
+        time_t pieceEnd = now + pieceMs / 1000;
+        int target = scheduleLevelAt(sched, event, pieceEnd);
         
-        // Check if schedule is active for current day
-        if (!(schedules[i].daysOfWeek & (1 << currentDay))) continue;
+        setDeviceState(sched.deviceId, target > 0, target, true, pieceMs, FADE_LINEAR);
         
-        // Check if current time matches schedule
-        if (currentMins >= schedules[i].startMins && currentMins < schedules[i].endMins) {
-            // Calculate brightness based on time progression
-            int duration = schedules[i].endMins - schedules[i].startMins;
-            int elapsed = currentMins - schedules[i].startMins;
-            float progress = (float)elapsed / duration;
-            
-            int targetBrightness = schedules[i].startBrightness + 
-                (int)((schedules[i].endBrightness - schedules[i].startBrightness) * progress);
-            
-            bool targetState = (targetBrightness > 0);
-            
-            // Only update if different from current state
-            if (devices[schedules[i].deviceId].state != targetState ||
-                devices[schedules[i].deviceId].brightness != targetBrightness) {
-                setDeviceState(schedules[i].deviceId, targetState, targetBrightness, true);
-            }
+        if (pieceEnd < event.windowEnd) {
+            next.when = pieceEnd;
+            next.kind = SCHED_EVENT_RAMP;
         }
     }
+    
+    heapPush(next);
+}
+
+// Wall clock for the schedule engine
+static time_t scheduleClockNow() {
+#ifdef HOST_SIMULATION
+    return hostWallClock();
+#else
+    return time(nullptr);
+#endif
+}
+
+// Recompute every schedule's next transition from scratch
+static void rebuildScheduleQueue(time_t now) {
+    if (!ensureScheduleHeap()) {
+        logMessage(LOG_ERROR, "Schedule queue: out of memory");
+        return;
+    }
+    
+    scheduleHeapSize = 0;
+    for (int i = 0; i < scheduleHeapCapacity; i++) {
+        scheduleHeapPos[i] = -1;
+    }
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        scheduleOwner[i] = -1;
+    }
+    for (int id = nextScheduleId(0); id >= 0; id = nextScheduleId(id + 1)) {
+        queueNextWindow(id, now);
+    }
+    scheduleQueueReady = true;
+    scheduleStats.rebuilds++;
+    logMessage(LOG_INFO, "Schedule queue rebuilt: %d pending", scheduleHeapSize);
+}
+
+void processSchedules() {
+    time_t now = scheduleClockNow();
+    if (now < NTP_VALID_EPOCH) return;  // Time not available
+    
+    unsigned long startUs = micros();
+    if (scheduleStats.since == 0) scheduleStats.since = now;
+    
+    // Rebuild once the clock is set and whenever it steps (NTP, manual set)
+    unsigned long nowMillis = millis();
+    long drift = (long)(now - scheduleLastWall) - (long)((nowMillis - scheduleLastMillis) / 1000);
+    if (!scheduleQueueReady || drift > 2 || drift < -2) {
+        rebuildScheduleQueue(now);
+    }
+    scheduleLastWall = now;
+    scheduleLastMillis = nowMillis;
+    
+    while (scheduleHeapSize > 0 && scheduleHeap[0].when <= now) {
+        ScheduleEvent event = scheduleHeap[0];
+        heapRemove(event.scheduleId);
+        runScheduleEvent(event, now);
+        scheduleStats.transitions++;
+    }
+    
+    uint32_t elapsedUs = micros() - startUs;
+    scheduleStats.evaluations++;
+    scheduleStats.totalEvalUs += elapsedUs;
+    if (elapsedUs > scheduleStats.maxEvalUs) scheduleStats.maxEvalUs = elapsedUs;
+}
+
+void scheduleUpdated(int scheduleId) {
+    if (scheduleId < 0 || scheduleId >= scheduleCapacity()) return;
+    if (!scheduleQueueReady) return;  // Picked up by the first rebuild
+    
+    // The store may have grown to hold a new schedule
+    if (!ensureScheduleHeap()) {
+        scheduleQueueReady = false;  // Retry from scratch next pass
+        return;
+    }
+    
+    time_t now = scheduleClockNow();
+    heapRemove(scheduleId);
+    queueNextWindow(scheduleId, now);
+    
+    // Its old window no longer drives anything
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        if (scheduleOwner[i] != scheduleId) continue;
+        scheduleOwner[i] = -1;
+        handOverDevice(i, now);
+    }
+}
+
+const ScheduleStats& getScheduleStats() {
+    scheduleStats.pending = scheduleHeapSize;
+    return scheduleStats;
+}
+
+void resetScheduleStats() {
+    memset(&scheduleStats, 0, sizeof(scheduleStats));
 }
 
 #endif // AUTOMATION_IMPL_H
@@ -0,0 +1,94 @@
+/**
+ * Brightness Curves
+ * Compile-time lookup tables mapping brightness to TRIAC phase delay
+ *
+ * Power delivered to a resistive load when firing at phase delay x
+ * (fraction of the half-cycle) is P(x) = 1 - x + sin(2*pi*x) / (2*pi).
+ * Each table picks a target power per brightness level and inverts P(x)
+ * by bisection, so the ISR path only does a table lookup.
+ */
+
+#ifndef BRIGHTNESS_CURVES_H
+#define BRIGHTNESS_CURVES_H
+
+#include "config.h"
+#include <Arduino.h>
+
+// ================================================================
+// CONSTEXPR MATH
+// ================================================================
+
+namespace curve_math {
+
+constexpr double kPi = 3.14159265358979323846;
+
+// Taylor series sine, argument reduced to [-pi, pi]
+constexpr double sine(double x) {
+    while (x > kPi) x -= 2 * kPi;
+    while (x < -kPi) x += 2 * kPi;
+
+    double term = x;
+    double sum = x;
+    for (int n = 1; n < 12; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+// Fraction of full power delivered when firing at phase delay x (0-1)
+constexpr double deliveredPower(double x) {
+    return 1.0 - x + sine(2 * kPi * x) / (2 * kPi);
+}
+
+// Phase delay (0-1) that delivers the given fraction of full power
+constexpr double phaseDelayForPower(double power) {
+    double lo = 0.0;  // Full power
+    double hi = 1.0;  // No power
+    for (int i = 0; i < 24; i++) {
+        double mid = (lo + hi) / 2;
+        if (deliveredPower(mid) > power) lo = mid; else hi = mid;
+    }
+    return (lo + hi) / 2;
+}
+
+} // namespace curve_math
+
+// ================================================================
+// CURVE TABLES
+// ================================================================
+
+enum CurveKind {
+    CURVE_DIMMER = 0,  // Perceptual: power = floor + (1 - floor) * level^2
+    CURVE_FAN = 1      // Minimum-torque floor: power = floor + (1 - floor) * level
+};
+
+/**
+ * Fire tick (0 to PHASE_STEPS) for each brightness level (0 to BRIGHTNESS_LEVELS)
+ * Level 0 never fires; level BRIGHTNESS_LEVELS fires at zero-cross
+ */
+struct PhaseCurve {
+    uint16_t fireTick[BRIGHTNESS_LEVELS + 1];
+};
+
+constexpr PhaseCurve makePhaseCurve(CurveKind kind) {
+    PhaseCurve curve = {};
+    double floor = (kind == CURVE_FAN ? FAN_MIN_POWER_PERMILLE : DIMMER_MIN_POWER_PERMILLE) / 1000.0;
+
+    curve.fireTick[0] = PHASE_STEPS;
+    for (int level = 1; level <= BRIGHTNESS_LEVELS; level++) {
+        double x = (double)level / BRIGHTNESS_LEVELS;
+        double shaped = (kind == CURVE_FAN) ? x : x * x;
+        double power = floor + (1.0 - floor) * shaped;
+        double delay = curve_math::phaseDelayForPower(power);
+        curve.fireTick[level] = (uint16_t)(delay * PHASE_STEPS + 0.5);
+    }
+    curve.fireTick[BRIGHTNESS_LEVELS] = 0;
+    return curve;
+}
+
+// Generated at compile time, placed in DRAM for ISR access
+static constexpr DRAM_ATTR PhaseCurve dimmerPhaseCurve = makePhaseCurve(CURVE_DIMMER);
+static constexpr DRAM_ATTR PhaseCurve fanPhaseCurve = makePhaseCurve(CURVE_FAN);
+
+#endif // BRIGHTNESS_CURVES_H
@@ -6,6 +6,8 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stdint.h>
+
 // ================================================================
 // FIRMWARE VERSION
 // ================================================================
@@ -18,11 +20,21 @@
 // Zero-Cross Detection Pin
 #define ZCD_PIN 13
 
-// TRIAC Control Pins (4 channels)
-const int TRIAC_PINS[4] = {16, 17, 18, 19};
+// Number of load channels (compile-time, 1-16)
+// TRIAC pins must be in GPIO bank 0 (0-31), see output_impl.h
+#define CHANNEL_COUNT 4
+
+// Bit i = channel i
+typedef uint16_t ChannelMask;
+static_assert(CHANNEL_COUNT >= 1 && CHANNEL_COUNT <= 16, "CHANNEL_COUNT must be 1-16");
 
-// Physical Switch Pins (4 channels)
-const int SWITCH_PINS[4] = {32, 33, 25, 26};
+// TRIAC Control Pins (one per channel)
+const int TRIAC_PINS[] = {16, 17, 18, 19};
+static_assert(sizeof(TRIAC_PINS) / sizeof(TRIAC_PINS[0]) == CHANNEL_COUNT, "TRIAC_PINS needs one pin per channel");
+
+// Physical Switch Pins (one per channel)
+const int SWITCH_PINS[] = {32, 33, 25, 26};
+static_assert(sizeof(SWITCH_PINS) / sizeof(SWITCH_PINS[0]) == CHANNEL_COUNT, "SWITCH_PINS needs one pin per channel");
 
 // Optional Temperature Sensor (set to -1 if not available)
 #define TEMP_SENSOR_PIN -1
@@ -36,8 +48,41 @@ const int SWITCH_PINS[4] = {32, 33, 25, 26};
 // TIMING CONFIGURATION
 // ================================================================
 // Phase angle control timing (microseconds)
+// fireTick is a fraction of the measured half-cycle (fireTick / PHASE_STEPS),
+// 1 us resolution at 50 Hz; TIMER_INTERVAL_US only paces PHASE_MODE_POLLING
 #define TIMER_INTERVAL_US 100
-#define PHASE_STEPS 100
+#define PHASE_STEPS 10000
+
+// Brightness curve resolution (levels per full scale, see brightness_curves.h)
+// and minimum delivered power for any non-zero level (per mille)
+#define BRIGHTNESS_LEVELS 1000
+#define DIMMER_MIN_POWER_PERMILLE 20   // Just above lamp visibility threshold
+#define FAN_MIN_POWER_PERMILLE 250     // Minimum torque to keep fans turning
+
+// Mains half-cycle measurement (microseconds)
+// Zero-cross intervals outside MIN..MAX are ignored by the period filter
+#define MAINS_HALF_CYCLE_NOMINAL_US 10000  // Start-up assumption (50 Hz)
+#define MAINS_HALF_CYCLE_MIN_US 7500       // ~66 Hz
+#define MAINS_HALF_CYCLE_MAX_US 11500      // ~43 Hz
+#define MAINS_FILTER_SHIFT 4               // Period/jitter EMA weight = 1/16
+
+// Zero-cross software PLL
+// Locked: edges outside +/- PLL_WINDOW_US of the prediction are rejected as
+// noise, and missing edges are replaced by the prediction up to
+// PLL_MAX_COAST_EDGES times before the signal is declared lost. Phase and
+// burst gates are released PLL_WINDOW_US before each predicted edge.
+#define PLL_LOCK_EDGES 8          // Consecutive plausible intervals to lock
+#define PLL_WINDOW_US 500         // Acceptance window around predicted edge
+#define PLL_MAX_COAST_EDGES 3     // Missed edges bridged before loss
+#define PLL_PHASE_SHIFT 2         // Phase correction gain = 1/4
+#define ZERO_CROSS_TIMEOUT_MS 100 // No accepted edge for this long = loss
+
+// TRIAC firing strategy
+// POLLING: periodic timer scans all channels every TIMER_INTERVAL_US
+// EVENT:   zero-cross arms one-shot alarms only at precomputed fire points
+#define PHASE_MODE_POLLING 0
+#define PHASE_MODE_EVENT 1
+#define PHASE_CONTROL_MODE PHASE_MODE_EVENT
 
 // Debounce delay for physical switches (milliseconds)
 #define SWITCH_DEBOUNCE_MS 50
@@ -65,6 +110,11 @@ const int SWITCH_PINS[4] = {32, 33, 25, 26};
 // WebSocket ping interval (milliseconds)
 #define WEBSOCKET_PING_INTERVAL_MS 30000
 
+// Local API (AsyncWebServer, handlers run on the AsyncTCP task)
+#define API_LOCK_TIMEOUT_MS 250      // Handler wait for the control loop before answering 503
+#define API_MAX_BODY_SIZE 4096       // Larger request bodies are not collected
+#define API_RESTART_DELAY_MS 500     // Time for a /restart response to go out
+
 // ================================================================
 // OTA UPDATE CONFIGURATION
 // ================================================================
@@ -83,6 +133,7 @@ const int SWITCH_PINS[4] = {32, 33, 25, 26};
 const char* NTP_SERVER = "pool.ntp.org";
 const long GMT_OFFSET_SEC = 19800;  // IST: UTC+5:30
 const int DAYLIGHT_OFFSET_SEC = 0;
+#define NTP_VALID_EPOCH 1609459200  // Clock treated as unset before 2021-01-01
 
 // ================================================================
 // LOGGING CONFIGURATION
@@ -102,8 +153,19 @@ enum LogLevel {
 // MEMORY CONFIGURATION
 // ================================================================
 #define JSON_BUFFER_SIZE 2048
-#define SCHEDULE_MAX_COUNT 10
-#define SCENE_MAX_COUNT 10
+#define STATE_RUNTIME_REFRESH_S 60    // Runtime counters bump the state version this often
+#define INFO_CACHE_S 10               // Cached /info body (live readings) reused this long
+#define STATUS_LONG_POLL_MS 20000     // GET /status?since= default wait
+#define STATUS_LONG_POLL_MAX_MS 60000
+#define SCHEDULE_INITIAL_CAPACITY 16  // Schedule slots allocated at boot
+#define SCHEDULE_MAX_COUNT 512        // Table grows by doubling up to this
+#define SCHEDULE_PAGE_DEFAULT 20      // GET /schedules page size
+#define SCHEDULE_PAGE_MAX 50
+#define SCENE_MAX_COUNT 128           // Scene catalog size
+#define SCENE_NAME_LEN 24             // Including the terminating NUL
+#define SCENE_ENTRY_POOL 512          // Device entries shared by all scenes
+#define SCENE_PAGE_DEFAULT 20         // GET /scenes page size
+#define SCENE_PAGE_MAX 50
 
 // ================================================================
 // DEVICE TYPES
@@ -111,7 +173,8 @@ enum LogLevel {
 enum DeviceType {
     TYPE_SWITCH = 0,
     TYPE_FAN = 1,
-    TYPE_DIMMER = 2
+    TYPE_DIMMER = 2,
+    TYPE_BURST = 3     // Whole-cycle (burst-fire) power control for resistive loads
 };
 
 // ================================================================
@@ -127,17 +190,46 @@ enum PowerOnState {
 // ================================================================
 // TRANSITION SETTINGS
 // ================================================================
-#define FADE_DURATION_MS 1000  // Default fade duration
-#define FADE_STEPS 20          // Number of steps in fade transition
+#define FADE_DURATION_MS 1000   // Default fade duration
+#define FADE_MIN_MS 50          // Shortest fade accepted
+#define FADE_MAX_MS 14400000UL  // Longest fade accepted (4 hours)
+#define FADE_CURVE_SEGMENTS 8   // Linear ISR ramps per eased/perceptual fade
+
+enum FadeCurve {
+    FADE_LINEAR = 0,       // Constant rate
+    FADE_EASE_IN_OUT = 1,  // Smoothstep: slow start and finish
+    FADE_PERCEPTUAL = 2    // Linear in sqrt(brightness): even perceived steps
+};
 
 // ================================================================
 // PREFERENCES KEYS
 // ================================================================
 #define PREF_NAMESPACE "smarthome"
-#define PREF_SYSTEM_NAME "sys_name"
-#define PREF_DEVICE_PREFIX "dev_"
-#define PREF_SCHEDULE_PREFIX "sched_"
-#define PREF_SCENE_PREFIX "scene_"
+#define PREF_SYSTEM_NAME "sys_name"      // Legacy key, migrated on boot
+#define PREF_DEVICE_PREFIX "dev_"         // Legacy per-device keys, migrated on boot
+#define PREF_DEVICE_SECTION "dev_cfg"
+#define PREF_SCHEDULE_PREFIX "sched_"     // Legacy per-slot keys, migrated on boot
+#define PREF_SCHEDULE_TABLE "sched_tbl"
+#define PREF_SCENE_PREFIX "scene_"        // Legacy per-slot keys, migrated on boot
+#define PREF_SCENE_TABLE "scene_tbl"
+
+// Section blob versions (bump and migrate in storage_impl.h on layout changes)
+#define DEVICE_SECTION_VERSION 1
+#define SCHEDULE_SECTION_VERSION 1
+#define SCENE_SECTION_VERSION 1
+#define SYSTEM_NAME_LEN 32            // Including the terminating NUL
+#define DEVICE_NAME_LEN 32
+
+// Write-behind: a changed section is written once changes stop for the
+// quiet time, or at the latest the max delay after its first change
+#define STORAGE_FLUSH_QUIET_MS 2000
+#define STORAGE_FLUSH_MAX_MS 30000
+
+// State journal: ring of fixed-size records in its own flash partition
+// (see partitions.csv), for values that change too often for NVS
+#define JOURNAL_PARTITION_LABEL "journal"
+#define JOURNAL_PARTITION_SUBTYPE 0x40       // Custom data subtype
+#define JOURNAL_RUNTIME_INTERVAL_MS 300000   // Runtime records every 5 minutes
 
 // ================================================================
 // SINRIC PRO CONFIGURATION (Google Assistant)
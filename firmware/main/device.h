@@ -8,12 +8,13 @@
 #define DEVICE_H
 
 #include "config.h"
+#include "brightness_curves.h"
 #include <Arduino.h>
 
 // ================================================================
 // EXTERNAL DEPENDENCIES
 // ================================================================
-extern portMUX_TYPE timerMux;
+extern SemaphoreHandle_t deviceMutex;
 
 // ================================================================
 // DEVICE STATE MANAGEMENT
@@ -23,18 +24,45 @@ extern portMUX_TYPE timerMux;
  * Set device state with optional fade transition
  * Thread-safe for multi-core operation
  * 
- * @param deviceId Device index (0-3)
+ * @param deviceId Device index (0 to CHANNEL_COUNT-1)
  * @param state Target state (true=ON, false=OFF)
  * @param brightness Target brightness (0-100)
  * @param fade Enable smooth fade transition
+ * @param fadeMs Fade duration, clamped to FADE_MIN_MS..FADE_MAX_MS (0 = immediate)
+ * @param curve Fade easing curve
  */
-void setDeviceState(int deviceId, bool state, int brightness, bool fade = false);
+void setDeviceState(int deviceId, bool state, int brightness, bool fade = false,
+                    uint32_t fadeMs = FADE_DURATION_MS, FadeCurve curve = FADE_LINEAR);
+
+/**
+ * One channel's entry in a batch of device changes
+ */
+struct DeviceChange {
+    int8_t deviceId;
+    bool state;
+    int8_t brightness;   // 0-100
+    uint32_t fadeMs;     // 0 = immediate
+    uint8_t curve;       // FadeCurve
+};
+
+/**
+ * Apply several device changes as one transaction
+ * Every entry is validated first; if any is invalid nothing changes.
+ * All channels are committed under one lock and one snapshot publish, so
+ * their fades start on the same zero-cross. Does not broadcast; the
+ * caller sends one message for the whole batch.
+ * 
+ * @param changes Entries, at most one per device
+ * @param count Number of entries
+ * @return Channels changed, or 0 if the batch was rejected or empty
+ */
+ChannelMask applyDeviceChanges(const DeviceChange *changes, int count);
 
 /**
  * Get device state atomically
- * Thread-safe read of device state
+ * Thread-safe read of device state (never blocks the ISRs)
  * 
- * @param deviceId Device index (0-3)
+ * @param deviceId Device index (0 to CHANNEL_COUNT-1)
  * @param state Output: current state
  * @param brightness Output: current brightness
  * @return true if successful, false if invalid deviceId
@@ -43,10 +71,19 @@ bool getDeviceState(int deviceId, bool &state, int &brightness);
 
 /**
  * Process fade transitions for all devices
- * Call regularly from main loop (Core 0)
+ * Fades run in the zero-cross ISR as linear ramps, one per fade or per
+ * FADE_CURVE_SEGMENTS piece of an eased one. Segment levels are computed
+ * from the fade's start time, so a late call never changes the curve.
+ * Call regularly from main loop (Core 0); it only acts when a ramp ends
  */
 void processFadeTransitions();
 
+/**
+ * Stop all fade transitions where they are
+ * Call with deviceMutex held, then publish
+ */
+void cancelFadeTransitions();
+
 /**
  * Update runtime statistics for all active devices
  * Call periodically to track usage time
@@ -59,26 +96,69 @@ void updateRuntimeStatistics();
  */
 void checkAutoOff();
 
+// ================================================================
+// STATE VERSION
+// ================================================================
+
+/**
+ * Version of what /status and /info report; increases on every device
+ * state, type or configuration change, and every
+ * STATE_RUNTIME_REFRESH_S while a device runs (runtime counters)
+ * Safe from either core
+ */
+uint32_t getStateVersion();
+
+/**
+ * Bump the state version after changing device state or configuration
+ */
+void stateChanged();
+
 // ================================================================
 // UTILITY FUNCTIONS
 // ================================================================
 
 /**
  * Calculate TRIAC fire tick from brightness percentage
+ * Uses the per-type curve from brightness_curves.h
  * 
+ * @param type Device type (selects dimmer or fan curve)
  * @param percent Brightness (0-100)
- * @return Fire tick delay (0-100, where 0=full brightness)
+ * @return Fire tick delay (0-PHASE_STEPS, where 0=full brightness)
+ */
+int calculateFireTick(DeviceType type, int percent);
+
+/**
+ * Look up TRIAC fire tick for a fine-grained brightness level
+ * Table lookup only, safe to call from an ISR
+ * 
+ * @param type Device type (selects dimmer or fan curve)
+ * @param level Brightness level (0-BRIGHTNESS_LEVELS)
+ * @return Fire tick delay (0-PHASE_STEPS, where 0=full brightness)
+ */
+inline uint16_t IRAM_ATTR fireTickForLevel(DeviceType type, int level) {
+    if (level <= 0) return PHASE_STEPS;
+    if (level >= BRIGHTNESS_LEVELS) return 0;
+    if (type == TYPE_FAN) return fanPhaseCurve.fireTick[level];
+    return dimmerPhaseCurve.fireTick[level];
+}
+
+/**
+ * Change a device's type
+ * Recomputes its fire tick for the new curve and publishes to the ISRs
+ * 
+ * @param deviceId Device index (0 to CHANNEL_COUNT-1)
+ * @param type New device type
  */
-int calculateFireTick(int percent);
+void setDeviceType(int deviceId, DeviceType type);
 
 /**
  * Validate device ID
  * 
  * @param deviceId Device index to validate
- * @return true if valid (0-3), false otherwise
+ * @return true if valid (0 to CHANNEL_COUNT-1), false otherwise
  */
 inline bool isValidDeviceId(int deviceId) {
-    return (deviceId >= 0 && deviceId < 4);
+    return (deviceId >= 0 && deviceId < CHANNEL_COUNT);
 }
 
 #endif // DEVICE_H
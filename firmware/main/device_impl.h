@@ -7,124 +7,313 @@
 #define DEVICE_IMPL_H
 
 #include "device.h"
+#include "isr.h"
 
 // External references
-extern Device devices[4];
-extern FadeState fadeStates[4];
-extern portMUX_TYPE timerMux;
+extern Device devices[CHANNEL_COUNT];
+extern FadeState fadeStates[CHANNEL_COUNT];
+extern SemaphoreHandle_t deviceMutex;
 extern void broadcastDeviceState(int deviceId);
 extern void logMessage(LogLevel level, const char* format, ...);
 
+static std::atomic<uint32_t> stateVersion(1);
+
 // ================================================================
 // UTILITY FUNCTIONS
 // ================================================================
 
-int calculateFireTick(int percent) {
+int calculateFireTick(DeviceType type, int percent) {
     if (percent >= 100) return 0;
-    if (percent <= 0) return 100;
-    return 100 - percent;
+    if (percent <= 0) return PHASE_STEPS;
+    return fireTickForLevel(type, percent * (BRIGHTNESS_LEVELS / 100));
+}
+
+// Fire tick for a Q16 brightness percent, at full curve resolution
+static int fireTickForLevelQ16(DeviceType type, int32_t levelQ16) {
+    int level = ((int64_t)levelQ16 * (BRIGHTNESS_LEVELS / 100) + 0x8000) >> 16;
+    return fireTickForLevel(type, level);
+}
+
+// ================================================================
+// FADE ENGINE (Q16 fixed point)
+// ================================================================
+
+#define Q16_ONE 65536
+
+// Integer square root of a 64-bit value
+static uint32_t isqrt64(uint64_t value) {
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+    
+    while (bit > value) bit >>= 2;
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+// Fade level (Q16 percent) after elapsedMs, in closed form
+static int32_t fadeLevelAt(const FadeState &fade, uint32_t elapsedMs) {
+    if (elapsedMs >= fade.durationMs) return fade.targetLevel;
+    
+    // Progress 0..1 in Q16
+    int64_t t = ((uint64_t)elapsedMs << 16) / fade.durationMs;
+    
+    switch (fade.curve) {
+        case FADE_EASE_IN_OUT: {
+            // Smoothstep: 3t^2 - 2t^3
+            int64_t t2 = (t * t) >> 16;
+            t = (t2 * (3 * Q16_ONE - 2 * t)) >> 16;
+            break;
+        }
+        case FADE_PERCEPTUAL: {
+            // Interpolate sqrt of the level as a fraction of full scale, then square
+            int64_t s0 = isqrt64(((uint64_t)fade.startLevel / 100) << 16);
+            int64_t s1 = isqrt64(((uint64_t)fade.targetLevel / 100) << 16);
+            int64_t s = s0 + (((s1 - s0) * t) >> 16);
+            return (int32_t)(((s * s) >> 16) * 100);
+        }
+        default:
+            break;
+    }
+    
+    return fade.startLevel + (int32_t)(((int64_t)(fade.targetLevel - fade.startLevel) * t) >> 16);
+}
+
+// Hand the ISRs the next linear piece of a fade, ending at the next
+// segment boundary (linear fades are a single piece). Caller holds deviceMutex
+static void startFadeSegment(int deviceId, FadeState &fade, uint32_t elapsedMs) {
+    uint32_t segments = (fade.curve == FADE_LINEAR) ? 1 : FADE_CURVE_SEGMENTS;
+    uint32_t segmentMs = fade.durationMs / segments;
+    if (segmentMs == 0) segmentMs = 1;
+    
+    // The remainder of the division is folded into the last segment
+    uint32_t endMs = (elapsedMs / segmentMs + 1) * segmentMs;
+    if (endMs >= fade.durationMs || fade.durationMs - endMs < segmentMs) endMs = fade.durationMs;
+    
+    int32_t startLevel = fade.segmentEndLevel;
+    int32_t endLevel = fadeLevelAt(fade, endMs);
+    uint32_t halfCycles = (uint64_t)(endMs - elapsedMs) * 1000 / getMainsHalfCycleUs();
+    
+    startChannelRamp(deviceId, startLevel, endLevel, halfCycles);
+    fade.segmentEndLevel = endLevel;
+    fade.segmentEndMs = endMs;
+}
+
+// Stop every fade where it is (caller holds deviceMutex)
+void cancelFadeTransitions() {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        if (!fadeStates[i].active) continue;
+        stopChannelRamp(i);
+        fadeStates[i].active = false;
+    }
 }
 
 // ================================================================
 // DEVICE STATE MANAGEMENT
 // ================================================================
 
-void setDeviceState(int deviceId, bool state, int brightness, bool fade) {
-    if (!isValidDeviceId(deviceId)) return;
+// Commit one channel's new target (caller holds deviceMutex, then publishes)
+static void commitDeviceState(int deviceId, bool state, int brightness, bool fade,
+                              uint32_t fadeMs, FadeCurve curve, unsigned long now) {
+    Device &device = devices[deviceId];
+    FadeState &fadeState = fadeStates[deviceId];
     
-    logMessage(LOG_DEBUG, "Setting device %d: state=%d, brightness=%d, fade=%d", 
-                deviceId, state, brightness, fade);
-    
-    if (fade && devices[deviceId].type != TYPE_SWITCH) {
-        // Start fade transition
-        fadeStates[deviceId].active = true;
-        fadeStates[deviceId].targetBrightness = state ? brightness : 0;
-        fadeStates[deviceId].currentStep = 0;
-        fadeStates[deviceId].totalSteps = FADE_STEPS;
-        fadeStates[deviceId].lastStepTime = millis();
-        fadeStates[deviceId].stepInterval = FADE_DURATION_MS / FADE_STEPS;
-        devices[deviceId].state = true;  // Keep on during fade
+    if (fade && fadeMs > 0 && device.type != TYPE_SWITCH) {
+        // Start from wherever the output is now, including mid-fade
+        int32_t startLevel = device.state ? (int32_t)device.brightness << 16 : 0;
+        if (fadeState.active) startLevel = fadeLevelAt(fadeState, now - fadeState.startTime);
+        
+        fadeState.startLevel = startLevel;
+        fadeState.targetLevel = (int32_t)(state ? brightness : 0) << 16;
+        fadeState.segmentEndLevel = startLevel;
+        fadeState.curve = curve;
+        fadeState.startTime = now;
+        fadeState.durationMs = constrain(fadeMs, (uint32_t)FADE_MIN_MS, (uint32_t)FADE_MAX_MS);
+        fadeState.active = true;
+        startFadeSegment(deviceId, fadeState, 0);
+        
+        // The ISRs own the output level until the fade ends; report the target
+        device.state = true;  // Keep on during fade
+        device.brightness = state ? brightness : 0;
+        device.fireTick = calculateFireTick(device.type, device.brightness);
+        if (state) device.lastOnTime = now;
     } else {
-        // Immediate change - use critical section to protect ISR-accessed variables
-        portENTER_CRITICAL(&timerMux);
-        devices[deviceId].state = state;
-        devices[deviceId].brightness = state ? brightness : 0;
-        devices[deviceId].fireTick = calculateFireTick(devices[deviceId].brightness);
-        portEXIT_CRITICAL(&timerMux);
+        // Immediate change (cancels any running fade) - ISRs see it once published
+        if (fadeState.active) stopChannelRamp(deviceId);
+        fadeState.active = false;
+        device.state = state;
+        device.brightness = state ? brightness : 0;
+        device.fireTick = calculateFireTick(device.type, device.brightness);
         
         if (state) {
-            devices[deviceId].lastOnTime = millis();
+            device.lastOnTime = now;
         }
     }
+}
+
+void setDeviceState(int deviceId, bool state, int brightness, bool fade, uint32_t fadeMs, FadeCurve curve) {
+    if (!isValidDeviceId(deviceId)) return;
+    
+    logMessage(LOG_DEBUG, "Setting device %d: state=%d, brightness=%d, fade=%d (%lu ms, curve %d)", 
+                deviceId, state, brightness, fade, (unsigned long)fadeMs, (int)curve);
+    
+    xSemaphoreTake(deviceMutex, portMAX_DELAY);
+    commitDeviceState(deviceId, state, brightness, fade, fadeMs, curve, millis());
+    xSemaphoreGive(deviceMutex);
+    
+    publishOutputSnapshot();
+    stateChanged();
     
     // Broadcast to WebSocket clients
     broadcastDeviceState(deviceId);
 }
 
+ChannelMask applyDeviceChanges(const DeviceChange *changes, int count) {
+    ChannelMask channels = 0;
+    
+    // Validate everything before touching any channel
+    for (int i = 0; i < count; i++) {
+        const DeviceChange &change = changes[i];
+        if (!isValidDeviceId(change.deviceId) || change.brightness < 0 || change.brightness > 100 ||
+            change.curve > FADE_PERCEPTUAL || (channels & (1 << change.deviceId))) {
+            logMessage(LOG_WARN, "Device batch rejected at entry %d", i);
+            return 0;
+        }
+        channels |= (1 << change.deviceId);
+    }
+    if (!channels) return 0;
+    
+    // One lock and one publish: every ramp starts on the same zero-cross
+    xSemaphoreTake(deviceMutex, portMAX_DELAY);
+    unsigned long now = millis();
+    for (int i = 0; i < count; i++) {
+        const DeviceChange &change = changes[i];
+        commitDeviceState(change.deviceId, change.state, change.brightness, change.fadeMs > 0,
+                          change.fadeMs, (FadeCurve)change.curve, now);
+    }
+    xSemaphoreGive(deviceMutex);
+    
+    publishOutputSnapshot();
+    stateChanged();
+    logMessage(LOG_DEBUG, "Applied %d device changes (channels 0x%x)", count, (unsigned)channels);
+    return channels;
+}
+
+void setDeviceType(int deviceId, DeviceType type) {
+    if (!isValidDeviceId(deviceId)) return;
+    
+    xSemaphoreTake(deviceMutex, portMAX_DELAY);
+    devices[deviceId].type = type;
+    devices[deviceId].fireTick = calculateFireTick(type, devices[deviceId].brightness);
+    xSemaphoreGive(deviceMutex);
+    
+    publishOutputSnapshot();
+    stateChanged();
+}
+
 bool getDeviceState(int deviceId, bool &state, int &brightness) {
     if (!isValidDeviceId(deviceId)) return false;
     
-    // Atomic read of volatile variables
-    portENTER_CRITICAL(&timerMux);
+    // Consistent read of state and brightness
+    xSemaphoreTake(deviceMutex, portMAX_DELAY);
     state = devices[deviceId].state;
     brightness = devices[deviceId].brightness;
-    portEXIT_CRITICAL(&timerMux);
+    xSemaphoreGive(deviceMutex);
     
     return true;
 }
 
 void processFadeTransitions() {
-    for (int i = 0; i < 4; i++) {
+    unsigned long now = millis();
+    
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
         if (!fadeStates[i].active) continue;
         
-        unsigned long now = millis();
-        if (now - fadeStates[i].lastStepTime >= fadeStates[i].stepInterval) {
-            fadeStates[i].currentStep++;
-            fadeStates[i].lastStepTime = now;
-            
-            // Use critical section to protect ISR-accessed variables
-            portENTER_CRITICAL(&timerMux);
-            if (fadeStates[i].currentStep >= fadeStates[i].totalSteps) {
-                // Fade complete
-                devices[i].brightness = fadeStates[i].targetBrightness;
-                devices[i].state = (devices[i].brightness > 0);
+        bool publish = false;
+        bool complete = false;
+        
+        xSemaphoreTake(deviceMutex, portMAX_DELAY);
+        FadeState &fade = fadeStates[i];
+        uint32_t elapsedMs = now - fade.startTime;
+        
+        // The ISRs step each ramp on their own; Core 0 only acts when one
+        // ends. The deadline finishes a ramp stalled by a mains dropout.
+        bool segmentDone = isChannelRampComplete(i) ||
+                           elapsedMs >= fade.segmentEndMs + ZERO_CROSS_TIMEOUT_MS;
+        
+        if (fade.active && segmentDone) {
+            if (fade.segmentEndMs >= fade.durationMs) {
+                // Fade complete: hand the final level back to the snapshot
+                Device &device = devices[i];
+                device.brightness = (fade.targetLevel + 0x8000) >> 16;
+                device.fireTick = fireTickForLevelQ16(device.type, fade.targetLevel);
+                device.state = (device.brightness > 0);
+                stopChannelRamp(i);
+                fade.active = false;
+                complete = true;
             } else {
-                // Calculate intermediate brightness
-                int startBrightness = devices[i].brightness;
-                int range = fadeStates[i].targetBrightness - startBrightness;
-                float progress = (float)fadeStates[i].currentStep / fadeStates[i].totalSteps;
-                devices[i].brightness = startBrightness + (int)(range * progress);
-            }
-            
-            devices[i].fireTick = calculateFireTick(devices[i].brightness);
-            portEXIT_CRITICAL(&timerMux);
-            
-            // Update fade state after critical section (not accessed by ISR)
-            if (fadeStates[i].currentStep >= fadeStates[i].totalSteps) {
-                fadeStates[i].active = false;
+                startFadeSegment(i, fade, elapsedMs);
             }
+            publish = true;
+        }
+        xSemaphoreGive(deviceMutex);
+        
+        if (publish) publishOutputSnapshot();
+        if (complete) {
+            stateChanged();
+            broadcastDeviceState(i);
         }
     }
 }
 
 void updateRuntimeStatistics() {
     static unsigned long lastUpdate = 0;
+    static uint32_t runningSeconds = 0;
     unsigned long now = millis();
     
     if (now - lastUpdate >= 1000) {  // Update every second
-        for (int i = 0; i < 4; i++) {
+        bool running = false;
+        for (int i = 0; i < CHANNEL_COUNT; i++) {
             if (devices[i].state) {
                 devices[i].totalRuntime++;
+                running = true;
             }
         }
         lastUpdate = now;
+        
+        // Runtime alone refreshes cached status at a slower pace
+        if (running && ++runningSeconds >= STATE_RUNTIME_REFRESH_S) {
+            runningSeconds = 0;
+            stateChanged();
+        }
     }
 }
 
+uint32_t getStateVersion() {
+    return stateVersion.load(std::memory_order_relaxed);
+}
+
+void stateChanged() {
+    stateVersion.fetch_add(1, std::memory_order_relaxed);
+}
+
 void checkAutoOff() {
-    for (int i = 0; i < 4; i++) {
+    if (AUTO_OFF_MS == 0) return;
+    
+    unsigned long now = millis();
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
         if (devices[i].autoOffEnabled && devices[i].state) {
-            if (millis() - devices[i].lastOnTime > AUTO_OFF_MS) {
+            // Already fading off (state stays on until the fade ends): a
+            // new call would restart the fade from its mid-point every pass
+            if (fadeStates[i].active && fadeStates[i].targetLevel == 0) continue;
+            if (now - devices[i].lastOnTime > AUTO_OFF_MS) {
                 logMessage(LOG_INFO, "Auto-off triggered for device %d", i);
                 setDeviceState(i, false, 0, true);
             }
@@ -9,6 +9,79 @@
 
 #include "config.h"
 #include <Arduino.h>
+#include <atomic>
+
+// ================================================================
+// FIRING TIMELINE
+// ================================================================
+
+/**
+ * One fire point within a half-cycle
+ * All channels in mask share the same fire tick
+ */
+struct FiringEvent {
+    uint16_t tick;      // Phase delay from zero-cross (0 to PHASE_STEPS-1)
+    ChannelMask mask;   // Bit i set = fire TRIAC_PINS[i]
+    uint32_t gpioMask;  // Same channels as a GPIO register mask
+};
+
+/**
+ * Per-half-cycle firing table, sorted by ascending tick
+ * Rebuilt on Core 0 whenever a channel's state, type or fireTick changes
+ */
+struct FiringTimeline {
+    uint8_t count;
+    FiringEvent events[CHANNEL_COUNT];
+};
+
+// ================================================================
+// FADE RAMPS
+// ================================================================
+
+/**
+ * Linear brightness ramp stepped by onZeroCross() once per half-cycle
+ * Levels are brightness percent in Q24 fixed point
+ */
+struct ChannelRamp {
+    uint32_t generation;  // Per channel, changes for every new ramp
+    int32_t startLevel;
+    int32_t slope;        // Added each half-cycle
+    int32_t endLevel;
+};
+
+// ================================================================
+// OUTPUT SNAPSHOT
+// ================================================================
+
+/**
+ * ISR-visible fields of one channel
+ */
+struct ChannelSnapshot {
+    bool state;
+    uint8_t type;       // DeviceType
+    uint16_t fireTick;
+    uint16_t burstDuty; // TYPE_BURST: conducting cycles per BRIGHTNESS_LEVELS
+    ChannelRamp ramp;   // Valid if the channel is in rampChannels
+};
+
+/**
+ * Everything the ISRs need for one half-cycle
+ * Published whole by Core 0 through a seqlock; the ISRs copy it at
+ * zero-cross and never take a lock. A copy that races with a publish is
+ * discarded and the previous snapshot is used for one more half-cycle.
+ */
+struct OutputSnapshot {
+    ChannelSnapshot channels[CHANNEL_COUNT];
+    FiringTimeline timeline;
+    uint32_t zeroCrossSetMask;    // GPIO pins driven HIGH at zero-cross (switches)
+    uint32_t zeroCrossClearMask;  // GPIO pins driven LOW at zero-cross (all others)
+    uint32_t channelGpioMask[CHANNEL_COUNT];  // Per-channel GPIO mask
+    ChannelMask phaseChannels;    // Channels with a phase-controlled fire point
+    ChannelMask burstChannels;    // Channels under burst-fire control
+    uint32_t burstGpioMask;       // GPIO pins of burstChannels
+    uint32_t releaseGpioMask;     // Phase and burst pins, released before each zero-cross
+    ChannelMask rampChannels;     // Channels whose level follows their ramp
+};
 
 // ================================================================
 // ISR HANDLERS
@@ -23,7 +96,8 @@ void IRAM_ATTR onTimerFire();
 
 /**
  * Zero-cross detection ISR
- * Resets TRIACs at AC zero crossing point
+ * Feeds the software PLL; edges outside the prediction window are ignored,
+ * accepted edges reset TRIACs at the filtered zero-crossing point
  * IRAM_ATTR: Ensures code is in IRAM for fast execution
  */
 void IRAM_ATTR onZeroCross();
@@ -31,8 +105,78 @@ void IRAM_ATTR onZeroCross();
 /**
  * Check zero-cross signal health
  * Call from Core 0 task to monitor signal integrity
- * Implements safety shutdown if signal lost
+ * Implements safety shutdown once the PLL stops coasting or no edge
+ * has been accepted for ZERO_CROSS_TIMEOUT_MS
  */
 void checkZeroCrossHealth();
 
+/**
+ * Whether the zero-cross PLL is locked to the mains
+ * While locked, noise edges are rejected and up to PLL_MAX_COAST_EDGES
+ * missing edges are replaced by the prediction
+ * 
+ * @return true if locked
+ */
+bool isZeroCrossLocked();
+
+/**
+ * Filtered mains half-cycle period measured from zero-cross edges
+ * 
+ * @return Half-cycle period in microseconds (nominal until locked)
+ */
+uint32_t getMainsHalfCycleUs();
+
+/**
+ * Mains frequency derived from the filtered half-cycle period
+ * 
+ * @return Frequency in Hz
+ */
+float getMainsFrequencyHz();
+
+/**
+ * Filtered mean absolute deviation of zero-cross edges from the PLL prediction
+ * 
+ * @return Jitter in microseconds
+ */
+uint32_t getMainsJitterUs();
+
+/**
+ * Hand a brightness ramp to the ISRs
+ * onZeroCross() moves the channel from startLevel to endLevel over
+ * halfCycles half-cycles, then holds endLevel until the ramp is stopped
+ * or replaced. Call with deviceMutex held; takes effect at the next
+ * publishOutputSnapshot().
+ * 
+ * @param channel Channel index (0 to CHANNEL_COUNT-1)
+ * @param startLevel Brightness percent, Q16
+ * @param endLevel Brightness percent, Q16
+ * @param halfCycles Ramp length in half-cycles
+ */
+void startChannelRamp(int channel, int32_t startLevel, int32_t endLevel, uint32_t halfCycles);
+
+/**
+ * Return a channel to its published fireTick and burstDuty
+ * Call with deviceMutex held; takes effect at the next publishOutputSnapshot().
+ * 
+ * @param channel Channel index (0 to CHANNEL_COUNT-1)
+ */
+void stopChannelRamp(int channel);
+
+/**
+ * Whether the ISRs have reached the end of the channel's current ramp
+ * Call with deviceMutex held
+ * 
+ * @param channel Channel index (0 to CHANNEL_COUNT-1)
+ * @return true once the last started ramp has completed
+ */
+bool isChannelRampComplete(int channel);
+
+/**
+ * Publish current device state to the ISRs
+ * Rebuilds the firing timeline and swaps in a new OutputSnapshot.
+ * Call from task context after changing any device state, type or fireTick.
+ * Takes deviceMutex; must not be called with it held.
+ */
+void publishOutputSnapshot();
+
 #endif // ISR_H
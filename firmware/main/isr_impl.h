@@ -7,66 +7,549 @@
 #define ISR_IMPL_H
 
 #include "isr.h"
+#include "device.h"
+#include "output.h"
+#include "metrics.h"
 
 // External references
-extern Device devices[4];
-extern const int TRIAC_PINS[4];
-extern portMUX_TYPE timerMux;
+extern Device devices[CHANNEL_COUNT];
+extern hw_timer_t *timer;
+extern SemaphoreHandle_t deviceMutex;
 extern volatile bool zeroCrossDetected;
 extern volatile unsigned long lastZeroCrossTime;
 extern int currentError;
 extern void logMessage(LogLevel level, const char* format, ...);
 
+// Seqlock-protected snapshot: odd sequence = publish in progress
+static OutputSnapshot sharedSnapshot = {};
+static std::atomic<uint32_t> snapshotSeq(0);
+
+// ISR-private state (both ISRs run on Core 1 and do not nest)
+static OutputSnapshot isrSnapshot = {};
+static uint32_t isrSnapshotSeq = 0;
+static uint8_t nextFiringEvent = 0;
+#if PHASE_CONTROL_MODE != PHASE_MODE_EVENT
+static int tickCounter = 0;
+static ChannelMask polledFiredMask = 0;
+#endif
+static uint32_t zeroCrossCycles = 0;  // Cycle counter at last zero-cross, for fire error
+
+// Zero-cross PLL, fixed point with MAINS_FILTER_SHIFT fractional bits where
+// noted; written only by the ISRs, 32-bit reads are atomic
+static volatile uint32_t halfCycleFiltered = (uint32_t)MAINS_HALF_CYCLE_NOMINAL_US << MAINS_FILTER_SHIFT;
+static volatile uint32_t jitterFiltered = 0;     // Mean |edge - prediction|
+static volatile bool pllLocked = false;
+static volatile bool zeroCrossLost = false;      // Set when coasting gives up, cleared by Core 0
+static unsigned long lastEdgeMicros = 0;         // Last accepted real edge
+static unsigned long predictedEdgeMicros = 0;    // Next expected zero-cross
+static uint8_t pllGoodIntervals = 0;
+static uint8_t pllCoastCount = 0;
+static uint32_t isrHalfCycleUs = MAINS_HALF_CYCLE_NOMINAL_US;  // Latched per half-cycle
+static uint32_t halfCycleOffsetUs = 0;           // Zero-cross estimate to half-cycle start
+
+// Ramps staged by Core 0 for the next publish (guarded by deviceMutex)
+static ChannelRamp stagedRamps[CHANNEL_COUNT] = {};
+static ChannelMask stagedRampChannels = 0;
+static uint32_t rampGenerationCounter[CHANNEL_COUNT] = {};
+
+// Ramp progress (zero-cross ISR only, except the done generations)
+static uint32_t isrRampGeneration[CHANNEL_COUNT] = {};
+static int32_t isrRampLevel[CHANNEL_COUNT] = {};
+static ChannelMask isrRampRunning = 0;
+static volatile uint32_t isrRampDoneGeneration[CHANNEL_COUNT] = {};
+
+// Burst-fire modulator state (zero-cross ISR only)
+static uint16_t burstAccumulator[CHANNEL_COUNT] = {};
+static uint32_t burstGpioOn = 0;   // Channels conducting for the current full cycle
+static bool burstSecondHalf = false;
+
+// ================================================================
+// ZERO-CROSS PLL
+// ================================================================
+
+// Fold a filter error (fixed point) into the jitter EMA
+static inline void IRAM_ATTR updateJitter(int32_t error) {
+    int32_t jitter = (int32_t)jitterFiltered;
+    int32_t deviation = error < 0 ? -error : error;
+    jitterFiltered = jitter + ((deviation - jitter) >> MAINS_FILTER_SHIFT);
+}
+
+// Classify a ZCD edge and update the loop
+// Returns false for noise edges; otherwise sets zeroCrossUs to the filtered
+// zero-cross time the new half-cycle is measured from
+static bool IRAM_ATTR pllOnEdge(unsigned long nowUs, unsigned long &zeroCrossUs) {
+    uint32_t intervalUs = nowUs - lastEdgeMicros;
+    int32_t period = (int32_t)halfCycleFiltered;
+    uint32_t deviationUs;
+    
+    if (pllLocked) {
+        // Tracking: accept only edges inside the window around the prediction
+        int32_t phaseError = (int32_t)(nowUs - predictedEdgeMicros);
+        if (phaseError > PLL_WINDOW_US || phaseError < -PLL_WINDOW_US) {
+            metricsRecordEdgeFault(false);
+            return false;
+        }
+        
+        // Proportional phase correction, integral period correction
+        // (phaseError us >> MAINS_FILTER_SHIFT == phaseError in fixed point)
+        period += phaseError;
+        if (period < ((int32_t)MAINS_HALF_CYCLE_MIN_US << MAINS_FILTER_SHIFT)) period = (int32_t)MAINS_HALF_CYCLE_MIN_US << MAINS_FILTER_SHIFT;
+        if (period > ((int32_t)MAINS_HALF_CYCLE_MAX_US << MAINS_FILTER_SHIFT)) period = (int32_t)MAINS_HALF_CYCLE_MAX_US << MAINS_FILTER_SHIFT;
+        halfCycleFiltered = period;
+        updateJitter(phaseError << MAINS_FILTER_SHIFT);
+        
+        zeroCrossUs = predictedEdgeMicros + (phaseError >> PLL_PHASE_SHIFT);
+        deviationUs = phaseError < 0 ? -phaseError : phaseError;
+    } else {
+        // Acquiring: measure the raw interval until enough agree
+        zeroCrossUs = nowUs;
+        deviationUs = 0;
+        
+        if (intervalUs >= MAINS_HALF_CYCLE_MIN_US && intervalUs <= MAINS_HALF_CYCLE_MAX_US) {
+            int32_t error = ((int32_t)intervalUs << MAINS_FILTER_SHIFT) - period;
+            halfCycleFiltered = period + (error >> MAINS_FILTER_SHIFT);
+            updateJitter(error);
+            deviationUs = (error < 0 ? -error : error) >> MAINS_FILTER_SHIFT;
+            
+            // Count only intervals the filter already predicts to within a
+            // quarter window: a locked loop settles at a phase error of
+            // about 1 << PLL_PHASE_SHIFT times its period error, so a supply
+            // far from nominal (60 Hz at boot) must not lock earlier
+            if (deviationUs > (PLL_WINDOW_US >> PLL_PHASE_SHIFT)) {
+                pllGoodIntervals = 0;
+            } else if (++pllGoodIntervals >= PLL_LOCK_EDGES) {
+                pllLocked = true;
+            }
+        } else {
+            pllGoodIntervals = 0;
+        }
+    }
+    
+    metricsRecordZeroCross(intervalUs, deviationUs);
+    lastEdgeMicros = nowUs;
+    predictedEdgeMicros = zeroCrossUs + (halfCycleFiltered >> MAINS_FILTER_SHIFT);
+    pllCoastCount = 0;
+    return true;
+}
+
+uint32_t getMainsHalfCycleUs() {
+    return halfCycleFiltered >> MAINS_FILTER_SHIFT;
+}
+
+float getMainsFrequencyHz() {
+    uint32_t halfCycle = halfCycleFiltered;
+    if (halfCycle == 0) return 0.0f;
+    return 500000.0f * (1 << MAINS_FILTER_SHIFT) / halfCycle;
+}
+
+uint32_t getMainsJitterUs() {
+    return jitterFiltered >> MAINS_FILTER_SHIFT;
+}
+
+// Convert a fire tick to a delay within the measured half-cycle
+static inline uint32_t IRAM_ATTR fireTickToUs(uint32_t tick) {
+    return tick * isrHalfCycleUs / PHASE_STEPS;
+}
+
+// ================================================================
+// OUTPUT SNAPSHOT
+// ================================================================
+
+// Channel types fired at a phase angle within each half-cycle
+static inline bool IRAM_ATTR isPhaseControlled(uint8_t type) {
+    return type == TYPE_FAN || type == TYPE_DIMMER;
+}
+
+// Precompute the GPIO masks applied at zero-cross and by the polling timer
+static void buildOutputMasks(OutputSnapshot &snapshot) {
+    ChannelMask onAtZeroCross = 0;
+    snapshot.phaseChannels = 0;
+    snapshot.burstChannels = 0;
+    
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        const ChannelSnapshot &ch = snapshot.channels[i];
+        
+        if (ch.state && ch.type == TYPE_SWITCH) onAtZeroCross |= (1 << i);
+        if (ch.state && ch.type == TYPE_BURST) snapshot.burstChannels |= (1 << i);
+        if (ch.state && isPhaseControlled(ch.type)) snapshot.phaseChannels |= (1 << i);
+        snapshot.channelGpioMask[i] = channelsToGpioMask(1 << i);
+    }
+    
+    snapshot.burstGpioMask = channelsToGpioMask(snapshot.burstChannels);
+    snapshot.releaseGpioMask = channelsToGpioMask(snapshot.phaseChannels | snapshot.burstChannels);
+    snapshot.zeroCrossSetMask = channelsToGpioMask(onAtZeroCross);
+    snapshot.zeroCrossClearMask = allTriacGpioMask() & ~snapshot.zeroCrossSetMask;
+}
+
+// Build the sorted firing table for the channels in a snapshot
+// Needs channelGpioMask from buildOutputMasks(); also run by the zero-cross
+// ISR while ramps move fire ticks
+static void IRAM_ATTR buildFiringTimeline(OutputSnapshot &snapshot) {
+    FiringTimeline &timeline = snapshot.timeline;
+    timeline.count = 0;
+
+#if PHASE_CONTROL_MODE == PHASE_MODE_EVENT
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        const ChannelSnapshot &ch = snapshot.channels[i];
+        if (!ch.state || !isPhaseControlled(ch.type)) continue;
+        
+        int tick = ch.fireTick;
+        if (tick >= PHASE_STEPS) continue;  // Fire point at/after next zero-cross
+        
+        // Merge with an existing fire point or insert in sorted position
+        int pos = 0;
+        while (pos < timeline.count && timeline.events[pos].tick < tick) pos++;
+        
+        if (pos < timeline.count && timeline.events[pos].tick == tick) {
+            timeline.events[pos].mask |= (1 << i);
+        } else {
+            for (int j = timeline.count; j > pos; j--) {
+                timeline.events[j] = timeline.events[j - 1];
+            }
+            timeline.events[pos].tick = tick;
+            timeline.events[pos].mask = (1 << i);
+            timeline.count++;
+        }
+    }
+    
+    for (int e = 0; e < timeline.count; e++) {
+        uint32_t gpioMask = 0;
+        ChannelMask pending = timeline.events[e].mask;
+        while (pending) {
+            gpioMask |= snapshot.channelGpioMask[__builtin_ctz(pending)];
+            pending &= pending - 1;
+        }
+        timeline.events[e].gpioMask = gpioMask;
+    }
+#endif
+}
+
+void publishOutputSnapshot() {
+    OutputSnapshot next;
+    
+    xSemaphoreTake(deviceMutex, portMAX_DELAY);
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        next.channels[i].state = devices[i].state;
+        next.channels[i].type = (uint8_t)devices[i].type;
+        next.channels[i].fireTick = (uint16_t)devices[i].fireTick;
+        next.channels[i].burstDuty = (uint16_t)constrain(devices[i].brightness, 0, 100) * (BRIGHTNESS_LEVELS / 100);
+        next.channels[i].ramp = stagedRamps[i];
+    }
+    next.rampChannels = stagedRampChannels;
+    buildOutputMasks(next);
+    buildFiringTimeline(next);
+    
+    // Single writer (serialised by deviceMutex): bump to odd, write, bump to even
+    uint32_t seq = snapshotSeq.load(std::memory_order_relaxed);
+    snapshotSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    sharedSnapshot = next;
+    snapshotSeq.store(seq + 2, std::memory_order_release);
+    xSemaphoreGive(deviceMutex);
+}
+
+// ================================================================
+// FADE RAMPS
+// ================================================================
+
+void startChannelRamp(int channel, int32_t startLevel, int32_t endLevel, uint32_t halfCycles) {
+    if (channel < 0 || channel >= CHANNEL_COUNT) return;
+    if (halfCycles == 0) halfCycles = 1;
+    
+    // Each channel counts its own ramps, so a new one always differs from
+    // the generation that channel's ISR state last saw (32 bits do not
+    // wrap in the device's lifetime); 0 is never used, so a fresh ISR
+    // state never matches
+    uint32_t &generation = rampGenerationCounter[channel];
+    if (++generation == 0) generation = 1;
+    
+    ChannelRamp &ramp = stagedRamps[channel];
+    ramp.generation = generation;
+    ramp.startLevel = startLevel << 8;
+    ramp.endLevel = endLevel << 8;
+    ramp.slope = (int32_t)(((int64_t)ramp.endLevel - ramp.startLevel) / (int64_t)halfCycles);
+    
+    // Always make progress, even for tiny changes over long ramps
+    if (ramp.slope == 0 && ramp.endLevel != ramp.startLevel) {
+        ramp.slope = ramp.endLevel > ramp.startLevel ? 1 : -1;
+    }
+    
+    stagedRampChannels |= (1 << channel);
+}
+
+void stopChannelRamp(int channel) {
+    if (channel < 0 || channel >= CHANNEL_COUNT) return;
+    stagedRampChannels &= ~(1 << channel);
+}
+
+bool isChannelRampComplete(int channel) {
+    if (channel < 0 || channel >= CHANNEL_COUNT) return false;
+    if (!(stagedRampChannels & (1 << channel))) return false;
+    return isrRampDoneGeneration[channel] == stagedRamps[channel].generation;
+}
+
+// Step each ramp by one half-cycle and apply its level to the ISR copy
+// Returns true if any channel follows a ramp (timeline needs rebuilding)
+static bool IRAM_ATTR advanceRamps() {
+    ChannelMask pending = isrSnapshot.rampChannels;
+    if (!pending) return false;
+    
+    while (pending) {
+        int i = __builtin_ctz(pending);
+        pending &= pending - 1;
+        
+        ChannelSnapshot &ch = isrSnapshot.channels[i];
+        const ChannelRamp &ramp = ch.ramp;
+        
+        if (ramp.generation != isrRampGeneration[i]) {
+            // New ramp: start level applies to this half-cycle
+            isrRampGeneration[i] = ramp.generation;
+            isrRampLevel[i] = ramp.startLevel;
+            isrRampRunning |= (1 << i);
+        } else if (isrRampRunning & (1 << i)) {
+            // 64-bit: a short ramp near 100% oversteps INT32_MAX on its last step
+            int64_t level = (int64_t)isrRampLevel[i] + ramp.slope;
+            bool reached = ramp.slope >= 0 ? level >= ramp.endLevel : level <= ramp.endLevel;
+            
+            if (reached) {
+                level = ramp.endLevel;
+                isrRampRunning &= ~(1 << i);
+                isrRampDoneGeneration[i] = ramp.generation;
+            }
+            isrRampLevel[i] = (int32_t)level;
+        }
+        
+        // Q24 percent to curve level
+        int level = ((isrRampLevel[i] >> 8) * (BRIGHTNESS_LEVELS / 100) + 0x8000) >> 16;
+        ch.fireTick = fireTickForLevel((DeviceType)ch.type, level);
+        ch.burstDuty = level < 0 ? 0 : level;
+    }
+    
+    return true;
+}
+
+// ================================================================
+// ISR SNAPSHOT
+// ================================================================
+
+// Pick up the latest published snapshot, wait-free
+// Keeps the previous copy if a publish is in flight or races with the read
+static void IRAM_ATTR refreshIsrSnapshot() {
+    uint32_t seq = snapshotSeq.load(std::memory_order_acquire);
+    if (seq == isrSnapshotSeq || (seq & 1)) return;
+    
+    OutputSnapshot copy = sharedSnapshot;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (snapshotSeq.load(std::memory_order_relaxed) != seq) return;
+    
+    isrSnapshot = copy;
+    isrSnapshotSeq = seq;
+}
+
+// Time into the half-cycle at which phase and burst gates are released,
+// PLL_WINDOW_US ahead of the predicted edge. A TRIAC already conducting
+// stays on until the zero; a gate still HIGH after a missed edge would
+// otherwise fire the next half-cycle at full power.
+static inline uint32_t IRAM_ATTR gateReleaseUs() {
+    return isrHalfCycleUs - PLL_WINDOW_US;
+}
+
+// Fire every due event, then arm a one-shot alarm for the next one
+// Once the table is exhausted the gates are released at gateReleaseUs(),
+// then a locked PLL arms the missed-edge deadline
+static void IRAM_ATTR serviceFiringTimeline() {
+    const FiringTimeline &timeline = isrSnapshot.timeline;
+    uint64_t elapsedUs = timerRead(timer);
+    uint64_t releaseUs = gateReleaseUs();
+    
+    while (nextFiringEvent < timeline.count) {
+        const FiringEvent &event = timeline.events[nextFiringEvent];
+        uint64_t dueUs = fireTickToUs(event.tick);
+        
+        // Too close to the next zero to fire (below 0.1% power)
+        if (dueUs >= releaseUs) {
+            nextFiringEvent = timeline.count;
+            break;
+        }
+        
+        if (dueUs > elapsedUs) {
+            timerAlarm(timer, dueUs, false, 0);
+            return;
+        }
+        
+        triacOutputWrite(event.gpioMask, 0);
+        metricsRecordFire(zeroCrossCycles, dueUs > halfCycleOffsetUs ? dueUs - halfCycleOffsetUs : 0);
+        nextFiringEvent++;
+    }
+    
+    if (elapsedUs < releaseUs) {
+        timerAlarm(timer, releaseUs, false, 0);
+        return;
+    }
+    
+    triacOutputWrite(0, isrSnapshot.releaseGpioMask);
+    if (pllLocked) timerAlarm(timer, isrHalfCycleUs + PLL_WINDOW_US, false, 0);
+}
+
+// First-order sigma-delta over whole mains cycles: each burst channel
+// conducts for burstDuty out of every BRIGHTNESS_LEVELS cycles, spread
+// as evenly as possible. Deciding per full cycle keeps both half-cycles
+// paired so the load sees no DC component.
+// Returns the GPIO mask of burst channels conducting this half-cycle
+static uint32_t IRAM_ATTR updateBurstOutputs() {
+    burstSecondHalf = !burstSecondHalf;
+    
+    if (!burstSecondHalf) {
+        burstGpioOn = 0;
+        ChannelMask pending = isrSnapshot.burstChannels;
+        while (pending) {
+            int i = __builtin_ctz(pending);
+            pending &= pending - 1;
+            
+            burstAccumulator[i] += isrSnapshot.channels[i].burstDuty;
+            if (burstAccumulator[i] >= BRIGHTNESS_LEVELS) {
+                burstAccumulator[i] -= BRIGHTNESS_LEVELS;
+                burstGpioOn |= isrSnapshot.channelGpioMask[i];
+            }
+        }
+    }
+    
+    // A channel switched away from burst mid-cycle stops immediately
+    return burstGpioOn & isrSnapshot.burstGpioMask;
+}
+
+// Start a half-cycle measured from the estimated zero-cross
+// Reset outputs, latch state and period, then restart the phase clock
+static void IRAM_ATTR beginHalfCycle(unsigned long nowUs, unsigned long zeroCrossUs) {
+    int32_t offsetUs = (int32_t)(nowUs - zeroCrossUs);
+    halfCycleOffsetUs = offsetUs > 0 ? offsetUs : 0;
+    isrHalfCycleUs = halfCycleFiltered >> MAINS_FILTER_SHIFT;
+    
+    // Latch the latest published state for this half-cycle, then step
+    // any fade ramps (no Core 0 involvement until a ramp completes)
+    refreshIsrSnapshot();
+    if (advanceRamps()) buildFiringTimeline(isrSnapshot);
+    
+    // Reset all TRIACs at zero crossing: switches and selected burst
+    // channels on, everything else off
+    uint32_t burstMask = updateBurstOutputs();
+    triacOutputWrite(isrSnapshot.zeroCrossSetMask | burstMask, isrSnapshot.zeroCrossClearMask & ~burstMask);
+
+#if PHASE_CONTROL_MODE == PHASE_MODE_EVENT
+    // Restart the half-cycle clock and arm the first fire point
+    timerWrite(timer, halfCycleOffsetUs);
+    nextFiringEvent = 0;
+    serviceFiringTimeline();
+#else
+    tickCounter = halfCycleOffsetUs / TIMER_INTERVAL_US;
+    polledFiredMask = 0;
+#endif
+}
+
+// No edge arrived inside the window: run on the prediction, or give up
+static void IRAM_ATTR coastThroughMissedEdge(uint32_t entryCycles) {
+    metricsRecordEdgeFault(true);
+    
+    if (++pllCoastCount > PLL_MAX_COAST_EDGES) {
+        // Signal gone: stop firing until edges return, Core 0 does the rest
+        pllLocked = false;
+        pllGoodIntervals = 0;
+        zeroCrossLost = true;
+        triacOutputAllOff();
+        return;
+    }
+    
+    unsigned long zeroCrossUs = predictedEdgeMicros;
+    predictedEdgeMicros = zeroCrossUs + (halfCycleFiltered >> MAINS_FILTER_SHIFT);
+    zeroCrossCycles = entryCycles;
+    beginHalfCycle(micros(), zeroCrossUs);
+}
+
 // ================================================================
 // ISR HANDLERS
 // ================================================================
 
 // Hardware timer ISR for phase angle control
 void IRAM_ATTR onTimerFire() {
-    portENTER_CRITICAL_ISR(&timerMux);
-    static int tickCounter = 0;
+    uint32_t entryCycles = metricsTimestamp();
+
+#if PHASE_CONTROL_MODE == PHASE_MODE_EVENT
+    // One-shot alarm: only raised at real fire points or the edge deadline
+    bool timelineDone = nextFiringEvent >= isrSnapshot.timeline.count;
+    if (pllLocked && timelineDone && timerRead(timer) >= isrHalfCycleUs + PLL_WINDOW_US) {
+        coastThroughMissedEdge(entryCycles);
+    } else {
+        serviceFiringTimeline();
+    }
+#else
     tickCounter++;
+    uint32_t elapsedUs = (uint32_t)tickCounter * TIMER_INTERVAL_US;
+    
+    if (pllLocked && elapsedUs >= isrHalfCycleUs + PLL_WINDOW_US) {
+        coastThroughMissedEdge(entryCycles);
+        elapsedUs = (uint32_t)tickCounter * TIMER_INTERVAL_US;
+    }
     
-    // Fire TRIACs at calculated phase angle
-    for (int i = 0; i < 4; i++) {
-        if (devices[i].state && devices[i].type != TYPE_SWITCH) {
-            if (tickCounter >= devices[i].fireTick) {
-                digitalWrite(TRIAC_PINS[i], HIGH);
+    // Fire TRIACs at calculated phase angle, visiting dimming channels only
+    uint32_t setMask = 0;
+    ChannelMask pending = isrSnapshot.phaseChannels;
+    while (pending) {
+        int i = __builtin_ctz(pending);
+        pending &= pending - 1;
+        
+        uint32_t dueUs = fireTickToUs(isrSnapshot.channels[i].fireTick);
+        if (elapsedUs >= dueUs) {
+            setMask |= isrSnapshot.channelGpioMask[i];
+            
+            if (!(polledFiredMask & (1 << i))) {
+                polledFiredMask |= (1 << i);
+                metricsRecordFire(zeroCrossCycles, dueUs > halfCycleOffsetUs ? dueUs - halfCycleOffsetUs : 0);
             }
         }
     }
+    // Past the release point only the gate release is written (see gateReleaseUs())
+    if (elapsedUs >= gateReleaseUs()) {
+        triacOutputWrite(0, isrSnapshot.releaseGpioMask);
+    } else if (setMask) {
+        triacOutputWrite(setMask, 0);
+    }
+#endif
     
-    if (tickCounter > PHASE_STEPS) tickCounter = 0;
-    portEXIT_CRITICAL_ISR(&timerMux);
+    metricsRecordIsrExit(entryCycles, false);
 }
 
 // Zero-cross detection ISR
 void IRAM_ATTR onZeroCross() {
-    portENTER_CRITICAL_ISR(&timerMux);
+    uint32_t entryCycles = metricsTimestamp();
+    unsigned long nowUs = micros();
+    unsigned long zeroCrossUs;
+    
+    // Noise edges leave the running half-cycle untouched
+    if (!pllOnEdge(nowUs, zeroCrossUs)) {
+        metricsRecordIsrExit(entryCycles, true);
+        return;
+    }
     
     // Update last zero-cross time for watchdog
     lastZeroCrossTime = millis();
     zeroCrossDetected = true;
     
-    // Reset all TRIACs at zero crossing
-    for (int i = 0; i < 4; i++) {
-        if (devices[i].state) {
-            if (devices[i].type == TYPE_SWITCH) {
-                digitalWrite(TRIAC_PINS[i], HIGH);
-            } else {
-                digitalWrite(TRIAC_PINS[i], LOW);
-            }
-        } else {
-            digitalWrite(TRIAC_PINS[i], LOW);
-        }
-    }
+    zeroCrossCycles = entryCycles;
+    beginHalfCycle(nowUs, zeroCrossUs);
     
-    portEXIT_CRITICAL_ISR(&timerMux);
+    metricsRecordIsrExit(entryCycles, true);
+}
+
+bool isZeroCrossLocked() {
+    return pllLocked;
 }
 
 // Check zero-cross signal health (call from Core 0 task)
 void checkZeroCrossHealth() {
-    if (millis() - lastZeroCrossTime > 100) {  // No signal for 100ms
+    // PLL gave up coasting, or no accepted edge at all (never locked)
+    bool lost = zeroCrossLost || millis() - lastZeroCrossTime > ZERO_CROSS_TIMEOUT_MS;
+    if (lost) {
+        zeroCrossLost = false;
         if (zeroCrossDetected) {
             logMessage(LOG_ERROR, "Zero-cross signal lost! Safety shutdown.");
             zeroCrossDetected = false;
@@ -75,16 +558,17 @@ void checkZeroCrossHealth() {
             // Safety: Turn off all TRIACs - hardware first, then state
             // Order matters: Set pins LOW before clearing state to ensure
             // ISR doesn't re-trigger TRIACs during the transition
-            for (int i = 0; i < 4; i++) {
-                digitalWrite(TRIAC_PINS[i], LOW);
-            }
+            triacOutputAllOff();
             
-            // Update state with critical section
-            portENTER_CRITICAL(&timerMux);
-            for (int i = 0; i < 4; i++) {
+            // Update state, then publish so the ISRs latch it at the next edge
+            xSemaphoreTake(deviceMutex, portMAX_DELAY);
+            cancelFadeTransitions();
+            for (int i = 0; i < CHANNEL_COUNT; i++) {
                 devices[i].state = false;
             }
-            portEXIT_CRITICAL(&timerMux);
+            xSemaphoreGive(deviceMutex);
+            
+            publishOutputSnapshot();
         }
     }
 }
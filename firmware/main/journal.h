@@ -0,0 +1,88 @@
+/**
+ * State Journal Module
+ * Append-only ring of small fixed-size records in a dedicated flash
+ * partition, holding per-device runtime and last state between config
+ * saves. A sector is erased only when the ring wraps onto it, ahead of
+ * the append that needs it.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "config.h"
+#include <Arduino.h>
+
+// ================================================================
+// DATA STRUCTURES
+// ================================================================
+
+/**
+ * One device's state at the time it was written (16 bytes)
+ */
+struct JournalRecord {
+    uint32_t sequence;      // Increases by one per record; erased flash reads 0xFFFFFFFF
+    uint32_t totalRuntime;  // Seconds
+    uint8_t deviceId;
+    uint8_t state;
+    uint8_t brightness;     // 0-100
+    uint8_t reserved;
+    uint32_t crc;           // CRC-32 of the fields above
+};
+
+static_assert(sizeof(JournalRecord) == 16, "JournalRecord must pack into 16 bytes");
+
+/**
+ * Journal counters, for the metrics API
+ */
+struct JournalStats {
+    uint32_t records;       // Records appended since boot
+    uint32_t erases;        // Sector erases since boot
+    uint64_t totalAppendUs; // Time spent appending (erases ahead of time not included)
+    uint32_t maxAppendUs;
+    uint32_t sequence;      // Sequence number of the newest record
+};
+
+// ================================================================
+// JOURNAL
+// ================================================================
+
+/**
+ * Find the journal partition and scan it for the newest record of each
+ * device. Call before loadDeviceConfig().
+ *
+ * @return false if there is no usable journal partition
+ */
+bool initJournal();
+
+/**
+ * Newest journaled state of a device
+ *
+ * @return false if the journal holds no record for the device
+ */
+bool getJournaledState(int deviceId, JournalRecord &record);
+
+/**
+ * Append a record for each device whose target state or brightness
+ * differs from its newest record, and for each running device every
+ * JOURNAL_RUNTIME_INTERVAL_MS. A pass with nothing to append may erase
+ * the next sector instead. Called from the connectivity loop.
+ */
+void processJournal();
+
+/**
+ * Append runtime records now for devices whose runtime moved (before a
+ * restart or OTA reboot)
+ */
+void flushJournal();
+
+/**
+ * Erase the whole journal (factory reset)
+ */
+void eraseJournal();
+
+/**
+ * Current journal counters
+ */
+const JournalStats& getJournalStats();
+
+#endif // JOURNAL_H
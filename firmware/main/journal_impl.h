@@ -0,0 +1,338 @@
+/**
+ * State Journal Implementation
+ * Records are appended to one sector at a time. Moving on to the next
+ * sector first copies every device's newest record into it, so the
+ * sector after that never holds the only copy and is erased ahead of
+ * time, on a processJournal() pass with nothing to append. An append
+ * only erases if the sector it moves to was not erased yet.
+ */
+
+#ifndef JOURNAL_IMPL_H
+#define JOURNAL_IMPL_H
+
+#include "journal.h"
+
+#include <esp_partition.h>
+
+// External references
+extern Device devices[CHANNEL_COUNT];
+extern FadeState fadeStates[CHANNEL_COUNT];
+extern void logMessage(LogLevel level, const char* format, ...);
+extern bool getDeviceState(int deviceId, bool &state, int &brightness);
+
+#define JOURNAL_SECTOR_SIZE 4096
+#define JOURNAL_RECORDS_PER_SECTOR (JOURNAL_SECTOR_SIZE / sizeof(JournalRecord))
+#define JOURNAL_SCAN_CHUNK 16  // Records read per flash access while scanning
+
+static_assert(JOURNAL_RECORDS_PER_SECTOR >= 2 * CHANNEL_COUNT,
+              "A journal sector must hold a copy of every device and then some");
+
+static bool journalReady = false;
+static size_t journalSectors = 0;
+static size_t journalSector = 0;      // Sector being appended to
+static size_t journalSlot = 0;        // Next free record in it
+static uint32_t journalSequence = 0;  // Newest record written, 0 = none
+static JournalRecord journalLast[CHANNEL_COUNT] = {};
+static ChannelMask journalKnown = 0;  // Devices with a record in journalLast
+static ChannelMask journalCarried = 0;  // Devices whose newest record is in journalSector
+static bool journalNextErased = false;  // Sector after journalSector is blank
+static unsigned long lastRuntimeRecordMs = 0;
+static JournalStats journalStats = {};
+
+// ================================================================
+// FLASH ACCESS
+// ================================================================
+
+static const esp_partition_t *journalPartition = NULL;
+
+static bool openJournalPartition(size_t &size) {
+    journalPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                (esp_partition_subtype_t)JOURNAL_PARTITION_SUBTYPE,
+                                                JOURNAL_PARTITION_LABEL);
+    size = journalPartition ? journalPartition->size : 0;
+    return journalPartition != NULL;
+}
+
+static bool readJournal(size_t offset, void *data, size_t length) {
+    return esp_partition_read(journalPartition, offset, data, length) == ESP_OK;
+}
+
+static bool writeJournal(size_t offset, const void *data, size_t length) {
+    return esp_partition_write(journalPartition, offset, data, length) == ESP_OK;
+}
+
+static bool eraseJournalSector(size_t sector) {
+    return esp_partition_erase_range(journalPartition, sector * JOURNAL_SECTOR_SIZE, JOURNAL_SECTOR_SIZE) == ESP_OK;
+}
+
+static size_t journalOffset(size_t sector, size_t slot) {
+    return sector * JOURNAL_SECTOR_SIZE + slot * sizeof(JournalRecord);
+}
+
+static bool journalRecordErased(const JournalRecord &record) {
+    const uint32_t *words = (const uint32_t *)&record;
+    for (size_t i = 0; i < sizeof(record) / sizeof(uint32_t); i++) {
+        if (words[i] != 0xFFFFFFFFUL) return false;
+    }
+    return true;
+}
+
+static bool journalSectorBlank(size_t sector) {
+    JournalRecord chunk[JOURNAL_SCAN_CHUNK];
+    for (size_t base = 0; base < JOURNAL_RECORDS_PER_SECTOR; base += JOURNAL_SCAN_CHUNK) {
+        if (!readJournal(journalOffset(sector, base), chunk, sizeof(chunk))) return false;
+        for (size_t k = 0; k < JOURNAL_SCAN_CHUNK; k++) {
+            if (!journalRecordErased(chunk[k])) return false;
+        }
+    }
+    return true;
+}
+
+// Same CRC as the NVS section blobs; a torn write fails it
+static bool journalRecordValid(const JournalRecord &record) {
+    return record.sequence != 0xFFFFFFFFUL &&
+           record.crc == sectionCrc(0, (const uint8_t *)&record, offsetof(JournalRecord, crc));
+}
+
+// ================================================================
+// APPENDING
+// ================================================================
+
+static bool appendJournalRecord(int deviceId, bool state, int brightness, uint32_t totalRuntime);
+
+static bool eraseNextJournalSector() {
+    size_t next = (journalSector + 1) % journalSectors;
+    if (!eraseJournalSector(next)) {
+        logMessage(LOG_ERROR, "Journal: erasing sector %u failed, journal disabled", (unsigned)next);
+        journalReady = false;
+        return false;
+    }
+    journalStats.erases++;
+    journalNextErased = true;
+    return true;
+}
+
+// Move on to the next sector and carry every device's newest record into
+// it. The erase normally happened ahead in prepareJournalSector().
+static bool advanceJournalSector() {
+    if (!journalNextErased && !eraseNextJournalSector()) return false;
+    journalSector = (journalSector + 1) % journalSectors;
+    journalSlot = 0;
+    journalCarried = 0;
+    journalNextErased = false;
+    
+    for (ChannelMask pending = journalKnown; pending; pending &= pending - 1) {
+        int i = __builtin_ctz(pending);
+        const JournalRecord last = journalLast[i];
+        if (!appendJournalRecord(i, last.state, last.brightness, last.totalRuntime)) return false;
+    }
+    return true;
+}
+
+static bool appendJournalRecord(int deviceId, bool state, int brightness, uint32_t totalRuntime) {
+    if (journalSlot >= JOURNAL_RECORDS_PER_SECTOR && !advanceJournalSector()) return false;
+    
+    JournalRecord record = {};
+    record.sequence = journalSequence + 1;
+    record.totalRuntime = totalRuntime;
+    record.deviceId = deviceId;
+    record.state = state;
+    record.brightness = brightness;
+    record.crc = sectionCrc(0, (const uint8_t *)&record, offsetof(JournalRecord, crc));
+    
+    // Either way the slot is spent: a failed write may have left bits programmed
+    size_t offset = journalOffset(journalSector, journalSlot++);
+    if (!writeJournal(offset, &record, sizeof(record))) {
+        logMessage(LOG_ERROR, "Journal: write at 0x%x failed, journal disabled", (unsigned)offset);
+        journalReady = false;
+        return false;
+    }
+    
+    journalSequence = record.sequence;
+    journalLast[deviceId] = record;
+    journalKnown |= (1 << deviceId);
+    journalCarried |= (1 << deviceId);
+    journalStats.records++;
+    return true;
+}
+
+// Once the current sector holds every device's newest record the next
+// one holds nothing needed, so erase it now instead of in an append
+static void prepareJournalSector() {
+    if (journalNextErased || (journalCarried & journalKnown) != journalKnown) return;
+    eraseNextJournalSector();
+}
+
+static void recordDeviceState(int deviceId, bool state, int brightness) {
+    unsigned long startUs = micros();
+    appendJournalRecord(deviceId, state, brightness, devices[deviceId].totalRuntime);
+    
+    uint32_t elapsedUs = micros() - startUs;
+    journalStats.totalAppendUs += elapsedUs;
+    if (elapsedUs > journalStats.maxAppendUs) journalStats.maxAppendUs = elapsedUs;
+}
+
+// Returns whether anything was appended
+static bool recordJournalChanges(bool runtimeDue) {
+    bool appended = false;
+    for (int i = 0; i < CHANNEL_COUNT && journalReady; i++) {
+        bool state;
+        int brightness;
+        getDeviceState(i, state, brightness);
+        
+        // A fade off keeps the device on at its target of 0 until the fade
+        // ends; journal where it is going, never "on at 0"
+        if (fadeStates[i].active && fadeStates[i].targetLevel == 0) state = false;
+        
+        const JournalRecord &last = journalLast[i];
+        bool changed = !(journalKnown & (1 << i)) || last.state != state || last.brightness != brightness;
+        if (changed || (runtimeDue && last.totalRuntime != devices[i].totalRuntime)) {
+            recordDeviceState(i, state, brightness);
+            appended = true;
+        }
+    }
+    return appended;
+}
+
+// ================================================================
+// JOURNAL
+// ================================================================
+
+bool initJournal() {
+    unsigned long startUs = micros();
+    journalReady = false;
+    journalSequence = 0;
+    journalKnown = 0;
+    journalCarried = 0;
+    
+    size_t size;
+    if (!openJournalPartition(size)) {
+        logMessage(LOG_WARN, "Journal: no '%s' partition, runtime and last state only saved with config",
+                   JOURNAL_PARTITION_LABEL);
+        return false;
+    }
+    
+    journalSectors = size / JOURNAL_SECTOR_SIZE;
+    if (journalSectors < 2) {
+        logMessage(LOG_ERROR, "Journal: partition needs at least 2 sectors");
+        return false;
+    }
+    
+    // Find the newest record overall and the newest one per device
+    size_t lastSector[CHANNEL_COUNT] = {};
+    bool anyWritten = false;
+    bool anyValid = false;
+    JournalRecord chunk[JOURNAL_SCAN_CHUNK];
+    for (size_t sector = 0; sector < journalSectors; sector++) {
+        for (size_t base = 0; base < JOURNAL_RECORDS_PER_SECTOR; base += JOURNAL_SCAN_CHUNK) {
+            if (!readJournal(journalOffset(sector, base), chunk, sizeof(chunk))) {
+                logMessage(LOG_ERROR, "Journal: reading sector %u failed", (unsigned)sector);
+                return false;
+            }
+            
+            for (size_t k = 0; k < JOURNAL_SCAN_CHUNK; k++) {
+                const JournalRecord &record = chunk[k];
+                if (journalRecordErased(record)) continue;
+                anyWritten = true;
+                if (!journalRecordValid(record)) continue;
+                
+                if (!anyValid || record.sequence > journalSequence) {
+                    journalSequence = record.sequence;
+                    journalSector = sector;
+                    journalSlot = base + k + 1;
+                }
+                anyValid = true;
+                
+                int id = record.deviceId;
+                if (id < CHANNEL_COUNT && (!(journalKnown & (1 << id)) || record.sequence > journalLast[id].sequence)) {
+                    journalLast[id] = record;
+                    journalKnown |= (1 << id);
+                    lastSector[id] = sector;
+                }
+            }
+        }
+    }
+    
+    if (!anyValid) {
+        // Blank, or holding nothing we can read: start over at sector 0
+        for (size_t sector = 0; anyWritten && sector < journalSectors; sector++) {
+            if (!eraseJournalSector(sector)) {
+                logMessage(LOG_ERROR, "Journal: erasing sector %u failed", (unsigned)sector);
+                return false;
+            }
+            journalStats.erases++;
+        }
+        journalSector = 0;
+        journalSlot = 0;
+        journalSequence = 0;
+        journalNextErased = true;
+    } else {
+        // Step over anything torn after the newest record
+        JournalRecord record;
+        while (journalSlot < JOURNAL_RECORDS_PER_SECTOR &&
+               readJournal(journalOffset(journalSector, journalSlot), &record, sizeof(record)) &&
+               !journalRecordErased(record)) {
+            journalSlot++;
+        }
+        
+        // A power cut can fall between moving on and the erase ahead, or in
+        // the middle of the carry: finish the carry so that the next sector
+        // can be erased by prepareJournalSector()
+        journalNextErased = journalSectorBlank((journalSector + 1) % journalSectors);
+        for (int i = 0; i < CHANNEL_COUNT; i++) {
+            if ((journalKnown & (1 << i)) && lastSector[i] == journalSector) journalCarried |= (1 << i);
+        }
+        for (ChannelMask pending = journalKnown & ~journalCarried; pending; pending &= pending - 1) {
+            int i = __builtin_ctz(pending);
+            const JournalRecord last = journalLast[i];
+            if (!appendJournalRecord(i, last.state, last.brightness, last.totalRuntime)) return false;
+        }
+    }
+    
+    journalReady = true;
+    lastRuntimeRecordMs = millis();
+    logMessage(LOG_INFO, "Journal: %u sectors, sequence %lu, %d devices (%lu us)",
+               (unsigned)journalSectors, (unsigned long)journalSequence,
+               __builtin_popcount(journalKnown), micros() - startUs);
+    return true;
+}
+
+bool getJournaledState(int deviceId, JournalRecord &record) {
+    if (deviceId < 0 || deviceId >= CHANNEL_COUNT || !(journalKnown & (1 << deviceId))) return false;
+    record = journalLast[deviceId];
+    return true;
+}
+
+void processJournal() {
+    if (!journalReady) return;
+    
+    unsigned long now = millis();
+    bool runtimeDue = now - lastRuntimeRecordMs >= JOURNAL_RUNTIME_INTERVAL_MS;
+    if (runtimeDue) lastRuntimeRecordMs = now;
+    if (!recordJournalChanges(runtimeDue) && journalReady) prepareJournalSector();
+}
+
+void flushJournal() {
+    if (journalReady) recordJournalChanges(true);
+}
+
+void eraseJournal() {
+    if (!journalReady) return;
+    
+    for (size_t sector = 0; sector < journalSectors; sector++) {
+        if (eraseJournalSector(sector)) journalStats.erases++;
+    }
+    journalSector = 0;
+    journalSlot = 0;
+    journalSequence = 0;
+    journalKnown = 0;
+    journalCarried = 0;
+    journalNextErased = true;
+}
+
+const JournalStats& getJournalStats() {
+    journalStats.sequence = journalSequence;
+    return journalStats;
+}
+
+#endif // JOURNAL_IMPL_H
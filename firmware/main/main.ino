@@ -16,11 +16,13 @@
  */
 
 #include <WiFi.h>
-#include <WebServer.h>
+#include <AsyncTCP.h>
+#include <ESPAsyncWebServer.h>
 #include <HTTPClient.h>
 #include <HTTPUpdate.h>
 #include <WiFiClientSecure.h>
 #include <ArduinoJson.h>
+#define ESPALEXA_ASYNC  // Espalexa serves from our port-80 AsyncWebServer
 #include <Espalexa.h>
 #include <Preferences.h>
 #include <WiFiManager.h>
@@ -32,6 +34,9 @@
 
 // Project headers
 #include "config.h"
+#include "schedule_store.h"
+#include "scene_store.h"
+#include "journal.h"
 #include "api.h"
 #include "voice.h"
 
@@ -52,26 +57,6 @@ struct Device {
     int defaultBrightness;
 };
 
-struct Schedule {
-    int16_t startMins;
-    int16_t endMins;
-    int8_t deviceId;
-    int8_t startBrightness;
-    int8_t endBrightness;
-    bool active;
-    uint8_t daysOfWeek;  // Bitmask: bit 0=Sun, 1=Mon, etc.
-};
-
-struct Scene {
-    String name;
-    bool active;
-    struct SceneDevice {
-        int8_t deviceId;
-        bool state;
-        int8_t brightness;
-    } devices[4];
-};
-
 // ================================================================
 // USER CONFIGURATION
 // ================================================================
@@ -83,18 +68,19 @@ String systemName = "Smart_Home_Hub";
 // SinricPro credentials (loaded from cloud)
 String sinricAppKey = "";
 String sinricAppSecret = "";
-String sinricDeviceIds[4] = {"", "", "", ""};
+String sinricDeviceIds[CHANNEL_COUNT];
 
 // ================================================================
 // GLOBAL OBJECTS
 // ================================================================
 Espalexa alexaManager;
 Preferences preferences;
-WebServer redirectServer(80);
-WebServer localServer(8080);
+AsyncWebServer webServer(80);     // Dashboard redirect and Alexa (Hue emulation)
+AsyncWebServer localServer(8080);
 WebSocketsServer webSocket = WebSocketsServer(81);
 hw_timer_t *timer = NULL;
-portMUX_TYPE timerMux = portMUX_INITIALIZER_UNLOCKED;
+SemaphoreHandle_t deviceMutex;  // Guards devices[] between tasks; ISRs use the output snapshot
+SemaphoreHandle_t controlMutex; // Serializes HTTP handlers (AsyncTCP task) with the connectivity loop
 QueueHandle_t deviceControlQueue;
 
 // Queue message structure
@@ -109,10 +95,8 @@ struct DeviceControlMsg {
 // GLOBAL VARIABLES
 // ================================================================
 // Global device state
-Device devices[4];
-Schedule schedules[SCHEDULE_MAX_COUNT];
-Scene scenes[SCENE_MAX_COUNT];
-bool lastSwitchState[4];
+Device devices[CHANNEL_COUNT];
+bool lastSwitchState[CHANNEL_COUNT];
 
 // System state
 volatile bool zeroCrossDetected = true;
@@ -121,28 +105,31 @@ unsigned long bootTime = 0;
 bool cloudConnected = false;
 int currentError = ERR_NONE;
 
-// Fade control
+// Fade control (levels are brightness percent in Q16 fixed point)
 struct FadeState {
     bool active;
-    int targetBrightness;
-    int currentStep;
-    int totalSteps;
-    unsigned long lastStepTime;
-    unsigned long stepInterval;
-} fadeStates[4]; 
+    uint8_t curve;            // FadeCurve
+    int32_t startLevel;
+    int32_t targetLevel;
+    int32_t segmentEndLevel;  // Where the current ISR ramp ends
+    unsigned long startTime;  // millis() at fade start
+    uint32_t durationMs;
+    uint32_t segmentEndMs;    // Fade time at which the current ISR ramp ends
+} fadeStates[CHANNEL_COUNT]; 
 
 // ================================================================
 // FORWARD DECLARATIONS
 // ================================================================
-void setDeviceState(int deviceId, bool state, int brightness, bool fade = false);
-void saveDeviceConfig();
-void saveSchedules();
-void saveScenes();
+void setDeviceState(int deviceId, bool state, int brightness, bool fade, uint32_t fadeMs, FadeCurve curve);
+bool saveDeviceConfig();
+bool saveSchedules();
+bool saveScenes();
 void activateScene(int sceneId);
 unsigned long getUptimeSeconds();
 const char* getSignalStrength(int rssi);
 void logMessage(LogLevel level, const char* format, ...);
 void broadcastDeviceState(int deviceId); 
+void runControlTasks();
 
 // ================================================================
 // IMPLEMENTATION INCLUDES
@@ -151,7 +138,12 @@ void broadcastDeviceState(int deviceId);
 // Included as .h for Arduino IDE compatibility
 // These are included AFTER data structures and forward declarations are defined
 #include "device_impl.h"
+#include "schedule_store_impl.h"
+#include "scene_store_impl.h"
 #include "storage_impl.h"
+#include "journal_impl.h"
+#include "output_impl.h"
+#include "metrics_impl.h"
 #include "isr_impl.h"
 #include "automation_impl.h"
 #include "api_impl.h"
@@ -178,13 +170,6 @@ void logMessage(LogLevel level, const char* format, ...) {
     Serial.println(buffer);
 }
 
-// Calculate TRIAC fire tick from brightness percentage
-int calculateFireTick(int percent) {
-    if (percent >= 100) return 0;
-    if (percent <= 0) return 100;
-    return 100 - percent;
-}
-
 // Get uptime in seconds
 unsigned long getUptimeSeconds() {
     return (millis() - bootTime) / 1000;
@@ -199,379 +184,6 @@ const char* getSignalStrength(int rssi) {
     return "Weak";
 }
 
-// Convert time to minutes since midnight
-int timeToMinutes(int hour, int minute) {
-    return hour * 60 + minute;
-}
-
-// Get current time in minutes since midnight
-int getCurrentMinutes() {
-    struct tm timeinfo;
-    if (!getLocalTime(&timeinfo)) return -1;
-    return timeToMinutes(timeinfo.tm_hour, timeinfo.tm_min);
-}
-// ================================================================
-// CORE 1: TIME-CRITICAL POWER CONTROL (PRO_CPU)
-// ================================================================
-
-// Hardware timer ISR for phase angle control
-void IRAM_ATTR onTimerFire() {
-    portENTER_CRITICAL_ISR(&timerMux);
-    static int tickCounter = 0;
-    tickCounter++;
-    
-    // Fire TRIACs at calculated phase angle
-    for (int i = 0; i < 4; i++) {
-        if (devices[i].state && devices[i].type != TYPE_SWITCH) {
-            if (tickCounter >= devices[i].fireTick) {
-                digitalWrite(TRIAC_PINS[i], HIGH);
-            }
-        }
-    }
-    
-    if (tickCounter > PHASE_STEPS) tickCounter = 0;
-    portEXIT_CRITICAL_ISR(&timerMux);
-}
-
-// Zero-cross detection ISR
-void IRAM_ATTR onZeroCross() {
-    portENTER_CRITICAL_ISR(&timerMux);
-    
-    // Update last zero-cross time for watchdog
-    lastZeroCrossTime = millis();
-    zeroCrossDetected = true;
-    
-    // Reset all TRIACs at zero crossing
-    for (int i = 0; i < 4; i++) {
-        if (devices[i].state) {
-            if (devices[i].type == TYPE_SWITCH) {
-                digitalWrite(TRIAC_PINS[i], HIGH);
-            } else {
-                digitalWrite(TRIAC_PINS[i], LOW);
-            }
-        } else {
-            digitalWrite(TRIAC_PINS[i], LOW);
-        }
-    }
-    
-    portEXIT_CRITICAL_ISR(&timerMux);
-}
-
-// Check zero-cross signal health (call from Core 0 task)
-void checkZeroCrossHealth() {
-    if (millis() - lastZeroCrossTime > 100) {  // No signal for 100ms
-        if (zeroCrossDetected) {
-            logMessage(LOG_ERROR, "Zero-cross signal lost! Safety shutdown.");
-            zeroCrossDetected = false;
-            currentError = ERR_ZERO_CROSS_LOST;
-            
-            // Safety: Turn off all TRIACs - hardware first, then state
-            // Order matters: Set pins LOW before clearing state to ensure
-            // ISR doesn't re-trigger TRIACs during the transition
-            for (int i = 0; i < 4; i++) {
-                digitalWrite(TRIAC_PINS[i], LOW);
-            }
-            
-            // Update state with critical section
-            portENTER_CRITICAL(&timerMux);
-            for (int i = 0; i < 4; i++) {
-                devices[i].state = false;
-            }
-            portEXIT_CRITICAL(&timerMux);
-        }
-    }
-}
-
-// ================================================================
-// PERSISTENCE & CONFIGURATION
-// ================================================================
-
-void saveDeviceConfig() {
-    preferences.begin(PREF_NAMESPACE, false);
-    preferences.putString(PREF_SYSTEM_NAME, systemName);
-    
-    for (int i = 0; i < 4; i++) {
-        String prefix = PREF_DEVICE_PREFIX + String(i) + "_";
-        preferences.putInt((prefix + "type").c_str(), (int)devices[i].type);
-        preferences.putString((prefix + "name").c_str(), devices[i].name);
-        preferences.putBool((prefix + "lock").c_str(), devices[i].childLock);
-        preferences.putInt((prefix + "pon").c_str(), (int)devices[i].powerOnBehavior);
-        preferences.putInt((prefix + "def_br").c_str(), devices[i].defaultBrightness);
-        preferences.putBool((prefix + "auto").c_str(), devices[i].autoOffEnabled);
-        
-        // Save last state for POWER_ON_LAST behavior
-        if (devices[i].powerOnBehavior == POWER_ON_LAST) {
-            preferences.putBool((prefix + "last_st").c_str(), devices[i].state);
-            preferences.putInt((prefix + "last_br").c_str(), devices[i].brightness);
-        }
-        
-        // Save runtime statistics
-        preferences.putULong((prefix + "runtime").c_str(), devices[i].totalRuntime);
-    }
-    
-    preferences.end();
-    logMessage(LOG_INFO, "Device configuration saved");
-}
-
-void loadDeviceConfig() {
-    preferences.begin(PREF_NAMESPACE, true);
-    systemName = preferences.getString(PREF_SYSTEM_NAME, "Smart_Home_Hub");
-    
-    for (int i = 0; i < 4; i++) {
-        String prefix = PREF_DEVICE_PREFIX + String(i) + "_";
-        devices[i].type = (DeviceType)preferences.getInt((prefix + "type").c_str(), TYPE_SWITCH);
-        devices[i].name = preferences.getString((prefix + "name").c_str(), "Device " + String(i + 1));
-        devices[i].childLock = preferences.getBool((prefix + "lock").c_str(), false);
-        devices[i].powerOnBehavior = (PowerOnState)preferences.getInt((prefix + "pon").c_str(), POWER_ON_OFF);
-        devices[i].defaultBrightness = preferences.getInt((prefix + "def_br").c_str(), 100);
-        devices[i].autoOffEnabled = preferences.getBool((prefix + "auto").c_str(), true);
-        devices[i].totalRuntime = preferences.getULong((prefix + "runtime").c_str(), 0);
-        
-        // Apply power-on behavior
-        switch (devices[i].powerOnBehavior) {
-            case POWER_ON_OFF:
-                devices[i].state = false;
-                devices[i].brightness = 100;
-                break;
-            case POWER_ON_ON:
-                devices[i].state = true;
-                devices[i].brightness = devices[i].defaultBrightness;
-                break;
-            case POWER_ON_LAST:
-                devices[i].state = preferences.getBool((prefix + "last_st").c_str(), false);
-                devices[i].brightness = preferences.getInt((prefix + "last_br").c_str(), 100);
-                break;
-            case POWER_ON_DEFAULT:
-                devices[i].state = true;
-                devices[i].brightness = devices[i].defaultBrightness;
-                break;
-        }
-        
-        devices[i].fireTick = calculateFireTick(devices[i].brightness);
-        devices[i].lastOnTime = millis();
-    }
-    
-    preferences.end();
-    logMessage(LOG_INFO, "Device configuration loaded");
-}
-
-void saveSchedules() {
-    preferences.begin(PREF_NAMESPACE, false);
-    for (int i = 0; i < SCHEDULE_MAX_COUNT; i++) {
-        String prefix = PREF_SCHEDULE_PREFIX + String(i) + "_";
-        preferences.putShort((prefix + "start").c_str(), schedules[i].startMins);
-        preferences.putShort((prefix + "end").c_str(), schedules[i].endMins);
-        preferences.putChar((prefix + "dev").c_str(), schedules[i].deviceId);
-        preferences.putChar((prefix + "sbr").c_str(), schedules[i].startBrightness);
-        preferences.putChar((prefix + "ebr").c_str(), schedules[i].endBrightness);
-        preferences.putBool((prefix + "act").c_str(), schedules[i].active);
-        preferences.putUChar((prefix + "days").c_str(), schedules[i].daysOfWeek);
-    }
-    preferences.end();
-    logMessage(LOG_INFO, "Schedules saved");
-}
-
-void loadSchedules() {
-    preferences.begin(PREF_NAMESPACE, true);
-    for (int i = 0; i < SCHEDULE_MAX_COUNT; i++) {
-        String prefix = PREF_SCHEDULE_PREFIX + String(i) + "_";
-        schedules[i].startMins = preferences.getShort((prefix + "start").c_str(), -1);
-        schedules[i].endMins = preferences.getShort((prefix + "end").c_str(), -1);
-        schedules[i].deviceId = preferences.getChar((prefix + "dev").c_str(), -1);
-        schedules[i].startBrightness = preferences.getChar((prefix + "sbr").c_str(), 0);
-        schedules[i].endBrightness = preferences.getChar((prefix + "ebr").c_str(), 100);
-        schedules[i].active = preferences.getBool((prefix + "act").c_str(), false);
-        schedules[i].daysOfWeek = preferences.getUChar((prefix + "days").c_str(), 0x7F);
-    }
-    preferences.end();
-    logMessage(LOG_INFO, "Schedules loaded");
-}
-
-void saveScenes() {
-    preferences.begin(PREF_NAMESPACE, false);
-    for (int i = 0; i < SCENE_MAX_COUNT; i++) {
-        String prefix = PREF_SCENE_PREFIX + String(i) + "_";
-        preferences.putString((prefix + "name").c_str(), scenes[i].name);
-        preferences.putBool((prefix + "act").c_str(), scenes[i].active);
-        for (int j = 0; j < 4; j++) {
-            String devPrefix = prefix + "d" + String(j) + "_";
-            preferences.putChar((devPrefix + "id").c_str(), scenes[i].devices[j].deviceId);
-            preferences.putBool((devPrefix + "st").c_str(), scenes[i].devices[j].state);
-            preferences.putChar((devPrefix + "br").c_str(), scenes[i].devices[j].brightness);
-        }
-    }
-    preferences.end();
-    logMessage(LOG_INFO, "Scenes saved");
-}
-
-void loadScenes() {
-    preferences.begin(PREF_NAMESPACE, true);
-    for (int i = 0; i < SCENE_MAX_COUNT; i++) {
-        String prefix = PREF_SCENE_PREFIX + String(i) + "_";
-        scenes[i].name = preferences.getString((prefix + "name").c_str(), "");
-        scenes[i].active = preferences.getBool((prefix + "act").c_str(), false);
-        for (int j = 0; j < 4; j++) {
-            String devPrefix = prefix + "d" + String(j) + "_";
-            scenes[i].devices[j].deviceId = preferences.getChar((devPrefix + "id").c_str(), -1);
-            scenes[i].devices[j].state = preferences.getBool((devPrefix + "st").c_str(), false);
-            scenes[i].devices[j].brightness = preferences.getChar((devPrefix + "br").c_str(), 100);
-        }
-    }
-    preferences.end();
-    logMessage(LOG_INFO, "Scenes loaded");
-}
-
-// ================================================================
-// 🎛️ DEVICE CONTROL
-// ================================================================
-
-void setDeviceState(int deviceId, bool state, int brightness, bool fade) {
-    if (deviceId < 0 || deviceId >= 4) return;
-    
-    logMessage(LOG_DEBUG, "Setting device %d: state=%d, brightness=%d, fade=%d", 
-               deviceId, state, brightness, fade);
-    
-    if (fade && devices[deviceId].type != TYPE_SWITCH) {
-        // Start fade transition
-        fadeStates[deviceId].active = true;
-        fadeStates[deviceId].targetBrightness = state ? brightness : 0;
-        fadeStates[deviceId].currentStep = 0;
-        fadeStates[deviceId].totalSteps = FADE_STEPS;
-        fadeStates[deviceId].lastStepTime = millis();
-        fadeStates[deviceId].stepInterval = FADE_DURATION_MS / FADE_STEPS;
-        devices[deviceId].state = true;  // Keep on during fade
-    } else {
-        // Immediate change - use critical section to protect ISR-accessed variables
-        portENTER_CRITICAL(&timerMux);
-        devices[deviceId].state = state;
-        devices[deviceId].brightness = state ? brightness : 0;
-        devices[deviceId].fireTick = calculateFireTick(devices[deviceId].brightness);
-        portEXIT_CRITICAL(&timerMux);
-        
-        if (state) {
-            devices[deviceId].lastOnTime = millis();
-        }
-    }
-    
-    // Broadcast to WebSocket clients
-    broadcastDeviceState(deviceId);
-}
-
-void processFadeTransitions() {
-    for (int i = 0; i < 4; i++) {
-        if (!fadeStates[i].active) continue;
-        
-        unsigned long now = millis();
-        if (now - fadeStates[i].lastStepTime >= fadeStates[i].stepInterval) {
-            fadeStates[i].currentStep++;
-            fadeStates[i].lastStepTime = now;
-            
-            // Use critical section to protect ISR-accessed variables
-            portENTER_CRITICAL(&timerMux);
-            if (fadeStates[i].currentStep >= fadeStates[i].totalSteps) {
-                // Fade complete
-                devices[i].brightness = fadeStates[i].targetBrightness;
-                devices[i].state = (devices[i].brightness > 0);
-            } else {
-                // Calculate intermediate brightness
-                int startBrightness = devices[i].brightness;
-                int range = fadeStates[i].targetBrightness - startBrightness;
-                float progress = (float)fadeStates[i].currentStep / fadeStates[i].totalSteps;
-                devices[i].brightness = startBrightness + (int)(range * progress);
-            }
-            
-            devices[i].fireTick = calculateFireTick(devices[i].brightness);
-            portEXIT_CRITICAL(&timerMux);
-            
-            // Update fade state after critical section (not accessed by ISR)
-            if (fadeStates[i].currentStep >= fadeStates[i].totalSteps) {
-                fadeStates[i].active = false;
-            }
-        }
-    }
-}
-
-void activateScene(int sceneId) {
-    if (sceneId < 0 || sceneId >= SCENE_MAX_COUNT) return;
-    if (!scenes[sceneId].active) return;
-    
-    logMessage(LOG_INFO, "Activating scene: %s", scenes[sceneId].name.c_str());
-    
-    for (int i = 0; i < 4; i++) {
-        if (scenes[sceneId].devices[i].deviceId >= 0) {
-            int devId = scenes[sceneId].devices[i].deviceId;
-            setDeviceState(devId, 
-                          scenes[sceneId].devices[i].state,
-                          scenes[sceneId].devices[i].brightness,
-                          true);  // Use fade transition
-        }
-    }
-}
-
-void processSchedules() {
-    int currentMins = getCurrentMinutes();
-    if (currentMins < 0) return;  // Time not available
-    
-    struct tm timeinfo;
-    if (!getLocalTime(&timeinfo)) return;
-    int currentDay = timeinfo.tm_wday;  // 0=Sunday
-    
-    for (int i = 0; i < SCHEDULE_MAX_COUNT; i++) {
-        if (!schedules[i].active) continue;
-        if (schedules[i].deviceId < 0 || schedules[i].deviceId >= 4) continue;
-        
-        // Check if schedule is active for current day
-        if (!(schedules[i].daysOfWeek & (1 << currentDay))) continue;
-        
-        // Check if current time matches schedule
-        if (currentMins >= schedules[i].startMins && currentMins < schedules[i].endMins) {
-            // Calculate brightness based on time progression
-            int duration = schedules[i].endMins - schedules[i].startMins;
-            int elapsed = currentMins - schedules[i].startMins;
-            float progress = (float)elapsed / duration;
-            
-            int targetBrightness = schedules[i].startBrightness + 
-                (int)((schedules[i].endBrightness - schedules[i].startBrightness) * progress);
-            
-            bool targetState = (targetBrightness > 0);
-            
-            // Only update if different from current state
-            if (devices[schedules[i].deviceId].state != targetState ||
-                devices[schedules[i].deviceId].brightness != targetBrightness) {
-                setDeviceState(schedules[i].deviceId, targetState, targetBrightness, true);
-            }
-        }
-    }
-}
-
-void updateRuntimeStatistics() {
-    static unsigned long lastUpdate = 0;
-    unsigned long now = millis();
-    
-    if (now - lastUpdate >= 1000) {  // Update every second
-        for (int i = 0; i < 4; i++) {
-            if (devices[i].state) {
-                devices[i].totalRuntime++;
-            }
-        }
-        lastUpdate = now;
-    }
-}
-
-void checkAutoOff() {
-    if (AUTO_OFF_MS == 0) return;
-    
-    unsigned long now = millis();
-    for (int i = 0; i < 4; i++) {
-        if (devices[i].state && devices[i].autoOffEnabled) {
-            if (now - devices[i].lastOnTime > AUTO_OFF_MS) {
-                logMessage(LOG_INFO, "Auto-off triggered for device %d", i);
-                setDeviceState(i, false, 0, true);
-            }
-        }
-    }
-}
-
 // ================================================================
 // OTA UPDATE SYSTEM
 // ================================================================
@@ -584,10 +196,11 @@ void performOTA(String binUrl) {
     detachInterrupt(digitalPinToInterrupt(ZCD_PIN));
     
     // Turn off all devices for safety
-    for (int i = 0; i < 4; i++) {
-        digitalWrite(TRIAC_PINS[i], LOW);
+    triacOutputAllOff();
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
         devices[i].state = false;
     }
+    publishOutputSnapshot();
     
     // Perform update
     WiFiClientSecure client;
@@ -616,7 +229,9 @@ void performOTA(String binUrl) {
             
         case HTTP_UPDATE_OK:
             logMessage(LOG_INFO, "OTA update successful! Rebooting...");
-            saveDeviceConfig();  // Save state before reboot
+            markConfigDirty(CONFIG_DEVICES);  // Save state before reboot
+            flushConfig();
+            flushJournal();
             delay(1000);
             ESP.restart();
             break;
@@ -649,7 +264,7 @@ bool validateOTAPartition() {
 // ================================================================
 
 void voiceCallback(uint8_t brightness, int deviceId) {
-    if (deviceId < 0 || deviceId >= 4) return;
+    if (deviceId < 0 || deviceId >= CHANNEL_COUNT) return;
     
     bool state = (brightness > 0);
     int brightnessPercent;
@@ -679,7 +294,9 @@ void checkFactoryReset(bool currentState) {
             WiFiManager wm;
             wm.resetSettings();
             
-            // Clear all preferences
+            // Clear all preferences; pending writes would only be erased again
+            discardConfigChanges();
+            eraseJournal();
             preferences.begin(PREF_NAMESPACE, false);
             preferences.clear();
             preferences.end();
@@ -695,13 +312,56 @@ void checkFactoryReset(bool currentState) {
 // ================================================================
 // CORE 0 TASK
 // ================================================================
+// Switches, fades, timers, schedules and storage (controlMutex held)
+void runControlTasks() {
+    // Handle physical switches with debouncing
+    for(int i = 0; i < CHANNEL_COUNT; i++) {
+        bool currentRead = digitalRead(SWITCH_PINS[i]);
+        if (i == 0) checkFactoryReset(currentRead);
+        
+        if (currentRead != lastSwitchState[i]) {
+            delay(SWITCH_DEBOUNCE_MS);
+            if (digitalRead(SWITCH_PINS[i]) == currentRead) {
+                lastSwitchState[i] = currentRead;
+                if (!devices[i].childLock) {
+                    // Toggle state - state and brightness must be read together
+                    bool currentState;
+                    int currentBrightness;
+                    getDeviceState(i, currentState, currentBrightness);
+                    setDeviceState(i, !currentState, currentBrightness, false);
+                }
+            }
+        }
+    }
+    
+    // Process fade transitions
+    processFadeTransitions();
+    
+    // Check auto-off
+    checkAutoOff();
+    
+    // Update runtime statistics
+    updateRuntimeStatistics();
+    
+    // Journal state changes and runtime
+    processJournal();
+    
+    // Check zero-cross health
+    checkZeroCrossHealth();
+    
+    // Run due schedule transitions (returns at once when none are due)
+    processSchedules();
+    
+    // Write behind settled configuration changes
+    processConfigFlush();
+}
+
 // ================================================================
 // CORE 0: CONNECTIVITY TASK (APP_CPU)
 // ================================================================
 void taskConnectivity(void * parameter) {
     HTTPClient http;
     unsigned long lastSyncTime = 0;
-    unsigned long lastScheduleCheck = 0;
     
     // Configure watchdog for Core 0
     esp_task_wdt_config_t wdt_config = {
@@ -717,55 +377,13 @@ void taskConnectivity(void * parameter) {
     while(true) {
         esp_task_wdt_reset();
         
-        // Handle web servers
-        redirectServer.handleClient();
-        handleLocalAPIRequests();  // Handles both localServer and webSocket
-        
-        // Handle voice assistants
-        alexaManager.loop();
-        
-        // Handle physical switches with debouncing
-        for(int i = 0; i < 4; i++) {
-            bool currentRead = digitalRead(SWITCH_PINS[i]);
-            if (i == 0) checkFactoryReset(currentRead);
-            
-            if (currentRead != lastSwitchState[i]) {
-                delay(SWITCH_DEBOUNCE_MS);
-                if (digitalRead(SWITCH_PINS[i]) == currentRead) {
-                    lastSwitchState[i] = currentRead;
-                    if (!devices[i].childLock) {
-                        // Toggle state - read state and brightness atomically
-                        // While individual volatile reads are atomic, we need both
-                        // values to be consistent relative to each other
-                        bool newState;
-                        int currentBrightness;
-                        portENTER_CRITICAL(&timerMux);
-                        newState = !devices[i].state;
-                        currentBrightness = devices[i].brightness;
-                        portEXIT_CRITICAL(&timerMux);
-                        setDeviceState(i, newState, currentBrightness);
-                    }
-                }
-            }
-        }
-        
-        // Process fade transitions
-        processFadeTransitions();
-        
-        // Check auto-off
-        checkAutoOff();
-        
-        // Update runtime statistics
-        updateRuntimeStatistics();
-        
-        // Check zero-cross health
-        checkZeroCrossHealth();
-        
-        // Process schedules every minute
-        if (millis() - lastScheduleCheck > 60000) {
-            processSchedules();
-            lastScheduleCheck = millis();
-        }
+        // HTTP requests (API and Alexa) are served on the AsyncTCP task;
+        // its handlers take controlMutex, so they run between passes
+        xSemaphoreTake(controlMutex, portMAX_DELAY);
+        handleLocalAPIRequests();  // WebSocket
+        runControlTasks();
+        processPendingRestart();
+        xSemaphoreGive(controlMutex);
         
         // Cloud sync
         if (millis() - lastSyncTime > CLOUD_POLL_INTERVAL_MS) {
@@ -799,8 +417,9 @@ bool syncWithCloud(HTTPClient &http) {
     doc["rssi"] = WiFi.RSSI();
     doc["heap"] = ESP.getFreeHeap();
     
-    // Add device states
-    for(int i = 0; i < 4; i++) {
+    // Add device states (handlers may be renaming devices meanwhile)
+    xSemaphoreTake(controlMutex, portMAX_DELAY);
+    for(int i = 0; i < CHANNEL_COUNT; i++) {
         String key = "d" + String(i + 1);
         JsonObject device = doc.createNestedObject(key);
         device["s"] = devices[i].state ? 1 : 0;
@@ -808,6 +427,7 @@ bool syncWithCloud(HTTPClient &http) {
         device["t"] = (int)devices[i].type;
         device["runtime"] = devices[i].totalRuntime;
     }
+    xSemaphoreGive(controlMutex);
     
     String jsonPayload;
     serializeJson(doc, jsonPayload);
@@ -830,8 +450,11 @@ bool syncWithCloud(HTTPClient &http) {
             return false;
         }
         
-        processCloudResponse(respDoc);
         http.end();
+        
+        xSemaphoreTake(controlMutex, portMAX_DELAY);
+        processCloudResponse(respDoc);
+        xSemaphoreGive(controlMutex);
         return true;
     } else {
         logMessage(LOG_ERROR, "Cloud sync failed: HTTP %d", httpCode);
@@ -846,7 +469,7 @@ void processCloudResponse(const JsonDocument &respDoc) {
         String newName = respDoc["sys_name"].as<String>();
         if (newName != systemName && newName.length() > 0) {
             systemName = newName;
-            saveDeviceConfig();
+            markConfigDirty(CONFIG_DEVICES);
             logMessage(LOG_INFO, "System name updated: %s", systemName.c_str());
         }
     }
@@ -868,7 +491,7 @@ void processCloudResponse(const JsonDocument &respDoc) {
     }
     
     // Device updates
-    for(int i = 0; i < 4; i++) {
+    for(int i = 0; i < CHANNEL_COUNT; i++) {
         String key = "d" + String(i + 1);
         if(respDoc.containsKey(key)) {
             JsonObjectConst d = respDoc[key].as<JsonObjectConst>();
@@ -881,10 +504,11 @@ void processCloudResponse(const JsonDocument &respDoc) {
                 if(typeStr == "FAN") newType = TYPE_FAN;
                 else if(typeStr == "SWITCH") newType = TYPE_SWITCH;
                 else if(typeStr == "DIMMER") newType = TYPE_DIMMER;
+                else if(typeStr == "BURST") newType = TYPE_BURST;
                 
                 if(newType != devices[i].type) {
-                    devices[i].type = newType;
-                    saveDeviceConfig();
+                    setDeviceType(i, newType);
+                    markConfigDirty(CONFIG_DEVICES);
                 }
             }
             
@@ -893,7 +517,7 @@ void processCloudResponse(const JsonDocument &respDoc) {
                 String newName = d["name"].as<String>();
                 if (newName != devices[i].name && newName.length() > 0) {
                     devices[i].name = newName;
-                    saveDeviceConfig();
+                    markConfigDirty(CONFIG_DEVICES);
                 }
             }
             
@@ -902,7 +526,7 @@ void processCloudResponse(const JsonDocument &respDoc) {
                 bool remoteLock = d["lock"].as<bool>();
                 if(remoteLock != devices[i].childLock) {
                     devices[i].childLock = remoteLock;
-                    saveDeviceConfig();
+                    markConfigDirty(CONFIG_DEVICES);
                 }
             }
             
@@ -936,7 +560,7 @@ void processCloudResponse(const JsonDocument &respDoc) {
 
 // WebSocket broadcast function
 void broadcastDeviceState(int deviceId) {
-    if (deviceId < 0 || deviceId >= 4) return;
+    if (deviceId < 0 || deviceId >= CHANNEL_COUNT) return;
     
     StaticJsonDocument<256> doc;
     doc["type"] = "device_update";
@@ -1156,9 +780,9 @@ void setup() {
     
     // Initialize hardware pins
     pinMode(ZCD_PIN, INPUT_PULLUP);
-    for(int i = 0; i < 4; i++) {
-        pinMode(TRIAC_PINS[i], OUTPUT);
-        digitalWrite(TRIAC_PINS[i], LOW);
+    initTriacOutputs();
+    initIsrMetrics();
+    for(int i = 0; i < CHANNEL_COUNT; i++) {
         pinMode(SWITCH_PINS[i], INPUT_PULLUP);
         lastSwitchState[i] = digitalRead(SWITCH_PINS[i]);
         
@@ -1166,10 +790,20 @@ void setup() {
         fadeStates[i].active = false;
     }
     
-    // Load configuration from flash
+    // Device state lock must exist before anything publishes to the ISRs
+    deviceMutex = xSemaphoreCreateMutex();
+    controlMutex = xSemaphoreCreateMutex();
+    
+    // Load configuration from flash (the journal first: it refines device state)
+    initJournal();
     loadDeviceConfig();
+    initScheduleStore();
     loadSchedules();
     loadScenes();
+    size_t nvsUsed, nvsTotal;
+    if (getStorageUsage(nvsUsed, nvsTotal)) {
+        logMessage(LOG_INFO, "NVS entries used: %u of %u", (unsigned)nvsUsed, (unsigned)nvsTotal);
+    }
     
     // Initialize WiFi
     WiFiManager wm;
@@ -1204,12 +838,10 @@ void setup() {
             logMessage(LOG_INFO, "mDNS started: %s.local", mdnsName.c_str());
         }
         
-        // Setup redirect server (port 80)
-        redirectServer.on("/", []() {
-            redirectServer.sendHeader("Location", GOOGLE_SCRIPT_URL, true);
-            redirectServer.send(302, "text/plain", "Redirecting to cloud dashboard...");
+        // Setup redirect to the cloud dashboard (port 80, started with Alexa below)
+        webServer.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
+            request->redirect(GOOGLE_SCRIPT_URL);
         });
-        redirectServer.begin();
         logMessage(LOG_INFO, "Redirect server started on port 80");
         
         // Setup local API server (port 8080)
@@ -1217,11 +849,22 @@ void setup() {
     }
     
     // Initialize voice assistants
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
         String deviceName = devices[i].name.length() > 0 ? devices[i].name : "Device " + String(i + 1);
         alexaManager.addDevice(deviceName.c_str(), [i](uint8_t b) { voiceCallback(b, i); });
     }
-    alexaManager.begin();
+    // Espalexa adds its pages to the port-80 server and starts it; the Hue
+    // API calls arrive as otherwise unmatched requests
+    webServer.onNotFound([](AsyncWebServerRequest *request) {
+        if (xSemaphoreTake(controlMutex, pdMS_TO_TICKS(API_LOCK_TIMEOUT_MS)) != pdTRUE) {
+            request->send(503, "text/plain", "Busy");
+            return;
+        }
+        bool handled = alexaManager.handleAlexaApiCall(request);
+        xSemaphoreGive(controlMutex);
+        if (!handled) request->send(404, "text/plain", "Not found");
+    });
+    alexaManager.begin(&webServer);
     logMessage(LOG_INFO, "Alexa integration initialized");
     
     // SinricPro for Google Assistant is not yet integrated.
@@ -1230,8 +873,13 @@ void setup() {
     // Initialize TRIAC control timer (Core 1)
     timer = timerBegin(1000000);  // 1MHz
     timerAttachInterrupt(timer, &onTimerFire);
+#if PHASE_CONTROL_MODE == PHASE_MODE_EVENT
+    // Alarms are armed one-shot from onZeroCross() at each fire point
+    logMessage(LOG_INFO, "Hardware timer initialized (event-driven firing)");
+#else
     timerAlarm(timer, TIMER_INTERVAL_US, true, 0);
     logMessage(LOG_INFO, "Hardware timer initialized");
+#endif
     
     // Attach zero-cross interrupt
     attachInterrupt(digitalPinToInterrupt(ZCD_PIN), onZeroCross, RISING);
@@ -1263,8 +911,8 @@ void setup() {
 // ================================================================
 
 void loop() {
-    // Core 1 handles only time-critical voice assistant polling
-    // All other logic is in Core 0 task
+    // Core 1 handles only Alexa discovery (UDP); its HTTP side runs on the
+    // AsyncTCP task. All other logic is in Core 0 task
     alexaManager.loop();
     
     // Minimal delay to prevent watchdog triggers
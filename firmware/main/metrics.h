@@ -0,0 +1,115 @@
+/**
+ * ISR Metrics Module
+ * Lock-free latency and jitter histograms recorded by the TRIAC ISRs
+ * Each core owns its own counters; the ISRs never take a lock to record
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "config.h"
+#include <Arduino.h>
+
+// ================================================================
+// DATA STRUCTURES
+// ================================================================
+
+// Power-of-two microsecond buckets: 0 = <1us, n = [2^(n-1), 2^n) us,
+// last bucket collects everything above
+#define ISR_HIST_BUCKETS 16
+
+struct IsrHistogram {
+    uint32_t counts[ISR_HIST_BUCKETS];
+    uint32_t maxUs;
+};
+
+struct IsrMetrics {
+    IsrHistogram fireError;           // Actual minus intended fire time
+    IsrHistogram zeroCrossIsr;        // onZeroCross() duration
+    IsrHistogram timerIsr;            // onTimerFire() duration
+    IsrHistogram zeroCrossDeviation;  // |accepted edge - predicted edge|
+    uint32_t zeroCrossEdges;
+    uint32_t missedEdges;             // Bridged by PLL coasting
+    uint32_t rejectedEdges;           // Outside the PLL window (noise)
+    uint32_t timerInterrupts;
+    uint32_t minIntervalUs;
+    uint32_t maxIntervalUs;
+    uint32_t resetGeneration;         // Last reset request applied by the owning core
+};
+
+// ================================================================
+// RECORDING (ISR context, Core 1)
+// ================================================================
+
+/**
+ * Cycle counter timestamp for ISR timing
+ */
+uint32_t IRAM_ATTR metricsTimestamp();
+
+/**
+ * Record an accepted zero-cross edge
+ * Also applies any pending reset request for this core
+ * 
+ * @param intervalUs Time since previous accepted edge
+ * @param deviationUs Distance from the predicted edge
+ */
+void IRAM_ATTR metricsRecordZeroCross(uint32_t intervalUs, uint32_t deviationUs);
+
+/**
+ * Record a zero-cross edge fault
+ * 
+ * @param missed true for a missing edge, false for a rejected noise edge
+ */
+void IRAM_ATTR metricsRecordEdgeFault(bool missed);
+
+/**
+ * Record how late a TRIAC fired against its intended delay
+ * 
+ * @param zeroCrossCycles Timestamp of the zero-cross the delay is relative to
+ * @param intendedUs Intended delay from zero-cross
+ */
+void IRAM_ATTR metricsRecordFire(uint32_t zeroCrossCycles, uint32_t intendedUs);
+
+/**
+ * Record ISR duration
+ * 
+ * @param entryCycles Timestamp taken at ISR entry
+ * @param zeroCross true for onZeroCross(), false for onTimerFire()
+ */
+void IRAM_ATTR metricsRecordIsrExit(uint32_t entryCycles, bool zeroCross);
+
+// ================================================================
+// READOUT (task context, Core 0)
+// ================================================================
+
+/**
+ * Initialize cycle-to-microsecond conversion
+ * Call once from setup() before ISRs are attached
+ */
+void initIsrMetrics();
+
+/**
+ * Get metrics for one core
+ * Counters are read without locking; individual 32-bit values are
+ * consistent but a histogram may be mid-update by one sample
+ * 
+ * @param core Core index (0 to portNUM_PROCESSORS-1)
+ */
+const IsrMetrics& getIsrMetrics(int core);
+
+/**
+ * Request a reset of all ISR metrics
+ * Each core clears its own counters at its next zero-cross
+ */
+void resetIsrMetrics();
+
+#ifdef HOST_SIMULATION
+/**
+ * Host build seam: virtual CPU cycle counter replacing the ESP32 one,
+ * advanced by the host simulation at getCpuFrequencyMhz() cycles per us
+ * Provided by the host simulation
+ */
+extern uint32_t hostCycleCount();
+#endif
+
+#endif // METRICS_H
@@ -0,0 +1,102 @@
+/**
+ * ISR Metrics Implementation
+ * Per-core histograms written only by the owning core's ISRs
+ */
+
+#ifndef METRICS_IMPL_H
+#define METRICS_IMPL_H
+
+#include "metrics.h"
+
+#ifndef HOST_SIMULATION
+#include <esp_cpu.h>
+#endif
+
+// Per-core metrics (DRAM for ISR access)
+static DRAM_ATTR IsrMetrics isrMetrics[portNUM_PROCESSORS];
+static DRAM_ATTR uint32_t cyclesPerUs = 240;
+static volatile uint32_t metricsResetRequest = 0;
+
+// ================================================================
+// RECORDING
+// ================================================================
+
+static inline void IRAM_ATTR histogramAdd(IsrHistogram &hist, uint32_t valueUs) {
+    int bucket = valueUs ? 32 - __builtin_clz(valueUs) : 0;
+    if (bucket >= ISR_HIST_BUCKETS) bucket = ISR_HIST_BUCKETS - 1;
+    hist.counts[bucket]++;
+    if (valueUs > hist.maxUs) hist.maxUs = valueUs;
+}
+
+uint32_t IRAM_ATTR metricsTimestamp() {
+#ifdef HOST_SIMULATION
+    return hostCycleCount();
+#else
+    return esp_cpu_get_cycle_count();
+#endif
+}
+
+void IRAM_ATTR metricsRecordZeroCross(uint32_t intervalUs, uint32_t deviationUs) {
+    IsrMetrics &m = isrMetrics[xPortGetCoreID()];
+    
+    // Apply a pending reset on the owning core so counters never race
+    uint32_t request = metricsResetRequest;
+    if (m.resetGeneration != request) {
+        memset(&m, 0, sizeof(m));
+        m.resetGeneration = request;
+    }
+    
+    m.zeroCrossEdges++;
+    if (intervalUs > 1000000) return;  // Start-up or after signal loss
+    
+    if (m.minIntervalUs == 0 || intervalUs < m.minIntervalUs) m.minIntervalUs = intervalUs;
+    if (intervalUs > m.maxIntervalUs) m.maxIntervalUs = intervalUs;
+    histogramAdd(m.zeroCrossDeviation, deviationUs);
+}
+
+void IRAM_ATTR metricsRecordEdgeFault(bool missed) {
+    IsrMetrics &m = isrMetrics[xPortGetCoreID()];
+    if (missed) {
+        m.missedEdges++;
+    } else {
+        m.rejectedEdges++;
+    }
+}
+
+void IRAM_ATTR metricsRecordFire(uint32_t zeroCrossCycles, uint32_t intendedUs) {
+    uint32_t actualUs = (metricsTimestamp() - zeroCrossCycles) / cyclesPerUs;
+    histogramAdd(isrMetrics[xPortGetCoreID()].fireError, actualUs > intendedUs ? actualUs - intendedUs : 0);
+}
+
+void IRAM_ATTR metricsRecordIsrExit(uint32_t entryCycles, bool zeroCross) {
+    IsrMetrics &m = isrMetrics[xPortGetCoreID()];
+    uint32_t durationUs = (metricsTimestamp() - entryCycles) / cyclesPerUs;
+    
+    if (zeroCross) {
+        histogramAdd(m.zeroCrossIsr, durationUs);
+    } else {
+        m.timerInterrupts++;
+        histogramAdd(m.timerIsr, durationUs);
+    }
+}
+
+// ================================================================
+// READOUT
+// ================================================================
+
+void initIsrMetrics() {
+    cyclesPerUs = getCpuFrequencyMhz();
+    if (cyclesPerUs == 0) cyclesPerUs = 1;
+    memset(isrMetrics, 0, sizeof(isrMetrics));
+}
+
+const IsrMetrics& getIsrMetrics(int core) {
+    if (core < 0 || core >= portNUM_PROCESSORS) core = 0;
+    return isrMetrics[core];
+}
+
+void resetIsrMetrics() {
+    metricsResetRequest = metricsResetRequest + 1;
+}
+
+#endif // METRICS_IMPL_H
@@ -0,0 +1,69 @@
+/**
+ * TRIAC Output HAL
+ * Single-write GPIO mask output for the TRIAC ISRs
+ * Channel sets are converted to GPIO bitmasks outside the ISR so each
+ * edge is one write to the GPIO set/clear registers
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include "config.h"
+#include <Arduino.h>
+
+// ================================================================
+// INITIALIZATION
+// ================================================================
+
+/**
+ * Configure TRIAC pins as outputs, drive them LOW and build the
+ * channel-to-GPIO mask table
+ * Call once from setup() before any ISR is attached
+ */
+void initTriacOutputs();
+
+// ================================================================
+// MASK CONVERSION (task context)
+// ================================================================
+
+/**
+ * Convert a channel bitmask to a GPIO bitmask
+ * 
+ * @param channels Bit i set = TRIAC_PINS[i]
+ * @return Bitmask for the GPIO W1TS/W1TC registers
+ */
+uint32_t channelsToGpioMask(ChannelMask channels);
+
+/**
+ * GPIO bitmask of every TRIAC pin
+ */
+uint32_t allTriacGpioMask();
+
+// ================================================================
+// OUTPUT (ISR safe)
+// ================================================================
+
+/**
+ * Drive TRIAC pins with one set and one clear register write
+ * Bits in both masks end up LOW (clear is applied last)
+ * 
+ * @param setMask GPIO pins to drive HIGH
+ * @param clearMask GPIO pins to drive LOW
+ */
+void IRAM_ATTR triacOutputWrite(uint32_t setMask, uint32_t clearMask);
+
+/**
+ * Drive every TRIAC pin LOW
+ */
+void IRAM_ATTR triacOutputAllOff();
+
+#ifdef HOST_SIMULATION
+/**
+ * Host build seam: receives every output write instead of the GPIO
+ * registers, e.g. to record per-channel pin timelines
+ * Provided by the host simulation
+ */
+extern void hostRecordTriacOutput(uint32_t setMask, uint32_t clearMask);
+#endif
+
+#endif // OUTPUT_H
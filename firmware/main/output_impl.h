@@ -0,0 +1,81 @@
+/**
+ * TRIAC Output HAL Implementation
+ * Direct GPIO register writes for the ESP32, recorder hook for host builds
+ */
+
+#ifndef OUTPUT_IMPL_H
+#define OUTPUT_IMPL_H
+
+#include "output.h"
+
+#ifndef HOST_SIMULATION
+#include <soc/gpio_reg.h>
+#endif
+
+// External references
+extern const int TRIAC_PINS[CHANNEL_COUNT];
+extern void logMessage(LogLevel level, const char* format, ...);
+
+// Per-channel GPIO masks, built once at init (DRAM for ISR access)
+static DRAM_ATTR uint32_t triacGpioMask[CHANNEL_COUNT] = {};
+static DRAM_ATTR uint32_t triacGpioAll = 0;
+
+// ================================================================
+// INITIALIZATION
+// ================================================================
+
+void initTriacOutputs() {
+    triacGpioAll = 0;
+    
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        pinMode(TRIAC_PINS[i], OUTPUT);
+        
+        // W1TS/W1TC cover GPIO 0-31 only
+        if (TRIAC_PINS[i] < 0 || TRIAC_PINS[i] > 31) {
+            logMessage(LOG_ERROR, "TRIAC pin %d not in GPIO bank 0, channel %d disabled", TRIAC_PINS[i], i);
+            triacGpioMask[i] = 0;
+            continue;
+        }
+        
+        triacGpioMask[i] = (1UL << TRIAC_PINS[i]);
+        triacGpioAll |= triacGpioMask[i];
+    }
+    
+    triacOutputAllOff();
+}
+
+// ================================================================
+// MASK CONVERSION
+// ================================================================
+
+uint32_t channelsToGpioMask(ChannelMask channels) {
+    uint32_t mask = 0;
+    while (channels) {
+        mask |= triacGpioMask[__builtin_ctz(channels)];
+        channels &= channels - 1;
+    }
+    return mask;
+}
+
+uint32_t allTriacGpioMask() {
+    return triacGpioAll;
+}
+
+// ================================================================
+// OUTPUT
+// ================================================================
+
+void IRAM_ATTR triacOutputWrite(uint32_t setMask, uint32_t clearMask) {
+#ifdef HOST_SIMULATION
+    hostRecordTriacOutput(setMask, clearMask);
+#else
+    if (setMask) REG_WRITE(GPIO_OUT_W1TS_REG, setMask);
+    if (clearMask) REG_WRITE(GPIO_OUT_W1TC_REG, clearMask);
+#endif
+}
+
+void IRAM_ATTR triacOutputAllOff() {
+    triacOutputWrite(0, triacGpioAll);
+}
+
+#endif // OUTPUT_IMPL_H
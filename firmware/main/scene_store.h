@@ -0,0 +1,123 @@
+/**
+ * Scene Store Module
+ * Fixed-size scene catalog with inline names, a shared pool of device
+ * entries and a hash index by name. No heap allocation.
+ */
+
+#ifndef SCENE_STORE_H
+#define SCENE_STORE_H
+
+#include "config.h"
+#include <Arduino.h>
+
+// ================================================================
+// DATA STRUCTURES
+// ================================================================
+
+/**
+ * One device setting within a scene (8 bytes)
+ */
+struct SceneEntry {
+    uint32_t fadeMs;        // 0 = immediate
+    int8_t deviceId;
+    int8_t brightness;      // 0-100
+    uint8_t state : 1;
+    uint8_t curve : 7;      // FadeCurve
+    uint8_t reserved;
+};
+
+static_assert(sizeof(SceneEntry) == 8, "SceneEntry must pack into 8 bytes");
+
+/**
+ * Scene header; its entries are a run of the shared entry pool
+ * A slot is free when its name is empty
+ */
+struct Scene {
+    char name[SCENE_NAME_LEN];  // NUL-terminated, unique (case-insensitive)
+    uint16_t firstEntry;        // Index of the first entry in the pool
+    uint8_t entryCount;         // 0 to CHANNEL_COUNT, one per device
+    uint8_t reserved;
+};
+
+// ================================================================
+// CATALOG ACCESS
+// ================================================================
+
+/**
+ * Look up a scene
+ *
+ * @param sceneId Scene index (0 to SCENE_MAX_COUNT-1)
+ * @return Scene, or NULL if out of range or unused
+ */
+const Scene *getScene(int sceneId);
+
+/**
+ * Device entries of a scene (entryCount of them)
+ */
+const SceneEntry *getSceneEntries(const Scene &scene);
+
+/**
+ * Find a scene by name through the hash index (case-insensitive)
+ *
+ * @return Scene id, or -1 if no scene has that name
+ */
+int findSceneByName(const char *name);
+
+/**
+ * Number of scenes in use
+ */
+int sceneCount();
+
+// ================================================================
+// CATALOG CHANGES
+// ================================================================
+
+/**
+ * Lowest unused scene id
+ *
+ * @return Scene id, or -1 if the catalog is full
+ */
+int allocateScene();
+
+/**
+ * Create or replace a scene
+ * Nothing changes if the name is empty, too long or used by another
+ * scene, an entry is invalid or repeats a device, or the pool is full.
+ *
+ * @param sceneId Scene index (0 to SCENE_MAX_COUNT-1)
+ * @param name Scene name
+ * @param entries Device entries, at most one per device
+ * @param count Number of entries (0 to CHANNEL_COUNT)
+ * @return false if rejected
+ */
+bool setScene(int sceneId, const char *name, const SceneEntry *entries, int count);
+
+/**
+ * Remove a scene and return its entries to the pool
+ */
+void deleteScene(int sceneId);
+
+// ================================================================
+// PERSISTENCE
+// ================================================================
+
+/**
+ * Raw catalog and entry pool, for loading and saving as blobs
+ */
+Scene *sceneTable();
+SceneEntry *sceneEntryPool();
+
+/**
+ * Number of pool entries in use; entries past this are free
+ */
+int sceneEntriesUsed();
+
+/**
+ * Rebuild pool bookkeeping and the name index after loading the raw
+ * tables, dropping any scene whose entries or name do not check out
+ *
+ * @param entriesUsed Pool entries loaded
+ */
+void restoreSceneStore(int entriesUsed);
+
+#endif // SCENE_STORE_H
@@ -0,0 +1,241 @@
+/**
+ * Scene Store Implementation
+ * Entries of all scenes are packed at the front of one pool; replacing
+ * or deleting a scene closes its gap so the free space stays contiguous
+ */
+
+#ifndef SCENE_STORE_IMPL_H
+#define SCENE_STORE_IMPL_H
+
+#include "scene_store.h"
+
+// External references
+extern void logMessage(LogLevel level, const char* format, ...);
+
+// Open-addressing name index: power of two, at least twice the catalog
+#define SCENE_HASH_SIZE 256
+static_assert(SCENE_HASH_SIZE >= 2 * SCENE_MAX_COUNT && !(SCENE_HASH_SIZE & (SCENE_HASH_SIZE - 1)),
+              "SCENE_HASH_SIZE must be a power of two >= 2 * SCENE_MAX_COUNT");
+static_assert(SCENE_MAX_COUNT < 256, "Scene ids must fit the uint8_t hash slots");
+
+static Scene sceneSlots[SCENE_MAX_COUNT] = {};
+static SceneEntry scenePool[SCENE_ENTRY_POOL] = {};
+static int scenePoolUsed = 0;
+static int sceneUsedCount = 0;
+static uint8_t sceneHash[SCENE_HASH_SIZE] = {};  // Scene id + 1, 0 = empty
+
+// FNV-1a over the lowercased name
+static uint32_t sceneNameHash(const char *name) {
+    uint32_t hash = 2166136261UL;
+    for (; *name; name++) {
+        hash ^= (uint8_t)tolower((unsigned char)*name);
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+static void sceneHashInsert(int sceneId) {
+    uint32_t slot = sceneNameHash(sceneSlots[sceneId].name) & (SCENE_HASH_SIZE - 1);
+    while (sceneHash[slot]) {
+        slot = (slot + 1) & (SCENE_HASH_SIZE - 1);
+    }
+    sceneHash[slot] = sceneId + 1;
+}
+
+// Linear probing has no cheap delete; the catalog is small, so rebuild
+static void rebuildSceneHash() {
+    memset(sceneHash, 0, sizeof(sceneHash));
+    sceneUsedCount = 0;
+    for (int i = 0; i < SCENE_MAX_COUNT; i++) {
+        if (!sceneSlots[i].name[0]) continue;
+        sceneHashInsert(i);
+        sceneUsedCount++;
+    }
+}
+
+// Remove a scene's run from the pool and close the gap
+static void releaseSceneEntries(Scene &scene) {
+    int first = scene.firstEntry;
+    int count = scene.entryCount;
+    if (count == 0) return;
+    
+    memmove(&scenePool[first], &scenePool[first + count],
+            (scenePoolUsed - first - count) * sizeof(SceneEntry));
+    scenePoolUsed -= count;
+    
+    for (int i = 0; i < SCENE_MAX_COUNT; i++) {
+        if (sceneSlots[i].name[0] && sceneSlots[i].firstEntry > first) {
+            sceneSlots[i].firstEntry -= count;
+        }
+    }
+    scene.firstEntry = 0;
+    scene.entryCount = 0;
+}
+
+// ================================================================
+// CATALOG ACCESS
+// ================================================================
+
+const Scene *getScene(int sceneId) {
+    if (sceneId < 0 || sceneId >= SCENE_MAX_COUNT) return NULL;
+    if (!sceneSlots[sceneId].name[0]) return NULL;
+    return &sceneSlots[sceneId];
+}
+
+const SceneEntry *getSceneEntries(const Scene &scene) {
+    return &scenePool[scene.firstEntry];
+}
+
+int findSceneByName(const char *name) {
+    if (!name || !name[0]) return -1;
+    
+    uint32_t slot = sceneNameHash(name) & (SCENE_HASH_SIZE - 1);
+    while (sceneHash[slot]) {
+        int sceneId = sceneHash[slot] - 1;
+        if (strcasecmp(sceneSlots[sceneId].name, name) == 0) return sceneId;
+        slot = (slot + 1) & (SCENE_HASH_SIZE - 1);
+    }
+    return -1;
+}
+
+int sceneCount() {
+    return sceneUsedCount;
+}
+
+// ================================================================
+// CATALOG CHANGES
+// ================================================================
+
+int allocateScene() {
+    for (int i = 0; i < SCENE_MAX_COUNT; i++) {
+        if (!sceneSlots[i].name[0]) return i;
+    }
+    return -1;
+}
+
+bool setScene(int sceneId, const char *name, const SceneEntry *entries, int count) {
+    if (sceneId < 0 || sceneId >= SCENE_MAX_COUNT) return false;
+    if (!name || !name[0] || strlen(name) >= SCENE_NAME_LEN) return false;
+    if (count < 0 || count > CHANNEL_COUNT) return false;
+    
+    int owner = findSceneByName(name);
+    if (owner >= 0 && owner != sceneId) return false;
+    
+    ChannelMask seen = 0;
+    for (int i = 0; i < count; i++) {
+        const SceneEntry &entry = entries[i];
+        if (entry.deviceId < 0 || entry.deviceId >= CHANNEL_COUNT) return false;
+        if (entry.brightness < 0 || entry.brightness > 100 || entry.curve > FADE_PERCEPTUAL) return false;
+        if (seen & (1 << entry.deviceId)) return false;
+        seen |= (1 << entry.deviceId);
+    }
+    
+    Scene &scene = sceneSlots[sceneId];
+    int reusable = scene.name[0] ? scene.entryCount : 0;
+    if (scenePoolUsed - reusable + count > SCENE_ENTRY_POOL) {
+        logMessage(LOG_WARN, "Scene entry pool full");
+        return false;
+    }
+    
+    // Replace: drop the old run, append the new one at the end of the pool
+    if (scene.name[0]) releaseSceneEntries(scene);
+    memcpy(&scenePool[scenePoolUsed], entries, count * sizeof(SceneEntry));
+    scene.firstEntry = scenePoolUsed;
+    scene.entryCount = count;
+    scenePoolUsed += count;
+    
+    strlcpy(scene.name, name, sizeof(scene.name));
+    rebuildSceneHash();
+    return true;
+}
+
+void deleteScene(int sceneId) {
+    if (!getScene(sceneId)) return;
+    
+    Scene &scene = sceneSlots[sceneId];
+    releaseSceneEntries(scene);
+    memset(&scene, 0, sizeof(scene));
+    rebuildSceneHash();
+}
+
+// ================================================================
+// PERSISTENCE
+// ================================================================
+
+Scene *sceneTable() {
+    return sceneSlots;
+}
+
+SceneEntry *sceneEntryPool() {
+    return scenePool;
+}
+
+int sceneEntriesUsed() {
+    return scenePoolUsed;
+}
+
+void restoreSceneStore(int entriesUsed) {
+    entriesUsed = constrain(entriesUsed, 0, SCENE_ENTRY_POOL);
+    
+    for (int i = 0; i < SCENE_MAX_COUNT; i++) {
+        Scene &scene = sceneSlots[i];
+        if (!scene.name[0]) continue;
+        
+        scene.name[SCENE_NAME_LEN - 1] = '\0';
+        bool valid = scene.entryCount <= CHANNEL_COUNT &&
+                     scene.firstEntry + scene.entryCount <= entriesUsed;
+        for (int e = 0; valid && e < scene.entryCount; e++) {
+            const SceneEntry &entry = scenePool[scene.firstEntry + e];
+            if (entry.deviceId < 0 || entry.deviceId >= CHANNEL_COUNT) valid = false;
+        }
+        
+        // Also drops a later duplicate of an earlier name
+        for (int j = 0; valid && j < i; j++) {
+            if (sceneSlots[j].name[0] && strcasecmp(sceneSlots[j].name, scene.name) == 0) valid = false;
+        }
+        
+        if (!valid) {
+            logMessage(LOG_WARN, "Scene %d discarded: inconsistent record", i);
+            memset(&scene, 0, sizeof(scene));
+        }
+    }
+    
+    // Repack the surviving runs in pool order, dropping gaps; a run that
+    // starts inside the previous one overlaps it and is never picked
+    bool packed[SCENE_MAX_COUNT] = {};
+    for (int i = 0; i < SCENE_MAX_COUNT; i++) {
+        if (sceneSlots[i].name[0] && sceneSlots[i].entryCount == 0) {
+            sceneSlots[i].firstEntry = 0;
+            packed[i] = true;
+        }
+    }
+    scenePoolUsed = 0;
+    int readFrom = 0;
+    while (true) {
+        int next = -1;
+        for (int i = 0; i < SCENE_MAX_COUNT; i++) {
+            const Scene &scene = sceneSlots[i];
+            if (!scene.name[0] || packed[i] || scene.firstEntry < readFrom) continue;
+            if (next < 0 || scene.firstEntry < sceneSlots[next].firstEntry) next = i;
+        }
+        if (next < 0) break;
+        
+        Scene &scene = sceneSlots[next];
+        readFrom = scene.firstEntry + scene.entryCount;
+        memmove(&scenePool[scenePoolUsed], &scenePool[scene.firstEntry], scene.entryCount * sizeof(SceneEntry));
+        scene.firstEntry = scenePoolUsed;
+        scenePoolUsed += scene.entryCount;
+        packed[next] = true;
+    }
+    
+    for (int i = 0; i < SCENE_MAX_COUNT; i++) {
+        if (sceneSlots[i].name[0] && !packed[i]) {
+            logMessage(LOG_WARN, "Scene %d discarded: overlapping entries", i);
+            memset(&sceneSlots[i], 0, sizeof(Scene));
+        }
+    }
+    
+    rebuildSceneHash();
+}
+
+#endif // SCENE_STORE_IMPL_H
@@ -0,0 +1,118 @@
+/**
+ * Schedule Store Module
+ * Packed schedule records with on-demand capacity and bitset indexes
+ * by device and by day of week
+ */
+
+#ifndef SCHEDULE_STORE_H
+#define SCHEDULE_STORE_H
+
+#include "config.h"
+#include <Arduino.h>
+
+// ================================================================
+// DATA STRUCTURES
+// ================================================================
+
+/**
+ * One schedule, packed into 8 bytes
+ * The window runs from startMins to endMins local time, starting on each
+ * day in daysOfWeek. endMins < startMins crosses midnight into the next
+ * day; endMins == startMins never runs.
+ * Overlapping open windows on one device: the higher priority wins, then
+ * the window that started later, then the higher schedule id.
+ */
+struct Schedule {
+    uint32_t startMins : 11;   // 0-1439
+    uint32_t endMins : 11;     // 0-1439
+    uint32_t daysOfWeek : 7;   // Bitmask of start days: bit 0=Sun, 1=Mon, etc.
+    uint32_t active : 1;
+    uint32_t reserved : 2;
+    int8_t deviceId;           // -1 = free slot
+    int8_t startBrightness;
+    int8_t endBrightness;
+    uint8_t priority;          // Higher wins on overlap
+};
+
+static_assert(sizeof(Schedule) == 8, "Schedule must pack into 8 bytes");
+
+// ================================================================
+// STORE MANAGEMENT
+// ================================================================
+
+/**
+ * Allocate the initial schedule table (SCHEDULE_INITIAL_CAPACITY slots)
+ * Call once from setup() before loading schedules
+ *
+ * @return false if out of memory
+ */
+bool initScheduleStore();
+
+/**
+ * Grow the table to hold at least the given number of slots
+ * Never shrinks; capped at SCHEDULE_MAX_COUNT
+ *
+ * @return false if the request exceeds the cap or memory is exhausted
+ */
+bool reserveSchedules(int capacity);
+
+/**
+ * Number of allocated slots; schedule ids are 0 to capacity-1
+ */
+int scheduleCapacity();
+
+/**
+ * Number of slots in use
+ */
+int scheduleCount();
+
+/**
+ * Access a slot
+ * Call updateScheduleIndex() after changing deviceId or daysOfWeek
+ *
+ * @param scheduleId Slot index
+ * @return Slot, or NULL if out of range
+ */
+Schedule *getSchedule(int scheduleId);
+
+/**
+ * Claim the lowest free slot, growing the table if needed
+ * The slot is filled with defaults and left unassigned (deviceId -1)
+ * until the caller sets a device and updates the index
+ *
+ * @return Schedule id, or -1 if the store is full
+ */
+int allocateSchedule();
+
+/**
+ * Release a slot
+ */
+void freeSchedule(int scheduleId);
+
+/**
+ * Refresh one slot's index entries after its device or days changed
+ */
+void updateScheduleIndex(int scheduleId);
+
+/**
+ * Rebuild all index entries (after bulk loading the table)
+ */
+void rebuildScheduleIndexes();
+
+/**
+ * Next schedule id at or after `from` matching the filters
+ * Walks the bitset indexes, so skipping non-matching slots is cheap
+ *
+ * @param from First id to consider
+ * @param deviceId Device filter, -1 for any
+ * @param day Start day filter (0=Sun), -1 for any
+ * @return Schedule id, or -1 if none
+ */
+int nextScheduleId(int from, int deviceId = -1, int day = -1);
+
+/**
+ * Raw table for persistence
+ */
+Schedule *scheduleTable();
+
+#endif // SCHEDULE_STORE_H
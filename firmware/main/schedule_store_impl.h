@@ -0,0 +1,179 @@
+/**
+ * Schedule Store Implementation
+ * Heap-allocated table of packed records, grown by doubling
+ */
+
+#ifndef SCHEDULE_STORE_IMPL_H
+#define SCHEDULE_STORE_IMPL_H
+
+#include "schedule_store.h"
+
+// External references
+extern void logMessage(LogLevel level, const char* format, ...);
+
+// Index bitsets, one bit per slot: in use, per device, per start day
+#define SCHEDULE_INDEX_SETS (1 + CHANNEL_COUNT + 7)
+
+static Schedule *scheduleSlots = NULL;
+static uint32_t *scheduleIndexBits = NULL;  // SCHEDULE_INDEX_SETS rows of scheduleIndexWords
+static int scheduleSlotCount = 0;
+static int scheduleIndexWords = 0;
+static int scheduleUsedCount = 0;
+
+static uint32_t *indexRow(int set) {
+    return scheduleIndexBits + set * scheduleIndexWords;
+}
+
+static uint32_t *usedIndex() { return indexRow(0); }
+static uint32_t *deviceIndex(int deviceId) { return indexRow(1 + deviceId); }
+static uint32_t *dayIndex(int day) { return indexRow(1 + CHANNEL_COUNT + day); }
+
+static void clearSlot(Schedule &sched) {
+    memset(&sched, 0, sizeof(sched));
+    sched.deviceId = -1;
+    sched.endBrightness = 100;
+    sched.daysOfWeek = 0x7F;
+}
+
+// ================================================================
+// STORE MANAGEMENT
+// ================================================================
+
+bool initScheduleStore() {
+    if (scheduleSlots) return true;
+    return reserveSchedules(SCHEDULE_INITIAL_CAPACITY);
+}
+
+bool reserveSchedules(int capacity) {
+    if (capacity <= scheduleSlotCount) return true;
+    if (capacity > SCHEDULE_MAX_COUNT) return false;
+    
+    // Double to amortize growth; words rounded so every row stays 32-bit aligned
+    int newCount = scheduleSlotCount ? scheduleSlotCount : SCHEDULE_INITIAL_CAPACITY;
+    while (newCount < capacity) newCount *= 2;
+    if (newCount > SCHEDULE_MAX_COUNT) newCount = SCHEDULE_MAX_COUNT;
+    int newWords = (newCount + 31) / 32;
+    
+    Schedule *slots = (Schedule *)realloc(scheduleSlots, newCount * sizeof(Schedule));
+    if (!slots) {
+        logMessage(LOG_ERROR, "Schedule store: out of memory growing to %d", newCount);
+        return false;
+    }
+    scheduleSlots = slots;
+    
+    uint32_t *bits = (uint32_t *)calloc(SCHEDULE_INDEX_SETS * newWords, sizeof(uint32_t));
+    if (!bits) {
+        logMessage(LOG_ERROR, "Schedule store: out of memory for indexes");
+        return false;
+    }
+    
+    for (int i = scheduleSlotCount; i < newCount; i++) {
+        clearSlot(scheduleSlots[i]);
+    }
+    
+    free(scheduleIndexBits);
+    scheduleIndexBits = bits;
+    scheduleIndexWords = newWords;
+    scheduleSlotCount = newCount;
+    rebuildScheduleIndexes();
+    
+    logMessage(LOG_DEBUG, "Schedule store capacity: %d", newCount);
+    return true;
+}
+
+int scheduleCapacity() {
+    return scheduleSlotCount;
+}
+
+int scheduleCount() {
+    return scheduleUsedCount;
+}
+
+Schedule *getSchedule(int scheduleId) {
+    if (scheduleId < 0 || scheduleId >= scheduleSlotCount) return NULL;
+    return &scheduleSlots[scheduleId];
+}
+
+Schedule *scheduleTable() {
+    return scheduleSlots;
+}
+
+int allocateSchedule() {
+    int id = 0;
+    for (int w = 0; w < scheduleIndexWords; w++) {
+        uint32_t freeBits = ~usedIndex()[w];
+        if (freeBits) {
+            id = w * 32 + __builtin_ctz(freeBits);
+            break;
+        }
+        id = (w + 1) * 32;
+    }
+    
+    if (id >= scheduleSlotCount && !reserveSchedules(id + 1)) return -1;
+    
+    clearSlot(scheduleSlots[id]);
+    return id;
+}
+
+void freeSchedule(int scheduleId) {
+    Schedule *sched = getSchedule(scheduleId);
+    if (!sched) return;
+    clearSlot(*sched);
+    updateScheduleIndex(scheduleId);
+}
+
+// ================================================================
+// INDEXES
+// ================================================================
+
+void updateScheduleIndex(int scheduleId) {
+    if (scheduleId < 0 || scheduleId >= scheduleSlotCount) return;
+    
+    int word = scheduleId / 32;
+    uint32_t bit = 1UL << (scheduleId % 32);
+    const Schedule &sched = scheduleSlots[scheduleId];
+    
+    if (usedIndex()[word] & bit) scheduleUsedCount--;
+    for (int set = 0; set < SCHEDULE_INDEX_SETS; set++) {
+        indexRow(set)[word] &= ~bit;
+    }
+    
+    if (sched.deviceId < 0 || sched.deviceId >= CHANNEL_COUNT) return;
+    
+    usedIndex()[word] |= bit;
+    deviceIndex(sched.deviceId)[word] |= bit;
+    for (int day = 0; day < 7; day++) {
+        if (sched.daysOfWeek & (1 << day)) dayIndex(day)[word] |= bit;
+    }
+    scheduleUsedCount++;
+}
+
+void rebuildScheduleIndexes() {
+    memset(scheduleIndexBits, 0, SCHEDULE_INDEX_SETS * scheduleIndexWords * sizeof(uint32_t));
+    scheduleUsedCount = 0;
+    for (int i = 0; i < scheduleSlotCount; i++) {
+        updateScheduleIndex(i);
+    }
+}
+
+int nextScheduleId(int from, int deviceId, int day) {
+    if (from < 0) from = 0;
+    if (from >= scheduleSlotCount) return -1;
+    if (deviceId >= CHANNEL_COUNT || day >= 7) return -1;
+    
+    const uint32_t *used = usedIndex();
+    const uint32_t *byDevice = deviceId >= 0 ? deviceIndex(deviceId) : NULL;
+    const uint32_t *byDay = day >= 0 ? dayIndex(day) : NULL;
+    
+    int word = from / 32;
+    uint32_t bits = used[word] & (~0UL << (from % 32));
+    while (true) {
+        if (byDevice) bits &= byDevice[word];
+        if (byDay) bits &= byDay[word];
+        if (bits) return word * 32 + __builtin_ctz(bits);
+        if (++word >= scheduleIndexWords) return -1;
+        bits = used[word];
+    }
+}
+
+#endif // SCHEDULE_STORE_IMPL_H
@@ -1,7 +1,9 @@
 /**
  * Storage and Persistence Module
  * Handles device configuration, schedules, and scenes storage
- * Uses ESP32 Preferences (NVS) for non-volatile storage
+ * Uses ESP32 Preferences (NVS) for non-volatile storage; each section is
+ * one versioned, CRC-checked blob and older key layouts are migrated on load.
+ * Changes are marked dirty and written behind by processConfigFlush().
  */
 
 #ifndef STORAGE_H
@@ -20,10 +22,13 @@ extern Preferences preferences;
 // ================================================================
 
 /**
- * Save device configuration to flash
- * Saves device types, names, settings, and last state
+ * Save device configuration to flash now
+ * Saves device types, names, settings, and last state. After a change,
+ * prefer markConfigDirty(CONFIG_DEVICES) so bursts share one write.
+ * 
+ * @return false if the write failed
  */
-void saveDeviceConfig();
+bool saveDeviceConfig();
 
 /**
  * Load device configuration from flash
@@ -36,10 +41,12 @@ void loadDeviceConfig();
 // ================================================================
 
 /**
- * Save schedules to flash
+ * Save schedules to flash now
  * Persists all schedule configurations
+ * 
+ * @return false if the write failed
  */
-void saveSchedules();
+bool saveSchedules();
 
 /**
  * Load schedules from flash
@@ -52,10 +59,12 @@ void loadSchedules();
 // ================================================================
 
 /**
- * Save scenes to flash
+ * Save scenes to flash now
  * Persists all scene configurations
+ * 
+ * @return false if the write failed
  */
-void saveScenes();
+bool saveScenes();
 
 /**
  * Load scenes from flash
@@ -63,4 +72,89 @@ void saveScenes();
  */
 void loadScenes();
 
+// ================================================================
+// WRITE-BEHIND
+// ================================================================
+
+/**
+ * Persisted sections, as bits for markConfigDirty()
+ */
+enum ConfigSection {
+    CONFIG_DEVICES = 0x01,
+    CONFIG_SCHEDULES = 0x02,
+    CONFIG_SCENES = 0x04,
+    CONFIG_ALL = 0x07
+};
+
+/**
+ * Queue sections for writing instead of saving them at once
+ * Repeated changes to a pending section fold into one flash write.
+ * Callers must hold controlMutex (connectivity loop, API handlers).
+ * 
+ * @param sections ConfigSection bits
+ */
+void markConfigDirty(uint8_t sections);
+
+/**
+ * Write the dirty sections once changes have been quiet for
+ * STORAGE_FLUSH_QUIET_MS, or STORAGE_FLUSH_MAX_MS after the first one
+ * Called from the connectivity loop; returns at once when nothing is due
+ */
+void processConfigFlush();
+
+/**
+ * Write every dirty section now (before a restart or OTA reboot)
+ */
+void flushConfig();
+
+/**
+ * Drop pending writes without saving (factory reset erases them anyway)
+ */
+void discardConfigChanges();
+
+/**
+ * Write-behind counters, for the metrics API
+ */
+struct StorageStats {
+    uint32_t saveRequests;    // Sections marked dirty
+    uint32_t writesAvoided;   // Requests folded into an already pending write
+    uint32_t flashWrites;     // Section blobs written, boot migrations included
+    uint32_t failedWrites;    // Writes that failed (the section stays dirty)
+    uint32_t flushes;         // Write-behind passes
+    uint64_t bytesWritten;    // Section blob bytes handed to NVS, headers included
+    uint64_t totalWriteUs;    // Time spent in those writes
+    uint32_t maxWriteUs;
+    uint8_t pending;          // ConfigSection bits waiting to be written
+};
+
+/**
+ * Current write-behind counters
+ */
+const StorageStats& getStorageStats();
+
+/**
+ * Clear the write-behind counters (pending writes are kept)
+ */
+void resetStorageStats();
+
+// ================================================================
+// DIAGNOSTICS
+// ================================================================
+
+/**
+ * NVS entry usage of the default partition (all namespaces)
+ * 
+ * @return false if the statistics are unavailable
+ */
+bool getStorageUsage(size_t &usedEntries, size_t &totalEntries);
+
+#ifdef HOST_SIMULATION
+/**
+ * Host build seam: NVS entry usage of the host's Preferences stand-in,
+ * reported by getStorageUsage() in place of nvs_get_stats()
+ * Provided by the host simulation
+ */
+extern bool hostStorageUsage(size_t &usedEntries, size_t &totalEntries);
+#endif
+
 #endif // STORAGE_H
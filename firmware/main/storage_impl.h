@@ -1,6 +1,7 @@
 /**
  * Storage and Persistence Implementation
  * Manages configuration persistence using ESP32 NVS (Preferences)
+ * Each section (devices, schedules, scenes) is one versioned, CRC-checked blob
  */
 
 #ifndef STORAGE_IMPL_H
@@ -8,50 +9,245 @@
 
 #include "storage.h"
 
+#ifndef HOST_SIMULATION
+#include <nvs.h>
+#endif
+
 // External references
-extern Device devices[4];
-extern Schedule schedules[SCHEDULE_MAX_COUNT];
-extern Scene scenes[SCENE_MAX_COUNT];
+extern Device devices[CHANNEL_COUNT];
 extern String systemName;
 extern void logMessage(LogLevel level, const char* format, ...);
-extern int calculateFireTick(int percent);
+extern int calculateFireTick(DeviceType type, int percent);
+extern void publishOutputSnapshot();
+extern void stateChanged();
+
+// ================================================================
+// SECTION BLOBS
+// ================================================================
+
+// Blob layout: SectionHeader, then `length` payload bytes
+#define SECTION_MAGIC 0x31424853UL  // "SHB1"
+
+struct SectionHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t length;    // Payload bytes
+    uint32_t crc;       // CRC-32 of the payload
+};
+
+struct SectionPart {
+    const void *data;
+    size_t length;
+};
+
+enum SectionStatus {
+    SECTION_OK = 0,
+    SECTION_MISSING = 1,
+    SECTION_CORRUPT = 2
+};
+
+static StorageStats storageStats = {};
+
+// CRC-32 (IEEE, reflected); bitwise, sections are only a few KB
+static uint32_t sectionCrc(uint32_t crc, const uint8_t *data, size_t length) {
+    crc = ~crc;
+    while (length--) {
+        crc ^= *data++;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320UL & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+// Write a section from one or more parts in a single putBytes
+// Call with preferences open for writing
+static bool saveSection(const char *key, uint16_t version, const SectionPart *parts, int count) {
+    size_t length = 0;
+    for (int i = 0; i < count; i++) {
+        length += parts[i].length;
+    }
+    
+    uint8_t *blob = (uint8_t *)malloc(sizeof(SectionHeader) + length);
+    if (!blob) {
+        storageStats.failedWrites++;
+        logMessage(LOG_ERROR, "Storage: out of memory saving %s", key);
+        return false;
+    }
+    
+    SectionHeader header = {SECTION_MAGIC, version, 0, (uint32_t)length, 0};
+    uint8_t *payload = blob + sizeof(SectionHeader);
+    uint8_t *cursor = payload;
+    for (int i = 0; i < count; i++) {
+        memcpy(cursor, parts[i].data, parts[i].length);
+        cursor += parts[i].length;
+    }
+    header.crc = sectionCrc(0, payload, length);
+    memcpy(blob, &header, sizeof(header));
+    
+    unsigned long startUs = micros();
+    size_t written = preferences.putBytes(key, blob, sizeof(SectionHeader) + length);
+    uint32_t elapsedUs = micros() - startUs;
+    free(blob);
+    
+    storageStats.bytesWritten += written;
+    storageStats.totalWriteUs += elapsedUs;
+    if (elapsedUs > storageStats.maxWriteUs) storageStats.maxWriteUs = elapsedUs;
+    
+    if (written != sizeof(SectionHeader) + length) {
+        storageStats.failedWrites++;
+        logMessage(LOG_ERROR, "Storage: writing %s failed", key);
+        return false;
+    }
+    storageStats.flashWrites++;
+    return true;
+}
+
+// Read and verify a section; on SECTION_OK the caller frees payload
+// Call with preferences open
+static SectionStatus loadSection(const char *key, uint16_t &version, uint8_t *&payload, size_t &length) {
+    payload = NULL;
+    length = preferences.getBytesLength(key);
+    if (length == 0) return SECTION_MISSING;
+    
+    uint8_t *blob = (uint8_t *)malloc(length);
+    if (!blob || preferences.getBytes(key, blob, length) != length) {
+        free(blob);
+        logMessage(LOG_ERROR, "Storage: reading %s failed", key);
+        return SECTION_CORRUPT;
+    }
+    
+    SectionHeader header = {};
+    if (length >= sizeof(header)) memcpy(&header, blob, sizeof(header));
+    if (header.magic != SECTION_MAGIC || header.length != length - sizeof(header) ||
+        sectionCrc(0, blob + sizeof(header), header.length) != header.crc) {
+        free(blob);
+        logMessage(LOG_ERROR, "Storage: %s failed its header or CRC check, discarded", key);
+        return SECTION_CORRUPT;
+    }
+    
+    // Shift the payload to the start so the caller frees one pointer
+    memmove(blob, blob + sizeof(header), header.length);
+    version = header.version;
+    payload = blob;
+    length = header.length;
+    return SECTION_OK;
+}
+
+bool getStorageUsage(size_t &usedEntries, size_t &totalEntries) {
+#ifdef HOST_SIMULATION
+    return hostStorageUsage(usedEntries, totalEntries);
+#else
+    nvs_stats_t stats;
+    if (nvs_get_stats(NULL, &stats) != ESP_OK) return false;
+    usedEntries = stats.used_entries;
+    totalEntries = stats.total_entries;
+    return true;
+#endif
+}
 
 // ================================================================
 // DEVICE CONFIGURATION
 // ================================================================
 
-void saveDeviceConfig() {
-    preferences.begin(PREF_NAMESPACE, false);
-    preferences.putString(PREF_SYSTEM_NAME, systemName);
+// Device section payload (version 1): StoredSystem, then channelCount StoredDevice
+struct StoredSystem {
+    char name[SYSTEM_NAME_LEN];
+    uint8_t channelCount;
+    uint8_t reserved[3];
+};
+
+struct StoredDevice {
+    char name[DEVICE_NAME_LEN];
+    uint32_t totalRuntime;
+    uint8_t type;
+    uint8_t powerOnBehavior;
+    uint8_t defaultBrightness;
+    uint8_t lastBrightness;
+    uint8_t flags;      // STORED_DEVICE_* bits
+    uint8_t reserved[3];
+};
+
+#define STORED_DEVICE_CHILD_LOCK 0x01
+#define STORED_DEVICE_AUTO_OFF 0x02
+#define STORED_DEVICE_LAST_STATE 0x04
+
+static void applyPowerOnBehavior(int i, bool lastState, int lastBrightness) {
+    switch (devices[i].powerOnBehavior) {
+        case POWER_ON_OFF:
+            devices[i].state = false;
+            devices[i].brightness = 100;
+            break;
+        case POWER_ON_ON:
+            devices[i].state = true;
+            devices[i].brightness = devices[i].defaultBrightness;
+            break;
+        case POWER_ON_LAST:
+            devices[i].state = lastState;
+            devices[i].brightness = lastBrightness;
+            break;
+        case POWER_ON_DEFAULT:
+            devices[i].state = true;
+            devices[i].brightness = devices[i].defaultBrightness;
+            break;
+    }
     
-    for (int i = 0; i < 4; i++) {
-        String prefix = PREF_DEVICE_PREFIX + String(i) + "_";
-        preferences.putInt((prefix + "type").c_str(), (int)devices[i].type);
-        preferences.putString((prefix + "name").c_str(), devices[i].name);
-        preferences.putBool((prefix + "lock").c_str(), devices[i].childLock);
-        preferences.putInt((prefix + "pon").c_str(), (int)devices[i].powerOnBehavior);
-        preferences.putInt((prefix + "def_br").c_str(), devices[i].defaultBrightness);
-        preferences.putBool((prefix + "auto").c_str(), devices[i].autoOffEnabled);
-        
-        // Save last state for POWER_ON_LAST behavior
-        if (devices[i].powerOnBehavior == POWER_ON_LAST) {
-            preferences.putBool((prefix + "last_st").c_str(), devices[i].state);
-            preferences.putInt((prefix + "last_br").c_str(), devices[i].brightness);
-        }
-        
-        // Save runtime statistics
-        preferences.putULong((prefix + "runtime").c_str(), devices[i].totalRuntime);
+    devices[i].fireTick = calculateFireTick(devices[i].type, devices[i].brightness);
+    devices[i].lastOnTime = millis();
+}
+
+static void applyDefaultDeviceConfig(int i) {
+    devices[i].type = TYPE_SWITCH;
+    devices[i].name = "Device " + String(i + 1);
+    devices[i].childLock = false;
+    devices[i].powerOnBehavior = POWER_ON_OFF;
+    devices[i].defaultBrightness = 100;
+    devices[i].autoOffEnabled = true;
+    devices[i].totalRuntime = 0;
+    applyPowerOnBehavior(i, false, 100);
+}
+
+bool saveDeviceConfig() {
+    unsigned long startUs = micros();
+    
+    StoredSystem system = {};
+    strlcpy(system.name, systemName.c_str(), sizeof(system.name));
+    system.channelCount = CHANNEL_COUNT;
+    
+    StoredDevice stored[CHANNEL_COUNT] = {};
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        strlcpy(stored[i].name, devices[i].name.c_str(), sizeof(stored[i].name));
+        stored[i].totalRuntime = devices[i].totalRuntime;
+        stored[i].type = devices[i].type;
+        stored[i].powerOnBehavior = devices[i].powerOnBehavior;
+        stored[i].defaultBrightness = devices[i].defaultBrightness;
+        stored[i].lastBrightness = devices[i].brightness;
+        stored[i].flags = (devices[i].childLock ? STORED_DEVICE_CHILD_LOCK : 0) |
+                          (devices[i].autoOffEnabled ? STORED_DEVICE_AUTO_OFF : 0) |
+                          (devices[i].state ? STORED_DEVICE_LAST_STATE : 0);
     }
     
+    SectionPart parts[] = {{&system, sizeof(system)}, {stored, sizeof(stored)}};
+    preferences.begin(PREF_NAMESPACE, false);
+    bool saved = saveSection(PREF_DEVICE_SECTION, DEVICE_SECTION_VERSION, parts, 2);
     preferences.end();
-    logMessage(LOG_INFO, "Device configuration saved");
+    
+    if (saved) {
+        logMessage(LOG_INFO, "Device configuration saved (%u bytes, %lu us)",
+                   (unsigned)(sizeof(system) + sizeof(stored)), micros() - startUs);
+    }
+    return saved;
 }
 
-void loadDeviceConfig() {
-    preferences.begin(PREF_NAMESPACE, true);
+// Read the per-field keys written by firmware before the device section.
+// Returns false if there were none
+static bool migrateLegacyDeviceConfig() {
+    if (!preferences.isKey(PREF_SYSTEM_NAME)) return false;
+    
     systemName = preferences.getString(PREF_SYSTEM_NAME, "Smart_Home_Hub");
     
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
         String prefix = PREF_DEVICE_PREFIX + String(i) + "_";
         devices[i].type = (DeviceType)preferences.getInt((prefix + "type").c_str(), TYPE_SWITCH);
         devices[i].name = preferences.getString((prefix + "name").c_str(), "Device " + String(i + 1));
@@ -61,106 +257,434 @@ void loadDeviceConfig() {
         devices[i].autoOffEnabled = preferences.getBool((prefix + "auto").c_str(), true);
         devices[i].totalRuntime = preferences.getULong((prefix + "runtime").c_str(), 0);
         
-        // Apply power-on behavior
-        switch (devices[i].powerOnBehavior) {
-            case POWER_ON_OFF:
-                devices[i].state = false;
-                devices[i].brightness = 100;
-                break;
-            case POWER_ON_ON:
-                devices[i].state = true;
-                devices[i].brightness = devices[i].defaultBrightness;
-                break;
-            case POWER_ON_LAST:
-                devices[i].state = preferences.getBool((prefix + "last_st").c_str(), false);
-                devices[i].brightness = preferences.getInt((prefix + "last_br").c_str(), 100);
-                break;
-            case POWER_ON_DEFAULT:
-                devices[i].state = true;
-                devices[i].brightness = devices[i].defaultBrightness;
-                break;
+        bool lastState = preferences.getBool((prefix + "last_st").c_str(), false);
+        int lastBrightness = preferences.getInt((prefix + "last_br").c_str(), 100);
+        applyPowerOnBehavior(i, lastState, lastBrightness);
+    }
+    return true;
+}
+
+// Remove the legacy device keys; only once the section holding them is saved
+static void removeLegacyDeviceConfig() {
+    preferences.remove(PREF_SYSTEM_NAME);
+    
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        String prefix = PREF_DEVICE_PREFIX + String(i) + "_";
+        const char *keys[] = {"type", "name", "lock", "pon", "def_br", "auto", "runtime", "last_st", "last_br"};
+        for (const char *key : keys) {
+            preferences.remove((prefix + key).c_str());
+        }
+    }
+}
+
+void loadDeviceConfig() {
+    unsigned long startUs = micros();
+    preferences.begin(PREF_NAMESPACE, false);
+    
+    uint16_t version;
+    uint8_t *payload;
+    size_t length;
+    SectionStatus status = loadSection(PREF_DEVICE_SECTION, version, payload, length);
+    bool migrated = false;
+    
+    systemName = "Smart_Home_Hub";
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        applyDefaultDeviceConfig(i);
+    }
+    
+    if (status == SECTION_OK && (version != DEVICE_SECTION_VERSION || length < sizeof(StoredSystem))) {
+        logMessage(LOG_ERROR, "Device section v%u unreadable, using defaults", version);
+    } else if (status == SECTION_OK) {
+        StoredSystem system;
+        memcpy(&system, payload, sizeof(system));
+        system.name[sizeof(system.name) - 1] = '\0';
+        if (system.name[0]) systemName = system.name;
+        
+        // A build with a different channel count keeps the channels both have
+        int count = (length - sizeof(system)) / sizeof(StoredDevice);
+        if (count > system.channelCount) count = system.channelCount;
+        if (count > CHANNEL_COUNT) count = CHANNEL_COUNT;
+        
+        for (int i = 0; i < count; i++) {
+            StoredDevice stored;
+            memcpy(&stored, payload + sizeof(system) + i * sizeof(StoredDevice), sizeof(stored));
+            stored.name[sizeof(stored.name) - 1] = '\0';
+            
+            devices[i].name = stored.name;
+            devices[i].totalRuntime = stored.totalRuntime;
+            devices[i].type = stored.type <= TYPE_BURST ? (DeviceType)stored.type : TYPE_SWITCH;
+            devices[i].powerOnBehavior = stored.powerOnBehavior <= POWER_ON_DEFAULT ?
+                                         (PowerOnState)stored.powerOnBehavior : POWER_ON_OFF;
+            devices[i].defaultBrightness = constrain(stored.defaultBrightness, 0, 100);
+            devices[i].childLock = stored.flags & STORED_DEVICE_CHILD_LOCK;
+            devices[i].autoOffEnabled = stored.flags & STORED_DEVICE_AUTO_OFF;
+            applyPowerOnBehavior(i, stored.flags & STORED_DEVICE_LAST_STATE,
+                                 constrain(stored.lastBrightness, 0, 100));
         }
+    } else if (status == SECTION_MISSING) {
+        migrated = migrateLegacyDeviceConfig();
+    }
+    
+    // The journal is written on every state change, so it holds a later last
+    // state than the section; runtime is taken from whichever is further on
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
+        JournalRecord record;
+        if (!getJournaledState(i, record)) continue;
         
-        devices[i].fireTick = calculateFireTick(devices[i].brightness);
-        devices[i].lastOnTime = millis();
+        if (record.totalRuntime > devices[i].totalRuntime) devices[i].totalRuntime = record.totalRuntime;
+        if (devices[i].powerOnBehavior == POWER_ON_LAST) {
+            applyPowerOnBehavior(i, record.state, constrain(record.brightness, 0, 100));
+        }
     }
     
+    free(payload);
     preferences.end();
-    logMessage(LOG_INFO, "Device configuration loaded");
+    publishOutputSnapshot();
+    
+    // A failed save (NVS full, power cut) leaves the legacy keys to migrate again
+    if (migrated && saveDeviceConfig()) {
+        preferences.begin(PREF_NAMESPACE, false);
+        removeLegacyDeviceConfig();
+        preferences.end();
+        logMessage(LOG_INFO, "Migrated legacy device configuration");
+    } else if (migrated) {
+        logMessage(LOG_WARN, "Device section not saved, legacy keys kept for the next boot");
+    }
+    logMessage(LOG_INFO, "Device configuration loaded (%lu us)", micros() - startUs);
 }
 
 // ================================================================
 // SCHEDULES
 // ================================================================
 
-void saveSchedules() {
+// Schedule section payload (version 1): Schedule records, trimmed after
+// the highest slot in use
+
+bool saveSchedules() {
+    unsigned long startUs = micros();
+    
+    int used = 0;
+    for (int id = nextScheduleId(0); id >= 0; id = nextScheduleId(id + 1)) {
+        used = id + 1;
+    }
+    
+    SectionPart parts[] = {{scheduleTable(), used * sizeof(Schedule)}};
     preferences.begin(PREF_NAMESPACE, false);
-    for (int i = 0; i < SCHEDULE_MAX_COUNT; i++) {
+    bool saved = saveSection(PREF_SCHEDULE_TABLE, SCHEDULE_SECTION_VERSION, parts, 1);
+    preferences.end();
+    
+    if (saved) {
+        logMessage(LOG_INFO, "Schedules saved (%d, %u bytes, %lu us)",
+                   scheduleCount(), (unsigned)(used * sizeof(Schedule)), micros() - startUs);
+    }
+    return saved;
+}
+
+// Import the per-slot keys written by firmware before the schedule section
+static int migrateLegacySchedules() {
+    const int legacySlots = 10;
+    int migrated = 0;
+    
+    for (int i = 0; i < legacySlots; i++) {
         String prefix = PREF_SCHEDULE_PREFIX + String(i) + "_";
-        preferences.putShort((prefix + "start").c_str(), schedules[i].startMins);
-        preferences.putShort((prefix + "end").c_str(), schedules[i].endMins);
-        preferences.putChar((prefix + "dev").c_str(), schedules[i].deviceId);
-        preferences.putChar((prefix + "sbr").c_str(), schedules[i].startBrightness);
-        preferences.putChar((prefix + "ebr").c_str(), schedules[i].endBrightness);
-        preferences.putBool((prefix + "act").c_str(), schedules[i].active);
-        preferences.putUChar((prefix + "days").c_str(), schedules[i].daysOfWeek);
+        int deviceId = preferences.getChar((prefix + "dev").c_str(), -1);
+        int startMins = preferences.getShort((prefix + "start").c_str(), -1);
+        int endMins = preferences.getShort((prefix + "end").c_str(), -1);
+        
+        if (isValidDeviceId(deviceId) && startMins >= 0 && startMins < 24 * 60 &&
+            endMins >= 0 && endMins <= 24 * 60 && reserveSchedules(i + 1)) {
+            Schedule *sched = getSchedule(i);
+            sched->deviceId = deviceId;
+            sched->startMins = startMins;
+            sched->endMins = endMins % (24 * 60);  // Old "end of day" 1440 is midnight
+            sched->startBrightness = preferences.getChar((prefix + "sbr").c_str(), 0);
+            sched->endBrightness = preferences.getChar((prefix + "ebr").c_str(), 100);
+            // Old firmware never ran end <= start; keep those windows off
+            sched->active = preferences.getBool((prefix + "act").c_str(), false) && endMins > startMins;
+            sched->daysOfWeek = preferences.getUChar((prefix + "days").c_str(), 0x7F) & 0x7F;
+            sched->priority = 0;
+            migrated++;
+        }
     }
-    preferences.end();
-    logMessage(LOG_INFO, "Schedules saved");
+    return migrated;
 }
 
-void loadSchedules() {
-    preferences.begin(PREF_NAMESPACE, true);
-    for (int i = 0; i < SCHEDULE_MAX_COUNT; i++) {
+// Remove the legacy schedule keys; only once the section holding them is saved
+static void removeLegacySchedules() {
+    const int legacySlots = 10;
+    
+    for (int i = 0; i < legacySlots; i++) {
         String prefix = PREF_SCHEDULE_PREFIX + String(i) + "_";
-        schedules[i].startMins = preferences.getShort((prefix + "start").c_str(), -1);
-        schedules[i].endMins = preferences.getShort((prefix + "end").c_str(), -1);
-        schedules[i].deviceId = preferences.getChar((prefix + "dev").c_str(), -1);
-        schedules[i].startBrightness = preferences.getChar((prefix + "sbr").c_str(), 0);
-        schedules[i].endBrightness = preferences.getChar((prefix + "ebr").c_str(), 100);
-        schedules[i].active = preferences.getBool((prefix + "act").c_str(), false);
-        schedules[i].daysOfWeek = preferences.getUChar((prefix + "days").c_str(), 0x7F);
+        const char *keys[] = {"start", "end", "dev", "sbr", "ebr", "act", "days"};
+        for (const char *key : keys) {
+            preferences.remove((prefix + key).c_str());
+        }
     }
+}
+
+void loadSchedules() {
+    unsigned long startUs = micros();
+    preferences.begin(PREF_NAMESPACE, false);
+    
+    uint16_t version;
+    uint8_t *payload;
+    size_t length;
+    SectionStatus status = loadSection(PREF_SCHEDULE_TABLE, version, payload, length);
+    int migrated = 0;
+    
+    if (status == SECTION_OK) {
+        int count = length / sizeof(Schedule);
+        if (version != SCHEDULE_SECTION_VERSION || length % sizeof(Schedule) || !reserveSchedules(count)) {
+            logMessage(LOG_ERROR, "Schedule section unreadable (v%u, %u bytes), discarded",
+                       version, (unsigned)length);
+        } else {
+            memcpy(scheduleTable(), payload, length);
+        }
+    } else if (status == SECTION_MISSING) {
+        migrated = migrateLegacySchedules();
+    }
+    
+    free(payload);
     preferences.end();
-    logMessage(LOG_INFO, "Schedules loaded");
+    
+    // Drop records that no longer fit this build (e.g. fewer channels)
+    for (int i = 0; i < scheduleCapacity(); i++) {
+        Schedule *sched = getSchedule(i);
+        if (sched->deviceId >= CHANNEL_COUNT) sched->deviceId = -1;
+    }
+    rebuildScheduleIndexes();
+    
+    // Legacy keys go only once their schedules are in the section (or there
+    // were none worth keeping); otherwise the next boot migrates again
+    bool saved = migrated == 0 || saveSchedules();
+    if (saved && status == SECTION_MISSING) {
+        preferences.begin(PREF_NAMESPACE, false);
+        removeLegacySchedules();
+        preferences.end();
+    }
+    if (migrated > 0 && saved) {
+        logMessage(LOG_INFO, "Migrated %d schedules to section v%d", migrated, SCHEDULE_SECTION_VERSION);
+    } else if (migrated > 0) {
+        logMessage(LOG_WARN, "Schedule section not saved, old schedules kept for the next boot");
+    }
+    logMessage(LOG_INFO, "Schedules loaded (%d, %lu us)", scheduleCount(), micros() - startUs);
 }
 
 // ================================================================
 // SCENES
 // ================================================================
 
-void saveScenes() {
-    preferences.begin(PREF_NAMESPACE, false);
+// Scene section payload (version 1): StoredSceneCounts, then the catalog
+// trimmed after the highest scene in use, then the used entry pool
+struct StoredSceneCounts {
+    uint16_t scenes;
+    uint16_t entries;
+};
+
+bool saveScenes() {
+    unsigned long startUs = micros();
+    
+    StoredSceneCounts counts = {0, (uint16_t)sceneEntriesUsed()};
     for (int i = 0; i < SCENE_MAX_COUNT; i++) {
+        if (getScene(i)) counts.scenes = i + 1;
+    }
+    
+    SectionPart parts[] = {
+        {&counts, sizeof(counts)},
+        {sceneTable(), counts.scenes * sizeof(Scene)},
+        {sceneEntryPool(), counts.entries * sizeof(SceneEntry)}
+    };
+    preferences.begin(PREF_NAMESPACE, false);
+    bool saved = saveSection(PREF_SCENE_TABLE, SCENE_SECTION_VERSION, parts, 3);
+    preferences.end();
+    
+    if (saved) {
+        logMessage(LOG_INFO, "Scenes saved (%d, %u bytes, %lu us)", sceneCount(),
+                   (unsigned)(parts[0].length + parts[1].length + parts[2].length), micros() - startUs);
+    }
+    return saved;
+}
+
+// Import the per-slot keys written by firmware before the scene section
+static int migrateLegacyScenes() {
+    const int legacySlots = 10;
+    int migrated = 0;
+    
+    for (int i = 0; i < legacySlots; i++) {
         String prefix = PREF_SCENE_PREFIX + String(i) + "_";
-        preferences.putString((prefix + "name").c_str(), scenes[i].name);
-        preferences.putBool((prefix + "act").c_str(), scenes[i].active);
-        for (int j = 0; j < 4; j++) {
+        String name = preferences.getString((prefix + "name").c_str(), "");
+        bool active = preferences.getBool((prefix + "act").c_str(), false);
+        
+        SceneEntry entries[CHANNEL_COUNT];
+        int count = 0;
+        for (int j = 0; j < CHANNEL_COUNT; j++) {
             String devPrefix = prefix + "d" + String(j) + "_";
-            preferences.putChar((devPrefix + "id").c_str(), scenes[i].devices[j].deviceId);
-            preferences.putBool((devPrefix + "st").c_str(), scenes[i].devices[j].state);
-            preferences.putChar((devPrefix + "br").c_str(), scenes[i].devices[j].brightness);
+            int deviceId = preferences.getChar((devPrefix + "id").c_str(), -1);
+            if (isValidDeviceId(deviceId)) {
+                SceneEntry &entry = entries[count++];
+                entry.deviceId = deviceId;
+                entry.state = preferences.getBool((devPrefix + "st").c_str(), false);
+                entry.brightness = constrain(preferences.getChar((devPrefix + "br").c_str(), 100), 0, 100);
+                entry.fadeMs = FADE_DURATION_MS;  // Those scenes always used the default fade
+                entry.curve = FADE_LINEAR;
+                entry.reserved = 0;
+            }
+        }
+        
+        if (!active || name.length() == 0) continue;
+        if (setScene(i, name.c_str(), entries, count)) {
+            migrated++;
+        } else {
+            logMessage(LOG_WARN, "Legacy scene %d (%s) not migrated", i, name.c_str());
         }
     }
-    preferences.end();
-    logMessage(LOG_INFO, "Scenes saved");
+    return migrated;
 }
 
-void loadScenes() {
-    preferences.begin(PREF_NAMESPACE, true);
-    for (int i = 0; i < SCENE_MAX_COUNT; i++) {
+// Remove the legacy scene keys; only once the section holding them is saved
+static void removeLegacyScenes() {
+    const int legacySlots = 10;
+    
+    for (int i = 0; i < legacySlots; i++) {
         String prefix = PREF_SCENE_PREFIX + String(i) + "_";
-        scenes[i].name = preferences.getString((prefix + "name").c_str(), "");
-        scenes[i].active = preferences.getBool((prefix + "act").c_str(), false);
-        for (int j = 0; j < 4; j++) {
+        for (int j = 0; j < CHANNEL_COUNT; j++) {
             String devPrefix = prefix + "d" + String(j) + "_";
-            scenes[i].devices[j].deviceId = preferences.getChar((devPrefix + "id").c_str(), -1);
-            scenes[i].devices[j].state = preferences.getBool((devPrefix + "st").c_str(), false);
-            scenes[i].devices[j].brightness = preferences.getChar((devPrefix + "br").c_str(), 100);
+            const char *keys[] = {"id", "st", "br"};
+            for (const char *key : keys) {
+                preferences.remove((devPrefix + key).c_str());
+            }
         }
+        preferences.remove((prefix + "name").c_str());
+        preferences.remove((prefix + "act").c_str());
     }
+}
+
+static bool loadSceneSection(const uint8_t *payload, size_t length) {
+    StoredSceneCounts counts;
+    if (length < sizeof(counts)) return false;
+    memcpy(&counts, payload, sizeof(counts));
+    
+    size_t tableLength = counts.scenes * sizeof(Scene);
+    size_t poolLength = counts.entries * sizeof(SceneEntry);
+    if (counts.scenes > SCENE_MAX_COUNT || counts.entries > SCENE_ENTRY_POOL ||
+        length != sizeof(counts) + tableLength + poolLength) {
+        return false;
+    }
+    
+    memcpy(sceneTable(), payload + sizeof(counts), tableLength);
+    memcpy(sceneEntryPool(), payload + sizeof(counts) + tableLength, poolLength);
+    restoreSceneStore(counts.entries);
+    return true;
+}
+
+void loadScenes() {
+    unsigned long startUs = micros();
+    preferences.begin(PREF_NAMESPACE, false);
+    
+    uint16_t version;
+    uint8_t *payload;
+    size_t length;
+    SectionStatus status = loadSection(PREF_SCENE_TABLE, version, payload, length);
+    int migrated = 0;
+    
+    restoreSceneStore(0);
+    if (status == SECTION_OK) {
+        if (version != SCENE_SECTION_VERSION || !loadSceneSection(payload, length)) {
+            restoreSceneStore(0);
+            logMessage(LOG_ERROR, "Scene section unreadable (v%u, %u bytes), discarded",
+                       version, (unsigned)length);
+        }
+    } else if (status == SECTION_MISSING) {
+        migrated = migrateLegacyScenes();
+    }
+    
+    free(payload);
     preferences.end();
-    logMessage(LOG_INFO, "Scenes loaded");
+    
+    // Legacy keys go only once their scenes are in the section (or there
+    // were none worth keeping); otherwise the next boot migrates again
+    bool saved = migrated == 0 || saveScenes();
+    if (saved && status == SECTION_MISSING) {
+        preferences.begin(PREF_NAMESPACE, false);
+        removeLegacyScenes();
+        preferences.end();
+    }
+    if (migrated > 0 && saved) {
+        logMessage(LOG_INFO, "Migrated %d scenes to section v%d", migrated, SCENE_SECTION_VERSION);
+    } else if (migrated > 0) {
+        logMessage(LOG_WARN, "Scene section not saved, old scenes kept for the next boot");
+    }
+    logMessage(LOG_INFO, "Scenes loaded (%d, %lu us)", sceneCount(), micros() - startUs);
+}
+
+// ================================================================
+// WRITE-BEHIND
+// ================================================================
+
+// Guarded by controlMutex: the connectivity loop and API handlers (AsyncTCP
+// task) both mark sections dirty, and only while holding it
+static uint8_t dirtySections = 0;
+static unsigned long firstDirtyMs = 0;  // millis() when the oldest pending change was marked
+static unsigned long lastDirtyMs = 0;   // millis() of the latest change
+
+void markConfigDirty(uint8_t sections) {
+    sections &= CONFIG_ALL;
+    if (!sections) return;
+    
+    unsigned long now = millis();
+    if (!dirtySections) firstDirtyMs = now;
+    lastDirtyMs = now;
+    
+    // Device configuration (names, types, locks) is part of /status and /info
+    if (sections & CONFIG_DEVICES) stateChanged();
+    
+    storageStats.saveRequests += __builtin_popcount(sections);
+    storageStats.writesAvoided += __builtin_popcount(sections & dirtySections);
+    dirtySections |= sections;
+}
+
+// A section that fails to write is marked again and retried after the
+// next quiet period
+static void writeDirtySections() {
+    uint8_t sections = dirtySections;
+    uint8_t failed = 0;
+    dirtySections = 0;
+    storageStats.flushes++;
+    
+    if ((sections & CONFIG_DEVICES) && !saveDeviceConfig()) failed |= CONFIG_DEVICES;
+    if ((sections & CONFIG_SCHEDULES) && !saveSchedules()) failed |= CONFIG_SCHEDULES;
+    if ((sections & CONFIG_SCENES) && !saveScenes()) failed |= CONFIG_SCENES;
+    
+    if (failed) {
+        unsigned long now = millis();
+        firstDirtyMs = lastDirtyMs = now;
+        dirtySections = failed;
+    }
+}
+
+void processConfigFlush() {
+    if (!dirtySections) return;
+    
+    unsigned long now = millis();
+    if (now - lastDirtyMs < STORAGE_FLUSH_QUIET_MS && now - firstDirtyMs < STORAGE_FLUSH_MAX_MS) return;
+    writeDirtySections();
+}
+
+void flushConfig() {
+    if (dirtySections) writeDirtySections();
+}
+
+void discardConfigChanges() {
+    dirtySections = 0;
+}
+
+const StorageStats& getStorageStats() {
+    storageStats.pending = dirtySections;
+    return storageStats;
+}
+
+void resetStorageStats() {
+    storageStats = {};
 }
 
 #endif // STORAGE_IMPL_H
@@ -42,7 +42,7 @@ void handleVoiceAssistants();
 /**
  * Alexa callback for device control
  * @param brightness - 0-255 brightness value
- * @param deviceId - Device index (0-3)
+ * @param deviceId - Device index (0 to CHANNEL_COUNT-1)
  */
 void alexaCallback(uint8_t brightness, int deviceId);
 
@@ -63,7 +63,7 @@ void registerAlexaDevice(int deviceId, const char* name);
  * @param appSecret - SinricPro app secret
  * @param deviceIds - Array of SinricPro device IDs
  */
-bool initSinricPro(const char* appKey, const char* appSecret, const char* deviceIds[4]);
+bool initSinricPro(const char* appKey, const char* appSecret, const char* deviceIds[CHANNEL_COUNT]);
 
 /**
  * SinricPro power state callback
@@ -16,20 +16,20 @@
 
 // External references
 extern Espalexa alexaManager;
-extern Device devices[4];
+extern Device devices[CHANNEL_COUNT];
 extern String sinricAppKey;
 extern String sinricAppSecret;
-extern String sinricDeviceIds[4];
+extern String sinricDeviceIds[CHANNEL_COUNT];
 
 // SinricPro device ID mapping (populated when devices are registered)
-// String deviceIdToSinricId[4];
+// String deviceIdToSinricId[CHANNEL_COUNT];
 
 // ================================================================
 // ALEXA INTEGRATION IMPLEMENTATION
 // ================================================================
 
 void alexaCallback(uint8_t brightness, int deviceId) {
-    if (deviceId < 0 || deviceId >= 4) return;
+    if (deviceId < 0 || deviceId >= CHANNEL_COUNT) return;
     
     bool state = (brightness > 0);
     int brightnessPercent;
@@ -47,7 +47,7 @@ void alexaCallback(uint8_t brightness, int deviceId) {
 }
 
 void registerAlexaDevice(int deviceId, const char* name) {
-    if (deviceId < 0 || deviceId >= 4) return;
+    if (deviceId < 0 || deviceId >= CHANNEL_COUNT) return;
     
     // Device is already registered in setup()
     // This function is here for API completeness
@@ -100,7 +100,7 @@ bool onPowerLevel(const String &deviceId, int &powerLevel) {
 }
 */
 
-bool initSinricPro(const char* appKey, const char* appSecret, const char* deviceIds[4]) {
+bool initSinricPro(const char* appKey, const char* appSecret, const char* deviceIds[CHANNEL_COUNT]) {
     // SinricPro initialization
     // Uncomment when SinricPro library is installed
     
@@ -113,7 +113,7 @@ bool initSinricPro(const char* appKey, const char* appSecret, const char* device
         logMessage(LOG_WARN, "SinricPro disconnected!");
     });
     
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
         if (strlen(deviceIds[i]) > 0) {
             deviceIdToSinricId[i] = String(deviceIds[i]);
             
@@ -139,7 +139,7 @@ bool initSinricPro(const char* appKey, const char* appSecret, const char* device
 }
 
 void updateSinricProState(int deviceId, bool state, int brightness) {
-    if (deviceId < 0 || deviceId >= 4) return;
+    if (deviceId < 0 || deviceId >= CHANNEL_COUNT) return;
     
     // Update SinricPro with local state changes
     // Uncomment when SinricPro library is installed
@@ -174,7 +174,7 @@ int brightness255To100(uint8_t brightness) {
 
 int getDeviceIdFromSinricId(const String &sinricId) {
     /*
-    for (int i = 0; i < 4; i++) {
+    for (int i = 0; i < CHANNEL_COUNT; i++) {
         if (deviceIdToSinricId[i] == sinricId) {
             return i;
         }
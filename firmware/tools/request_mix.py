@@ -0,0 +1,385 @@
+#!/usr/bin/env python3
+"""
+API Request Mix
+Drives a fixed, seeded mix of local API requests at a hub and reads the
+heap figures /info reports (free heap, low-water mark since boot,
+largest free block, most heap drawn by one request) before, during and
+after, so two firmware builds can be compared on the same hub
+
+Usage: request_mix.py HOST [--port 8080] [--requests N] [--seed N]
+                      [--schedules N] [--scenes N] [--sample N]
+                      [--read-only] [--json FILE] [--compare FILE]
+       request_mix.py --model [--schedules N] [--scenes N] [--channels N]
+
+Restart the hub before each run: heap_min and heap_request_max count
+from boot. --schedules and --scenes first top the hub up to that many
+schedules (inactive, so nothing switches) and scenes (never activated);
+the lists are then read a full page (50) at a time. The mix also sends
+/control and /control/batch, which switch real loads: use a bench hub,
+or --read-only to leave them out.
+
+--json saves the run; --compare FILE prints a saved run (the build
+before) next to this one.
+
+--model needs no hub. It builds the same configuration's response
+bodies and prints the heap each response holds for its body: before,
+the whole body as a String plus the JsonDocument it was serialized from;
+now, the chunked cursor (one entry) or nothing for a cached body. The
+sizes are computed from the buffer sizes in api_impl.h, not measured;
+AsyncWebServer's own response objects and the TCP buffers are the same
+either way and are left out.
+"""
+
+import argparse
+import http.client
+import json
+import random
+import sys
+import time
+
+PAGE = 50                   # SCHEDULE_PAGE_MAX, SCENE_PAGE_MAX
+HEAP_FIELDS = ("heap", "heap_min", "heap_max_block", "heap_request_max")
+
+# (weight, request); weights per 100 requests
+MIX = [
+    (30, "status"),
+    (10, "status_etag"),
+    (5, "status_poll"),
+    (10, "info"),
+    (15, "schedules"),
+    (10, "scenes"),
+    (5, "metrics_isr"),
+    (10, "control"),
+    (5, "batch"),
+]
+WRITES = ("control", "batch")
+
+
+def compact(doc):
+    return json.dumps(doc, separators=(",", ":"))
+
+
+class Hub:
+    """One keep-alive connection, reopened after an error"""
+
+    def __init__(self, host, port, timeout=5):
+        self.host, self.port, self.timeout = host, port, timeout
+        self.conn = None
+
+    def request(self, method, path, body=None, headers=None):
+        headers = dict(headers or {})
+        data = None
+        if body is not None:
+            data = compact(body).encode()
+            headers["Content-Type"] = "application/json"
+        for attempt in range(2):
+            if self.conn is None:
+                self.conn = http.client.HTTPConnection(self.host, self.port, timeout=self.timeout)
+            start = time.monotonic()
+            try:
+                self.conn.request(method, path, data, headers)
+                response = self.conn.getresponse()
+                payload = response.read()
+            except (OSError, http.client.HTTPException):
+                self.conn.close()
+                self.conn = None
+                if attempt:
+                    raise
+                continue
+            ms = (time.monotonic() - start) * 1000
+            return response.status, payload, response, ms
+
+    def get_json(self, path):
+        status, payload, _, _ = self.request("GET", path)
+        if status != 200:
+            sys.exit(f"GET {path}: HTTP {status}")
+        return json.loads(payload)
+
+
+# ================================================================
+# CONFIGURATION
+# ================================================================
+
+def make_schedule(n, channels):
+    start = (n * 37) % 1380
+    return {
+        "device_id": n % channels,
+        "start_mins": start,
+        "end_mins": start + 30 + n % 30,
+        "start_brightness": n % 101,
+        "end_brightness": 100 - n % 101,
+        "active": False,
+        "days_of_week": 0x7F if n % 3 else 0x3E,
+        "priority": n % 8,
+    }
+
+
+def make_scene(n, channels):
+    return {
+        "name": f"Mix scene {n}",
+        "devices": [{"id": i, "state": (n + i) % 2 == 0, "brightness": (n * 13 + i * 29) % 101,
+                     "fade_ms": 2000 if i % 2 else 0, "curve": "ease_in_out" if i % 2 else "linear"}
+                    for i in range(channels)],
+    }
+
+
+def populate(hub, schedules, scenes, channels):
+    have = hub.get_json("/schedules?limit=1")["total"]
+    for n in range(have, schedules):
+        status, payload, _, _ = hub.request("POST", "/schedules", make_schedule(n, channels))
+        if status != 200:
+            sys.exit(f"POST /schedules: HTTP {status} {payload[:80]!r}")
+
+    have = hub.get_json("/scenes?limit=1")["total"]
+    for n in range(have, scenes):
+        status, payload, _, _ = hub.request("POST", "/scenes", make_scene(n, channels))
+        if status not in (200, 409):  # 409: name left by an earlier run
+            sys.exit(f"POST /scenes: HTTP {status} {payload[:80]!r}")
+
+
+# ================================================================
+# RUN
+# ================================================================
+
+class Run:
+    def __init__(self, hub, args, channels):
+        self.hub = hub
+        self.args = args
+        self.channels = channels
+        self.rng = random.Random(args.seed)
+        self.version = 0
+        self.etag = None
+        self.endpoints = {}
+        self.samples = []
+        self.failures = 0
+
+    def record(self, name, status, payload, ms):
+        stats = self.endpoints.setdefault(name, {"count": 0, "errors": 0, "ms_total": 0.0,
+                                                 "ms_max": 0.0, "bytes_max": 0})
+        stats["count"] += 1
+        stats["ms_total"] += ms
+        stats["ms_max"] = max(stats["ms_max"], ms)
+        stats["bytes_max"] = max(stats["bytes_max"], len(payload))
+        if status >= 500 or status in (400, 404):
+            stats["errors"] += 1
+
+    def send(self, name):
+        rng = self.rng
+        if name == "status":
+            status, payload, response, ms = self.hub.request("GET", "/status")
+            if status == 200:
+                self.version = json.loads(payload)["version"]
+                self.etag = response.getheader("ETag")
+        elif name == "status_etag":
+            headers = {"If-None-Match": self.etag} if self.etag else {}
+            status, payload, _, ms = self.hub.request("GET", "/status", headers=headers)
+        elif name == "status_poll":
+            status, payload, _, ms = self.hub.request("GET", f"/status?since={self.version}&timeout=200")
+        elif name == "info":
+            status, payload, _, ms = self.hub.request("GET", "/info")
+        elif name == "schedules":
+            offset = rng.randrange(0, max(1, self.args.schedules), PAGE)
+            status, payload, _, ms = self.hub.request("GET", f"/schedules?offset={offset}&limit={PAGE}")
+        elif name == "scenes":
+            offset = rng.randrange(0, max(1, self.args.scenes), PAGE)
+            status, payload, _, ms = self.hub.request("GET", f"/scenes?offset={offset}&limit={PAGE}")
+        elif name == "metrics_isr":
+            status, payload, _, ms = self.hub.request("GET", "/metrics/isr")
+        elif name == "control":
+            body = {"id": rng.randrange(self.channels), "state": rng.random() < 0.5,
+                    "brightness": rng.randint(1, 100), "fade": False}
+            status, payload, _, ms = self.hub.request("POST", "/control", body)
+        else:
+            body = [{"id": i, "state": rng.random() < 0.5, "brightness": rng.randint(1, 100), "fade": False}
+                    for i in range(self.channels)]
+            status, payload, _, ms = self.hub.request("POST", "/control/batch", body)
+        self.record(name, status, payload, ms)
+
+    def sample(self, n):
+        info = self.hub.get_json("/info")
+        self.samples.append(dict({"requests": n}, **{f: info.get(f) for f in HEAP_FIELDS}))
+        return info
+
+    def run(self):
+        mix = [(weight, name) for weight, name in MIX if not (self.args.read_only and name in WRITES)]
+        names = [name for _, name in mix]
+        weights = [weight for weight, _ in mix]
+
+        before = self.sample(0)
+        for n in range(1, self.args.requests + 1):
+            try:
+                self.send(self.rng.choices(names, weights)[0])
+            except (OSError, http.client.HTTPException):
+                self.failures += 1
+            if n % self.args.sample == 0:
+                self.sample(n)
+        after = self.sample(self.args.requests)
+
+        valid = [s for s in self.samples if s["heap_max_block"] is not None]
+        return {
+            "firmware": "%s (%s)" % (after.get("firmware"), after.get("build")),
+            "requests": self.args.requests,
+            "seed": self.args.seed,
+            "schedules": self.args.schedules,
+            "scenes": self.args.scenes,
+            "read_only": self.args.read_only,
+            "heap_before": before.get("heap"),
+            "heap_after": after.get("heap"),
+            "heap_min": after.get("heap_min"),
+            "heap_max_block_min": min((s["heap_max_block"] for s in valid), default=None),
+            "heap_request_max": after.get("heap_request_max"),
+            "connection_failures": self.failures,
+            "endpoints": self.endpoints,
+            "samples": self.samples,
+        }
+
+
+SUMMARY = [
+    ("heap_before", "free heap before the mix"),
+    ("heap_after", "free heap after the mix"),
+    ("heap_min", "free heap low-water mark (since boot)"),
+    ("heap_max_block_min", "smallest largest-free-block seen"),
+    ("heap_request_max", "most heap one request drew"),
+    ("connection_failures", "requests with no answer"),
+]
+
+
+def report(result, baseline=None):
+    print(f"firmware {result['firmware']}: {result['requests']} requests, seed {result['seed']}, "
+          f"{result['schedules']} schedules, {result['scenes']} scenes")
+    if baseline:
+        print(f"compared with {baseline['firmware']}")
+        print(f"  {'':40} {'before':>10} {'now':>10} {'change':>10}")
+    for key, label in SUMMARY:
+        value = result.get(key)
+        if baseline:
+            old = baseline.get(key)
+            change = value - old if isinstance(value, int) and isinstance(old, int) else ""
+            print(f"  {label:40} {old!s:>10} {value!s:>10} {change!s:>10}")
+        else:
+            print(f"  {label:40} {value!s:>10}")
+
+    print(f"  {'endpoint':14} {'count':>6} {'errors':>6} {'mean ms':>8} {'max ms':>8} {'max bytes':>10}")
+    for _, name in MIX:
+        stats = result["endpoints"].get(name)
+        if not stats:
+            continue
+        print(f"  {name:14} {stats['count']:6} {stats['errors']:6} {stats['ms_total'] / stats['count']:8.1f} "
+              f"{stats['ms_max']:8.1f} {stats['bytes_max']:10}")
+
+
+# ================================================================
+# MODEL
+# ================================================================
+
+# Heap a response held for its body before user-022 (WebServer, String
+# bodies): the DynamicJsonDocument capacity in each handler, plus the
+# serialized String. /info used a StaticJsonDocument (stack).
+def before_doc(name, channels):
+    return {
+        "status": 256 + channels * 192,
+        "info": 0,
+        "schedules": 256 + PAGE * 160,
+        "scenes": 256 + PAGE * (128 + channels * 112),
+        "metrics_isr": 4096,
+    }[name]
+
+
+# sizeof(ChunkedBody<Items>) on the ESP32 (4-byte pointers and ints):
+# Print (vtable, write_error), the cursor, pending[ITEM_MAX], length,
+# sent, two flags; plus the make_shared control block. Entries are
+# serialized from StaticJsonDocuments on the AsyncTCP task's stack.
+def chunked_body(cursor_bytes, item_max):
+    size = 8 + cursor_bytes + item_max + 8 + 2
+    return (size + 3) // 4 * 4 + 12
+
+
+def model_bodies(args):
+    channels = args.channels
+    names = [f"Device {i + 1}" for i in range(channels)]
+    status = compact({"version": 1234, "devices": [
+        {"id": i, "name": names[i], "type": 2, "state": True, "brightness": 75, "runtime": 123456,
+         "locked": False} for i in range(channels)]})
+    info = compact({
+        "name": "Smart_Home_Hub", "firmware": "2.1", "build": "Jan  1 2026 12:00:00",
+        "mac": "AA:BB:CC:DD:EE:FF", "ip": "192.168.100.200", "uptime": 1234567, "rssi": -67,
+        "signal": 66, "heap": 123456, "heap_min": 98765, "heap_max_block": 65524,
+        "heap_request_last": 1234, "heap_request_max": 12345, "cloud_connected": True,
+        "mains_hz": 50.01, "mains_half_cycle_us": 9998, "mains_jitter_us": 12, "mains_locked": True,
+        "nvs_used_entries": 123, "nvs_total_entries": 630})
+
+    def page(key, items):
+        return compact({key: items, "total": len(items), "offset": 0, "limit": PAGE})
+
+    schedules = page("schedules", [dict({"id": n}, **make_schedule(n, channels))
+                                   for n in range(min(args.schedules, PAGE))])
+    scenes = page("scenes", [dict({"id": n}, **make_scene(n, channels))
+                             for n in range(min(args.scenes, PAGE))])
+
+    # Two cores running, every bucket count in the millions
+    histogram = {"counts": [1234567] * 16, "max_us": 1234}
+    core = {"core": 0, "zero_cross_edges": 12345678, "missed_edges": 12, "rejected_edges": 34,
+            "timer_interrupts": 98765432, "min_interval_us": 9876, "max_interval_us": 10123,
+            "fire_error": histogram, "zero_cross_isr": histogram, "timer_isr": histogram,
+            "zero_cross_deviation": histogram}
+    isr = compact({"bucket_upper_us": [1 << b for b in range(15)], "cores": [core, dict(core, core=1)]})
+
+    # (body, cursor bytes, ITEM_MAX); None: sent from its cache
+    return [
+        ("status", status, None),
+        ("info", info, None),
+        ("schedules", schedules, (28, 256)),
+        ("scenes", scenes, (20, 128 + channels * 112)),
+        ("metrics_isr", isr, (8, 1280)),
+    ]
+
+
+def model(args):
+    print(f"Heap held for one response body, {args.channels} channels, {args.schedules} schedules, "
+          f"{args.scenes} scenes, pages of {PAGE} (computed)")
+    print(f"  {'endpoint':12} {'body':>7} {'before':>8} {'now':>6}")
+    for name, body, chunked in model_bodies(args):
+        before = before_doc(name, args.channels) + len(body)
+        now = chunked_body(*chunked) if chunked else 0
+        print(f"  {name:12} {len(body):7} {before:8} {now:6}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Local API request mix with heap readings")
+    parser.add_argument("host", nargs="?")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--requests", type=int, default=2000)
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--schedules", type=int, default=100)
+    parser.add_argument("--scenes", type=int, default=50)
+    parser.add_argument("--channels", type=int, default=4, help="--model only; a run asks the hub")
+    parser.add_argument("--sample", type=int, default=100, help="read /info every N requests")
+    parser.add_argument("--read-only", action="store_true")
+    parser.add_argument("--json")
+    parser.add_argument("--compare")
+    parser.add_argument("--model", action="store_true")
+    args = parser.parse_args()
+
+    if args.model:
+        model(args)
+        return
+    if not args.host:
+        parser.error("HOST is required without --model")
+
+    hub = Hub(args.host, args.port)
+    channels = len(hub.get_json("/status")["devices"])
+    populate(hub, args.schedules, args.scenes, channels)
+    result = Run(hub, args, channels).run()
+
+    baseline = None
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+    report(result, baseline)
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(result, f, indent=2)
+
+
+if __name__ == "__main__":
+    main()